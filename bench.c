@@ -0,0 +1,565 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+/* Compresses a generated corpus with every format, and prints how long it took, how
+   much memory it used, and how small the output was, as JSON. The corpus is made from
+   a fixed seed, so that two builds can be compared on exactly the same data. */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+#include "clownlzss.h"
+#include "corpus.h"
+#include "formats.h"
+#include "timer.h"
+
+#define MAXIMUM_MODULED_SIZE 0xFFFF	/* The moduled header can only describe 15 whole modules */
+#define CONTENT_SIZE 0xF000	/* Small enough to be compressed into modules */
+#define MINIMUM_SWEEP_SIZE 0x400
+#define DEFAULT_MAXIMUM_SWEEP_SIZE (4ul << 20)
+#define MAXIMUM_SWEEP_SIZE (64ul << 20)
+#define REPEAT_TIME_LIMIT 1000000000ull	/* Runs are not repeated once they have taken this long in total */
+
+/* The most memory that the process has held at once, as the operating system sees it.
+   On Linux, this can be reset, so that it covers a single run; elsewhere, it covers
+   the whole life of the process. */
+typedef struct PeakMemory
+{
+	bool available;
+	bool per_run;
+	unsigned long long before;	/* How much was held when the run began, if 'per_run' */
+} PeakMemory;
+
+#ifdef __linux__
+/* Reads a line like 'VmHWM:     1234 kB' from /proc/self/status */
+static bool ReadProcessStatus(const char *field, unsigned long long *bytes)
+{
+	bool success = false;
+	FILE *file = fopen("/proc/self/status", "r");
+
+	if (file != NULL)
+	{
+		char line[0x100];
+		const size_t field_length = strlen(field);
+
+		while (fgets(line, sizeof(line), file) != NULL)
+		{
+			if (!strncmp(line, field, field_length) && line[field_length] == ':')
+			{
+				*bytes = strtoull(line + field_length + 1, NULL, 10) * 1024;
+				success = true;
+				break;
+			}
+		}
+
+		fclose(file);
+	}
+
+	return success;
+}
+#endif
+
+static void PeakMemory_Begin(PeakMemory *peak_memory)
+{
+	peak_memory->available = false;
+	peak_memory->per_run = false;
+
+#ifdef __linux__
+	/* Writing '5' resets the peak to what is held right now */
+	const int descriptor = open("/proc/self/clear_refs", O_WRONLY);
+
+	if (descriptor != -1)
+	{
+		peak_memory->per_run = write(descriptor, "5", 1) == 1 && ReadProcessStatus("VmRSS", &peak_memory->before);
+		close(descriptor);
+	}
+
+	peak_memory->available = true;
+#elif !defined(_WIN32)
+	peak_memory->available = true;
+#endif
+}
+
+static bool PeakMemory_End(const PeakMemory *peak_memory, unsigned long long *bytes)
+{
+	if (!peak_memory->available)
+		return false;
+
+#ifdef __linux__
+	return ReadProcessStatus("VmHWM", bytes);
+#elif !defined(_WIN32)
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return false;
+
+	#ifdef __APPLE__
+	*bytes = (unsigned long long)usage.ru_maxrss;
+	#else
+	*bytes = (unsigned long long)usage.ru_maxrss * 1024;
+	#endif
+
+	return true;
+#else
+	(void)bytes;
+	return false;
+#endif
+}
+
+typedef struct Options
+{
+	unsigned int level;
+	unsigned int repeat;
+	size_t maximum_sweep_size;
+} Options;
+
+typedef struct Result
+{
+	bool success;
+	bool representable;	/* False if the sizes do not fit in the format's header, so it cannot be decompressed */
+	bool verified;
+	size_t compressed_size;
+	unsigned long long nanoseconds;	/* The fastest of the runs */
+	unsigned int runs;
+	size_t library_peak_bytes;
+	bool has_peak_rss;
+	bool peak_rss_per_run;
+	unsigned long long peak_rss_bytes;
+	unsigned long long rss_growth_bytes;
+} Result;
+
+static Result Measure(const Format *format, bool moduled, unsigned char *data, size_t data_size, const Options *options, ClownLZSS_Context *context)
+{
+	Result result;
+	memset(&result, 0, sizeof(result));
+
+	const size_t bound = format->bound(data_size, moduled);
+	unsigned char *compressed_buffer = (unsigned char*)malloc(bound);
+
+	if (compressed_buffer != NULL)
+	{
+		unsigned long long total_nanoseconds = 0;
+
+		result.success = true;
+
+		/* The first run warms the context up, so the fastest run is usually a later one */
+		for (result.runs = 0; result.runs < options->repeat && total_nanoseconds < REPEAT_TIME_LIMIT; ++result.runs)
+		{
+			PeakMemory peak_memory;
+			PeakMemory_Begin(&peak_memory);
+
+			const unsigned long long start = Timer_GetNanoseconds();
+			const bool success = format->compress(data, data_size, compressed_buffer, bound, &result.compressed_size, moduled, options->level, context);
+			const unsigned long long nanoseconds = Timer_GetNanoseconds() - start;
+
+			unsigned long long peak_rss_bytes;
+
+			if (PeakMemory_End(&peak_memory, &peak_rss_bytes) && (!result.has_peak_rss || peak_rss_bytes > result.peak_rss_bytes))
+			{
+				result.has_peak_rss = true;
+				result.peak_rss_per_run = peak_memory.per_run;
+				result.peak_rss_bytes = peak_rss_bytes;
+				result.rss_growth_bytes = peak_memory.per_run && peak_rss_bytes > peak_memory.before ? peak_rss_bytes - peak_memory.before : 0;
+			}
+
+			if (!success)
+			{
+				result.success = false;
+				break;
+			}
+
+			if (result.runs == 0 || nanoseconds < result.nanoseconds)
+				result.nanoseconds = nanoseconds;
+
+			total_nanoseconds += nanoseconds;
+			result.library_peak_bytes = CLOWNLZSS_MAX(result.library_peak_bytes, ClownLZSS_ContextGetPeakBytes(context));
+		}
+
+		/* Each module has a header of its own, which is always large enough */
+		result.representable = moduled || !format->small_header || (data_size <= 0xFFFF && result.compressed_size <= 0xFFFF);
+
+		if (result.success && result.representable)
+		{
+			size_t decompressed_size;
+			unsigned char *decompressed_buffer = format->decompress(compressed_buffer, result.compressed_size, &decompressed_size, moduled);
+
+			result.verified = decompressed_buffer != NULL && decompressed_size == data_size && !memcmp(decompressed_buffer, data, data_size);
+
+			free(decompressed_buffer);
+		}
+
+		free(compressed_buffer);
+	}
+
+	return result;
+}
+
+/* Prints the fields of a result, which follow those that say what was compressed */
+static void PrintResult(const Result *result, size_t data_size)
+{
+	const double seconds = (double)result->nanoseconds / 1e9;
+
+	printf("\"success\": %s, \"verified\": %s", result->success ? "true" : "false", !result->representable ? "null" : result->verified ? "true" : "false");
+
+	if (result->success)
+	{
+		printf(", \"compressed_size\": %lu, \"ratio\": %.6f, \"runs\": %u, \"seconds\": %.9f", (unsigned long)result->compressed_size, data_size == 0 ? 0.0 : (double)result->compressed_size / (double)data_size, result->runs, seconds);
+
+		if (result->nanoseconds != 0)
+			printf(", \"mib_per_second\": %.3f", (double)data_size / (1024.0 * 1024.0) / seconds);
+		else
+			printf(", \"mib_per_second\": null");
+
+		printf(", \"library_peak_bytes\": %lu", (unsigned long)result->library_peak_bytes);
+	}
+
+	if (result->has_peak_rss)
+	{
+		printf(", \"peak_rss_bytes\": %llu", result->peak_rss_bytes);
+
+		if (result->peak_rss_per_run)
+			printf(", \"rss_growth_bytes\": %llu", result->rss_growth_bytes);
+		else
+			printf(", \"rss_growth_bytes\": null");
+	}
+	else
+	{
+		printf(", \"peak_rss_bytes\": null, \"rss_growth_bytes\": null");
+	}
+}
+
+static void PrintProgress(const Format *format, bool moduled, const char *content, size_t data_size, const Result *result)
+{
+	fprintf(stderr, "%-16s %-7s %-8s %9lu -> ", format->name, moduled ? "moduled" : "normal", content, (unsigned long)data_size);
+
+	if (!result->success)
+		fprintf(stderr, "failed\n");
+	else
+		fprintf(stderr, "%9lu  %10.3fms%s\n", (unsigned long)result->compressed_size, (double)result->nanoseconds / 1e6, !result->representable ? "  (too large for the header)" : result->verified ? "" : "  (does not decompress to the input!)");
+}
+
+/* Compresses each kind of content, at a size that can be compressed into modules */
+static bool RunContentTable(const Options *options, ClownLZSS_Context *context)
+{
+	bool success = true;
+
+	printf("  \"content\": [\n");
+
+	for (size_t i = 0; i < Corpus_GetTotalContents(); ++i)
+	{
+		const char *name = Corpus_GetContentName(i);
+		unsigned char *data = Corpus_Generate(name, CONTENT_SIZE);
+
+		if (data == NULL)
+		{
+			fprintf(stderr, "Could not allocate memory for the corpus\n");
+			success = false;
+			break;
+		}
+
+		for (size_t j = 0; j < Format_GetTotal(); ++j)
+		{
+			const Format *format = Format_Get(j);
+
+			for (unsigned int moduled = 0; moduled < 2; ++moduled)
+			{
+				const Result result = Measure(format, moduled, data, CONTENT_SIZE, options, context);
+
+				PrintProgress(format, moduled, name, CONTENT_SIZE, &result);
+
+				printf("%s    {\"format\": \"%s\", \"moduled\": %s, \"content\": \"%s\", \"size\": %lu, ", i == 0 && j == 0 && moduled == 0 ? "" : ",\n", format->name, moduled ? "true" : "false", name, (unsigned long)CONTENT_SIZE);
+				PrintResult(&result, CONTENT_SIZE);
+				printf("}");
+
+				success = success && result.success && (result.verified || !result.representable);
+			}
+		}
+
+		free(data);
+	}
+
+	printf("\n  ],\n");
+
+	return success;
+}
+
+/* Compresses a ROM's worth of mixed content, doubling the size each time. Each step
+   records the slope of time against size on a log-log scale, and a line is fitted to
+   all of them: 1 is linear, and anything much greater is superlinear. Moduled data
+   is limited in size, so modules are only swept as far as they can go. */
+static bool RunSizeSweep(const Options *options, ClownLZSS_Context *context)
+{
+	bool success = true;
+
+	unsigned char *data = Corpus_Generate("rom", options->maximum_sweep_size);
+
+	if (data == NULL)
+	{
+		fprintf(stderr, "Could not allocate memory for the corpus\n");
+		return false;
+	}
+
+	printf("  \"sweep\": [\n");
+
+	for (size_t i = 0; i < Format_GetTotal(); ++i)
+	{
+		const Format *format = Format_Get(i);
+
+		for (unsigned int moduled = 0; moduled < 2; ++moduled)
+		{
+			const size_t maximum_size = moduled ? CLOWNLZSS_MIN(options->maximum_sweep_size, MAXIMUM_MODULED_SIZE) : options->maximum_sweep_size;
+
+			double previous_log_size = 0.0, previous_log_time = 0.0;
+			double sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+			unsigned int total_points = 0;
+
+			printf("%s    {\"format\": \"%s\", \"moduled\": %s, \"content\": \"rom\", \"points\": [\n", i == 0 && moduled == 0 ? "" : ",\n", format->name, moduled ? "true" : "false");
+
+			for (size_t size = MINIMUM_SWEEP_SIZE; size <= maximum_size; size *= 2)
+			{
+				const Result result = Measure(format, moduled, data, size, options, context);
+
+				PrintProgress(format, moduled, "rom", size, &result);
+
+				printf("%s      {\"size\": %lu, ", size == MINIMUM_SWEEP_SIZE ? "" : ",\n", (unsigned long)size);
+				PrintResult(&result, size);
+
+				if (result.success && result.nanoseconds != 0)
+				{
+					const double log_size = log((double)size);
+					const double log_time = log((double)result.nanoseconds);
+
+					if (total_points != 0)
+						printf(", \"slope\": %.4f", (log_time - previous_log_time) / (log_size - previous_log_size));
+					else
+						printf(", \"slope\": null");
+
+					previous_log_size = log_size;
+					previous_log_time = log_time;
+
+					sum_x += log_size;
+					sum_y += log_time;
+					sum_xx += log_size * log_size;
+					sum_xy += log_size * log_time;
+					++total_points;
+				}
+				else
+				{
+					printf(", \"slope\": null");
+				}
+
+				printf("}");
+
+				success = success && result.success && (result.verified || !result.representable);
+			}
+
+			printf("\n    ], \"scaling_exponent\": ");
+
+			/* The least-squares slope of log(time) against log(size) */
+			if (total_points >= 2)
+				printf("%.4f}", (total_points * sum_xy - sum_x * sum_y) / (total_points * sum_xx - sum_x * sum_x));
+			else
+				printf("null}");
+		}
+	}
+
+	printf("\n  ]\n");
+
+	free(data);
+
+	return success;
+}
+
+static void PrintUsage(void)
+{
+	fprintf(stderr,
+	"Compresses a generated corpus of Mega Drive style data with every format,\n"
+	"and prints the results as JSON\n"
+	"\n"
+	"Usage: bench [options] > results.json\n"
+	"\n"
+	"Options:\n"
+	"  -l=LEVEL          Sets the compression level, from 1 (fastest) to 5\n"
+	"                    (smallest, and the default)\n"
+	"  -t=THREADS        Sets how many threads to compress with (defaults to 1)\n"
+	"  -p                Also splits large files into segments that are parsed\n"
+	"                    on separate threads\n"
+	"  --max-size=SIZE   Sets the largest size in the size sweep, from 1KiB to\n"
+	"                    64MiB (defaults to 4MiB): 'K' and 'M' suffixes are allowed\n"
+	"  --repeat=COUNT    Sets how many times each run is repeated, keeping the\n"
+	"                    fastest (defaults to 3, and stops early after a second)\n"
+	"  --skip-content    Only runs the size sweep\n"
+	"  --skip-sweep      Only runs the table of content types\n"
+	);
+}
+
+static bool ParseSize(const char *string, size_t *size)
+{
+	char *end;
+	unsigned long result = strtoul(string, &end, 0);
+
+	if (end == string)
+		return false;
+
+	if (*end == 'K' || *end == 'k')
+	{
+		result <<= 10;
+		++end;
+	}
+	else if (*end == 'M' || *end == 'm')
+	{
+		result <<= 20;
+		++end;
+	}
+
+	*size = result;
+
+	return *end == '\0';
+}
+
+int main(int argc, char *argv[])
+{
+	Options options;
+	options.level = CLOWNLZSS_DEFAULT_LEVEL;
+	options.repeat = 3;
+	options.maximum_sweep_size = DEFAULT_MAXIMUM_SWEEP_SIZE;
+
+	size_t total_threads = 1;
+	bool run_content_table = true;
+	bool run_size_sweep = true;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		char *end;
+
+		if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+		{
+			PrintUsage();
+			return 0;
+		}
+		else if (!strncmp(argv[i], "-l=", 3))
+		{
+			const unsigned long result = strtoul(argv[i] + 3, &end, 0);
+
+			if (*end != '\0' || result < CLOWNLZSS_MINIMUM_LEVEL || result > CLOWNLZSS_MAXIMUM_LEVEL)
+			{
+				fprintf(stderr, "Invalid parameter to -l\n");
+				return -1;
+			}
+
+			options.level = result;
+		}
+		else if (!strncmp(argv[i], "-t=", 3))
+		{
+			const unsigned long result = strtoul(argv[i] + 3, &end, 0);
+
+			if (*end != '\0' || result == 0)
+			{
+				fprintf(stderr, "Invalid parameter to -t\n");
+				return -1;
+			}
+
+			total_threads = result;
+		}
+		else if (!strcmp(argv[i], "-p"))
+		{
+			ClownLZSS_SetParallelParse(true);
+		}
+		else if (!strncmp(argv[i], "--max-size=", 11))
+		{
+			if (!ParseSize(argv[i] + 11, &options.maximum_sweep_size) || options.maximum_sweep_size < MINIMUM_SWEEP_SIZE || options.maximum_sweep_size > MAXIMUM_SWEEP_SIZE)
+			{
+				fprintf(stderr, "Invalid parameter to --max-size\n");
+				return -1;
+			}
+		}
+		else if (!strncmp(argv[i], "--repeat=", 9))
+		{
+			const unsigned long result = strtoul(argv[i] + 9, &end, 0);
+
+			if (*end != '\0' || result == 0)
+			{
+				fprintf(stderr, "Invalid parameter to --repeat\n");
+				return -1;
+			}
+
+			options.repeat = result;
+		}
+		else if (!strcmp(argv[i], "--skip-content"))
+		{
+			run_content_table = false;
+		}
+		else if (!strcmp(argv[i], "--skip-sweep"))
+		{
+			run_size_sweep = false;
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+			PrintUsage();
+			return -1;
+		}
+	}
+
+	ClownLZSS_SetThreadCount(total_threads);
+
+	ClownLZSS_Context context;
+
+	if (!ClownLZSS_ContextInit(&context))
+	{
+		fprintf(stderr, "Could not create a compression context\n");
+		return -1;
+	}
+
+	bool success = true;
+
+	printf("{\n  \"level\": %u, \"threads\": %lu, \"parallel_parse\": %s, \"repeat\": %u, \"seed\": %llu, \"module_size\": %u,\n", options.level, (unsigned long)total_threads, ClownLZSS_GetParallelParse() ? "true" : "false", options.repeat, CORPUS_SEED, FORMAT_MODULE_SIZE);
+
+	if (run_content_table)
+		success = RunContentTable(&options, &context) && success;
+	else
+		printf("  \"content\": [],\n");
+
+	if (run_size_sweep)
+		success = RunSizeSweep(&options, &context) && success;
+	else
+		printf("  \"sweep\": []\n");
+
+	printf("}\n");
+
+	ClownLZSS_ContextDeinit(&context);
+
+	return success ? 0 : -1;
+}
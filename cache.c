@@ -0,0 +1,500 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "cache.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#include "clownlzss.h"
+#include "threads.h"
+
+#define ENTRY_EXTENSION ".clzc"
+#define TEMPORARY_EXTENSION ".tmp"
+
+// The magic number, the key's hash and input size, the size of the compressed data, and its checksum
+#define HEADER_SIZE (4 + 8 * 5)
+
+// A temporary file this old was left behind by a process that never finished writing it
+#define STALE_SECONDS (60 * 60)
+
+static const unsigned char magic[4] = {'C', 'L', 'Z', 'C'};
+
+#define PRIME_1 0x9E3779B185EBCA87ULL
+#define PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME_3 0x165667B19E3779F9ULL
+
+static unsigned long long ReadWord(const unsigned char *bytes)
+{
+	unsigned long long word = 0;
+
+	for (unsigned int i = 0; i < 8; ++i)
+		word |= (unsigned long long)bytes[i] << (i * 8);
+
+	return word;
+}
+
+static void WriteWord(unsigned char *bytes, unsigned long long word)
+{
+	for (unsigned int i = 0; i < 8; ++i)
+		bytes[i] = (word >> (i * 8)) & 0xFF;
+}
+
+static unsigned long long Rotate(unsigned long long value, unsigned int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+// MurmurHash3's finaliser, which spreads every bit of the value across all of the others
+static unsigned long long Finalise(unsigned long long value)
+{
+	value ^= value >> 33;
+	value *= 0xFF51AFD7ED558CCDULL;
+	value ^= value >> 33;
+	value *= 0xC4CEB9FE1A85EC53ULL;
+	value ^= value >> 33;
+
+	return value;
+}
+
+static void InitHash(unsigned long long hash[2])
+{
+	hash[0] = PRIME_1;
+	hash[1] = PRIME_2;
+}
+
+// Reads eight bytes at a time into two separate lanes, which together make a 128-bit hash, as a
+// collision would hand back the wrong data. This is far faster than even the fastest compression level.
+static void Hash(unsigned long long hash[2], const unsigned char *data, size_t size)
+{
+	const unsigned long long total_size = size;
+
+	for (; size >= 8; data += 8, size -= 8)
+	{
+		const unsigned long long word = ReadWord(data);
+
+		hash[0] = Rotate(hash[0] ^ word * PRIME_2, 31) * PRIME_1;
+		hash[1] = Rotate(hash[1] + word * PRIME_3, 27) * PRIME_2;
+	}
+
+	unsigned char tail[8] = {0};
+
+	if (size != 0)
+		memcpy(tail, data, size);
+
+	// The size tells apart inputs that only differ by zeroes at the end
+	const unsigned long long word = ReadWord(tail);
+
+	hash[0] = Finalise(hash[0] ^ word * PRIME_2 ^ total_size);
+	hash[1] = Finalise(hash[1] + word * PRIME_3 + total_size) ^ hash[0];
+}
+
+void CacheKey_Init(CacheKey *key, const unsigned char *data, size_t data_size, const char *name, unsigned int level, size_t module_size)
+{
+	// Everything that changes the output is part of the key
+	char settings[0x80];
+	snprintf(settings, sizeof(settings), "%s:%u:%lu:%d:%d", name, level, (unsigned long)module_size, CLOWNLZSS_CACHE_VERSION, CLOWNLZSS_BRUTE_FORCE);
+
+	InitHash(key->hash);
+	Hash(key->hash, data, data_size);
+	Hash(key->hash, (const unsigned char*)settings, strlen(settings));
+	key->data_size = data_size;
+}
+
+static char* GetPath(const ClownLZSS_Cache *cache, const char *filename)
+{
+	char *path = (char*)malloc(strlen(cache->directory) + 1 + strlen(filename) + 1);
+
+	if (path != NULL)
+		sprintf(path, "%s/%s", cache->directory, filename);
+
+	return path;
+}
+
+static void GetEntryName(char *name, const CacheKey *key)
+{
+	sprintf(name, "%016llx%016llx" ENTRY_EXTENSION, key->hash[0], key->hash[1]);
+}
+
+static bool HasExtension(const char *filename, const char *extension)
+{
+	const size_t filename_length = strlen(filename);
+	const size_t extension_length = strlen(extension);
+
+	return filename_length > extension_length && !strcmp(filename + filename_length - extension_length, extension);
+}
+
+static bool MakeDirectory(const char *directory)
+{
+#ifdef _WIN32
+	return CreateDirectoryA(directory, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+	return mkdir(directory, 0777) == 0 || errno == EEXIST;
+#endif
+}
+
+static unsigned long GetProcessID(void)
+{
+#ifdef _WIN32
+	return (unsigned long)GetCurrentProcessId();
+#else
+	return (unsigned long)getpid();
+#endif
+}
+
+// Replaces any file that is already at 'new_path' all at once, so that nothing ever sees half of either
+static bool Rename(const char *old_path, const char *new_path)
+{
+#ifdef _WIN32
+	return MoveFileExA(old_path, new_path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(old_path, new_path) == 0;
+#endif
+}
+
+// Sets the file's modification time to now, which is what the eviction goes by
+static void Touch(const char *path)
+{
+#ifdef _WIN32
+	_utime(path, NULL);
+#else
+	utime(path, NULL);
+#endif
+}
+
+typedef struct Entry
+{
+	char *path;
+	unsigned long long size;
+	time_t time;
+} Entry;
+
+typedef struct EntryList
+{
+	Entry *entries;
+	size_t total_entries;
+	size_t capacity;
+	unsigned long long size;
+	time_t now;
+} EntryList;
+
+// Takes ownership of 'path'. Files that are not the cache's are left alone.
+static void AddFile(EntryList *list, const char *filename, char *path, unsigned long long size, time_t time)
+{
+	if (HasExtension(filename, ENTRY_EXTENSION))
+	{
+		if (list->total_entries == list->capacity)
+		{
+			const size_t new_capacity = list->capacity == 0 ? 0x100 : list->capacity * 2;
+			Entry *new_entries = (Entry*)realloc(list->entries, new_capacity * sizeof(Entry));
+
+			if (new_entries == NULL)
+			{
+				free(path);
+				return;
+			}
+
+			list->entries = new_entries;
+			list->capacity = new_capacity;
+		}
+
+		list->entries[list->total_entries].path = path;
+		list->entries[list->total_entries].size = size;
+		list->entries[list->total_entries].time = time;
+		++list->total_entries;
+		list->size += size;
+	}
+	else
+	{
+		if (HasExtension(filename, TEMPORARY_EXTENSION) && difftime(list->now, time) > STALE_SECONDS)
+			remove(path);
+
+		free(path);
+	}
+}
+
+static void ListFiles(const ClownLZSS_Cache *cache, EntryList *list)
+{
+#ifdef _WIN32
+	char *pattern = GetPath(cache, "*");
+
+	if (pattern == NULL)
+		return;
+
+	WIN32_FIND_DATAA data;
+	HANDLE handle = FindFirstFileA(pattern, &data);
+
+	free(pattern);
+
+	if (handle == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		char *path = GetPath(cache, data.cFileName);
+
+		if (path != NULL)
+		{
+			// File times count 100 nanosecond intervals since 1601, rather than seconds since 1970
+			ULARGE_INTEGER time;
+			time.LowPart = data.ftLastWriteTime.dwLowDateTime;
+			time.HighPart = data.ftLastWriteTime.dwHighDateTime;
+
+			AddFile(list, data.cFileName, path, ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow, (time_t)((time.QuadPart - 116444736000000000ULL) / 10000000));
+		}
+	} while (FindNextFileA(handle, &data));
+
+	FindClose(handle);
+#else
+	DIR *directory = opendir(cache->directory);
+
+	if (directory == NULL)
+		return;
+
+	for (struct dirent *file; (file = readdir(directory)) != NULL;)
+	{
+		char *path = GetPath(cache, file->d_name);
+		struct stat status;
+
+		if (path != NULL && stat(path, &status) == 0 && S_ISREG(status.st_mode))
+			AddFile(list, file->d_name, path, (unsigned long long)status.st_size, status.st_mtime);
+		else
+			free(path);
+	}
+
+	closedir(directory);
+#endif
+}
+
+static int CompareEntryTimes(const void *a, const void *b)
+{
+	const Entry *entry_a = (const Entry*)a;
+	const Entry *entry_b = (const Entry*)b;
+
+	return entry_a->time < entry_b->time ? -1 : entry_a->time > entry_b->time ? 1 : 0;
+}
+
+// Measures the directory again, as other processes may have added to it or evicted from it, and then
+// deletes the least recently used entries if it is too large. It goes a quarter under the maximum, so
+// that it is not measured again after every entry that is added. Another process may be reading an
+// entry as it is deleted, which is fine: on Windows the deletion fails, and otherwise the reader keeps
+// what it has opened.
+static void Evict(ClownLZSS_Cache *cache)
+{
+	EntryList list;
+	list.entries = NULL;
+	list.total_entries = 0;
+	list.capacity = 0;
+	list.size = 0;
+	list.now = time(NULL);
+
+	ListFiles(cache, &list);
+
+	if (list.size > cache->maximum_size)
+	{
+		qsort(list.entries, list.total_entries, sizeof(Entry), CompareEntryTimes);
+
+		const unsigned long long target_size = cache->maximum_size / 4 * 3;
+
+		for (size_t i = 0; i < list.total_entries && list.size > target_size; ++i)
+			if (remove(list.entries[i].path) == 0)
+				list.size -= list.entries[i].size;
+	}
+
+	cache->size = list.size;
+
+	for (size_t i = 0; i < list.total_entries; ++i)
+		free(list.entries[i].path);
+
+	free(list.entries);
+}
+
+bool ClownLZSS_CacheInit(ClownLZSS_Cache *cache, const char *directory, unsigned long long maximum_size)
+{
+	cache->directory = (char*)malloc(strlen(directory) + 1);
+	cache->maximum_size = maximum_size;
+	cache->size = 0;
+	cache->total_temporary_files = 0;
+	cache->mutex = Mutex_Create();
+
+	if (cache->directory == NULL || cache->mutex == NULL || !MakeDirectory(directory))
+	{
+		if (cache->mutex != NULL)
+			Mutex_Destroy(cache->mutex);
+
+		free(cache->directory);
+		return false;
+	}
+
+	strcpy(cache->directory, directory);
+
+	Evict(cache);
+
+	return true;
+}
+
+void ClownLZSS_CacheDeinit(ClownLZSS_Cache *cache)
+{
+	Mutex_Destroy(cache->mutex);
+	free(cache->directory);
+}
+
+unsigned char* Cache_Find(ClownLZSS_Cache *cache, const CacheKey *key, const ClownLZSS_Allocator *allocator, size_t *size)
+{
+	char name[0x30];
+	GetEntryName(name, key);
+
+	char *path = GetPath(cache, name);
+
+	if (path == NULL)
+		return NULL;
+
+	unsigned char *data = NULL;
+	FILE *file = fopen(path, "rb");
+
+	if (file != NULL)
+	{
+		unsigned char header[HEADER_SIZE];
+
+		if (fread(header, 1, sizeof(header), file) == sizeof(header)
+		 && !memcmp(header, magic, sizeof(magic))
+		 && ReadWord(&header[4]) == key->hash[0]
+		 && ReadWord(&header[12]) == key->hash[1]
+		 && ReadWord(&header[20]) == key->data_size
+		 && ReadWord(&header[28]) < (size_t)-1)
+		{
+			const size_t data_size = (size_t)ReadWord(&header[28]);
+
+			// One byte more than there should be is read, to check that the entry ends where it should
+			data = (unsigned char*)ClownLZSS_Allocate(allocator, data_size + 1);
+
+			if (data != NULL)
+			{
+				unsigned long long checksum[2];
+				InitHash(checksum);
+
+				// A damaged entry is treated as if it was not there, and is replaced once the input has been compressed again
+				if (fread(data, 1, data_size + 1, file) == data_size && (Hash(checksum, data, data_size), checksum[0] == ReadWord(&header[36])))
+				{
+					*size = data_size;
+				}
+				else
+				{
+					ClownLZSS_Free(allocator, data);
+					data = NULL;
+				}
+			}
+		}
+
+		fclose(file);
+	}
+
+	if (data != NULL)
+		Touch(path);
+
+	free(path);
+
+	return data;
+}
+
+void Cache_Add(ClownLZSS_Cache *cache, const CacheKey *key, const unsigned char *data, size_t size)
+{
+	char name[0x30];
+	GetEntryName(name, key);
+
+	// The entry is written under a name that no other thread or process uses, and then renamed into place
+	Mutex_Lock(cache->mutex);
+	const unsigned long temporary_file = cache->total_temporary_files++;
+	Mutex_Unlock(cache->mutex);
+
+	char temporary_name[0x60];
+	sprintf(temporary_name, "%s.%lu-%lu" TEMPORARY_EXTENSION, name, GetProcessID(), temporary_file);
+
+	char *path = GetPath(cache, name);
+	char *temporary_path = GetPath(cache, temporary_name);
+	bool success = false;
+
+	if (path != NULL && temporary_path != NULL)
+	{
+		unsigned long long checksum[2];
+		InitHash(checksum);
+		Hash(checksum, data, size);
+
+		unsigned char header[HEADER_SIZE];
+		memcpy(header, magic, sizeof(magic));
+		WriteWord(&header[4], key->hash[0]);
+		WriteWord(&header[12], key->hash[1]);
+		WriteWord(&header[20], key->data_size);
+		WriteWord(&header[28], size);
+		WriteWord(&header[36], checksum[0]);
+
+		FILE *file = fopen(temporary_path, "wb");
+
+		if (file != NULL)
+		{
+			success = fwrite(header, 1, sizeof(header), file) == sizeof(header) && fwrite(data, 1, size, file) == size;
+			success = fclose(file) == 0 && success && Rename(temporary_path, path);
+
+			if (!success)
+				remove(temporary_path);
+		}
+	}
+
+	free(path);
+	free(temporary_path);
+
+	if (success)
+	{
+		Mutex_Lock(cache->mutex);
+
+		cache->size += HEADER_SIZE + size;
+
+		if (cache->size > cache->maximum_size)
+			Evict(cache);
+
+		Mutex_Unlock(cache->mutex);
+	}
+}
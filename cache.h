@@ -0,0 +1,45 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+
+#include "clownlzss.h"
+
+// What a cache entry is named after. The input's size is kept alongside its hash, so that an
+// entry is never mistaken for the output of an input of a different size.
+typedef struct CacheKey
+{
+	unsigned long long hash[2];
+	unsigned long long data_size;
+} CacheKey;
+
+// 'name' identifies the format and its options, and 'module_size' is 0 for data that is not in modules
+void CacheKey_Init(CacheKey *key, const unsigned char *data, size_t data_size, const char *name, unsigned int level, size_t module_size);
+
+// Returns the entry's data, allocated with 'allocator', or NULL if there is no such entry, or it is damaged.
+// Finding an entry marks it as used, so that it is evicted after the ones that have not been used since.
+unsigned char* Cache_Find(ClownLZSS_Cache *cache, const CacheKey *key, const ClownLZSS_Allocator *allocator, size_t *size);
+// Failing to add an entry is not an error: the input just has to be compressed again next time
+void Cache_Add(ClownLZSS_Cache *cache, const CacheKey *key, const unsigned char *data, size_t size);
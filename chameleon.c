@@ -24,6 +24,7 @@
 #include <stdbool.h>
 #endif
 #include <stddef.h>
+#include <string.h>
 
 #include "clownlzss.h"
 #include "common.h"
@@ -31,34 +32,22 @@
 
 #define TOTAL_DESCRIPTOR_BITS 8
 
+// Chameleon keeps all of its descriptors together, before the match bytes, so
+// only the descriptors are buffered: the match bytes go straight into the output
 typedef struct ChameleonInstance
 {
-	MemoryStream *match_stream;
-	MemoryStream *descriptor_stream;
-
-	unsigned char descriptor;
-	unsigned int descriptor_bits_remaining;
+	BitWriter match_writer;
+	BitWriter descriptor_writer;
 } ChameleonInstance;
 
 static void PutMatchByte(ChameleonInstance *instance, unsigned char byte)
 {
-	MemoryStream_WriteByte(instance->match_stream, byte);
+	BitWriter_PutByte(&instance->match_writer, byte);
 }
 
 static void PutDescriptorBit(ChameleonInstance *instance, bool bit)
 {
-	if (instance->descriptor_bits_remaining == 0)
-	{
-		MemoryStream_WriteByte(instance->descriptor_stream, instance->descriptor);
-
-		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
-	}
-
-	--instance->descriptor_bits_remaining;
-
-	instance->descriptor <<= 1;
-
-	instance->descriptor |= bit;
+	BitWriter_PutBit(&instance->descriptor_writer, bit);
 }
 
 static void DoLiteral(unsigned char value, void *user)
@@ -107,41 +96,39 @@ static void DoMatch(size_t distance, size_t length, size_t offset, void *user)
 	}
 }
 
-static unsigned int GetMatchCost(size_t distance, size_t length, void *user)
-{
-	(void)user;
+static const ClownLZSS_MatchEncoding match_encodings[] = {
+	{255, 2, 3, 2 + 8 + 1},		// Descriptor bits, offset byte, length bit
+	{0x7FF, 3, 5, 2 + 3 + 8 + 2},		// Descriptor bits, offset bits, offset byte, length bits
+	{0x7FF, 6, 0xFF, 2 + 3 + 8 + 2 + 8}	// Descriptor bits, offset bits, offset byte, (blank) length bits, length byte
+};
 
-	if (length >= 2 && length <= 3 && distance < 256)
-		return 2 + 8 + 1;		// Descriptor bits, offset byte, length bit
-	else if (length >= 3 && length <= 5)
-		return 2 + 3 + 8 + 2;		// Descriptor bits, offset bits, offset byte, length bits
-	else if (length >= 6)
-		return 2 + 3 + 8 + 2 + 8;	// Descriptor bits, offset bits, offset byte, (blank) length bits, length byte
-	else
-		return 0; 			// In the event a match cannot be compressed
-}
+static const ClownLZSS_Format format = {2, 0xFF, 0x7FF, 1 + 8, match_encodings, sizeof(match_encodings) / sizeof(match_encodings[0]), NULL};
 
-static void FindExtraMatches(unsigned char *data, size_t data_size, size_t offset, ClownLZSS_GraphEdge *node_meta_array, void *user)
+static void FindExtraMatches(unsigned char *data, size_t data_size, const unsigned int *run_lengths, size_t offset, ClownLZSS_Graph *graph, void *user)
 {
 	(void)data;
 	(void)data_size;
+	(void)run_lengths;
 	(void)offset;
-	(void)node_meta_array;
+	(void)graph;
 	(void)user;
 }
 
-static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, 0xFF, 0x7FF, FindExtraMatches, 1 + 8, DoLiteral, GetMatchCost, DoMatch)
+static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, format, FindExtraMatches, DoLiteral, DoMatch)
 
-static void ChameleonCompressStream(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user)
+static void ChameleonCompressStream(unsigned char *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, MemoryStream *output_stream, void *user)
 {
 	(void)user;
 
+	MemoryStream descriptor_stream;
+	ScratchStream_Init(&descriptor_stream, context, CLOWNLZSS_CONTEXT_FORMAT_0);
+	const size_t file_offset = MemoryStream_GetPosition(output_stream);
+
 	ChameleonInstance instance;
-	instance.match_stream = MemoryStream_Create(true);
-	instance.descriptor_stream = MemoryStream_Create(true);
-	instance.descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+	BitWriter_Init(&instance.match_writer, output_stream, 0, false, false, false);
+	BitWriter_Init(&instance.descriptor_writer, &descriptor_stream, TOTAL_DESCRIPTOR_BITS, false, true, false);
 
-	CompressData(data, data_size, &instance);
+	CompressData(data, data_size, level, context, &instance);
 
 	// Terminator match
 	PutDescriptorBit(&instance, 0);
@@ -154,31 +141,175 @@ static void ChameleonCompressStream(unsigned char *data, size_t data_size, Memor
 	PutDescriptorBit(&instance, 1);
 	PutMatchByte(&instance, 0);
 
-	MemoryStream_WriteByte(instance.descriptor_stream, instance.descriptor << instance.descriptor_bits_remaining);
+	BitWriter_Finish(&instance.descriptor_writer);
+	BitWriter_Finish(&instance.match_writer);
+
+	const size_t descriptor_buffer_size = MemoryStream_GetPosition(&descriptor_stream);
+	unsigned char *descriptor_buffer = MemoryStream_GetBuffer(&descriptor_stream);
+
+	// Move the match bytes up, to make room for the header and the descriptors in front of them
+	const size_t match_buffer_size = MemoryStream_GetPosition(output_stream) - file_offset;
+	const size_t header_size = 2 + descriptor_buffer_size;
+
+	// If either stream ran out of memory, then the output is lost, and there is nothing to put together
+	if (!MemoryStream_HasFailed(&descriptor_stream) && MemoryStream_Reserve(output_stream, file_offset + header_size + match_buffer_size) >= file_offset + header_size + match_buffer_size)
+	{
+		unsigned char *buffer = MemoryStream_GetBuffer(output_stream);
+
+		memmove(&buffer[file_offset + header_size], &buffer[file_offset], match_buffer_size);
+
+		buffer[file_offset + 0] = (descriptor_buffer_size >> 8) & 0xFF;
+		buffer[file_offset + 1] = descriptor_buffer_size & 0xFF;
+		memcpy(&buffer[file_offset + 2], descriptor_buffer, descriptor_buffer_size);
+
+		MemoryStream_SetPosition(output_stream, (ptrdiff_t)(file_offset + header_size + match_buffer_size), MEMORYSTREAM_START);
+	}
+
+	ScratchStream_Deinit(&descriptor_stream, context, CLOWNLZSS_CONTEXT_FORMAT_0);
+}
+
+unsigned char* ClownLZSS_ChameleonCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularWrapper(data, data_size, compressed_size, level, context, "chameleon", NULL, ChameleonCompressStream);
+}
+
+unsigned char* ClownLZSS_ModuledChameleonCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledCompressionWrapper(data, data_size, compressed_size, level, context, "chameleon", NULL, ChameleonCompressStream, module_size, 1);
+}
+
+size_t ClownLZSS_ChameleonCompressBound(size_t data_size)
+{
+	// The terminator match is included
+	return CompressBound(2, data_size * format.literal_cost + 2 + 3 + 8 + 2 + 8, TOTAL_DESCRIPTOR_BITS / 8);
+}
+
+size_t ClownLZSS_ModuledChameleonCompressBound(size_t data_size, size_t module_size)
+{
+	return ModuledCompressBound(data_size, module_size, 1, ClownLZSS_ChameleonCompressBound(module_size), ClownLZSS_ChameleonCompressBound(data_size % module_size));
+}
+
+bool ClownLZSS_ChameleonCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "chameleon", NULL, ChameleonCompressStream);
+}
+
+bool ClownLZSS_ModuledChameleonCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "chameleon", NULL, ChameleonCompressStream, module_size, 1);
+}
+
+bool ClownLZSS_ChameleonCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "chameleon", NULL, ChameleonCompressStream);
+}
+
+bool ClownLZSS_ModuledChameleonCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "chameleon", NULL, ChameleonCompressStream, module_size, 1);
+}
+
+typedef struct ChameleonDecompressionInstance
+{
+	DecompressionInput *descriptor_input;
+
+	unsigned char descriptor;
+	unsigned int descriptor_bits_remaining;
+} ChameleonDecompressionInstance;
+
+static bool GetDescriptorBit(ChameleonDecompressionInstance *instance)
+{
+	if (instance->descriptor_bits_remaining == 0)
+	{
+		instance->descriptor = DecompressionInput_ReadByte(instance->descriptor_input);
+		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+	}
 
-	const size_t descriptor_buffer_size = MemoryStream_GetPosition(instance.descriptor_stream);
-	unsigned char *descriptor_buffer = MemoryStream_GetBuffer(instance.descriptor_stream);
+	--instance->descriptor_bits_remaining;
 
-	MemoryStream_WriteByte(output_stream, (descriptor_buffer_size >> 8) & 0xFF);
-	MemoryStream_WriteByte(output_stream, descriptor_buffer_size & 0xFF);
+	const bool bit = instance->descriptor & (1 << (TOTAL_DESCRIPTOR_BITS - 1));
 
-	MemoryStream_WriteBytes(output_stream, descriptor_buffer, descriptor_buffer_size);
+	instance->descriptor <<= 1;
 
-	const size_t match_buffer_size = MemoryStream_GetPosition(instance.match_stream);
-	unsigned char *match_buffer = MemoryStream_GetBuffer(instance.match_stream);
+	return bit;
+}
 
-	MemoryStream_WriteBytes(output_stream, match_buffer, match_buffer_size);
+static bool ChameleonDecompressStream(DecompressionInput *input, DecompressionBuffer *output, size_t decompressed_size, void *user)
+{
+	(void)decompressed_size;
+	(void)user;
+
+	// The descriptors and the match bytes are stored separately, so they are read separately too
+	size_t descriptor_buffer_size = DecompressionInput_ReadByte(input) << 8;
+	descriptor_buffer_size |= DecompressionInput_ReadByte(input);
+
+	if (descriptor_buffer_size > input->size - input->position)
+		return false;
+
+	DecompressionInput descriptor_input = {input->data, input->position + descriptor_buffer_size, input->position, false};
+	input->position += descriptor_buffer_size;
+
+	ChameleonDecompressionInstance instance;
+	instance.descriptor_input = &descriptor_input;
+	instance.descriptor_bits_remaining = 0;
+
+	while (!input->out_of_data && !descriptor_input.out_of_data)
+	{
+		if (GetDescriptorBit(&instance))
+		{
+			// Literal
+			if (!DecompressionBuffer_WriteByte(output, DecompressionInput_ReadByte(input)))
+				return false;
+		}
+		else
+		{
+			size_t distance;
+			size_t length;
+
+			if (!GetDescriptorBit(&instance))
+			{
+				// Short match
+				distance = DecompressionInput_ReadByte(input);
+				length = GetDescriptorBit(&instance) ? 3 : 2;
+			}
+			else
+			{
+				// Long match
+				distance = GetDescriptorBit(&instance) << 10;
+				distance |= GetDescriptorBit(&instance) << 9;
+				distance |= GetDescriptorBit(&instance) << 8;
+				distance |= DecompressionInput_ReadByte(input);
+
+				const bool length_bit_1 = GetDescriptorBit(&instance);
+				const bool length_bit_2 = GetDescriptorBit(&instance);
+
+				if (length_bit_1 && length_bit_2)
+				{
+					length = DecompressionInput_ReadByte(input);
+
+					if (length == 0)
+						break;	// Terminator match
+				}
+				else
+				{
+					length = length_bit_1 ? 5 : length_bit_2 ? 4 : 3;
+				}
+			}
+
+			if (!DecompressionBuffer_CopyMatch(output, distance, length))
+				return false;
+		}
+	}
 
-	MemoryStream_Destroy(instance.descriptor_stream);
-	MemoryStream_Destroy(instance.match_stream);
+	return !descriptor_input.out_of_data;
 }
 
-unsigned char* ClownLZSS_ChameleonCompress(unsigned char *data, size_t data_size, size_t *compressed_size)
+unsigned char* ClownLZSS_ChameleonDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size)
 {
-	return RegularWrapper(data, data_size, compressed_size, NULL, ChameleonCompressStream);
+	return RegularDecompressionWrapper(data, data_size, decompressed_size, NULL, ChameleonDecompressStream);
 }
 
-unsigned char* ClownLZSS_ModuledChameleonCompress(unsigned char *data, size_t data_size, size_t *compressed_size, size_t module_size)
+unsigned char* ClownLZSS_ModuledChameleonDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, size_t module_size)
 {
-	return ModuledCompressionWrapper(data, data_size, compressed_size, NULL, ChameleonCompressStream, module_size, 1);
+	return ModuledDecompressionWrapper(data, data_size, decompressed_size, NULL, ChameleonDecompressStream, module_size, 1);
 }
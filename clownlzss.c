@@ -0,0 +1,1744 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "clownlzss.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "threads.h"
+#if CLOWNLZSS_STATISTICS
+#include "timer.h"
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !CLOWNLZSS_BRUTE_FORCE
+#define CLOWNLZSS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/* The graph starts out this large, and only grows if the paths through it take a long time to converge */
+#define GRAPH_INITIAL_NODES 0x10000
+
+/* What contexts start out with, and what calls without a context use */
+static size_t thread_count;
+static bool parallel_parse;
+static const ClownLZSS_Profiler *profiler;
+
+static unsigned int GetEncodingsCost(const ClownLZSS_Format *format, size_t distance, size_t length)
+{
+	unsigned int cost = 0;
+
+	for (size_t i = 0; i < format->total_match_encodings; ++i)
+	{
+		const ClownLZSS_MatchEncoding *encoding = &format->match_encodings[i];
+
+		if (distance <= encoding->maximum_distance && length >= encoding->minimum_length && length <= encoding->maximum_length && (cost == 0 || encoding->cost < cost))
+			cost = encoding->cost;
+	}
+
+	return cost;
+}
+
+bool ClownLZSS_CostTableInit(ClownLZSS_CostTable *cost_table, const ClownLZSS_Format *format)
+{
+	/* Each distinct distance that an encoding stops at ends a tier, in ascending order */
+	cost_table->total_tiers = 0;
+
+	for (size_t i = 0; i < format->total_match_encodings; ++i)
+	{
+		const size_t distance = format->match_encodings[i].maximum_distance;
+		size_t tier = 0;
+
+		while (tier < cost_table->total_tiers && cost_table->maximum_distances[tier] < distance)
+			++tier;
+
+		if (tier < cost_table->total_tiers && cost_table->maximum_distances[tier] == distance)
+			continue;
+
+		if (cost_table->total_tiers == CLOWNLZSS_MAX_DISTANCE_TIERS)
+			return false;
+
+		memmove(&cost_table->maximum_distances[tier + 1], &cost_table->maximum_distances[tier], (cost_table->total_tiers - tier) * sizeof(size_t));
+		cost_table->maximum_distances[tier] = distance;
+		++cost_table->total_tiers;
+	}
+
+	/* Matches further away than every encoding allows fall into a final tier that has no lengths */
+	if (cost_table->total_tiers == 0 || cost_table->maximum_distances[cost_table->total_tiers - 1] < format->maximum_match_distance)
+	{
+		if (cost_table->total_tiers == CLOWNLZSS_MAX_DISTANCE_TIERS)
+			return false;
+
+		cost_table->maximum_distances[cost_table->total_tiers++] = (size_t)-1;
+	}
+
+	for (size_t tier = 0; tier < cost_table->total_tiers; ++tier)
+	{
+		ClownLZSS_CostRun *runs = cost_table->runs[tier];
+		size_t total_runs = 0;
+
+		for (size_t length = format->minimum_match_length; length <= format->maximum_match_length; ++length)
+		{
+			const unsigned int cost = GetEncodingsCost(format, cost_table->maximum_distances[tier], length);
+
+			if (cost == 0)
+				continue;
+
+			/* Extend the previous run if this length follows on from it at the same cost */
+			if (total_runs != 0 && runs[total_runs - 1].maximum_length == length - 1 && runs[total_runs - 1].cost == cost)
+			{
+				runs[total_runs - 1].maximum_length = length;
+			}
+			else
+			{
+				if (total_runs == CLOWNLZSS_MAX_COST_RUNS)
+					return false;
+
+				runs[total_runs].minimum_length = length;
+				runs[total_runs].maximum_length = length;
+				runs[total_runs].cost = cost;
+				++total_runs;
+			}
+		}
+
+		cost_table->total_runs[tier] = total_runs;
+	}
+
+	return true;
+}
+
+unsigned int ClownLZSS_GetMatchCost(const ClownLZSS_Format *format, size_t distance, size_t length, void *user)
+{
+	if (format->match_encodings == NULL)
+		return format->get_match_cost(distance, length, user);
+
+	return GetEncodingsCost(format, distance, length);
+}
+
+void* ClownLZSS_Allocate(const ClownLZSS_Allocator *allocator, size_t size)
+{
+	if (allocator == NULL)
+		return malloc(size);
+
+	return allocator->allocate(size, allocator->user);
+}
+
+void* ClownLZSS_Reallocate(const ClownLZSS_Allocator *allocator, void *memory, size_t size)
+{
+	if (allocator == NULL)
+		return realloc(memory, size);
+
+	return allocator->reallocate(memory, size, allocator->user);
+}
+
+void ClownLZSS_Free(const ClownLZSS_Allocator *allocator, void *memory)
+{
+	if (allocator == NULL)
+		free(memory);
+	else
+		allocator->free(memory, allocator->user);
+}
+
+/* Goes in front of each allocation that is counted or made by an arena. It is
+   as large as the most strictly-aligned types, so the memory after it is just
+   as aligned as the memory in front of it. */
+typedef union AllocationHeader
+{
+	size_t size;
+	void *pointer;
+	long double floating_point;
+} AllocationHeader;
+
+/* Rounds 'size' up to the next multiple of the header's size, so that everything in an arena stays aligned */
+static size_t AlignAllocationSize(size_t size)
+{
+	return (size + sizeof(AllocationHeader) - 1) / sizeof(AllocationHeader) * sizeof(AllocationHeader);
+}
+
+static void* ArenaReallocate(void *memory, size_t size, void *user)
+{
+	ClownLZSS_Arena *arena = (ClownLZSS_Arena*)user;
+
+	const size_t aligned_size = AlignAllocationSize(size);
+	AllocationHeader *header = memory == NULL ? NULL : (AllocationHeader*)memory - 1;
+
+	if (aligned_size < size)
+		return NULL;
+
+	/* The most recent allocation can simply be extended */
+	if (header != NULL && (unsigned char*)header == arena->memory + arena->last_allocation)
+	{
+		if (aligned_size > arena->size - arena->last_allocation - sizeof(AllocationHeader))
+			return NULL;
+
+		header->size = size;
+		arena->used = arena->last_allocation + sizeof(AllocationHeader) + aligned_size;
+
+		return memory;
+	}
+
+	if (arena->size - arena->used < sizeof(AllocationHeader) || aligned_size > arena->size - arena->used - sizeof(AllocationHeader))
+		return NULL;
+
+	AllocationHeader *new_header = (AllocationHeader*)(arena->memory + arena->used);
+	new_header->size = size;
+
+	if (header != NULL)
+		memcpy(new_header + 1, memory, CLOWNLZSS_MIN(header->size, size));
+
+	arena->last_allocation = arena->used;
+	arena->used += sizeof(AllocationHeader) + aligned_size;
+
+	return new_header + 1;
+}
+
+static void* ArenaAllocate(size_t size, void *user)
+{
+	return ArenaReallocate(NULL, size, user);
+}
+
+static void ArenaFree(void *memory, void *user)
+{
+	ClownLZSS_Arena *arena = (ClownLZSS_Arena*)user;
+
+	/* Only the most recent allocation can be given back before the arena is reset */
+	if (memory != NULL && (unsigned char*)memory - sizeof(AllocationHeader) == arena->memory + arena->last_allocation)
+		arena->used = arena->last_allocation;
+}
+
+void ClownLZSS_ArenaInit(ClownLZSS_Arena *arena, void *memory, size_t size)
+{
+	/* Line the first allocation up with the header's alignment */
+	const size_t misalignment = (size_t)(uintptr_t)memory % sizeof(AllocationHeader);
+	const size_t padding = misalignment == 0 ? 0 : sizeof(AllocationHeader) - misalignment;
+
+	arena->allocator.allocate = ArenaAllocate;
+	arena->allocator.reallocate = ArenaReallocate;
+	arena->allocator.free = ArenaFree;
+	arena->allocator.user = arena;
+	arena->memory = (unsigned char*)memory + CLOWNLZSS_MIN(padding, size);
+	arena->size = size - CLOWNLZSS_MIN(padding, size);
+
+	ClownLZSS_ArenaReset(arena);
+}
+
+void ClownLZSS_ArenaReset(ClownLZSS_Arena *arena)
+{
+	arena->used = 0;
+	arena->last_allocation = (size_t)-1;
+}
+
+/* Counts the memory that is in use at once, so that every call can report its peak */
+static void* TrackedReallocate(void *memory, size_t size, void *user)
+{
+	ClownLZSS_Context *context = (ClownLZSS_Context*)user;
+	ClownLZSS_Context *root = context->root;
+
+	/* Without a mutex, the allocations cannot be counted safely, so they are only passed on */
+	if (root->mutex == NULL)
+		return ClownLZSS_Reallocate(context->allocator, memory, size);
+
+	AllocationHeader *header = memory == NULL ? NULL : (AllocationHeader*)memory - 1;
+	const size_t old_size = header == NULL ? 0 : header->size;
+
+	/* The allocator is called with the mutex held, so that it does not need one of its own */
+	Mutex_Lock(root->mutex);
+
+	AllocationHeader *new_header = size > (size_t)-1 - sizeof(AllocationHeader) ? NULL : (AllocationHeader*)ClownLZSS_Reallocate(context->allocator, header, sizeof(AllocationHeader) + size);
+
+	if (new_header == NULL)
+	{
+		root->out_of_memory = true;
+	}
+	else
+	{
+		new_header->size = size;
+		root->bytes_in_use = root->bytes_in_use - old_size + size;
+		root->peak_bytes = CLOWNLZSS_MAX(root->peak_bytes, root->bytes_in_use);
+	}
+
+	Mutex_Unlock(root->mutex);
+
+	return new_header == NULL ? NULL : new_header + 1;
+}
+
+static void* TrackedAllocate(size_t size, void *user)
+{
+	return TrackedReallocate(NULL, size, user);
+}
+
+static void TrackedFree(void *memory, void *user)
+{
+	ClownLZSS_Context *context = (ClownLZSS_Context*)user;
+	ClownLZSS_Context *root = context->root;
+
+	if (root->mutex == NULL)
+	{
+		ClownLZSS_Free(context->allocator, memory);
+	}
+	else if (memory != NULL)
+	{
+		AllocationHeader *header = (AllocationHeader*)memory - 1;
+
+		Mutex_Lock(root->mutex);
+		root->bytes_in_use -= header->size;
+		ClownLZSS_Free(context->allocator, header);
+		Mutex_Unlock(root->mutex);
+	}
+}
+
+static void InitContext(ClownLZSS_Context *context, ClownLZSS_Context *root, const ClownLZSS_Allocator *allocator, bool keep_buffers)
+{
+	for (size_t i = 0; i < CLOWNLZSS_CONTEXT_TOTAL_BUFFERS; ++i)
+	{
+		context->buffers[i].memory = NULL;
+		context->buffers[i].size = 0;
+	}
+
+	context->keep_buffers = keep_buffers;
+	context->allocator = allocator;
+	context->tracked.allocate = TrackedAllocate;
+	context->tracked.reallocate = TrackedReallocate;
+	context->tracked.free = TrackedFree;
+	context->tracked.user = context;
+	context->root = root == NULL ? context : root;
+	context->mutex = NULL;
+	context->bytes_in_use = 0;
+	context->peak_bytes = 0;
+	context->out_of_memory = false;
+	context->statistics = NULL;
+	context->cache = NULL;
+	context->cached = false;
+	context->thread_count = thread_count;
+	context->parallel_parse = parallel_parse;
+	context->profiler = profiler;
+}
+
+bool ClownLZSS_ContextInit(ClownLZSS_Context *context)
+{
+	return ClownLZSS_ContextInitWithAllocator(context, NULL);
+}
+
+bool ClownLZSS_ContextInitWithAllocator(ClownLZSS_Context *context, const ClownLZSS_Allocator *allocator)
+{
+	InitContext(context, NULL, allocator, true);
+	context->mutex = Mutex_Create();
+
+	return context->mutex != NULL;
+}
+
+void ClownLZSS_ContextInitWorker(ClownLZSS_Context *context, ClownLZSS_Context *parent)
+{
+	InitContext(context, parent == NULL ? NULL : parent->root, parent == NULL ? NULL : parent->allocator, true);
+}
+
+ClownLZSS_Context* ClownLZSS_ContextInitShared(ClownLZSS_Context *context, ClownLZSS_Context *parent)
+{
+	if (parent == NULL)
+		return NULL;
+
+	InitContext(context, parent->root, parent->allocator, false);
+
+	return context;
+}
+
+void ClownLZSS_ContextDeinit(ClownLZSS_Context *context)
+{
+	for (size_t i = 0; i < CLOWNLZSS_CONTEXT_TOTAL_BUFFERS; ++i)
+		ClownLZSS_Free(&context->tracked, context->buffers[i].memory);
+
+	if (context->mutex != NULL)
+		Mutex_Destroy(context->mutex);
+}
+
+const ClownLZSS_Allocator* ClownLZSS_ContextGetAllocator(ClownLZSS_Context *context)
+{
+	return context == NULL ? NULL : &context->tracked;
+}
+
+void ClownLZSS_ContextBeginCall(ClownLZSS_Context *context)
+{
+	context->peak_bytes = context->bytes_in_use;
+	context->out_of_memory = false;
+	context->cached = false;
+
+	if (context->statistics != NULL)
+		ClownLZSS_StatisticsClear(context->statistics);
+}
+
+size_t ClownLZSS_ContextGetPeakBytes(const ClownLZSS_Context *context)
+{
+	return context->peak_bytes;
+}
+
+bool ClownLZSS_ContextHasRunOutOfMemory(const ClownLZSS_Context *context)
+{
+	return context->out_of_memory;
+}
+
+void ClownLZSS_ContextSetStatistics(ClownLZSS_Context *context, ClownLZSS_Statistics *statistics)
+{
+	context->root->statistics = statistics;
+}
+
+void ClownLZSS_ContextSetCache(ClownLZSS_Context *context, ClownLZSS_Cache *cache)
+{
+	context->root->cache = cache;
+}
+
+ClownLZSS_Cache* ClownLZSS_ContextGetCache(ClownLZSS_Context *context)
+{
+	return context == NULL ? NULL : context->root->cache;
+}
+
+bool ClownLZSS_ContextWasCached(const ClownLZSS_Context *context)
+{
+	return context->cached;
+}
+
+void ClownLZSS_ContextAddStatistics(ClownLZSS_Context *context, const ClownLZSS_Statistics *statistics)
+{
+	if (context == NULL)
+		return;
+
+	ClownLZSS_Context *root = context->root;
+
+	/* Like the allocations, the statistics cannot be counted safely without a mutex */
+	if (root->statistics == NULL || root->mutex == NULL)
+		return;
+
+	Mutex_Lock(root->mutex);
+	ClownLZSS_StatisticsAdd(root->statistics, statistics);
+	Mutex_Unlock(root->mutex);
+}
+
+void* ClownLZSS_ContextAllocate(ClownLZSS_Context *context, ClownLZSS_ContextBuffer buffer, size_t size)
+{
+	if (context == NULL)
+		return malloc(size);
+
+	if (!context->keep_buffers)
+		return ClownLZSS_Allocate(&context->tracked, size);
+
+	if (size > context->buffers[buffer].size || context->buffers[buffer].memory == NULL)
+	{
+		/* The old contents are not needed, so they are freed first, instead of
+		   being copied with realloc, which also lets an arena reuse their space */
+		ClownLZSS_Free(&context->tracked, context->buffers[buffer].memory);
+
+		context->buffers[buffer].memory = ClownLZSS_Allocate(&context->tracked, size == 0 ? 1 : size);
+		context->buffers[buffer].size = context->buffers[buffer].memory == NULL ? 0 : size;
+	}
+
+	return context->buffers[buffer].memory;
+}
+
+void* ClownLZSS_ContextReallocate(ClownLZSS_Context *context, ClownLZSS_ContextBuffer buffer, void *memory, size_t size)
+{
+	if (context == NULL)
+		return realloc(memory, size);
+
+	if (!context->keep_buffers)
+		return ClownLZSS_Reallocate(&context->tracked, memory, size);
+
+	if (size > context->buffers[buffer].size || context->buffers[buffer].memory == NULL)
+	{
+		void *new_memory = ClownLZSS_Reallocate(&context->tracked, context->buffers[buffer].memory, size == 0 ? 1 : size);
+
+		if (new_memory == NULL)
+			return NULL;
+
+		context->buffers[buffer].memory = new_memory;
+		context->buffers[buffer].size = size;
+	}
+
+	return context->buffers[buffer].memory;
+}
+
+void ClownLZSS_ContextFree(ClownLZSS_Context *context, void *memory)
+{
+	if (context == NULL)
+		free(memory);
+	else if (!context->keep_buffers)
+		ClownLZSS_Free(&context->tracked, memory);
+}
+
+void ClownLZSS_ContextReplace(ClownLZSS_Context *context, ClownLZSS_ContextBuffer buffer, void *memory, size_t size)
+{
+	if (!context->keep_buffers)
+	{
+		ClownLZSS_Free(&context->tracked, memory);
+		return;
+	}
+
+	ClownLZSS_Free(&context->tracked, context->buffers[buffer].memory);
+	context->buffers[buffer].memory = memory;
+	context->buffers[buffer].size = size;
+}
+
+static bool AllocateGraph(ClownLZSS_Graph *graph, size_t total_nodes)
+{
+	graph->costs = (unsigned int*)ClownLZSS_ContextAllocate(graph->context, CLOWNLZSS_CONTEXT_GRAPH_COSTS, total_nodes * sizeof(unsigned int));
+	graph->lengths = ClownLZSS_ContextAllocate(graph->context, CLOWNLZSS_CONTEXT_GRAPH_LENGTHS, total_nodes * graph->length_size);
+	graph->offsets = (unsigned int*)ClownLZSS_ContextAllocate(graph->context, CLOWNLZSS_CONTEXT_GRAPH_OFFSETS, total_nodes * sizeof(unsigned int));
+
+	if (graph->costs == NULL || graph->lengths == NULL || graph->offsets == NULL)
+	{
+		ClownLZSS_GraphDeinit(graph);
+		return false;
+	}
+
+	graph->mask = total_nodes - 1;
+
+	return true;
+}
+
+/* Only 'first_node' is reachable to begin with: it is where the path starts */
+bool ClownLZSS_GraphInit(ClownLZSS_Graph *graph, size_t first_node, size_t total_nodes, size_t max_match_length, ClownLZSS_Context *context)
+{
+	if (first_node + total_nodes > UINT_MAX)
+		return false;
+
+	graph->context = context;
+
+	if (max_match_length <= UCHAR_MAX)
+		graph->length_size = sizeof(unsigned char);
+	else if (max_match_length <= USHRT_MAX)
+		graph->length_size = sizeof(unsigned short);
+	else
+		graph->length_size = sizeof(unsigned int);
+
+	size_t ring_size = 1;
+
+	while (ring_size < total_nodes && ring_size < GRAPH_INITIAL_NODES)
+		ring_size <<= 1;
+
+	if (!AllocateGraph(graph, ring_size))
+		return false;
+
+	graph->costs[first_node & graph->mask] = 0;
+	graph->first_node = first_node;
+	graph->end_node = first_node + 1;
+
+	return true;
+}
+
+void ClownLZSS_GraphDeinit(ClownLZSS_Graph *graph)
+{
+	ClownLZSS_ContextFree(graph->context, graph->offsets);
+	ClownLZSS_ContextFree(graph->context, graph->lengths);
+	ClownLZSS_ContextFree(graph->context, graph->costs);
+}
+
+/* Moves the nodes that are still in use to where they belong in a ring buffer
+   that has grown from 'old_size' elements to 'new_size'. The nodes in use are no
+   more than 'old_size' apart, so they are split across at most one wrap-around
+   of the old ring: the nodes before it move up to their new place, and then the
+   nodes after it move up past them, if they have to move at all. */
+static void RelocateRing(unsigned char *ring, size_t element_size, size_t old_size, size_t new_size, size_t first_node, size_t end_node)
+{
+	const size_t wrap_node = (first_node | (old_size - 1)) + 1;
+	const size_t total_before = CLOWNLZSS_MIN(end_node, wrap_node) - first_node;
+	const size_t total_after = end_node > wrap_node ? end_node - wrap_node : 0;
+
+	memmove(&ring[(first_node & (new_size - 1)) * element_size], &ring[(first_node & (old_size - 1)) * element_size], total_before * element_size);
+	memmove(&ring[(wrap_node & (new_size - 1)) * element_size], &ring[0], total_after * element_size);
+}
+
+/* Makes the nodes up to (but not including) 'end_node' available */
+bool ClownLZSS_GraphExtend(ClownLZSS_Graph *graph, size_t end_node)
+{
+	if (end_node - graph->first_node > graph->mask + 1)
+	{
+		/* The ring buffer is full, so grow it, and move the nodes that are still in use to where they now belong */
+		const size_t old_ring_size = graph->mask + 1;
+		size_t ring_size = old_ring_size;
+
+		while (ring_size < end_node - graph->first_node)
+			ring_size <<= 1;
+
+		/* The nodes are only moved once all of the buffers have grown, so that the graph is left as it was on failure */
+		unsigned int *costs = (unsigned int*)ClownLZSS_ContextReallocate(graph->context, CLOWNLZSS_CONTEXT_GRAPH_COSTS, graph->costs, ring_size * sizeof(unsigned int));
+
+		if (costs == NULL)
+			return false;
+
+		graph->costs = costs;
+
+		void *lengths = ClownLZSS_ContextReallocate(graph->context, CLOWNLZSS_CONTEXT_GRAPH_LENGTHS, graph->lengths, ring_size * graph->length_size);
+
+		if (lengths == NULL)
+			return false;
+
+		graph->lengths = lengths;
+
+		unsigned int *offsets = (unsigned int*)ClownLZSS_ContextReallocate(graph->context, CLOWNLZSS_CONTEXT_GRAPH_OFFSETS, graph->offsets, ring_size * sizeof(unsigned int));
+
+		if (offsets == NULL)
+			return false;
+
+		graph->offsets = offsets;
+
+		RelocateRing((unsigned char*)graph->costs, sizeof(unsigned int), old_ring_size, ring_size, graph->first_node, graph->end_node);
+		RelocateRing((unsigned char*)graph->lengths, graph->length_size, old_ring_size, ring_size, graph->first_node, graph->end_node);
+		RelocateRing((unsigned char*)graph->offsets, sizeof(unsigned int), old_ring_size, ring_size, graph->first_node, graph->end_node);
+
+		graph->mask = ring_size - 1;
+	}
+
+	/* Set costs to maximum possible value, so later comparisons work */
+	for (; graph->end_node < end_node; ++graph->end_node)
+		graph->costs[graph->end_node & graph->mask] = UINT_MAX;
+
+	return true;
+}
+
+static size_t GetPreviousNode(const ClownLZSS_Graph *graph, size_t node)
+{
+	const size_t length = ClownLZSS_GraphGetLength(graph, node);
+
+	return node - (length == 0 ? 1 : length);
+}
+
+/* Finds the last node that every path must pass through. No edges may start
+   after 'settled_node' yet, so the cheapest path to it and every node before it
+   is final, and every path leaves those nodes by an edge that is already in the graph. */
+size_t ClownLZSS_GraphFindConvergence(const ClownLZSS_Graph *graph, size_t settled_node)
+{
+	size_t convergence = settled_node;
+
+	for (size_t node = settled_node + 1; node < graph->end_node; ++node)
+	{
+		if (graph->costs[node & graph->mask] == UINT_MAX)
+			continue;
+
+		/* Walk back along both paths until they meet */
+		size_t other_node = GetPreviousNode(graph, node);
+
+		while (other_node != convergence)
+		{
+			if (other_node > convergence)
+				other_node = GetPreviousNode(graph, other_node);
+			else
+				convergence = GetPreviousNode(graph, convergence);
+		}
+	}
+
+	return convergence;
+}
+
+static unsigned int GetElement(const void *data, size_t element_size, size_t index)
+{
+	if (element_size == 1)
+		return ((const unsigned char*)data)[index];
+	else
+		return ((const unsigned short*)data)[index];
+}
+
+/* Builds the suffix array by prefix-doubling: each pass sorts the suffixes by
+   their first 2k values, using the ranks from the previous pass as keys.
+   Its scratch memory is only needed while it runs, so it is not kept in one of
+   the context's buffers, where it would stay allocated through the whole parse. */
+static bool BuildSuffixArray(const void *data, size_t element_size, size_t length, unsigned int *suffix_array, unsigned int *ranks, ClownLZSS_Context *context)
+{
+	const size_t alphabet_size = (size_t)1 << (element_size * 8);
+	const size_t total_counts = CLOWNLZSS_MAX(alphabet_size, length);
+	const ClownLZSS_Allocator *allocator = ClownLZSS_ContextGetAllocator(context);
+
+	unsigned int *scratch = (unsigned int*)ClownLZSS_Allocate(allocator, length * sizeof(unsigned int));
+	unsigned int *counts = (unsigned int*)ClownLZSS_Allocate(allocator, total_counts * sizeof(unsigned int));	/* The input is smaller than UINT_MAX, so no count can overflow */
+
+	if (scratch == NULL || counts == NULL)
+	{
+		ClownLZSS_Free(allocator, counts);
+		ClownLZSS_Free(allocator, scratch);
+		return false;
+	}
+
+	memset(counts, 0, total_counts * sizeof(unsigned int));
+
+	/* Initial sort, by the first value of each suffix */
+	for (size_t i = 0; i < length; ++i)
+		++counts[GetElement(data, element_size, i)];
+
+	for (size_t i = 1; i < alphabet_size; ++i)
+		counts[i] += counts[i - 1];
+
+	for (size_t i = length; i-- > 0;)
+		suffix_array[--counts[GetElement(data, element_size, i)]] = (unsigned int)i;
+
+	ranks[suffix_array[0]] = 0;
+
+	for (size_t i = 1; i < length; ++i)
+		ranks[suffix_array[i]] = ranks[suffix_array[i - 1]] + (GetElement(data, element_size, suffix_array[i]) != GetElement(data, element_size, suffix_array[i - 1]));
+
+	for (size_t k = 1; length != 0 && ranks[suffix_array[length - 1]] != length - 1; k <<= 1)
+	{
+		/* Order by the second half of the key: suffixes too short to have one come first */
+		size_t total_scratch = 0;
+
+		for (size_t i = length - CLOWNLZSS_MIN(k, length); i < length; ++i)
+			scratch[total_scratch++] = (unsigned int)i;
+
+		for (size_t i = 0; i < length; ++i)
+			if (suffix_array[i] >= k)
+				scratch[total_scratch++] = (unsigned int)(suffix_array[i] - k);
+
+		/* Then do a stable sort by the first half of the key */
+		const size_t total_ranks = ranks[suffix_array[length - 1]] + 1;
+
+		for (size_t i = 0; i < total_ranks; ++i)
+			counts[i] = 0;
+
+		for (size_t i = 0; i < length; ++i)
+			++counts[ranks[i]];
+
+		for (size_t i = 1; i < total_ranks; ++i)
+			counts[i] += counts[i - 1];
+
+		for (size_t i = length; i-- > 0;)
+			suffix_array[--counts[ranks[scratch[i]]]] = scratch[i];
+
+		/* Re-rank the suffixes, reusing 'scratch' for the new ranks */
+		scratch[suffix_array[0]] = 0;
+
+		for (size_t i = 1; i < length; ++i)
+		{
+			const size_t a = suffix_array[i - 1];
+			const size_t b = suffix_array[i];
+			const bool same = ranks[a] == ranks[b] && (a + k < length ? ranks[a + k] : UINT_MAX) == (b + k < length ? ranks[b + k] : UINT_MAX);
+
+			scratch[b] = scratch[a] + !same;
+		}
+
+		for (size_t i = 0; i < length; ++i)
+			ranks[i] = scratch[i];
+	}
+
+	ClownLZSS_Free(allocator, counts);
+	ClownLZSS_Free(allocator, scratch);
+
+	return true;
+}
+
+/* The trees have a leaf for every rank, and one past the end, but are padded out
+   to a power of two. The searches never read the nodes whose leaves are all in
+   the padding, so only the others are zeroed, along with the first node after
+   them on each level, which the parent of the last one can read. The rest are
+   never touched, so with a fresh allocation, their memory is never even used. */
+static void ClearTree(unsigned int *tree, size_t total_leaves, size_t total_used_leaves)
+{
+	for (size_t level = total_leaves, used = total_used_leaves; level != 0; level >>= 1, used = (used + 1) / 2)
+		memset(&tree[level], 0, CLOWNLZSS_MIN(used + 1, level) * sizeof(unsigned int));
+}
+
+bool ClownLZSS_SuffixArrayInit(ClownLZSS_SuffixArray *suffix_array, const void *data, size_t element_size, size_t length, ClownLZSS_Context *context)
+{
+	if (length == 0 || length >= UINT_MAX || (element_size != 1 && element_size != 2))
+		return false;
+
+	suffix_array->context = context;
+	suffix_array->length = length;
+
+	suffix_array->total_leaves = 1;
+	while (suffix_array->total_leaves < length + 1)	/* +1 so that there is always a leaf past the end */
+		suffix_array->total_leaves <<= 1;
+
+	/* The sorted suffixes are only needed to build the LCP tree, so like the
+	   scratch memory of the sort, they are freed as soon as they are done with.
+	   The LCP tree is only allocated once that scratch memory has been freed. */
+	const ClownLZSS_Allocator *allocator = ClownLZSS_ContextGetAllocator(context);
+	unsigned int *sorted_suffixes = (unsigned int*)ClownLZSS_Allocate(allocator, length * sizeof(unsigned int));
+	suffix_array->ranks = (unsigned int*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_SUFFIX_ARRAY_RANKS, length * sizeof(unsigned int));
+	suffix_array->lcp_tree = NULL;
+
+	if (sorted_suffixes == NULL || suffix_array->ranks == NULL
+	 || !BuildSuffixArray(data, element_size, length, sorted_suffixes, suffix_array->ranks, context)
+	 || (suffix_array->lcp_tree = (unsigned int*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_SUFFIX_ARRAY_LCP_TREE, suffix_array->total_leaves * 2 * sizeof(unsigned int))) == NULL)
+	{
+		ClownLZSS_Free(allocator, sorted_suffixes);
+		ClownLZSS_SuffixArrayDeinit(suffix_array);
+		return false;
+	}
+
+	ClearTree(suffix_array->lcp_tree, suffix_array->total_leaves, length + 1);
+
+	/* Compute the longest common prefix of each suffix and the one sorted before it,
+	   using Kasai's algorithm, and store them in the leaves of the LCP tree */
+	unsigned int *lcp_leaves = &suffix_array->lcp_tree[suffix_array->total_leaves];
+
+	for (size_t i = 0, common = 0; i < length; ++i)
+	{
+		const size_t rank = suffix_array->ranks[i];
+
+		if (rank == 0)
+		{
+			common = 0;
+		}
+		else
+		{
+			const size_t previous = sorted_suffixes[rank - 1];
+
+			while (i + common < length && previous + common < length && GetElement(data, element_size, i + common) == GetElement(data, element_size, previous + common))
+				++common;
+
+			lcp_leaves[rank] = (unsigned int)common;
+
+			if (common != 0)
+				--common;
+		}
+	}
+
+	ClownLZSS_Free(allocator, sorted_suffixes);
+
+	/* The last node of each level that is not all padding has the leaf past the
+	   end under it, which is always 0, so the zeroed node after it does not change it */
+	for (size_t level = suffix_array->total_leaves / 2, used = (length + 2) / 2; level != 0; level >>= 1, used = (used + 1) / 2)
+		for (size_t node = level; node < level + used; ++node)
+			suffix_array->lcp_tree[node] = CLOWNLZSS_MIN(suffix_array->lcp_tree[node * 2], suffix_array->lcp_tree[node * 2 + 1]);
+
+	return true;
+}
+
+void ClownLZSS_SuffixArrayDeinit(ClownLZSS_SuffixArray *suffix_array)
+{
+	ClownLZSS_ContextFree(suffix_array->context, suffix_array->lcp_tree);
+	ClownLZSS_ContextFree(suffix_array->context, suffix_array->ranks);
+}
+
+unsigned int* ClownLZSS_SuffixArrayCreatePositionTree(const ClownLZSS_SuffixArray *suffix_array, ClownLZSS_Context *context)
+{
+	unsigned int *position_tree = (unsigned int*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_POSITION_TREE, suffix_array->total_leaves * 2 * sizeof(unsigned int));
+
+	if (position_tree != NULL)
+		ClearTree(position_tree, suffix_array->total_leaves, suffix_array->length + 1);
+
+	return position_tree;
+}
+
+/* Finds the last rank at or before 'rank' whose LCP is shorter than 'length' */
+static size_t FindPreviousShorterLCP(const ClownLZSS_SuffixArray *suffix_array, size_t rank, size_t length)
+{
+	size_t node = suffix_array->total_leaves + rank;
+
+	if (suffix_array->lcp_tree[node] >= length)
+	{
+		for (;;)
+		{
+			if (node == 1)
+				return 0;	/* Cannot happen: the first rank's LCP is always 0 */
+
+			if ((node & 1) != 0 && suffix_array->lcp_tree[node - 1] < length)
+			{
+				--node;
+				break;
+			}
+
+			node >>= 1;
+		}
+
+		while (node < suffix_array->total_leaves)
+		{
+			node = node * 2 + 1;
+
+			if (suffix_array->lcp_tree[node] >= length)
+				--node;
+		}
+	}
+
+	return node - suffix_array->total_leaves;
+}
+
+/* Finds the first rank after 'rank' whose LCP is shorter than 'length' */
+static size_t FindNextShorterLCP(const ClownLZSS_SuffixArray *suffix_array, size_t rank, size_t length)
+{
+	size_t node = suffix_array->total_leaves + rank + 1;
+
+	if (suffix_array->lcp_tree[node] >= length)
+	{
+		for (;;)
+		{
+			if (node == 1)
+				return suffix_array->total_leaves;	/* Cannot happen: the leaf past the end is always 0 */
+
+			if ((node & 1) == 0 && suffix_array->lcp_tree[node + 1] < length)
+			{
+				++node;
+				break;
+			}
+
+			node >>= 1;
+		}
+
+		while (node < suffix_array->total_leaves)
+		{
+			node = node * 2;
+
+			if (suffix_array->lcp_tree[node] >= length)
+				++node;
+		}
+	}
+
+	return node - suffix_array->total_leaves;
+}
+
+size_t ClownLZSS_SuffixArrayFindMatch(const ClownLZSS_SuffixArray *suffix_array, const unsigned int *position_tree, size_t position, size_t minimum_length, size_t oldest_position, size_t *match_length)
+{
+	const size_t rank = suffix_array->ranks[position];
+
+	/* Every suffix that shares at least 'minimum_length' values with this one
+	   lies in a contiguous range of ranks around it */
+	size_t first = FindPreviousShorterLCP(suffix_array, rank, minimum_length) + suffix_array->total_leaves;
+	size_t last = FindNextShorterLCP(suffix_array, rank, minimum_length) + suffix_array->total_leaves;
+
+	/* Of the positions that have already been passed, pick the newest within that range */
+	unsigned int newest = 0;
+
+	for (; first < last; first >>= 1, last >>= 1)
+	{
+		if ((first & 1) != 0)
+		{
+			newest = CLOWNLZSS_MAX(newest, position_tree[first]);
+			++first;
+		}
+
+		if ((last & 1) != 0)
+		{
+			--last;
+			newest = CLOWNLZSS_MAX(newest, position_tree[last]);
+		}
+	}
+
+	if (newest == 0 || newest - 1 < oldest_position)
+		return (size_t)-1;
+
+	/* Find the full length of the match: the smallest LCP between the two ranks */
+	const size_t other_rank = suffix_array->ranks[newest - 1];
+	size_t low = CLOWNLZSS_MIN(rank, other_rank) + 1 + suffix_array->total_leaves;
+	size_t high = CLOWNLZSS_MAX(rank, other_rank) + 1 + suffix_array->total_leaves;
+	unsigned int common = UINT_MAX;
+
+	for (; low < high; low >>= 1, high >>= 1)
+	{
+		if ((low & 1) != 0)
+		{
+			common = CLOWNLZSS_MIN(common, suffix_array->lcp_tree[low]);
+			++low;
+		}
+
+		if ((high & 1) != 0)
+		{
+			--high;
+			common = CLOWNLZSS_MIN(common, suffix_array->lcp_tree[high]);
+		}
+	}
+
+	*match_length = common;
+
+	return newest - 1;
+}
+
+void ClownLZSS_SuffixArrayInsert(const ClownLZSS_SuffixArray *suffix_array, unsigned int *position_tree, size_t position)
+{
+	/* Positions are always inserted in increasing order, so each one is the newest */
+	for (size_t node = suffix_array->total_leaves + suffix_array->ranks[position]; node != 0; node >>= 1)
+		position_tree[node] = (unsigned int)(position + 1);
+}
+
+/* The tree is only correct again once every position that was inserted has been cleared */
+void ClownLZSS_SuffixArrayClear(const ClownLZSS_SuffixArray *suffix_array, unsigned int *position_tree, size_t position)
+{
+	/* If a node has already been cleared, then so has everything above it */
+	for (size_t node = suffix_array->total_leaves + suffix_array->ranks[position]; node != 0 && position_tree[node] != 0; node >>= 1)
+		position_tree[node] = 0;
+}
+
+unsigned int* ClownLZSS_RunLengthsCreate(const void *data, size_t element_size, size_t length, ClownLZSS_Context *context)
+{
+	unsigned int *run_lengths = (unsigned int*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_RUN_LENGTHS, (length + 1) * sizeof(unsigned int));	/* +1 so that empty inputs still get a buffer */
+
+	if (run_lengths == NULL)
+		return NULL;
+
+	run_lengths[length] = 0;
+
+	for (size_t i = length; i-- != 0;)
+	{
+		if (i + 1 != length && GetElement(data, element_size, i) == GetElement(data, element_size, i + 1))
+			run_lengths[i] = run_lengths[i + 1] + 1;
+		else
+			run_lengths[i] = 1;
+	}
+
+	return run_lengths;
+}
+
+static size_t MatchLengthScalar(const void *a, const void *b, size_t maximum)
+{
+	const unsigned char *a_bytes = (const unsigned char*)a;
+	const unsigned char *b_bytes = (const unsigned char*)b;
+
+	size_t length = 0;
+
+	while (length < maximum && a_bytes[length] == b_bytes[length])
+		++length;
+
+	return length;
+}
+
+#ifdef CLOWNLZSS_X86_KERNELS
+
+/* These compare a block of bytes at once, and use the first set bit of the
+   mismatch mask to find where the match ends */
+__attribute__((target("sse2"))) static size_t MatchLengthSSE2(const void *a, const void *b, size_t maximum)
+{
+	const unsigned char *a_bytes = (const unsigned char*)a;
+	const unsigned char *b_bytes = (const unsigned char*)b;
+
+	size_t length = 0;
+
+	for (; length + 16 <= maximum; length += 16)
+	{
+		const __m128i a_block = _mm_loadu_si128((const __m128i*)&a_bytes[length]);
+		const __m128i b_block = _mm_loadu_si128((const __m128i*)&b_bytes[length]);
+		const unsigned int mismatches = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(a_block, b_block)) ^ 0xFFFF;
+
+		if (mismatches != 0)
+			return length + __builtin_ctz(mismatches);
+	}
+
+	return length + MatchLengthScalar(&a_bytes[length], &b_bytes[length], maximum - length);
+}
+
+__attribute__((target("avx2"))) static size_t MatchLengthAVX2(const void *a, const void *b, size_t maximum)
+{
+	const unsigned char *a_bytes = (const unsigned char*)a;
+	const unsigned char *b_bytes = (const unsigned char*)b;
+
+	size_t length = 0;
+
+	for (; length + 32 <= maximum; length += 32)
+	{
+		const __m256i a_block = _mm256_loadu_si256((const __m256i*)&a_bytes[length]);
+		const __m256i b_block = _mm256_loadu_si256((const __m256i*)&b_bytes[length]);
+		const unsigned int mismatches = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a_block, b_block));
+
+		if (mismatches != 0)
+			return length + __builtin_ctz(mismatches);
+	}
+
+	return length + MatchLengthSSE2(&a_bytes[length], &b_bytes[length], maximum - length);
+}
+
+#endif
+
+ClownLZSS_MatchLengthFunction ClownLZSS_GetMatchLengthFunction(void)
+{
+#ifdef CLOWNLZSS_X86_KERNELS
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		return MatchLengthAVX2;
+	else if (__builtin_cpu_supports("sse2"))
+		return MatchLengthSSE2;
+#endif
+
+	/* The brute-force search always uses this, so that it remains a simple reference */
+	return MatchLengthScalar;
+}
+
+/* 0 uses one thread per processor. The output is the same no matter how many are used. */
+bool ClownLZSS_MatchFinderStateInit(ClownLZSS_MatchFinderState *state, const void *data, size_t data_size, const unsigned int *run_lengths, const ClownLZSS_SuffixArray *suffix_array, size_t total_threads, size_t maximum_match_distance, ClownLZSS_Context *context)
+{
+	state->data = data;
+	state->data_size = data_size;
+	state->run_lengths = run_lengths;
+	state->suffix_array = suffix_array;
+	state->position_trees = NULL;
+	state->get_match_length = ClownLZSS_GetMatchLengthFunction();
+	state->hash_bits = 8;
+	state->hash_chain_size = 1;
+	state->total_threads = total_threads;
+	state->context = context;
+
+	while (state->hash_bits < CLOWNLZSS_HASH_MAX_BITS && ((size_t)1 << state->hash_bits) < data_size)
+		++state->hash_bits;
+
+	while (state->hash_chain_size < maximum_match_distance && state->hash_chain_size < data_size)
+		state->hash_chain_size <<= 1;
+
+	if (suffix_array != NULL)
+	{
+		/* Each thread creates its own position tree when it first needs one */
+		state->position_trees = (unsigned int**)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_POSITION_TREES, total_threads * sizeof(unsigned int*));
+
+		if (state->position_trees == NULL)
+			return false;
+
+		for (size_t i = 0; i < total_threads; ++i)
+			state->position_trees[i] = NULL;
+	}
+
+	return true;
+}
+
+void ClownLZSS_MatchFinderStateDeinit(ClownLZSS_MatchFinderState *state)
+{
+	if (state->position_trees != NULL)
+		for (size_t i = 0; i < state->total_threads; ++i)
+			ClownLZSS_ContextFree(state->context, state->position_trees[i]);
+
+	ClownLZSS_ContextFree(state->context, state->position_trees);
+}
+
+/* Each level compares against more positions than the one before it. Only the
+   first is greedy: with more candidates, a greedy parse keeps taking long, distant
+   matches that cost more than the shorter, nearer ones they cut off, so Kosinski's
+   output grew between the first two levels before the second was made lazy. */
+static const ClownLZSS_Level levels[CLOWNLZSS_MAXIMUM_LEVEL - CLOWNLZSS_MINIMUM_LEVEL] = {
+	{2, false},
+	{8, true},
+	{32, true},
+	{128, true}
+};
+
+const ClownLZSS_Level* ClownLZSS_GetLevel(unsigned int level)
+{
+	if (level >= CLOWNLZSS_MAXIMUM_LEVEL)
+		return NULL;
+
+	return &levels[CLOWNLZSS_MAX(level, CLOWNLZSS_MINIMUM_LEVEL) - CLOWNLZSS_MINIMUM_LEVEL];
+}
+
+bool ClownLZSS_FastParserInit(ClownLZSS_FastParser *parser, const void *data, size_t data_size, const unsigned int *run_lengths, const ClownLZSS_Format *format, const ClownLZSS_Level *level, ClownLZSS_Context *context)
+{
+	parser->level = level;
+	parser->indexed_end = 0;
+	parser->run_start = 0;
+#if CLOWNLZSS_STATISTICS
+	ClownLZSS_StatisticsClear(&parser->statistics);
+#endif
+
+	if (format->match_encodings != NULL && !ClownLZSS_CostTableInit(&parser->cost_table, format))
+		return false;
+
+	/* Without a suffix array, this cannot fail */
+	ClownLZSS_MatchFinderStateInit(&parser->state, data, data_size, run_lengths, NULL, 1, format->maximum_match_distance, context);
+
+	if (!ClownLZSS_GraphInit(&parser->graph, 0, data_size + 1, CLOWNLZSS_MIN(format->maximum_match_length, data_size), context))
+		return false;
+
+	parser->hash_heads = (size_t*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_HASH_HEADS, ((size_t)1 << parser->state.hash_bits) * sizeof(size_t));
+	parser->hash_chain = (size_t*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_HASH_CHAIN, parser->state.hash_chain_size * sizeof(size_t));
+
+	if (parser->hash_heads == NULL || parser->hash_chain == NULL)
+	{
+		ClownLZSS_FastParserDeinit(parser);
+		return false;
+	}
+
+	for (size_t i = 0; i < (size_t)1 << parser->state.hash_bits; ++i)
+		parser->hash_heads[i] = (size_t)-1;
+
+	return true;
+}
+
+void ClownLZSS_FastParserDeinit(ClownLZSS_FastParser *parser)
+{
+	ClownLZSS_ContextFree(parser->state.context, parser->hash_chain);
+	ClownLZSS_ContextFree(parser->state.context, parser->hash_heads);
+	ClownLZSS_GraphDeinit(&parser->graph);
+	ClownLZSS_MatchFinderStateDeinit(&parser->state);
+}
+
+void ClownLZSS_SetThreadCount(size_t total_threads)
+{
+	thread_count = total_threads;
+}
+
+size_t ClownLZSS_GetThreadCount(void)
+{
+	return thread_count != 0 ? thread_count : Thread_GetProcessorCount();
+}
+
+void ClownLZSS_ContextSetThreadCount(ClownLZSS_Context *context, size_t total_threads)
+{
+	context->root->thread_count = total_threads;
+}
+
+size_t ClownLZSS_ContextGetThreadCount(const ClownLZSS_Context *context)
+{
+	if (context == NULL)
+		return ClownLZSS_GetThreadCount();
+
+	return context->root->thread_count != 0 ? context->root->thread_count : Thread_GetProcessorCount();
+}
+
+void ClownLZSS_SetProfiler(const ClownLZSS_Profiler *new_profiler)
+{
+	profiler = new_profiler;
+}
+
+void ClownLZSS_ContextSetProfiler(ClownLZSS_Context *context, const ClownLZSS_Profiler *new_profiler)
+{
+	context->root->profiler = new_profiler;
+}
+
+static const ClownLZSS_Profiler* GetProfiler(const ClownLZSS_Context *context)
+{
+	return context == NULL ? profiler : context->root->profiler;
+}
+
+void ClownLZSS_ProfileBegin(ClownLZSS_Context *context, ClownLZSS_Stage stage)
+{
+	const ClownLZSS_Profiler *context_profiler = GetProfiler(context);
+
+	if (context_profiler != NULL)
+		context_profiler->begin(stage, context_profiler->user);
+
+#if CLOWNLZSS_STATISTICS
+	if (context != NULL && context->root->statistics != NULL)
+		context->stage_starts[stage] = Timer_GetNanoseconds();
+#else
+	(void)context;
+#endif
+}
+
+void ClownLZSS_ProfileEnd(ClownLZSS_Context *context, ClownLZSS_Stage stage)
+{
+#if CLOWNLZSS_STATISTICS
+	if (context != NULL && context->root->statistics != NULL)
+	{
+		ClownLZSS_Statistics statistics;
+		ClownLZSS_StatisticsClear(&statistics);
+		statistics.stage_nanoseconds[stage] = Timer_GetNanoseconds() - context->stage_starts[stage];
+		ClownLZSS_ContextAddStatistics(context, &statistics);
+	}
+#else
+	(void)context;
+#endif
+
+	const ClownLZSS_Profiler *context_profiler = GetProfiler(context);
+
+	if (context_profiler != NULL)
+		context_profiler->end(stage, context_profiler->user);
+}
+
+void ClownLZSS_StatisticsClear(ClownLZSS_Statistics *statistics)
+{
+	memset(statistics, 0, sizeof(*statistics));
+}
+
+void ClownLZSS_StatisticsAdd(ClownLZSS_Statistics *statistics, const ClownLZSS_Statistics *other)
+{
+	statistics->nodes += other->nodes;
+	statistics->candidates += other->candidates;
+	statistics->comparisons += other->comparisons;
+	statistics->edges_relaxed += other->edges_relaxed;
+	statistics->edges_improved += other->edges_improved;
+
+	for (size_t i = 0; i < CLOWNLZSS_TOTAL_STAGES; ++i)
+		statistics->stage_nanoseconds[i] += other->stage_nanoseconds[i];
+
+	statistics->literals += other->literals;
+	statistics->matches += other->matches;
+	statistics->literal_bits += other->literal_bits;
+	statistics->match_bits += other->match_bits;
+
+	for (size_t i = 0; i < CLOWNLZSS_STATISTICS_BUCKETS; ++i)
+	{
+		statistics->match_lengths[i] += other->match_lengths[i];
+		statistics->match_distances[i] += other->match_distances[i];
+	}
+
+	statistics->output_reallocations += other->output_reallocations;
+	statistics->output_bytes_copied += other->output_bytes_copied;
+}
+
+/* The histogram bucket of a value: how many bits wide it is */
+static size_t GetBucket(size_t value)
+{
+	size_t bucket = 0;
+
+	for (; value != 0 && bucket != CLOWNLZSS_STATISTICS_BUCKETS - 1; value >>= 1)
+		++bucket;
+
+	return bucket;
+}
+
+void ClownLZSS_StatisticsAddLiterals(ClownLZSS_Statistics *statistics, size_t total_literals, unsigned int cost)
+{
+	statistics->literals += total_literals;
+	statistics->literal_bits += cost;
+}
+
+void ClownLZSS_StatisticsAddMatch(ClownLZSS_Statistics *statistics, size_t distance, size_t length, unsigned int cost)
+{
+	++statistics->matches;
+	statistics->match_bits += cost;
+	++statistics->match_lengths[GetBucket(length)];
+	++statistics->match_distances[GetBucket(distance)];
+}
+
+void ClownLZSS_StatisticsAddPathEdge(ClownLZSS_Statistics *statistics, const ClownLZSS_Graph *graph, size_t node, unsigned int cost)
+{
+	const size_t length = ClownLZSS_GraphGetLength(graph, node);
+
+	if (length == 0)
+	{
+		ClownLZSS_StatisticsAddLiterals(statistics, 1, cost);
+	}
+	else
+	{
+		/* Matches that point at or after their own start, like zero-fill, copy no earlier data */
+		const size_t start = node - length;
+		const size_t offset = graph->offsets[node & graph->mask];
+
+		ClownLZSS_StatisticsAddMatch(statistics, offset < start ? start - offset : 0, length, cost);
+	}
+}
+
+bool ClownLZSS_MatchBlockGrow(ClownLZSS_MatchBlock *block)
+{
+	const size_t new_capacity = block->matches_capacity == 0 ? 0x1000 : block->matches_capacity * 2;
+	ClownLZSS_Match *new_matches = (ClownLZSS_Match*)ClownLZSS_ContextReallocate(block->context, CLOWNLZSS_CONTEXT_MATCHES, block->matches, new_capacity * sizeof(ClownLZSS_Match));
+
+	if (new_matches == NULL)
+		return false;
+
+	block->matches = new_matches;
+	block->matches_capacity = new_capacity;
+
+	return true;
+}
+
+/* Blocks are handed out to the worker threads in order, and handed to the
+   relaxation stage in the same order. Only 'total_slots' blocks may be in
+   flight at once, so the workers wait for the relaxation stage to catch up
+   instead of using an unbounded amount of memory. Without any worker threads,
+   each block is simply found when the relaxation stage asks for it. */
+struct ClownLZSS_MatchPipeline
+{
+	ClownLZSS_MatchFinder finder;
+	void *user;
+	size_t first_position;
+	size_t end_position;
+	size_t block_size;
+	size_t total_blocks;
+	ClownLZSS_MatchBlock *slots;
+	bool *slot_ready;
+	size_t total_slots;
+	size_t next_block;	/* The next block for a worker to find the matches of */
+	size_t current_block;	/* The block that the relaxation stage is on */
+	bool quit;
+	Mutex *mutex;
+	ConditionVariable *condition_variable;
+	Thread **threads;
+	size_t total_threads;
+	size_t next_thread_index;
+	ClownLZSS_Context *context;
+};
+
+static void FindBlockMatches(ClownLZSS_MatchPipeline *pipeline, size_t block_index, size_t thread_index, ClownLZSS_MatchBlock *block)
+{
+	block->first_position = pipeline->first_position + block_index * pipeline->block_size;
+	block->end_position = CLOWNLZSS_MIN(block->first_position + pipeline->block_size, pipeline->end_position);
+	block->total_matches = 0;
+	block->out_of_memory = false;
+
+	pipeline->finder(block, thread_index, pipeline->user);
+}
+
+static void MatchPipelineWorker(void *user)
+{
+	ClownLZSS_MatchPipeline *pipeline = (ClownLZSS_MatchPipeline*)user;
+
+	Mutex_Lock(pipeline->mutex);
+
+	const size_t thread_index = pipeline->next_thread_index++;
+
+	for (;;)
+	{
+		while (!pipeline->quit && pipeline->next_block < pipeline->total_blocks && pipeline->next_block >= pipeline->current_block + pipeline->total_slots)
+			ConditionVariable_Wait(pipeline->condition_variable, pipeline->mutex);
+
+		if (pipeline->quit || pipeline->next_block >= pipeline->total_blocks)
+			break;
+
+		const size_t block_index = pipeline->next_block++;
+		const size_t slot = block_index % pipeline->total_slots;
+
+		Mutex_Unlock(pipeline->mutex);
+
+		FindBlockMatches(pipeline, block_index, thread_index, &pipeline->slots[slot]);
+
+		Mutex_Lock(pipeline->mutex);
+
+		pipeline->slot_ready[slot] = true;
+		ConditionVariable_Broadcast(pipeline->condition_variable);
+	}
+
+	Mutex_Unlock(pipeline->mutex);
+}
+
+bool ClownLZSS_MatchPipelineIsSerial(size_t first_position, size_t end_position, size_t block_size, size_t total_threads)
+{
+	/* With only one block, there is nothing for the relaxation stage to do while the matches are being found */
+	return total_threads <= 1 || end_position - first_position <= block_size;
+}
+
+/* Up to 'total_threads' worker threads are used. With only one, the finder is
+   called by the thread that calls ClownLZSS_MatchPipelineGetBlock instead. */
+ClownLZSS_MatchPipeline* ClownLZSS_MatchPipelineCreate(size_t first_position, size_t end_position, size_t block_size, size_t total_threads, ClownLZSS_MatchFinder finder, void *user, ClownLZSS_Context *context)
+{
+	ClownLZSS_MatchPipeline *pipeline = (ClownLZSS_MatchPipeline*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_MATCH_PIPELINE, sizeof(ClownLZSS_MatchPipeline));
+
+	if (pipeline == NULL)
+		return NULL;
+
+	pipeline->finder = finder;
+	pipeline->user = user;
+	pipeline->first_position = first_position;
+	pipeline->end_position = end_position;
+	pipeline->block_size = block_size;
+	pipeline->total_blocks = (end_position - first_position + block_size - 1) / block_size;
+	pipeline->next_block = 0;
+	pipeline->current_block = 0;
+	pipeline->quit = false;
+	pipeline->mutex = NULL;
+	pipeline->condition_variable = NULL;
+	pipeline->threads = NULL;
+	pipeline->total_threads = 0;
+	pipeline->next_thread_index = 0;
+	pipeline->context = context;
+
+	if (ClownLZSS_MatchPipelineIsSerial(first_position, end_position, block_size, total_threads))
+		total_threads = 0;
+	else
+		total_threads = CLOWNLZSS_MIN(total_threads, pipeline->total_blocks);
+
+	if (total_threads != 0)
+	{
+		pipeline->mutex = Mutex_Create();
+		pipeline->condition_variable = ConditionVariable_Create();
+		pipeline->threads = (Thread**)ClownLZSS_Allocate(ClownLZSS_ContextGetAllocator(context), total_threads * sizeof(Thread*));
+
+		if (pipeline->mutex == NULL || pipeline->condition_variable == NULL || pipeline->threads == NULL)
+			total_threads = 0;
+	}
+
+	pipeline->total_slots = total_threads == 0 ? 1 : total_threads * 2;
+	pipeline->slots = (ClownLZSS_MatchBlock*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_MATCH_SLOTS, pipeline->total_slots * sizeof(ClownLZSS_MatchBlock));
+	pipeline->slot_ready = (bool*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_MATCH_SLOT_READY, pipeline->total_slots * sizeof(bool));
+
+	if (pipeline->slots == NULL || pipeline->slot_ready == NULL)
+	{
+		pipeline->total_slots = 0;
+		ClownLZSS_MatchPipelineDestroy(pipeline);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < pipeline->total_slots; ++i)
+	{
+		/* Without worker threads, there is only one slot, so it can have the context's buffers to itself */
+		pipeline->slots[i].match_ends = (size_t*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_MATCH_ENDS, block_size * sizeof(size_t));
+		pipeline->slots[i].matches = NULL;
+		pipeline->slots[i].matches_capacity = 0;
+		pipeline->slots[i].context = context;
+		pipeline->slot_ready[i] = false;
+
+		if (pipeline->slots[i].match_ends == NULL)
+		{
+			pipeline->total_slots = i + 1;
+			ClownLZSS_MatchPipelineDestroy(pipeline);
+			return NULL;
+		}
+	}
+
+	/* If some of the threads cannot be created, then the rest will simply do more of the work */
+	for (size_t i = 0; i < total_threads; ++i)
+	{
+		pipeline->threads[pipeline->total_threads] = Thread_Create(MatchPipelineWorker, pipeline);
+
+		if (pipeline->threads[pipeline->total_threads] != NULL)
+			++pipeline->total_threads;
+	}
+
+	return pipeline;
+}
+
+void ClownLZSS_MatchPipelineDestroy(ClownLZSS_MatchPipeline *pipeline)
+{
+	if (pipeline->total_threads != 0)
+	{
+		Mutex_Lock(pipeline->mutex);
+		pipeline->quit = true;
+		ConditionVariable_Broadcast(pipeline->condition_variable);
+		Mutex_Unlock(pipeline->mutex);
+
+		for (size_t i = 0; i < pipeline->total_threads; ++i)
+			Thread_Join(pipeline->threads[i]);
+	}
+
+	for (size_t i = 0; i < pipeline->total_slots; ++i)
+	{
+		ClownLZSS_ContextFree(pipeline->context, pipeline->slots[i].matches);
+		ClownLZSS_ContextFree(pipeline->context, pipeline->slots[i].match_ends);
+	}
+
+	ClownLZSS_ContextFree(pipeline->context, pipeline->slot_ready);
+	ClownLZSS_ContextFree(pipeline->context, pipeline->slots);
+	ClownLZSS_Free(ClownLZSS_ContextGetAllocator(pipeline->context), pipeline->threads);
+
+	if (pipeline->condition_variable != NULL)
+		ConditionVariable_Destroy(pipeline->condition_variable);
+
+	if (pipeline->mutex != NULL)
+		Mutex_Destroy(pipeline->mutex);
+
+	ClownLZSS_ContextFree(pipeline->context, pipeline);
+}
+
+/* Waits for the matches of the next block to be found */
+const ClownLZSS_MatchBlock* ClownLZSS_MatchPipelineGetBlock(ClownLZSS_MatchPipeline *pipeline)
+{
+	const size_t slot = pipeline->current_block % pipeline->total_slots;
+
+	if (pipeline->total_threads == 0)
+	{
+		FindBlockMatches(pipeline, pipeline->current_block, 0, &pipeline->slots[slot]);
+	}
+	else
+	{
+		Mutex_Lock(pipeline->mutex);
+
+		while (!pipeline->slot_ready[slot])
+			ConditionVariable_Wait(pipeline->condition_variable, pipeline->mutex);
+
+		Mutex_Unlock(pipeline->mutex);
+	}
+
+	return &pipeline->slots[slot];
+}
+
+/* Lets the block returned by ClownLZSS_MatchPipelineGetBlock be reused */
+void ClownLZSS_MatchPipelineReleaseBlock(ClownLZSS_MatchPipeline *pipeline)
+{
+	if (pipeline->total_threads == 0)
+	{
+		++pipeline->current_block;
+	}
+	else
+	{
+		Mutex_Lock(pipeline->mutex);
+
+		pipeline->slot_ready[pipeline->current_block % pipeline->total_slots] = false;
+		++pipeline->current_block;
+		ConditionVariable_Broadcast(pipeline->condition_variable);
+
+		Mutex_Unlock(pipeline->mutex);
+	}
+}
+
+/* Parses segments of the input on separate threads, and joins them together afterwards */
+void ClownLZSS_SetParallelParse(bool enabled)
+{
+	parallel_parse = enabled;
+}
+
+bool ClownLZSS_GetParallelParse(void)
+{
+	return parallel_parse;
+}
+
+void ClownLZSS_ContextSetParallelParse(ClownLZSS_Context *context, bool enabled)
+{
+	context->root->parallel_parse = enabled;
+}
+
+bool ClownLZSS_ContextGetParallelParse(const ClownLZSS_Context *context)
+{
+	return context == NULL ? parallel_parse : context->root->parallel_parse;
+}
+
+typedef struct ParallelJob
+{
+	void (*function)(void *item);
+	unsigned char *items;
+	size_t item_size;
+	size_t total_items;
+	size_t next_item;
+	Mutex *mutex;	/* NULL if there is only one thread */
+} ParallelJob;
+
+static void ParallelWorker(void *user)
+{
+	ParallelJob *job = (ParallelJob*)user;
+
+	for (;;)
+	{
+		if (job->mutex != NULL)
+			Mutex_Lock(job->mutex);
+
+		const size_t item = job->next_item++;
+
+		if (job->mutex != NULL)
+			Mutex_Unlock(job->mutex);
+
+		if (item >= job->total_items)
+			break;
+
+		job->function(job->items + item * job->item_size);
+	}
+}
+
+/* Calls 'function' on each item using up to 'total_threads' threads, one of
+   which is the calling thread. The items are started in order, but may finish
+   in any order. */
+void ClownLZSS_RunInParallel(void (*function)(void *item), void *items, size_t item_size, size_t total_items, size_t total_threads)
+{
+	ParallelJob job;
+	job.function = function;
+	job.items = (unsigned char*)items;
+	job.item_size = item_size;
+	job.total_items = total_items;
+	job.next_item = 0;
+	job.mutex = NULL;
+
+	total_threads = CLOWNLZSS_MIN(total_threads, total_items);
+	Thread **threads = NULL;
+	size_t total_created_threads = 0;
+
+	if (total_threads > 1)
+	{
+		job.mutex = Mutex_Create();
+		threads = (Thread**)malloc((total_threads - 1) * sizeof(Thread*));
+
+		/* If the threads cannot be created, then the calling thread does everything */
+		if (job.mutex != NULL && threads != NULL)
+		{
+			for (size_t i = 0; i < total_threads - 1; ++i)
+			{
+				threads[total_created_threads] = Thread_Create(ParallelWorker, &job);
+
+				if (threads[total_created_threads] != NULL)
+					++total_created_threads;
+			}
+		}
+	}
+
+	ParallelWorker(&job);
+
+	for (size_t i = 0; i < total_created_threads; ++i)
+		Thread_Join(threads[i]);
+
+	free(threads);
+
+	if (job.mutex != NULL)
+		Mutex_Destroy(job.mutex);
+}
+
+static void AddPathEdge(ClownLZSS_Path *path, size_t length, size_t offset)
+{
+	if (path->total_edges == path->capacity)
+	{
+		const size_t new_capacity = path->capacity == 0 ? 0x1000 : path->capacity * 2;
+		ClownLZSS_PathEdge *new_edges = (ClownLZSS_PathEdge*)ClownLZSS_Reallocate(path->allocator, path->edges, new_capacity * sizeof(ClownLZSS_PathEdge));
+
+		if (new_edges == NULL)
+		{
+			path->out_of_memory = true;
+			return;
+		}
+
+		path->edges = new_edges;
+		path->capacity = new_capacity;
+	}
+
+	path->edges[path->total_edges].length = (unsigned int)length;
+	path->edges[path->total_edges].offset = (unsigned int)offset;
+	++path->total_edges;
+
+	path->end_node += length == 0 ? 1 : length;
+}
+
+void ClownLZSS_PathInit(ClownLZSS_Path *path, size_t start_node, const ClownLZSS_Allocator *allocator)
+{
+	path->start_node = start_node;
+	path->end_node = start_node;
+	path->edges = NULL;
+	path->total_edges = 0;
+	path->capacity = 0;
+	path->out_of_memory = false;
+	path->allocator = allocator;
+}
+
+void ClownLZSS_PathDeinit(ClownLZSS_Path *path)
+{
+	ClownLZSS_Free(path->allocator, path->edges);
+}
+
+void ClownLZSS_PathAddLiteral(unsigned int value, void *user)
+{
+	(void)value;
+
+	AddPathEdge((ClownLZSS_Path*)user, 0, 0);
+}
+
+void ClownLZSS_PathAddMatch(size_t distance, size_t length, size_t offset, void *user)
+{
+	(void)distance;
+
+	AddPathEdge((ClownLZSS_Path*)user, length, offset);
+}
+
+static size_t GetPathEdgeLength(const ClownLZSS_PathEdge *edge)
+{
+	return edge->length == 0 ? 1 : edge->length;
+}
+
+/* Finds the first node after 'b' starts, and no later than 'last_node', that both paths pass through */
+size_t ClownLZSS_PathFindCommonNode(const ClownLZSS_Path *a, const ClownLZSS_Path *b, size_t last_node)
+{
+	size_t a_node = a->start_node;
+	size_t b_node = b->start_node;
+	size_t a_edge = 0;
+	size_t b_edge = 0;
+
+	while (b_node <= last_node)
+	{
+		if (a_node == b_node)
+			return a_node;
+		else if (a_node < b_node && a_edge < a->total_edges)
+			a_node += GetPathEdgeLength(&a->edges[a_edge++]);
+		else if (b_node < a_node && b_edge < b->total_edges)
+			b_node += GetPathEdgeLength(&b->edges[b_edge++]);
+		else
+			break;
+	}
+
+	return (size_t)-1;
+}
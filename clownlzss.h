@@ -20,96 +20,1554 @@
 
 #pragma once
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
 #include <limits.h>
 #include <stddef.h>
 #include <stdlib.h>
 
-#define CLOWNLZSS_MIN(a, b) (a) < (b) ? (a) : (b)
-#define CLOWNLZSS_MAX(a, b) (a) > (b) ? (a) : (b)
+#define CLOWNLZSS_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define CLOWNLZSS_MAX(a, b) ((a) > (b) ? (a) : (b))
 
-typedef struct ClownLZSS_GraphEdge
+/* Where the library gets its memory from. Each function is given 'user', and
+   they behave like malloc, realloc, and free. */
+typedef struct ClownLZSS_Allocator
 {
-	union
+	void* (*allocate)(size_t size, void *user);
+	void* (*reallocate)(void *memory, size_t size, void *user);
+	void (*free)(void *memory, void *user);
+	void *user;
+} ClownLZSS_Allocator;
+
+/* These use malloc, realloc, and free if 'allocator' is NULL */
+void* ClownLZSS_Allocate(const ClownLZSS_Allocator *allocator, size_t size);
+void* ClownLZSS_Reallocate(const ClownLZSS_Allocator *allocator, void *memory, size_t size);
+void ClownLZSS_Free(const ClownLZSS_Allocator *allocator, void *memory);
+
+/* Hands out memory from one block that the caller supplies, each allocation
+   straight after the one before it, and takes all of it back at once when it is
+   reset. Only the most recent allocation can be freed or grown in place; the
+   others are only given back by the reset. Give 'allocator' to one context (or
+   to ClownLZSS_ContextInitWithAllocator), and reset the arena once that context
+   has been deinitialised: a job that needs more memory than the block holds
+   fails instead of taking memory from the rest of the program. */
+typedef struct ClownLZSS_Arena
+{
+	ClownLZSS_Allocator allocator;
+	unsigned char *memory;
+	size_t size;
+	size_t used;
+	size_t last_allocation;	/* Where the most recent allocation starts */
+} ClownLZSS_Arena;
+
+void ClownLZSS_ArenaInit(ClownLZSS_Arena *arena, void *memory, size_t size);
+void ClownLZSS_ArenaReset(ClownLZSS_Arena *arena);
+
+/* The stages that a call goes through, as reported to the profiler (see
+   ClownLZSS_SetProfiler) and timed by the statistics */
+typedef enum ClownLZSS_Stage
+{
+	CLOWNLZSS_STAGE_RUN_LENGTHS,	/* Measuring the runs of the same value */
+	CLOWNLZSS_STAGE_SUFFIX_ARRAY,	/* Sorting the suffixes of a large input */
+	CLOWNLZSS_STAGE_MATCH_FINDING,	/* Finding the matches of a block, or waiting for the worker threads to */
+	CLOWNLZSS_STAGE_GRAPH,	/* Adding the matches of a block to the graph */
+	CLOWNLZSS_STAGE_PATH_REVERSAL,	/* Following the cheapest path backwards, so it can be output */
+	CLOWNLZSS_STAGE_EMISSION,	/* Passing the path's literals and matches to the format */
+	CLOWNLZSS_STAGE_FAST_PARSE,	/* The greedy parse of the faster levels, which emits as it goes */
+	CLOWNLZSS_STAGE_MODULE,	/* Compressing one module of a moduled call, with the stages above inside it */
+	CLOWNLZSS_TOTAL_STAGES
+} ClownLZSS_Stage;
+
+/* Define this as 1 to have the compressors count what they do into the
+   statistics given to ClownLZSS_ContextSetStatistics. Counting slows the inner
+   loops down, so otherwise, the code that does it is compiled out entirely. */
+#ifndef CLOWNLZSS_STATISTICS
+#define CLOWNLZSS_STATISTICS 0
+#endif
+
+/* Code that only exists when the statistics are counted, semicolons and all */
+#if CLOWNLZSS_STATISTICS
+#define CLOWNLZSS_COUNT(...) __VA_ARGS__
+#else
+#define CLOWNLZSS_COUNT(...)
+#endif
+
+/* Enough for every value up to 32 bits wide, and 0 */
+#define CLOWNLZSS_STATISTICS_BUCKETS 33
+
+/* What a call did, for finding out why an input takes a long time to compress,
+   or compresses badly. The levels below the maximum do not build the graph, so
+   they relax no edges, and only search the first few candidates of each position.
+   The bits of each kind of token are what the format's costs say they are,
+   including their descriptor bits, except that the parallel parse takes the
+   cost of a match from its length and distance, as if it were an ordinary one. */
+typedef struct ClownLZSS_Statistics
+{
+	unsigned long long nodes;	/* Positions that were searched for matches */
+	unsigned long long candidates;	/* Earlier positions that they were compared against */
+	unsigned long long comparisons;	/* Values that were compared to measure those matches */
+	unsigned long long edges_relaxed;	/* Matches and literals that were tried as edges of the graph */
+	unsigned long long edges_improved;	/* The ones that made a cheaper path to the node that they end at */
+	unsigned long long stage_nanoseconds[CLOWNLZSS_TOTAL_STAGES];	/* Including the stages inside them, and added up over every thread */
+	unsigned long long literals;	/* Of the path that was output */
+	unsigned long long matches;
+	unsigned long long literal_bits;
+	unsigned long long match_bits;
+	unsigned long long match_lengths[CLOWNLZSS_STATISTICS_BUCKETS];	/* Bucket N counts the values that are N bits wide */
+	unsigned long long match_distances[CLOWNLZSS_STATISTICS_BUCKETS];	/* Matches that copy no earlier data, like zero-fill, are in bucket 0 */
+	unsigned long long output_reallocations;	/* How often the buffer of the compressed data had to grow */
+	unsigned long long output_bytes_copied;	/* How much had to be moved to do so */
+} ClownLZSS_Statistics;
+
+void ClownLZSS_StatisticsClear(ClownLZSS_Statistics *statistics);
+void ClownLZSS_StatisticsAdd(ClownLZSS_Statistics *statistics, const ClownLZSS_Statistics *other);
+void ClownLZSS_StatisticsAddLiterals(ClownLZSS_Statistics *statistics, size_t total_literals, unsigned int cost);
+/* 'distance' is 0 for matches that copy no earlier data */
+void ClownLZSS_StatisticsAddMatch(ClownLZSS_Statistics *statistics, size_t distance, size_t length, unsigned int cost);
+
+/* Memory that is kept between calls to the compression functions, so that
+   compressing many inputs one after another stops allocating once the buffers
+   are large enough for them. Each part of a call that needs memory is given its
+   own buffer, which only ever grows, and is freed by ClownLZSS_ContextDeinit.
+   A context may only be used by one call at a time, and only by the thread that
+   makes it: the worker threads of a call are given contexts of their own with
+   ClownLZSS_ContextInitWorker and ClownLZSS_ContextInitShared, which get their
+   memory from the same allocator, and count it towards the same peak.
+   Every function that takes a context also accepts NULL, in which case it
+   allocates and frees its memory itself with malloc. */
+typedef enum ClownLZSS_ContextBuffer
+{
+	CLOWNLZSS_CONTEXT_RUN_LENGTHS,
+	CLOWNLZSS_CONTEXT_SUFFIX_ARRAY_RANKS,
+	CLOWNLZSS_CONTEXT_SUFFIX_ARRAY_LCP_TREE,
+	CLOWNLZSS_CONTEXT_POSITION_TREES,
+	CLOWNLZSS_CONTEXT_POSITION_TREE,
+	CLOWNLZSS_CONTEXT_HASH_HEADS,
+	CLOWNLZSS_CONTEXT_HASH_CHAIN,
+	CLOWNLZSS_CONTEXT_GRAPH_COSTS,
+	CLOWNLZSS_CONTEXT_GRAPH_LENGTHS,
+	CLOWNLZSS_CONTEXT_GRAPH_OFFSETS,
+	CLOWNLZSS_CONTEXT_MATCH_PIPELINE,
+	CLOWNLZSS_CONTEXT_MATCH_SLOTS,
+	CLOWNLZSS_CONTEXT_MATCH_SLOT_READY,
+	CLOWNLZSS_CONTEXT_MATCH_ENDS,
+	CLOWNLZSS_CONTEXT_MATCHES,
+	CLOWNLZSS_CONTEXT_FORMAT_0,	/* For the formats' own use */
+	CLOWNLZSS_CONTEXT_FORMAT_1,
+	CLOWNLZSS_CONTEXT_FORMAT_2,
+	CLOWNLZSS_CONTEXT_FORMAT_3,
+	CLOWNLZSS_CONTEXT_FORMAT_4,
+	CLOWNLZSS_CONTEXT_OUTPUT,	/* Compressed data that is held until it is complete */
+	CLOWNLZSS_CONTEXT_TOTAL_BUFFERS
+} ClownLZSS_ContextBuffer;
+
+typedef struct ClownLZSS_Context
+{
+	struct
+	{
+		void *memory;
+		size_t size;
+	} buffers[CLOWNLZSS_CONTEXT_TOTAL_BUFFERS];
+	bool keep_buffers;	/* False for shared contexts, and the ones that calls without a context make, which allocate afresh every time */
+	const ClownLZSS_Allocator *allocator;	/* The caller's allocator, or NULL for malloc */
+	ClownLZSS_Allocator tracked;	/* Passes everything on to 'allocator', while counting how much is in use */
+	struct ClownLZSS_Context *root;	/* The context of the call, which does the counting for its workers */
+	struct Mutex *mutex;	/* Only the root's is used */
+	size_t bytes_in_use;
+	size_t peak_bytes;
+	bool out_of_memory;
+	ClownLZSS_Statistics *statistics;	/* Only the root's is used */
+	struct ClownLZSS_Cache *cache;	/* Only the root's is used */
+	bool cached;	/* Whether the last call's output came from the cache */
+	size_t thread_count;	/* These three are only the root's used, and start out as the defaults (see ClownLZSS_SetThreadCount) */
+	bool parallel_parse;
+	const struct ClownLZSS_Profiler *profiler;
+	unsigned long long stage_starts[CLOWNLZSS_TOTAL_STAGES];	/* When each stage that this context's thread is in began */
+} ClownLZSS_Context;
+
+/* These fail if the context's mutex cannot be created. 'allocator' may be NULL,
+   and otherwise must outlive the context. The context must not be moved or copied. */
+bool ClownLZSS_ContextInit(ClownLZSS_Context *context);
+bool ClownLZSS_ContextInitWithAllocator(ClownLZSS_Context *context, const ClownLZSS_Allocator *allocator);
+/* A context with buffers of its own for a worker thread of the call that 'parent'
+   is being used for. It needs no mutex, so it cannot fail. 'parent' may be NULL,
+   in which case the worker is a context of its own that only it may use. */
+void ClownLZSS_ContextInitWorker(ClownLZSS_Context *context, ClownLZSS_Context *parent);
+/* A context that keeps no buffers, so that any number of the worker threads of
+   the call that 'parent' is being used for can allocate through it at once. It
+   needs no deinitialising. Returns NULL if 'parent' is NULL, so that the workers
+   fall back on malloc too. */
+ClownLZSS_Context* ClownLZSS_ContextInitShared(ClownLZSS_Context *context, ClownLZSS_Context *parent);
+void ClownLZSS_ContextDeinit(ClownLZSS_Context *context);
+/* What allocations that do not go in a buffer should use: it counts them
+   towards the peak, and is safe to use from the call's worker threads. */
+const ClownLZSS_Allocator* ClownLZSS_ContextGetAllocator(ClownLZSS_Context *context);
+/* The compressors call this at the start of each call, so that the two below only describe that call */
+void ClownLZSS_ContextBeginCall(ClownLZSS_Context *context);
+/* The most memory that the context and the workers of its call held at once, including the buffers that it kept from earlier calls */
+size_t ClownLZSS_ContextGetPeakBytes(const ClownLZSS_Context *context);
+/* Whether an allocation failed, in which case the output is incomplete */
+bool ClownLZSS_ContextHasRunOutOfMemory(const ClownLZSS_Context *context);
+/* Makes each call that the context is used for count what it does into
+   'statistics', which the call clears first, until this is given NULL.
+   Nothing is counted unless CLOWNLZSS_STATISTICS is 1. */
+void ClownLZSS_ContextSetStatistics(ClownLZSS_Context *context, ClownLZSS_Statistics *statistics);
+/* Adds to the statistics of the call, if it has any. Like the allocator, this
+   is safe to use from the call's worker threads. */
+void ClownLZSS_ContextAddStatistics(ClownLZSS_Context *context, const ClownLZSS_Statistics *statistics);
+/* Makes each call that the context is used for look its output up in 'cache',
+   and add it there if it was not found, until this is given NULL */
+void ClownLZSS_ContextSetCache(ClownLZSS_Context *context, struct ClownLZSS_Cache *cache);
+/* Returns NULL if 'context' is NULL */
+struct ClownLZSS_Cache* ClownLZSS_ContextGetCache(ClownLZSS_Context *context);
+/* Whether the last call read its output from the cache, instead of compressing */
+bool ClownLZSS_ContextWasCached(const ClownLZSS_Context *context);
+/* Returns at least 'size' bytes of the buffer, whose contents are undefined */
+void* ClownLZSS_ContextAllocate(ClownLZSS_Context *context, ClownLZSS_ContextBuffer buffer, size_t size);
+/* Like ClownLZSS_ContextAllocate, but keeps the contents. 'memory' is what the buffer
+   last returned, or NULL if it has not been used yet in this call. */
+void* ClownLZSS_ContextReallocate(ClownLZSS_Context *context, ClownLZSS_ContextBuffer buffer, void *memory, size_t size);
+/* Only frees 'memory' if the context does not keep its buffers, as it belongs to the context otherwise */
+void ClownLZSS_ContextFree(ClownLZSS_Context *context, void *memory);
+/* Frees the buffer, and replaces it with 'memory', which must have been allocated with ClownLZSS_ContextGetAllocator.
+   If the context does not keep its buffers, 'memory' is freed instead. */
+void ClownLZSS_ContextReplace(ClownLZSS_Context *context, ClownLZSS_ContextBuffer buffer, void *memory, size_t size);
+
+/* Compressed data that is kept on disk, so that compressing the same input the
+   same way again, even in another run of the program, only has to read it back.
+   The entries are named after a hash of the input, the format and its options,
+   the level, the module size, and CLOWNLZSS_CACHE_VERSION. Each is written to a
+   file of its own and renamed into place, so any number of threads and processes
+   can share a directory without ever reading a half-written entry. Once this
+   process has seen the directory grow past 'maximum_size', the entries that were
+   used least recently are deleted, until it is well under it again. Only calls
+   that are given a context with a cache use it (see ClownLZSS_ContextSetCache).
+   This is only public so that caches can live on the stack: use the functions
+   below instead of the fields. */
+typedef struct ClownLZSS_Cache
+{
+	char *directory;
+	unsigned long long maximum_size;
+	unsigned long long size;	/* Of the whole directory as of when it was last measured, plus what this process has added since */
+	unsigned long total_temporary_files;	/* Makes the names of this process's temporary files unique */
+	struct Mutex *mutex;
+} ClownLZSS_Cache;
+
+/* Changed whenever a change to a compressor changes what it outputs, so that the
+   entries made by older versions are no longer used, and are evicted in time */
+#define CLOWNLZSS_CACHE_VERSION 1
+
+/* Creates the directory if it does not exist. Fails if it cannot be created, or the mutex cannot. */
+bool ClownLZSS_CacheInit(ClownLZSS_Cache *cache, const char *directory, unsigned long long maximum_size);
+void ClownLZSS_CacheDeinit(ClownLZSS_Cache *cache);
+
+/* One of the ways that a format can encode a match: every match that is no
+   further away than 'maximum_distance', and whose length is in the range, can
+   be encoded in 'cost' bits */
+typedef struct ClownLZSS_MatchEncoding
+{
+	size_t maximum_distance;
+	size_t minimum_length;
+	size_t maximum_length;
+	unsigned int cost;
+} ClownLZSS_MatchEncoding;
+
+/* Describes a format to the compression engine. Each format defines one of these
+   as a static const object, so the engine's loops are specialised for it when they
+   are compiled: lengths that the format cannot encode are never visited, and the
+   cost of each match is looked up in a table instead of being computed.
+   Formats whose costs cannot be listed as encodings set 'match_encodings' to
+   NULL, and provide 'get_match_cost' instead, which returns 0 for matches that
+   cannot be encoded. */
+typedef struct ClownLZSS_Format
+{
+	size_t minimum_match_length;	/* The shortest match that can be cheaper than encoding its values as literals */
+	size_t maximum_match_length;
+	size_t maximum_match_distance;
+	unsigned int literal_cost;
+	const ClownLZSS_MatchEncoding *match_encodings;
+	size_t total_match_encodings;
+	unsigned int (*get_match_cost)(size_t distance, size_t length, void *user);
+} ClownLZSS_Format;
+
+/* The cheapest cost of every length of match, for each of the distances that the
+   format's encodings stop at. A match uses the first tier that it is close enough
+   for. Each tier can only use the encodings of the tiers after it, so matches
+   never get cheaper by getting further away. Within a tier, the costs are stored
+   as runs of lengths that all cost the same, in ascending order, leaving out the
+   lengths that cannot be encoded at all. */
+#define CLOWNLZSS_MAX_DISTANCE_TIERS 8
+#define CLOWNLZSS_MAX_COST_RUNS 8
+
+typedef struct ClownLZSS_CostRun
+{
+	size_t minimum_length;
+	size_t maximum_length;
+	unsigned int cost;
+} ClownLZSS_CostRun;
+
+typedef struct ClownLZSS_CostTable
+{
+	size_t total_tiers;
+	size_t maximum_distances[CLOWNLZSS_MAX_DISTANCE_TIERS];
+	size_t total_runs[CLOWNLZSS_MAX_DISTANCE_TIERS];
+	ClownLZSS_CostRun runs[CLOWNLZSS_MAX_DISTANCE_TIERS][CLOWNLZSS_MAX_COST_RUNS];
+} ClownLZSS_CostTable;
+
+/* Fails if the format has more tiers or runs than the table has room for */
+bool ClownLZSS_CostTableInit(ClownLZSS_CostTable *cost_table, const ClownLZSS_Format *format);
+
+/* For use by FIND_EXTRA_MATCHES: returns 0 if the format cannot encode the match */
+unsigned int ClownLZSS_GetMatchCost(const ClownLZSS_Format *format, size_t distance, size_t length, void *user);
+
+/* The LZSS graph, stored as separate arrays so that the costs, which are
+   accessed far more than anything else, are packed tightly together.
+   Each node is the position in the input that the edge leading to it ends
+   at: the edge's start is the node minus its length, or minus 1 for literals.
+   Node indices and offsets are 32-bit, so inputs must be smaller than 4 GiB.
+
+   The arrays are ring buffers: once every path that is still being considered
+   passes through the same node, everything before that node is output and its
+   space is reused. This usually keeps the graph not much larger than the
+   longest match, no matter how large the input is. */
+typedef struct ClownLZSS_Graph
+{
+	unsigned int *costs;	/* Nodes that have been output hold the distance to the next node on the cheapest path instead */
+	void *lengths;	/* 0 for literals. Each is 'length_size' bytes wide: as narrow as the longest possible match allows */
+	unsigned int *offsets;
+	size_t length_size;
+	size_t mask;	/* Node N is stored at index (N & mask) */
+	size_t first_node;	/* The nodes before this one have been output */
+	size_t end_node;	/* The nodes from this one onwards have not been reached yet */
+	ClownLZSS_Context *context;
+} ClownLZSS_Graph;
+
+bool ClownLZSS_GraphInit(ClownLZSS_Graph *graph, size_t first_node, size_t total_nodes, size_t max_match_length, ClownLZSS_Context *context);
+void ClownLZSS_GraphDeinit(ClownLZSS_Graph *graph);
+bool ClownLZSS_GraphExtend(ClownLZSS_Graph *graph, size_t end_node);
+size_t ClownLZSS_GraphFindConvergence(const ClownLZSS_Graph *graph, size_t settled_node);
+
+static inline size_t ClownLZSS_GraphGetLength(const ClownLZSS_Graph *graph, size_t node)
+{
+	switch (graph->length_size)
+	{
+		case 1:
+			return ((const unsigned char*)graph->lengths)[node & graph->mask];
+
+		case 2:
+			return ((const unsigned short*)graph->lengths)[node & graph->mask];
+
+		default:
+			return ((const unsigned int*)graph->lengths)[node & graph->mask];
+	}
+}
+
+static inline void ClownLZSS_GraphSetLength(ClownLZSS_Graph *graph, size_t node, size_t length)
+{
+	switch (graph->length_size)
+	{
+		case 1:
+			((unsigned char*)graph->lengths)[node & graph->mask] = (unsigned char)length;
+			break;
+
+		case 2:
+			((unsigned short*)graph->lengths)[node & graph->mask] = (unsigned short)length;
+			break;
+
+		default:
+			((unsigned int*)graph->lengths)[node & graph->mask] = (unsigned int)length;
+			break;
+	}
+}
+
+/* Positions are checked for a point where all paths converge this often, or
+   less often if matches are long enough that the check would be wasteful.
+   Each check walks the paths back to where they converge, so if they have not
+   converged for a while, as in long runs where every node has its own path,
+   the next check waits for as many positions as are still waiting to be output. */
+#ifndef CLOWNLZSS_CONVERGENCE_INTERVAL
+#define CLOWNLZSS_CONVERGENCE_INTERVAL 0x1000
+#endif
+
+/* Define this as 1 to make the compressors check every position in the
+   window for matches, instead of only the ones found by the hash chains.
+   This is far slower, but produces the exact same output, so it serves as
+   a reference for the faster search. */
+#ifndef CLOWNLZSS_BRUTE_FORCE
+#define CLOWNLZSS_BRUTE_FORCE 0
+#endif
+
+#define CLOWNLZSS_HASH_MAX_BITS 16
+
+/* The suffix array match-finder: the suffixes of the whole input are sorted,
+   and the positions in the window are tracked by their rank, in a position tree.
+   The suffixes that share a prefix of a given length always form a contiguous
+   range of ranks, so the nearest occurrence of each match length can be found
+   in logarithmic time, no matter how repetitive the data is.
+   The suffix array itself is never modified once it is built, so it can be
+   searched by several threads at once, as long as each has its own position tree. */
+typedef struct ClownLZSS_SuffixArray
+{
+	size_t length;
+	size_t total_leaves;
+	unsigned int *ranks;
+	unsigned int *lcp_tree;	/* Minimum-tree of the longest common prefix of each suffix and the one before it */
+	ClownLZSS_Context *context;
+} ClownLZSS_SuffixArray;
+
+bool ClownLZSS_SuffixArrayInit(ClownLZSS_SuffixArray *suffix_array, const void *data, size_t element_size, size_t length, ClownLZSS_Context *context);
+void ClownLZSS_SuffixArrayDeinit(ClownLZSS_SuffixArray *suffix_array);
+unsigned int* ClownLZSS_SuffixArrayCreatePositionTree(const ClownLZSS_SuffixArray *suffix_array, ClownLZSS_Context *context);	/* Maximum-tree of the (position + 1) of each suffix that has been inserted */
+size_t ClownLZSS_SuffixArrayFindMatch(const ClownLZSS_SuffixArray *suffix_array, const unsigned int *position_tree, size_t position, size_t minimum_length, size_t oldest_position, size_t *match_length);
+void ClownLZSS_SuffixArrayInsert(const ClownLZSS_SuffixArray *suffix_array, unsigned int *position_tree, size_t position);
+void ClownLZSS_SuffixArrayClear(const ClownLZSS_SuffixArray *suffix_array, unsigned int *position_tree, size_t position);
+
+/* The run-length index: how many values in a row, starting at each position,
+   are the same as the one there. Long runs of one value, such as blank tiles,
+   are everywhere in game data, and finding the matches in them one value at a
+   time is the search's worst case. The index is built once for the whole
+   input and is then only read, so it is shared by every thread, and is passed
+   to FIND_EXTRA_MATCHES too. It is freed with ClownLZSS_ContextFree. */
+unsigned int* ClownLZSS_RunLengthsCreate(const void *data, size_t element_size, size_t length, ClownLZSS_Context *context);
+
+/* Returns how many leading bytes 'a' and 'b' have in common, up to 'maximum' */
+typedef size_t (*ClownLZSS_MatchLengthFunction)(const void *a, const void *b, size_t maximum);
+
+/* Picks the fastest match-length kernel that this CPU supports */
+ClownLZSS_MatchLengthFunction ClownLZSS_GetMatchLengthFunction(void);
+
+/* Formats whose longest match is shorter than this many bytes compare one
+   value at a time instead, as the call to the kernel would cost more than it saves */
+#ifndef CLOWNLZSS_MATCH_LENGTH_KERNEL_THRESHOLD
+#define CLOWNLZSS_MATCH_LENGTH_KERNEL_THRESHOLD 0x20
+#endif
+
+/* Inputs at least this large are searched with the suffix array instead of
+   the hash chains. Building it has a fixed cost, but it does not slow down
+   on repetitive data like the hash chains do. */
+#ifndef CLOWNLZSS_SUFFIX_ARRAY_THRESHOLD
+#define CLOWNLZSS_SUFFIX_ARRAY_THRESHOLD 0x10000
+#endif
+
+/* Sets how many threads the match-finding stage may use: 0 uses one per processor.
+   This, like the parallel parse and the profiler, is only a default: each context
+   starts out with the one that is set when it is initialised, and can be given its
+   own, so that calls running at once can each use as many threads as suits them.
+   Calls without a context use the default as it is when they start. */
+void ClownLZSS_SetThreadCount(size_t total_threads);
+size_t ClownLZSS_GetThreadCount(void);
+void ClownLZSS_ContextSetThreadCount(ClownLZSS_Context *context, size_t total_threads);
+/* Returns the default if 'context' is NULL */
+size_t ClownLZSS_ContextGetThreadCount(const ClownLZSS_Context *context);
+
+/* Define this as 1 to have the compressors report each stage of compression to the
+   profiler given to ClownLZSS_SetProfiler, so that they can be timed separately.
+   Otherwise, the reports are compiled out entirely, unless the statistics need them. */
+#ifndef CLOWNLZSS_PROFILE
+#define CLOWNLZSS_PROFILE 0
+#endif
+
+/* Stages nest: the graph stage outputs each part of the path as soon as it is
+   final, and a parallel parse runs the stages of each segment on its own thread,
+   so the callbacks must be safe to call from any thread that compresses. */
+typedef struct ClownLZSS_Profiler
+{
+	void (*begin)(ClownLZSS_Stage stage, void *user);
+	void (*end)(ClownLZSS_Stage stage, void *user);
+	void *user;
+} ClownLZSS_Profiler;
+
+/* NULL disables the profiler. As with the thread count, this is only the default of
+   the contexts that are initialised afterwards, and of the calls without one. */
+void ClownLZSS_SetProfiler(const ClownLZSS_Profiler *profiler);
+void ClownLZSS_ContextSetProfiler(ClownLZSS_Context *context, const ClownLZSS_Profiler *profiler);
+/* 'context' is the one that the stage is using, so that it can be timed for the call's statistics. It may be NULL. */
+void ClownLZSS_ProfileBegin(ClownLZSS_Context *context, ClownLZSS_Stage stage);
+void ClownLZSS_ProfileEnd(ClownLZSS_Context *context, ClownLZSS_Stage stage);
+
+#if CLOWNLZSS_PROFILE || CLOWNLZSS_STATISTICS
+#define CLOWNLZSS_PROFILE_BEGIN(CONTEXT, STAGE) ClownLZSS_ProfileBegin(CONTEXT, STAGE)
+#define CLOWNLZSS_PROFILE_END(CONTEXT, STAGE) ClownLZSS_ProfileEnd(CONTEXT, STAGE)
+#else
+#define CLOWNLZSS_PROFILE_BEGIN(CONTEXT, STAGE) (void)(CONTEXT)
+#define CLOWNLZSS_PROFILE_END(CONTEXT, STAGE) (void)(CONTEXT)
+#endif
+
+/* The match-finding stage splits the input into blocks of this many positions */
+#ifndef CLOWNLZSS_MATCH_BLOCK_SIZE
+#if CLOWNLZSS_BRUTE_FORCE
+#define CLOWNLZSS_MATCH_BLOCK_SIZE 0x10	/* The brute-force search finds far more matches per position */
+#else
+#define CLOWNLZSS_MATCH_BLOCK_SIZE 0x2000
+#endif
+#endif
+
+/* The nearest earlier position that the data matches for 'length' values */
+typedef struct ClownLZSS_Match
+{
+	unsigned int position;
+	unsigned int length;
+} ClownLZSS_Match;
+
+/* The matches found for the positions from 'first_position' up to (but not
+   including) 'end_position'. The matches of each position are stored after
+   those of the one before it, ending at 'match_ends[position - first_position]',
+   and each is longer than the one before it. */
+typedef struct ClownLZSS_MatchBlock
+{
+	size_t first_position;
+	size_t end_position;
+	size_t *match_ends;
+	ClownLZSS_Match *matches;
+	size_t total_matches;
+	size_t matches_capacity;
+	bool out_of_memory;
+	ClownLZSS_Context *context;	/* A shared context if the blocks are found by worker threads */
+	unsigned long long candidates;	/* Only counted when CLOWNLZSS_STATISTICS is 1 */
+	unsigned long long comparisons;
+} ClownLZSS_MatchBlock;
+
+bool ClownLZSS_MatchBlockGrow(ClownLZSS_MatchBlock *block);
+
+static inline void ClownLZSS_MatchBlockAdd(ClownLZSS_MatchBlock *block, size_t position, size_t length)
+{
+	if (block->total_matches == block->matches_capacity && !ClownLZSS_MatchBlockGrow(block))
 	{
-		unsigned int cost;
-		size_t next_node_index;
-	} u;
-	size_t previous_node_index;
-	size_t match_length;
-	size_t match_offset;
-} ClownLZSS_GraphEdge;
-
-#define CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(NAME, TYPE, MAX_MATCH_LENGTH, MAX_MATCH_DISTANCE, FIND_EXTRA_MATCHES, LITERAL_COST, LITERAL_CALLBACK, MATCH_COST_CALLBACK, MATCH_CALLBACK)\
-void NAME(TYPE *data, size_t data_size, void *user)\
+		block->out_of_memory = true;
+		return;
+	}
+
+	block->matches[block->total_matches].position = (unsigned int)position;
+	block->matches[block->total_matches].length = (unsigned int)length;
+	++block->total_matches;
+}
+
+/* Match-finding only reads the input, so blocks are searched by a pool of
+   threads while the calling thread relaxes the graph with the blocks that are
+   already done, in order. 'thread_index' identifies which of the 'total_threads'
+   threads given to ClownLZSS_MatchPipelineCreate is calling the finder. */
+typedef void (*ClownLZSS_MatchFinder)(ClownLZSS_MatchBlock *block, size_t thread_index, void *user);
+typedef struct ClownLZSS_MatchPipeline ClownLZSS_MatchPipeline;
+
+/* Whether the pipeline finds every block on the thread that creates it, so that it can use that
+   thread's context. Otherwise, it must be given a shared context (see ClownLZSS_ContextInitShared). */
+bool ClownLZSS_MatchPipelineIsSerial(size_t first_position, size_t end_position, size_t block_size, size_t total_threads);
+ClownLZSS_MatchPipeline* ClownLZSS_MatchPipelineCreate(size_t first_position, size_t end_position, size_t block_size, size_t total_threads, ClownLZSS_MatchFinder finder, void *user, ClownLZSS_Context *context);
+void ClownLZSS_MatchPipelineDestroy(ClownLZSS_MatchPipeline *pipeline);
+const ClownLZSS_MatchBlock* ClownLZSS_MatchPipelineGetBlock(ClownLZSS_MatchPipeline *pipeline);
+void ClownLZSS_MatchPipelineReleaseBlock(ClownLZSS_MatchPipeline *pipeline);
+
+/* The parallel parse splits the input into segments that overlap by this many
+   positions, and parses them all at once. Each segment starts from scratch, but
+   its cheapest path soon converges with the one that the serial parse would
+   find, so the segments are joined at the first node that both paths provably
+   share. The output is exactly the same as the serial parse's. */
+#ifndef CLOWNLZSS_PARALLEL_PARSE_OVERLAP
+#define CLOWNLZSS_PARALLEL_PARSE_OVERLAP 0x2000
+#endif
+
+/* Segments are never made shorter than this, so the overlaps are a small part of the work */
+#ifndef CLOWNLZSS_PARALLEL_PARSE_MINIMUM_SEGMENT
+#define CLOWNLZSS_PARALLEL_PARSE_MINIMUM_SEGMENT 0x10000
+#endif
+
+/* The format's 'get_match_cost' and FIND_EXTRA_MATCHES are called from several
+   threads at once when this is enabled, so they must not modify 'user' */
+void ClownLZSS_SetParallelParse(bool enabled);
+bool ClownLZSS_GetParallelParse(void);
+void ClownLZSS_ContextSetParallelParse(ClownLZSS_Context *context, bool enabled);
+/* Returns the default if 'context' is NULL */
+bool ClownLZSS_ContextGetParallelParse(const ClownLZSS_Context *context);
+
+void ClownLZSS_RunInParallel(void (*function)(void *item), void *items, size_t item_size, size_t total_items, size_t total_threads);
+
+/* A parse that has been recorded, to be output later */
+typedef struct ClownLZSS_PathEdge
+{
+	unsigned int length;	/* 0 for literals */
+	unsigned int offset;
+} ClownLZSS_PathEdge;
+
+typedef struct ClownLZSS_Path
+{
+	size_t start_node;
+	size_t end_node;
+	ClownLZSS_PathEdge *edges;
+	size_t total_edges;
+	size_t capacity;
+	bool out_of_memory;
+	const ClownLZSS_Allocator *allocator;
+} ClownLZSS_Path;
+
+void ClownLZSS_PathInit(ClownLZSS_Path *path, size_t start_node, const ClownLZSS_Allocator *allocator);
+void ClownLZSS_PathDeinit(ClownLZSS_Path *path);
+void ClownLZSS_PathAddLiteral(unsigned int value, void *user);
+void ClownLZSS_PathAddMatch(size_t distance, size_t length, size_t offset, void *user);
+size_t ClownLZSS_PathFindCommonNode(const ClownLZSS_Path *a, const ClownLZSS_Path *b, size_t last_node);
+
+/* One segment of the parallel parse. It is parsed from 'start_node' until every
+   position before 'end_node' has been searched, and its path is recorded up to
+   the node that every path converges on at that point. 'checkpoint_convergence'
+   is the node that every path converges on once the positions before
+   'checkpoint_node' have been searched. */
+typedef struct ClownLZSS_Segment
+{
+	const void *data;
+	size_t data_size;
+	void *user;
+	const unsigned int *run_lengths;
+	const ClownLZSS_SuffixArray *suffix_array;
+	size_t start_node;
+	size_t end_node;
+	size_t checkpoint_node;
+	size_t checkpoint_convergence;
+	ClownLZSS_Path path;
+	bool complete;
+	ClownLZSS_Context context;	/* A worker of the context of the call */
+} ClownLZSS_Segment;
+
+/* What the match-finder of a compression function needs to know about its input */
+typedef struct ClownLZSS_MatchFinderState
+{
+	const void *data;
+	size_t data_size;
+	const ClownLZSS_SuffixArray *suffix_array;	/* NULL if the hash chains are used instead */
+	unsigned int **position_trees;	/* One for each thread, created when it is first needed */
+	ClownLZSS_MatchLengthFunction get_match_length;
+	unsigned int hash_bits;
+	size_t hash_chain_size;
+	size_t total_threads;
+	const unsigned int *run_lengths;
+	ClownLZSS_Context *context;	/* A shared context if the match pipeline is not serial */
+} ClownLZSS_MatchFinderState;
+
+/* Fails if there is not enough memory for the position trees */
+bool ClownLZSS_MatchFinderStateInit(ClownLZSS_MatchFinderState *state, const void *data, size_t data_size, const unsigned int *run_lengths, const ClownLZSS_SuffixArray *suffix_array, size_t total_threads, size_t maximum_match_distance, ClownLZSS_Context *context);
+void ClownLZSS_MatchFinderStateDeinit(ClownLZSS_MatchFinderState *state);
+
+/* The compression levels. Every level below the maximum parses the input
+   greedily instead of building the graph: at each position, it takes the
+   match that saves the most bits out of the first few that the hash chains
+   find. The lazy levels first check whether the next position has a better
+   match, and output a literal instead if it does. The maximum level finds
+   the optimal parse. */
+#define CLOWNLZSS_MINIMUM_LEVEL 1
+#define CLOWNLZSS_MAXIMUM_LEVEL 5
+#define CLOWNLZSS_DEFAULT_LEVEL CLOWNLZSS_MAXIMUM_LEVEL
+
+typedef struct ClownLZSS_Level
+{
+	size_t maximum_candidates;	/* How many positions are compared against at each position */
+	bool lazy;
+} ClownLZSS_Level;
+
+/* Returns NULL for the maximum level. Levels below the minimum are treated as the minimum. */
+const ClownLZSS_Level* ClownLZSS_GetLevel(unsigned int level);
+
+/* The best match that the fast parser has found at a position */
+typedef struct ClownLZSS_FastMatch
+{
+	size_t length;	/* 0 if no match is cheaper than literals */
+	size_t offset;
+	size_t savings;	/* How many bits cheaper than literals it is */
+} ClownLZSS_FastMatch;
+
+/* What the fast parser needs to know about its input. The matches that
+   FIND_EXTRA_MATCHES adds are found by giving it a graph that starts at the
+   position being searched, so that only they are in it. */
+typedef struct ClownLZSS_FastParser
+{
+	ClownLZSS_MatchFinderState state;
+	ClownLZSS_CostTable cost_table;
+	ClownLZSS_Graph graph;
+	const ClownLZSS_Level *level;
+	size_t *hash_heads;
+	size_t *hash_chain;
+	size_t indexed_end;	/* Every position before this one is in the hash chains */
+	size_t run_start;	/* The start of the run that the position before 'indexed_end' is in */
+	ClownLZSS_Statistics statistics;	/* Only counted when CLOWNLZSS_STATISTICS is 1 */
+} ClownLZSS_FastParser;
+
+/* Fails if there is not enough memory for the hash chains or the graph */
+bool ClownLZSS_FastParserInit(ClownLZSS_FastParser *parser, const void *data, size_t data_size, const unsigned int *run_lengths, const ClownLZSS_Format *format, const ClownLZSS_Level *level, ClownLZSS_Context *context);
+void ClownLZSS_FastParserDeinit(ClownLZSS_FastParser *parser);
+
+#define CLOWNLZSS_HASH(DATA, POSITION, MIN_MATCH_LENGTH, HASH_BITS, HASH)\
+do\
+{\
+	unsigned long clownlzss_hash = 0;\
+\
+	for (size_t clownlzss_k = 0; clownlzss_k < (MIN_MATCH_LENGTH); ++clownlzss_k)\
+		clownlzss_hash = (clownlzss_hash * 33 + (unsigned long)(DATA)[(POSITION) + clownlzss_k]) & 0xFFFFFFFF;\
+\
+	(HASH) = ((clownlzss_hash * 0x9E3779B1) & 0xFFFFFFFF) >> (32 - (HASH_BITS));\
+} while (0)
+
+/* Adds an edge to the LZSS graph, if it produces a cheaper path to the node that it ends at */
+#define CLOWNLZSS_ADD_MATCH(GRAPH, START, LENGTH, OFFSET, COST)\
+do\
+{\
+	const size_t clownlzss_end = (START) + (LENGTH);\
+	const unsigned int clownlzss_cost = (COST);\
+\
+	if (clownlzss_cost && (clownlzss_end < (GRAPH)->end_node || ClownLZSS_GraphExtend(GRAPH, clownlzss_end + 1)))\
+	{\
+		const unsigned int clownlzss_total_cost = (GRAPH)->costs[(START) & (GRAPH)->mask] + clownlzss_cost;\
+\
+		if ((GRAPH)->costs[clownlzss_end & (GRAPH)->mask] > clownlzss_total_cost)\
+		{\
+			(GRAPH)->costs[clownlzss_end & (GRAPH)->mask] = clownlzss_total_cost;\
+			ClownLZSS_GraphSetLength(GRAPH, clownlzss_end, LENGTH);\
+			(GRAPH)->offsets[clownlzss_end & (GRAPH)->mask] = (unsigned int)(OFFSET);\
+		}\
+	}\
+} while (0)
+
+/* Counts the edge of the path that ends at 'node', which cost 'cost' bits */
+void ClownLZSS_StatisticsAddPathEdge(ClownLZSS_Statistics *statistics, const ClownLZSS_Graph *graph, size_t node, unsigned int cost);
+
+/* Outputs the cheapest path from the first node of the graph to END_NODE, and frees the space that it used.
+   Its edges are counted in STATISTICS, unless it is NULL. */
+#define CLOWNLZSS_OUTPUT_PATH(GRAPH, END_NODE, DATA, LITERAL_CALLBACK, MATCH_CALLBACK, USER, STATISTICS)\
+do\
+{\
+	CLOWNLZSS_PROFILE_BEGIN((GRAPH)->context, CLOWNLZSS_STAGE_PATH_REVERSAL);\
+\
+	/* What it costs to reach the node, before it is replaced */\
+	CLOWNLZSS_COUNT(unsigned int clownlzss_cost = (GRAPH)->costs[(END_NODE) & (GRAPH)->mask];)\
+\
+	/* Follow the path backwards, replacing the cost of each node on it
+	   with the distance to the next node, so it can be followed forwards */\
+	for (size_t clownlzss_node = (END_NODE); clownlzss_node != (GRAPH)->first_node;)\
+	{\
+		const size_t clownlzss_length = ClownLZSS_GraphGetLength(GRAPH, clownlzss_node);\
+		const size_t clownlzss_previous_node = clownlzss_node - (clownlzss_length == 0 ? 1 : clownlzss_length);\
+\
+		CLOWNLZSS_COUNT(\
+			const unsigned int clownlzss_previous_cost = (GRAPH)->costs[clownlzss_previous_node & (GRAPH)->mask];\
+\
+			if ((STATISTICS) != NULL)\
+				ClownLZSS_StatisticsAddPathEdge(STATISTICS, GRAPH, clownlzss_node, clownlzss_cost - clownlzss_previous_cost);\
+\
+			clownlzss_cost = clownlzss_previous_cost;\
+		)\
+\
+		(GRAPH)->costs[clownlzss_previous_node & (GRAPH)->mask] = (unsigned int)(clownlzss_node - clownlzss_previous_node);\
+		clownlzss_node = clownlzss_previous_node;\
+	}\
+\
+	CLOWNLZSS_PROFILE_END((GRAPH)->context, CLOWNLZSS_STAGE_PATH_REVERSAL);\
+	CLOWNLZSS_PROFILE_BEGIN((GRAPH)->context, CLOWNLZSS_STAGE_EMISSION);\
+\
+	for (size_t clownlzss_node = (GRAPH)->first_node; clownlzss_node != (END_NODE);)\
+	{\
+		const size_t clownlzss_next_node = clownlzss_node + (GRAPH)->costs[clownlzss_node & (GRAPH)->mask];\
+		const size_t clownlzss_length = ClownLZSS_GraphGetLength(GRAPH, clownlzss_next_node);\
+\
+		if (clownlzss_length == 0)\
+		{\
+			LITERAL_CALLBACK((DATA)[clownlzss_node], USER);\
+		}\
+		else\
+		{\
+			const size_t clownlzss_offset = (GRAPH)->offsets[clownlzss_next_node & (GRAPH)->mask];\
+\
+			MATCH_CALLBACK(clownlzss_next_node - clownlzss_length - clownlzss_offset, clownlzss_length, clownlzss_offset, USER);\
+		}\
+\
+		clownlzss_node = clownlzss_next_node;\
+	}\
+\
+	CLOWNLZSS_PROFILE_END((GRAPH)->context, CLOWNLZSS_STAGE_EMISSION);\
+\
+	(GRAPH)->first_node = (END_NODE);\
+} while (0)
+
+/* FORMAT is the ClownLZSS_Format that describes the format. Positions are
+   indexed in hash chains by their first 'minimum_match_length' values, so that
+   only positions which can actually produce a useful match are compared against.
+
+   Large inputs use the suffix array instead. Either way, only the nearest
+   occurrence of each match length is added to the graph. This gives the same
+   graph as the brute-force search as long as a match never becomes cheaper by
+   being further away. Formats that list their encodings get this for free, but
+   a 'get_match_cost' callback may only depend on the distance through tiers that
+   get more expensive as they get further away, such as Kosinski's short matches,
+   which only exist within 256 bytes. */
+#define CLOWNLZSS_MAKE_MATCH_FINDER(NAME, TYPE, FORMAT)\
+static void NAME##_FindMatches(ClownLZSS_MatchBlock *block, size_t thread_index, void *user)\
+{\
+	const ClownLZSS_MatchFinderState *state = (const ClownLZSS_MatchFinderState*)user;\
+	const TYPE *data = (const TYPE*)state->data;\
+	const size_t data_size = state->data_size;\
+\
+	/* The kernels only pay for themselves when matches can be long */\
+	const bool use_match_length_kernel = !CLOWNLZSS_BRUTE_FORCE && (FORMAT).maximum_match_length * sizeof(TYPE) >= CLOWNLZSS_MATCH_LENGTH_KERNEL_THRESHOLD;\
+\
+	CLOWNLZSS_COUNT(block->candidates = 0; block->comparisons = 0;)\
+\
+	/* The hash chains: 'hash_heads' holds the most recent position for each hash,
+	   and 'hash_chain' links each position in the window to the previous position
+	   with the same hash. 'hash_chain' is a ring buffer large enough to cover the
+	   whole window, so positions that fall out of the window are simply overwritten. */\
+	const bool use_hash_chains = !CLOWNLZSS_BRUTE_FORCE && state->suffix_array == NULL;\
+	size_t *hash_heads = NULL;\
+	size_t *hash_chain = NULL;\
+\
+	/* The positions before the block that are still in the window are indexed
+	   first, so the search finds the same matches as if every position before
+	   the block had been searched in order */\
+	const size_t window_start = (FORMAT).maximum_match_distance > block->first_position ? 0 : block->first_position - (FORMAT).maximum_match_distance;\
+	unsigned int *position_tree = NULL;\
+\
+	if (state->suffix_array != NULL)\
+	{\
+		if (state->position_trees[thread_index] == NULL)\
+			state->position_trees[thread_index] = ClownLZSS_SuffixArrayCreatePositionTree(state->suffix_array, state->context);\
+\
+		position_tree = state->position_trees[thread_index];\
+\
+		if (position_tree == NULL)\
+		{\
+			block->out_of_memory = true;\
+			return;\
+		}\
+\
+		for (size_t i = window_start; i < block->first_position; ++i)\
+			ClownLZSS_SuffixArrayInsert(state->suffix_array, position_tree, i);\
+	}\
+	else if (use_hash_chains)\
+	{\
+		hash_heads = (size_t*)ClownLZSS_ContextAllocate(state->context, CLOWNLZSS_CONTEXT_HASH_HEADS, ((size_t)1 << state->hash_bits) * sizeof(size_t));\
+		hash_chain = (size_t*)ClownLZSS_ContextAllocate(state->context, CLOWNLZSS_CONTEXT_HASH_CHAIN, state->hash_chain_size * sizeof(size_t));\
+\
+		if (hash_heads == NULL || hash_chain == NULL)\
+		{\
+			ClownLZSS_ContextFree(state->context, hash_chain);\
+			ClownLZSS_ContextFree(state->context, hash_heads);\
+			block->out_of_memory = true;\
+			return;\
+		}\
+\
+		for (size_t i = 0; i < (size_t)1 << state->hash_bits; ++i)\
+			hash_heads[i] = (size_t)-1;\
+\
+		for (size_t i = window_start; i < block->first_position && i + (FORMAT).minimum_match_length <= data_size; ++i)\
+		{\
+			unsigned long hash;\
+			CLOWNLZSS_HASH(data, i, (FORMAT).minimum_match_length, state->hash_bits, hash);\
+\
+			hash_chain[i & (state->hash_chain_size - 1)] = hash_heads[hash];\
+			hash_heads[hash] = i;\
+		}\
+	}\
+\
+	/* The start of the run that the current position is in, or of the window if the run starts before it */\
+	size_t run_start = block->first_position;\
+\
+	while (run_start > window_start && data[run_start - 1] == data[run_start])\
+		--run_start;\
+\
+	for (size_t i = block->first_position; i < block->end_position; ++i)\
+	{\
+		const size_t max_read_ahead = CLOWNLZSS_MIN((FORMAT).maximum_match_length, data_size - i);\
+		const size_t max_read_behind = (FORMAT).maximum_match_distance > i ? 0 : i - (FORMAT).maximum_match_distance;\
+\
+		if (i == 0 || data[i - 1] != data[i])\
+			run_start = i;\
+\
+		/* Inside a run, the previous position is the nearest match, and it
+		   matches for the rest of the run, so it does not need to be searched for */\
+		const bool in_run = !CLOWNLZSS_BRUTE_FORCE && run_start != i && state->run_lengths[i] >= (FORMAT).minimum_match_length;\
+		const size_t run_match_length = in_run ? CLOWNLZSS_MIN(state->run_lengths[i], max_read_ahead) : 0;\
+\
+		if (in_run)\
+		{\
+			ClownLZSS_MatchBlockAdd(block, i - 1, run_match_length);\
+			CLOWNLZSS_COUNT(++block->candidates;)\
+		}\
+\
+		if (state->suffix_array != NULL)\
+		{\
+			/* Each match found here is the nearest one that is at least 'length'
+			   long, so it is the best choice for every length up to its own */\
+			for (size_t length = in_run ? run_match_length + 1 : (FORMAT).minimum_match_length; length <= max_read_ahead;)\
+			{\
+				size_t match_length;\
+				const size_t j = ClownLZSS_SuffixArrayFindMatch(state->suffix_array, position_tree, i, length, max_read_behind, &match_length);\
+\
+				if (j == (size_t)-1)\
+					break;\
+\
+				match_length = CLOWNLZSS_MIN(match_length, max_read_ahead);\
+				ClownLZSS_MatchBlockAdd(block, j, match_length);\
+				CLOWNLZSS_COUNT(++block->candidates;)\
+				length = match_length + 1;\
+			}\
+\
+			ClownLZSS_SuffixArrayInsert(state->suffix_array, position_tree, i);\
+		}\
+		else if (!use_hash_chains || i + (FORMAT).minimum_match_length <= data_size)\
+		{\
+			unsigned long hash = 0;\
+\
+			if (use_hash_chains)\
+				CLOWNLZSS_HASH(data, i, (FORMAT).minimum_match_length, state->hash_bits, hash);\
+\
+			/* Newest positions come first in both searches, so ties between
+			   equally-cheap matches are always resolved in the same way.
+			   Because of this, the hash chains only need to add the lengths that
+			   no nearer match has reached: a match never becomes cheaper by being
+			   further away, so the nearer one would win anyway. */\
+			size_t longest_match = run_match_length;\
+			size_t first_j = use_hash_chains ? hash_heads[hash] : i - 1;\
+\
+			/* Every other position in the run matches for exactly as long as the
+			   previous one, so the search skips to the positions before the run */\
+			if (in_run)\
+				first_j = run_match_length == max_read_ahead || run_start <= max_read_behind ? (size_t)-1 : hash_chain[run_start & (state->hash_chain_size - 1)];\
+\
+			for (size_t j = first_j; j != (size_t)-1 && j >= max_read_behind; j = use_hash_chains ? hash_chain[j & (state->hash_chain_size - 1)] : j - 1)\
+			{\
+				CLOWNLZSS_COUNT(++block->candidates; ++block->comparisons;)\
+\
+				/* Skip matches that cannot be longer than the longest one so far */\
+				if (data[i + longest_match] != data[j + longest_match])\
+					continue;\
+\
+				size_t match_length;\
+\
+				if (use_match_length_kernel)\
+					match_length = state->get_match_length(&data[i], &data[j], max_read_ahead * sizeof(TYPE)) / sizeof(TYPE);\
+				else\
+					for (match_length = 0; match_length < max_read_ahead && data[i + match_length] == data[j + match_length]; ++match_length);\
+\
+				CLOWNLZSS_COUNT(block->comparisons += CLOWNLZSS_MIN(match_length + 1, max_read_ahead);)\
+\
+				if (!use_hash_chains)\
+				{\
+					/* The brute-force search adds every length of every match */\
+					if (match_length != 0)\
+						ClownLZSS_MatchBlockAdd(block, j, match_length);\
+				}\
+				else if (match_length > longest_match)\
+				{\
+					ClownLZSS_MatchBlockAdd(block, j, match_length);\
+					longest_match = match_length;\
+\
+					/* Every possible length has been found, so nothing further away can help */\
+					if (longest_match == max_read_ahead)\
+						break;\
+				}\
+			}\
+\
+			if (use_hash_chains)\
+			{\
+				hash_chain[i & (state->hash_chain_size - 1)] = hash_heads[hash];\
+				hash_heads[hash] = i;\
+			}\
+		}\
+\
+		block->match_ends[i - block->first_position] = block->total_matches;\
+	}\
+\
+	/* Leave the position tree empty for the next block */\
+	if (position_tree != NULL)\
+		for (size_t i = window_start; i < block->end_position; ++i)\
+			ClownLZSS_SuffixArrayClear(state->suffix_array, position_tree, i);\
+\
+	ClownLZSS_ContextFree(state->context, hash_chain);\
+	ClownLZSS_ContextFree(state->context, hash_heads);\
+}
+
+/* For CLOWNLZSS_MAKE_FAST_PARSER's LIMIT_MATCH_LENGTH: leaves every match as long as it is */
+#define CLOWNLZSS_KEEP_MATCH_LENGTH(DATA, RUN_LENGTHS, POSITION, LENGTH, USER) (LENGTH)
+
+/* The parser of the levels below the maximum, as NAME_ParseFast. It outputs
+   the matches as soon as it picks them, with the same callbacks as the optimal
+   parser, so that formats which build their own graph can use it too.
+   LIMIT_MATCH_LENGTH is given each match that the search finds, and returns
+   how much of it to consider, for formats where the end of a long match is
+   better off encoded another way, which the greedy parse would not notice. */
+#define CLOWNLZSS_MAKE_FAST_PARSER(NAME, TYPE, FORMAT, FIND_EXTRA_MATCHES, LIMIT_MATCH_LENGTH, LITERAL_CALLBACK, MATCH_CALLBACK)\
+static void NAME##_KeepBetterMatch(ClownLZSS_FastMatch *best, size_t length, size_t offset, unsigned int cost)\
+{\
+	const size_t literals_cost = length * (FORMAT).literal_cost;\
+\
+	if (cost != 0 && literals_cost > cost && literals_cost - cost > best->savings)\
+	{\
+		best->length = length;\
+		best->offset = offset;\
+		best->savings = literals_cost - cost;\
+	}\
+}\
+\
+/* Only the longest length of each cost is worth considering */\
+static void NAME##_ConsiderMatch(const ClownLZSS_FastParser *parser, size_t position, size_t j, size_t length, void *user, ClownLZSS_FastMatch *best)\
+{\
+	if ((FORMAT).match_encodings != NULL)\
+	{\
+		size_t tier = 0;\
+\
+		while (position - j > parser->cost_table.maximum_distances[tier])\
+			++tier;\
+\
+		const ClownLZSS_CostRun *run = parser->cost_table.runs[tier];\
+		const ClownLZSS_CostRun *runs_end = run + parser->cost_table.total_runs[tier];\
+\
+		for (; run != runs_end && run->minimum_length <= length; ++run)\
+			NAME##_KeepBetterMatch(best, CLOWNLZSS_MIN(length, run->maximum_length), j, run->cost);\
+	}\
+	else\
+	{\
+		NAME##_KeepBetterMatch(best, length, j, (FORMAT).get_match_cost(position - j, length, user));\
+	}\
+}\
+\
+/* Adds the positions up to 'end' to the hash chains */\
+static void NAME##_IndexPositions(ClownLZSS_FastParser *parser, const TYPE *data, size_t data_size, size_t end)\
+{\
+	for (; parser->indexed_end < end; ++parser->indexed_end)\
+	{\
+		const size_t i = parser->indexed_end;\
+\
+		if (i == 0 || data[i - 1] != data[i])\
+			parser->run_start = i;\
+\
+		if (i + (FORMAT).minimum_match_length <= data_size)\
+		{\
+			unsigned long hash;\
+			CLOWNLZSS_HASH(data, i, (FORMAT).minimum_match_length, parser->state.hash_bits, hash);\
+\
+			parser->hash_chain[i & (parser->state.hash_chain_size - 1)] = parser->hash_heads[hash];\
+			parser->hash_heads[hash] = i;\
+		}\
+	}\
+}\
+\
+/* Every position before 'i' must have been indexed, and 'i' must not have been */\
+static void NAME##_FindFastMatch(ClownLZSS_FastParser *parser, TYPE *data, size_t data_size, size_t i, void *user, ClownLZSS_FastMatch *best)\
+{\
+	const unsigned int *run_lengths = parser->state.run_lengths;\
+	const size_t max_read_ahead = CLOWNLZSS_MIN((FORMAT).maximum_match_length, data_size - i);\
+	const size_t max_read_behind = (FORMAT).maximum_match_distance > i ? 0 : i - (FORMAT).maximum_match_distance;\
+\
+	best->length = 0;\
+	best->offset = 0;\
+	best->savings = 0;\
+\
+	CLOWNLZSS_COUNT(++parser->statistics.nodes;)\
+\
+	/* The format's own matches come first, so that they win ties, like they do in the graph */\
+	parser->graph.first_node = i;\
+	parser->graph.end_node = i + 1;\
+	parser->graph.costs[i & parser->graph.mask] = 0;\
+\
+	FIND_EXTRA_MATCHES(data, data_size, run_lengths, i, &parser->graph, user);\
+\
+	for (size_t node = i + 1; node < parser->graph.end_node; ++node)\
+		if (parser->graph.costs[node & parser->graph.mask] != UINT_MAX)\
+			NAME##_KeepBetterMatch(best, node - i, parser->graph.offsets[node & parser->graph.mask], parser->graph.costs[node & parser->graph.mask]);\
+\
+	if (i + (FORMAT).minimum_match_length > data_size)\
+		return;\
+\
+	const size_t run_start = i != 0 && data[i - 1] == data[i] ? parser->run_start : i;\
+	const bool in_run = run_start != i && run_lengths[i] >= (FORMAT).minimum_match_length;\
+	const bool use_match_length_kernel = (FORMAT).maximum_match_length * sizeof(TYPE) >= CLOWNLZSS_MATCH_LENGTH_KERNEL_THRESHOLD;\
+\
+	unsigned long hash;\
+	CLOWNLZSS_HASH(data, i, (FORMAT).minimum_match_length, parser->state.hash_bits, hash);\
+\
+	size_t longest_match = 0;\
+	size_t total_candidates = 0;\
+	size_t first_j = parser->hash_heads[hash];\
+\
+	/* As in the match-finder, the previous position is the nearest match inside
+	   a run, and the search skips to the positions before the run */\
+	if (in_run)\
+	{\
+		longest_match = CLOWNLZSS_MIN(run_lengths[i], max_read_ahead);\
+		NAME##_ConsiderMatch(parser, i, i - 1, LIMIT_MATCH_LENGTH(data, run_lengths, i, longest_match, user), user, best);\
+		++total_candidates;\
+		CLOWNLZSS_COUNT(++parser->statistics.candidates;)\
+\
+		first_j = longest_match == max_read_ahead || run_start <= max_read_behind ? (size_t)-1 : parser->hash_chain[run_start & (parser->state.hash_chain_size - 1)];\
+	}\
+\
+	for (size_t j = first_j; j != (size_t)-1 && j >= max_read_behind && total_candidates < parser->level->maximum_candidates; j = parser->hash_chain[j & (parser->state.hash_chain_size - 1)], ++total_candidates)\
+	{\
+		CLOWNLZSS_COUNT(++parser->statistics.candidates; ++parser->statistics.comparisons;)\
+\
+		if (data[i + longest_match] != data[j + longest_match])\
+			continue;\
+\
+		size_t match_length;\
+\
+		if (use_match_length_kernel)\
+			match_length = parser->state.get_match_length(&data[i], &data[j], max_read_ahead * sizeof(TYPE)) / sizeof(TYPE);\
+		else\
+			for (match_length = 0; match_length < max_read_ahead && data[i + match_length] == data[j + match_length]; ++match_length);\
+\
+		CLOWNLZSS_COUNT(parser->statistics.comparisons += CLOWNLZSS_MIN(match_length + 1, max_read_ahead);)\
+\
+		if (match_length > longest_match)\
+		{\
+			NAME##_ConsiderMatch(parser, i, j, LIMIT_MATCH_LENGTH(data, run_lengths, i, match_length, user), user, best);\
+			longest_match = match_length;\
+\
+			if (longest_match == max_read_ahead)\
+				break;\
+		}\
+	}\
+}\
+\
+static bool NAME##_ParseFast(TYPE *data, size_t data_size, void *user, const unsigned int *run_lengths, const ClownLZSS_Level *level, ClownLZSS_Context *context)\
+{\
+	ClownLZSS_FastParser parser;\
+\
+	if (!ClownLZSS_FastParserInit(&parser, data, data_size, run_lengths, &(FORMAT), level, context))\
+		return false;\
+\
+	CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_FAST_PARSE);\
+\
+	ClownLZSS_FastMatch match;\
+	ClownLZSS_FastMatch next_match;\
+	bool match_found = false;	/* Whether 'match' was already found for this position by the lazy check */\
+\
+	for (size_t i = 0; i < data_size;)\
+	{\
+		if (!match_found)\
+		{\
+			NAME##_FindFastMatch(&parser, data, data_size, i, user, &match);\
+			NAME##_IndexPositions(&parser, data, data_size, i + 1);\
+		}\
+\
+		match_found = false;\
+\
+		if (match.length != 0 && level->lazy && i + 1 < data_size)\
+		{\
+			NAME##_FindFastMatch(&parser, data, data_size, i + 1, user, &next_match);\
+			NAME##_IndexPositions(&parser, data, data_size, i + 2);\
+			match_found = true;\
+\
+			if (next_match.savings > match.savings)\
+			{\
+				LITERAL_CALLBACK(data[i], user);\
+				CLOWNLZSS_COUNT(ClownLZSS_StatisticsAddLiterals(&parser.statistics, 1, (FORMAT).literal_cost);)\
+				match = next_match;\
+				++i;\
+				continue;\
+			}\
+		}\
+\
+		if (match.length == 0)\
+		{\
+			LITERAL_CALLBACK(data[i], user);\
+			CLOWNLZSS_COUNT(ClownLZSS_StatisticsAddLiterals(&parser.statistics, 1, (FORMAT).literal_cost);)\
+			++i;\
+		}\
+		else\
+		{\
+			MATCH_CALLBACK(i - match.offset, match.length, match.offset, user);\
+			CLOWNLZSS_COUNT(ClownLZSS_StatisticsAddMatch(&parser.statistics, match.offset < i ? i - match.offset : 0, match.length, (unsigned int)(match.length * (FORMAT).literal_cost - match.savings));)\
+			i += match.length;\
+\
+			/* The next position was already searched if this match is only one value long */\
+			if (match_found && match.length == 1)\
+			{\
+				match = next_match;\
+				continue;\
+			}\
+\
+			match_found = false;\
+			NAME##_IndexPositions(&parser, data, data_size, i);\
+		}\
+	}\
+\
+	CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_FAST_PARSE);\
+\
+	CLOWNLZSS_COUNT(ClownLZSS_ContextAddStatistics(context, &parser.statistics);)\
+	ClownLZSS_FastParserDeinit(&parser);\
+\
+	return true;\
+}
+
+/* The match-finder is also available on its own, as NAME_FindMatches, and the
+   fast parser as NAME_ParseFast, for formats that parse the matches themselves */
+#define CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(NAME, TYPE, FORMAT, FIND_EXTRA_MATCHES, LITERAL_CALLBACK, MATCH_CALLBACK)\
+/* This declaration comes first so that it is the one given the storage-class of the macro's user */\
+void NAME(TYPE *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, void *user);\
+\
+CLOWNLZSS_MAKE_MATCH_FINDER(NAME, TYPE, FORMAT)\
+\
+CLOWNLZSS_MAKE_FAST_PARSER(NAME, TYPE, FORMAT, FIND_EXTRA_MATCHES, CLOWNLZSS_KEEP_MATCH_LENGTH, LITERAL_CALLBACK, MATCH_CALLBACK)\
+\
+/* A recorded path is counted once it is output, as only part of it might be */\
+static void NAME##_OutputPath(ClownLZSS_Graph *graph, size_t end_node, TYPE *data, void *user, ClownLZSS_Path *path, ClownLZSS_Statistics *statistics)\
 {\
-	ClownLZSS_GraphEdge *node_meta_array = (ClownLZSS_GraphEdge*)malloc((data_size + 1) * sizeof(ClownLZSS_GraphEdge));	/* +1 for the end-node */\
+	(void)statistics;\
+\
+	if (path != NULL)\
+		CLOWNLZSS_OUTPUT_PATH(graph, end_node, data, ClownLZSS_PathAddLiteral, ClownLZSS_PathAddMatch, path, NULL);\
+	else\
+		CLOWNLZSS_OUTPUT_PATH(graph, end_node, data, LITERAL_CALLBACK, MATCH_CALLBACK, user, statistics);\
+}\
+\
+/* Parses the input from 'start_node' to 'end_node', as described by ClownLZSS_Segment.
+   The path is recorded in 'path', or output directly if it is NULL. */\
+static bool NAME##_Parse(TYPE *data, size_t data_size, void *user, const unsigned int *run_lengths, const ClownLZSS_SuffixArray *suffix_array, size_t total_threads, size_t start_node, size_t end_node, size_t checkpoint_node, size_t *checkpoint_convergence, ClownLZSS_Path *path, ClownLZSS_Context *context)\
+{\
+	ClownLZSS_Graph graph;\
+	ClownLZSS_CostTable cost_table;\
+	ClownLZSS_Statistics statistics;\
+\
+	CLOWNLZSS_COUNT(ClownLZSS_StatisticsClear(&statistics);)\
+\
+	if ((FORMAT).match_encodings != NULL && !ClownLZSS_CostTableInit(&cost_table, &(FORMAT)))\
+		return false;\
+\
+	if (!ClownLZSS_GraphInit(&graph, start_node, data_size + 1 - start_node, CLOWNLZSS_MIN((FORMAT).maximum_match_length, data_size), context))	/* +1 for the end-node */\
+		return false;\
 \
-	/* Set costs to maximum possible value, so later comparisons work */\
-	node_meta_array[0].u.cost = 0;\
-	for (size_t i = 1; i < data_size + 1; ++i)\
-		node_meta_array[i].u.cost = UINT_MAX;\
+	size_t next_convergence_check = start_node + CLOWNLZSS_CONVERGENCE_INTERVAL;\
+	size_t previous_run_match_length = 0;\
+	bool graph_complete = true;\
 \
-	/* Search for matches, to populate the edges of the LZSS graph.
-	   Notably, while doing this, we're also using a shortest-path
-	   algorithm on the edges to find the best combination of matches
-	   to produce the smallest file. */\
-	for (size_t i = 0; i < data_size; ++i)\
+	ClownLZSS_Context shared_context;\
+	ClownLZSS_Context *finder_context = ClownLZSS_MatchPipelineIsSerial(start_node, end_node, CLOWNLZSS_MATCH_BLOCK_SIZE, total_threads) ? context : ClownLZSS_ContextInitShared(&shared_context, context);\
+	ClownLZSS_MatchFinderState state;\
+	const bool state_ready = ClownLZSS_MatchFinderStateInit(&state, data, data_size, run_lengths, suffix_array, total_threads, (FORMAT).maximum_match_distance, finder_context);\
+\
+	ClownLZSS_MatchPipeline *pipeline = NULL;\
+\
+	if (state_ready)\
+		pipeline = ClownLZSS_MatchPipelineCreate(start_node, end_node, CLOWNLZSS_MATCH_BLOCK_SIZE, total_threads, NAME##_FindMatches, &state, finder_context);\
+\
+	if (pipeline == NULL)\
+		graph_complete = false;\
+\
+	/* Use a shortest-path algorithm on the matches to find
+	   the combination of them that produces the smallest file */\
+	for (size_t block_start = start_node; graph_complete && block_start < end_node; block_start += CLOWNLZSS_MATCH_BLOCK_SIZE)\
 	{\
-		const size_t max_read_ahead = CLOWNLZSS_MIN(MAX_MATCH_LENGTH, data_size - i);\
-		const size_t max_read_behind = MAX_MATCH_DISTANCE > i ? 0 : i - MAX_MATCH_DISTANCE;\
+		CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_MATCH_FINDING);\
+		const ClownLZSS_MatchBlock *block = ClownLZSS_MatchPipelineGetBlock(pipeline);\
+		const ClownLZSS_Match *match = block->matches;\
+		CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_MATCH_FINDING);\
 \
-		FIND_EXTRA_MATCHES(data, data_size, i, node_meta_array, user);\
+		if (block->out_of_memory)\
+			graph_complete = false;\
 \
-		for (size_t j = i; j-- > max_read_behind;)\
+		CLOWNLZSS_COUNT(\
+			statistics.nodes += block->end_position - block->first_position;\
+			statistics.candidates += block->candidates;\
+			statistics.comparisons += block->comparisons;\
+		)\
+\
+		CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_GRAPH);\
+\
+		for (size_t i = block->first_position; graph_complete && i < block->end_position; ++i)\
 		{\
-			for (size_t k = 0; k < max_read_ahead; ++k)\
+			if (i + 1 >= graph.end_node && !ClownLZSS_GraphExtend(&graph, i + 2))\
+			{\
+				graph_complete = false;\
+				break;\
+			}\
+\
+			FIND_EXTRA_MATCHES(data, data_size, run_lengths, i, &graph, user);\
+\
+			/* Each match only adds the lengths that the ones before it did not reach */\
+			size_t longest_match = 0;\
+\
+			/* Inside a run, the previous position's match with the position before
+			   it reaches every node that this position's match with it does, for
+			   one more value. If this position is no cheaper to reach, then those
+			   lengths only need to be added where that extra value costs more. */\
+			const size_t run_match_length = match != &block->matches[block->match_ends[i - block->first_position]] && match->position == i - 1 ? match->length : 0;\
+			const size_t skippable_run_length = !CLOWNLZSS_BRUTE_FORCE && previous_run_match_length != 0 && i != graph.first_node && graph.costs[i & graph.mask] >= graph.costs[(i - 1) & graph.mask] ? previous_run_match_length : 0;\
+\
+			previous_run_match_length = run_match_length;\
+\
+			for (; match != &block->matches[block->match_ends[i - block->first_position]]; ++match)\
 			{\
-				if (data[i + k] == data[j + k])\
+				const size_t j = match->position;\
+\
+				if (i + match->length >= graph.end_node && !ClownLZSS_GraphExtend(&graph, i + match->length + 1))\
+				{\
+					graph_complete = false;\
+					break;\
+				}\
+\
+				/* A match never ends at the node it starts at, so this cost cannot change in the loop */\
+				const unsigned int base_cost = graph.costs[i & graph.mask];\
+				const size_t shortest_new_length = CLOWNLZSS_BRUTE_FORCE ? 1 : longest_match + 1;\
+\
+				if ((FORMAT).match_encodings != NULL)\
 				{\
-					const unsigned int cost = MATCH_COST_CALLBACK(i - j, k + 1, user);\
+					/* Only the lengths that the match's tier can encode are visited */\
+					size_t tier = 0;\
 \
-					if (cost && node_meta_array[i + k + 1].u.cost > node_meta_array[i].u.cost + cost)\
+					while (i - j > cost_table.maximum_distances[tier])\
+						++tier;\
+\
+					const ClownLZSS_CostRun *run = cost_table.runs[tier];\
+					const ClownLZSS_CostRun *runs_end = run + cost_table.total_runs[tier];\
+\
+					for (; run != runs_end && run->minimum_length <= match->length; ++run)\
 					{\
-						node_meta_array[i + k + 1].u.cost = node_meta_array[i].u.cost + cost;\
-						node_meta_array[i + k + 1].previous_node_index = i;\
-						node_meta_array[i + k + 1].match_length = k + 1;\
-						node_meta_array[i + k + 1].match_offset = j;\
+						const unsigned int total_cost = base_cost + run->cost;\
+						const size_t longest_length = CLOWNLZSS_MIN(match->length, run->maximum_length);\
+						size_t shortest_length = CLOWNLZSS_MAX(shortest_new_length, run->minimum_length);\
+\
+						if (j == i - 1)\
+							shortest_length = CLOWNLZSS_MAX(shortest_length, CLOWNLZSS_MIN(run->maximum_length, skippable_run_length));\
+\
+						for (size_t k = shortest_length; k <= longest_length; ++k)\
+						{\
+							CLOWNLZSS_COUNT(++statistics.edges_relaxed;)\
+\
+							if (graph.costs[(i + k) & graph.mask] > total_cost)\
+							{\
+								CLOWNLZSS_COUNT(++statistics.edges_improved;)\
+								graph.costs[(i + k) & graph.mask] = total_cost;\
+								ClownLZSS_GraphSetLength(&graph, i + k, k);\
+								graph.offsets[(i + k) & graph.mask] = (unsigned int)j;\
+							}\
+						}\
 					}\
 				}\
 				else\
-					break;\
+				{\
+					for (size_t k = CLOWNLZSS_MAX(shortest_new_length, (FORMAT).minimum_match_length); k <= match->length; ++k)\
+					{\
+						const unsigned int cost = (FORMAT).get_match_cost(i - j, k, user);\
+\
+						CLOWNLZSS_COUNT(++statistics.edges_relaxed;)\
+\
+						if (cost && graph.costs[(i + k) & graph.mask] > base_cost + cost)\
+						{\
+							CLOWNLZSS_COUNT(++statistics.edges_improved;)\
+							graph.costs[(i + k) & graph.mask] = base_cost + cost;\
+							ClownLZSS_GraphSetLength(&graph, i + k, k);\
+							graph.offsets[(i + k) & graph.mask] = (unsigned int)j;\
+						}\
+					}\
+				}\
+\
+				longest_match = match->length;\
 			}\
+\
+			/* Insert a literal match if it's more efficient */\
+			CLOWNLZSS_COUNT(++statistics.edges_relaxed;)\
+\
+			if (graph.costs[(i + 1) & graph.mask] >= graph.costs[i & graph.mask] + (FORMAT).literal_cost)\
+			{\
+				CLOWNLZSS_COUNT(++statistics.edges_improved;)\
+				graph.costs[(i + 1) & graph.mask] = graph.costs[i & graph.mask] + (FORMAT).literal_cost;\
+				ClownLZSS_GraphSetLength(&graph, i + 1, 0);\
+			}\
+\
+			/* Every path now passes through one of the nodes up to 'i + 1', and the
+			   cheapest paths to those will not change. If all of those paths share
+			   a node, then the path up to it is final, so it can be output. */\
+			if (i + 1 >= next_convergence_check)\
+			{\
+				const size_t convergence = ClownLZSS_GraphFindConvergence(&graph, i + 1);\
+\
+				NAME##_OutputPath(&graph, convergence, data, user, path, &statistics);\
+\
+				next_convergence_check = i + 1 + CLOWNLZSS_MAX(CLOWNLZSS_CONVERGENCE_INTERVAL, CLOWNLZSS_MAX(graph.end_node - (i + 1), (i + 1) - graph.first_node));\
+			}\
+\
+			if (i + 1 == checkpoint_node)\
+				*checkpoint_convergence = ClownLZSS_GraphFindConvergence(&graph, i + 1);\
 		}\
 \
-		/* Insert a literal match if it's more efficient */\
-		if (node_meta_array[i + 1].u.cost >= node_meta_array[i].u.cost + LITERAL_COST)\
+		CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_GRAPH);\
+\
+		ClownLZSS_MatchPipelineReleaseBlock(pipeline);\
+	}\
+\
+	/* Output the rest of the LZSS graph */\
+	if (graph_complete)\
+		NAME##_OutputPath(&graph, end_node == data_size ? data_size : ClownLZSS_GraphFindConvergence(&graph, end_node), data, user, path, &statistics);\
+\
+	if (pipeline != NULL)\
+		ClownLZSS_MatchPipelineDestroy(pipeline);\
+\
+	if (state_ready)\
+		ClownLZSS_MatchFinderStateDeinit(&state);\
+\
+	ClownLZSS_GraphDeinit(&graph);\
+\
+	CLOWNLZSS_COUNT(ClownLZSS_ContextAddStatistics(context, &statistics);)\
+\
+	return graph_complete && (path == NULL || !path->out_of_memory);\
+}\
+\
+static void NAME##_ParseSegment(void *item)\
+{\
+	ClownLZSS_Segment *segment = (ClownLZSS_Segment*)item;\
+\
+	segment->complete = NAME##_Parse((TYPE*)segment->data, segment->data_size, segment->user, segment->run_lengths, segment->suffix_array, 1, segment->start_node, segment->end_node, segment->checkpoint_node, &segment->checkpoint_convergence, &segment->path, &segment->context);\
+}\
+\
+static void NAME##_OutputRecordedPath(TYPE *data, void *user, const ClownLZSS_Path *path, size_t first_node, size_t end_node, ClownLZSS_Context *context)\
+{\
+	size_t node = path->start_node;\
+\
+	CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_EMISSION);\
+	CLOWNLZSS_COUNT(ClownLZSS_Statistics statistics; ClownLZSS_StatisticsClear(&statistics);)\
+\
+	for (size_t i = 0; i < path->total_edges && node < end_node; ++i)\
+	{\
+		const size_t length = path->edges[i].length;\
+		const size_t offset = path->edges[i].offset;\
+\
+		if (node >= first_node)\
 		{\
-			node_meta_array[i + 1].u.cost = node_meta_array[i].u.cost + LITERAL_COST;\
-			node_meta_array[i + 1].previous_node_index = i;\
-			node_meta_array[i + 1].match_length = 0;\
+			if (length == 0)\
+			{\
+				LITERAL_CALLBACK(data[node], user);\
+				CLOWNLZSS_COUNT(ClownLZSS_StatisticsAddLiterals(&statistics, 1, (FORMAT).literal_cost);)\
+			}\
+			else\
+			{\
+				MATCH_CALLBACK(node - offset, length, offset, user);\
+				CLOWNLZSS_COUNT(\
+					const size_t distance = offset < node ? node - offset : 0;\
+					ClownLZSS_StatisticsAddMatch(&statistics, distance, length, ClownLZSS_GetMatchCost(&(FORMAT), distance, length, user));\
+				)\
+			}\
 		}\
+\
+		node += length == 0 ? 1 : length;\
 	}\
 \
-	/* Mark start/end nodes for the following loops */\
-	node_meta_array[0].previous_node_index = (size_t)-1;\
-	node_meta_array[data_size].u.next_node_index = (size_t)-1;\
+	CLOWNLZSS_COUNT(ClownLZSS_ContextAddStatistics(context, &statistics);)\
+	CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_EMISSION);\
+}\
+\
+/* Segment N is joined to segment N - 1 at a node that both of their paths pass
+   through, and that both converge on once the positions up to where segment
+   N - 1 stops have been searched. The serial parse converges on it too at that
+   point, so from there on, it and segment N find exactly the same path.
+   If there is no such node, segment N is parsed again, starting at the node
+   that segment N - 1 converged on. */\
+static bool NAME##_ParseInParallel(TYPE *data, size_t data_size, void *user, const unsigned int *run_lengths, const ClownLZSS_SuffixArray *suffix_array, size_t total_segments, ClownLZSS_Context *context)\
+{\
+	const ClownLZSS_Allocator *allocator = ClownLZSS_ContextGetAllocator(context);\
+	ClownLZSS_Segment *segments = (ClownLZSS_Segment*)ClownLZSS_Allocate(allocator, total_segments * sizeof(ClownLZSS_Segment));\
 \
-	/* Reverse the direction of the edges, so we can parse the LZSS graph from start to end */\
-	for (size_t node_index = data_size; node_meta_array[node_index].previous_node_index != (size_t)-1; node_index = node_meta_array[node_index].previous_node_index)\
-		node_meta_array[node_meta_array[node_index].previous_node_index].u.next_node_index = node_index;\
+	if (segments == NULL)\
+		return false;\
 \
-	/* Go through our now-complete LZSS graph, and output the optimally-compressed file */\
-	for (size_t node_index = 0; node_meta_array[node_index].u.next_node_index != (size_t)-1; node_index = node_meta_array[node_index].u.next_node_index)\
+	for (size_t i = 0; i < total_segments; ++i)\
 	{\
-		const size_t next_index = node_meta_array[node_index].u.next_node_index;\
-		const size_t length = node_meta_array[next_index].match_length;\
-		const size_t offset = node_meta_array[next_index].match_offset;\
+		ClownLZSS_Segment *segment = &segments[i];\
 \
-		if (length == 0)\
-			LITERAL_CALLBACK(data[node_index], user);\
-		else\
-			MATCH_CALLBACK(next_index - length - offset, length, offset, user);\
+		segment->data = data;\
+		segment->data_size = data_size;\
+		segment->user = user;\
+		segment->run_lengths = run_lengths;\
+		segment->suffix_array = suffix_array;\
+		segment->start_node = data_size / total_segments * i;\
+		segment->end_node = i == total_segments - 1 ? data_size : data_size / total_segments * (i + 1) + CLOWNLZSS_PARALLEL_PARSE_OVERLAP;\
+		segment->checkpoint_node = i == 0 ? 0 : segment->start_node + CLOWNLZSS_PARALLEL_PARSE_OVERLAP;\
+		segment->checkpoint_convergence = segment->start_node;\
+		ClownLZSS_PathInit(&segment->path, segment->start_node, allocator);\
+		ClownLZSS_ContextInitWorker(&segment->context, context);\
+	}\
+\
+	ClownLZSS_RunInParallel(NAME##_ParseSegment, segments, sizeof(ClownLZSS_Segment), total_segments, total_segments);\
+\
+	bool success = true;\
+	size_t first_node = 0;\
+\
+	for (size_t i = 0; i < total_segments && success; ++i)\
+	{\
+		ClownLZSS_Segment *segment = &segments[i];\
+\
+		if (i != 0)\
+		{\
+			const ClownLZSS_Segment *previous_segment = &segments[i - 1];\
+			size_t join_node = (size_t)-1;\
+\
+			if (segment->complete)\
+				join_node = ClownLZSS_PathFindCommonNode(&previous_segment->path, &segment->path, CLOWNLZSS_MIN(previous_segment->path.end_node, segment->checkpoint_convergence));\
+\
+			if (join_node == (size_t)-1)\
+			{\
+				/* Every path of the serial parse goes through the node that the
+				   previous segment converged on, so starting there is always correct */\
+				join_node = previous_segment->path.end_node;\
+\
+				ClownLZSS_PathDeinit(&segment->path);\
+				ClownLZSS_PathInit(&segment->path, join_node, allocator);\
+				segment->start_node = join_node;\
+				segment->checkpoint_node = 0;\
+				NAME##_ParseSegment(segment);\
+			}\
+\
+			NAME##_OutputRecordedPath(data, user, &previous_segment->path, first_node, join_node, context);\
+			first_node = join_node;\
+		}\
+\
+		success = segment->complete;\
 	}\
 \
-	free(node_meta_array);\
+	if (success)\
+		NAME##_OutputRecordedPath(data, user, &segments[total_segments - 1].path, first_node, data_size, context);\
+\
+	for (size_t i = 0; i < total_segments; ++i)\
+	{\
+		ClownLZSS_PathDeinit(&segments[i].path);\
+		ClownLZSS_ContextDeinit(&segments[i].context);\
+	}\
+\
+	ClownLZSS_Free(allocator, segments);\
+\
+	return success;\
+}\
+\
+void NAME(TYPE *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, void *user)\
+{\
+	const size_t total_threads = ClownLZSS_ContextGetThreadCount(context);\
+	const ClownLZSS_Level *fast_level = ClownLZSS_GetLevel(level);\
+\
+	CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_RUN_LENGTHS);\
+	unsigned int *run_lengths = ClownLZSS_RunLengthsCreate(data, sizeof(TYPE), data_size, context);\
+	CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_RUN_LENGTHS);\
+\
+	if (run_lengths == NULL)\
+		return;\
+\
+	if (fast_level != NULL)\
+	{\
+		NAME##_ParseFast(data, data_size, user, run_lengths, fast_level, context);\
+		ClownLZSS_ContextFree(context, run_lengths);\
+		return;\
+	}\
+\
+	CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_SUFFIX_ARRAY);\
+	ClownLZSS_SuffixArray suffix_array;\
+	const bool use_suffix_array = !CLOWNLZSS_BRUTE_FORCE && data_size >= CLOWNLZSS_SUFFIX_ARRAY_THRESHOLD && ClownLZSS_SuffixArrayInit(&suffix_array, data, sizeof(TYPE), data_size, context);\
+	CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_SUFFIX_ARRAY);\
+\
+	size_t total_segments = 1;\
+\
+	if (ClownLZSS_ContextGetParallelParse(context))\
+		total_segments = CLOWNLZSS_MAX(1, CLOWNLZSS_MIN(total_threads, data_size / CLOWNLZSS_PARALLEL_PARSE_MINIMUM_SEGMENT));\
+\
+	if (total_segments > 1)\
+		NAME##_ParseInParallel(data, data_size, user, run_lengths, use_suffix_array ? &suffix_array : NULL, total_segments, context);\
+	else\
+		NAME##_Parse(data, data_size, user, run_lengths, use_suffix_array ? &suffix_array : NULL, total_threads, 0, data_size, 0, NULL, NULL, context);\
+\
+	if (use_suffix_array)\
+		ClownLZSS_SuffixArrayDeinit(&suffix_array);\
+\
+	ClownLZSS_ContextFree(context, run_lengths);\
 }
@@ -23,50 +23,658 @@
 #include <stddef.h>
 #include <stdlib.h>
 
+#include "cache.h"
+#include "clownlzss.h"
 #include "memory_stream.h"
 
-unsigned char* RegularWrapper(unsigned char *data, size_t data_size, size_t *compressed_size, void *user_data, void (*function)(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user_data))
+// A call without a context is given one of its own, so that every call can tell whether it ran out of memory.
+// If even that cannot be made, the call goes ahead without one. The context keeps no buffers, like a shared
+// one, so that memory is still freed as soon as it is done with, instead of being held until the call ends.
+static ClownLZSS_Context* BeginCall(ClownLZSS_Context *context, ClownLZSS_Context *local_context)
 {
-	MemoryStream *output_stream = MemoryStream_Create(false);
+	if (context == NULL)
+	{
+		if (!ClownLZSS_ContextInit(local_context))
+		{
+			ClownLZSS_ContextDeinit(local_context);
+			return NULL;
+		}
+
+		local_context->keep_buffers = false;
+		context = local_context;
+	}
+
+	ClownLZSS_ContextBeginCall(context);
+
+	return context;
+}
+
+static bool HasRunOutOfMemory(ClownLZSS_Context *context)
+{
+	return context != NULL && ClownLZSS_ContextHasRunOutOfMemory(context);
+}
+
+// Returns false if the call ran out of memory
+static bool EndCall(ClownLZSS_Context *context, ClownLZSS_Context *local_context)
+{
+	const bool success = !HasRunOutOfMemory(context);
+
+	if (context == local_context)
+		ClownLZSS_ContextDeinit(local_context);
+
+	return success;
+}
+
+// Counts how often the buffer of the compressed data had to grow towards the call's statistics
+static void CountStream(ClownLZSS_Context *context, MemoryStream *stream)
+{
+#if CLOWNLZSS_STATISTICS
+	ClownLZSS_Statistics statistics;
+	ClownLZSS_StatisticsClear(&statistics);
+	statistics.output_reallocations = MemoryStream_GetTotalReallocations(stream);
+	statistics.output_bytes_copied = MemoryStream_GetBytesCopied(stream);
+	ClownLZSS_ContextAddStatistics(context, &statistics);
+#else
+	(void)context;
+	(void)stream;
+#endif
+}
+
+// A call whose output is looked up in the context's cache before compressing, and added to it afterwards
+typedef struct CachedCall
+{
+	ClownLZSS_Cache *cache;	// NULL if the context has none
+	CacheKey key;
+} CachedCall;
+
+// Returns the output of the call from the context's cache, allocated with the context's allocator,
+// or NULL if it is not there, or the context has no cache
+static unsigned char* FindInCache(CachedCall *call, ClownLZSS_Context *context, const unsigned char *data, size_t data_size, const char *name, unsigned int level, size_t module_size, size_t *size)
+{
+	call->cache = ClownLZSS_ContextGetCache(context);
+
+	if (call->cache == NULL)
+		return NULL;
+
+	CacheKey_Init(&call->key, data, data_size, name, level, module_size);
 
-	function(data, data_size, output_stream, user_data);
+	unsigned char *output = Cache_Find(call->cache, &call->key, ClownLZSS_ContextGetAllocator(context), size);
+	context->cached = output != NULL;
 
-	unsigned char *out_buffer = MemoryStream_GetBuffer(output_stream);
+	return output;
+}
+
+// Writes the output of the call from the context's cache into 'stream', instead of it being compressed, if it is there
+static bool ReadFromCache(CachedCall *call, ClownLZSS_Context *context, const unsigned char *data, size_t data_size, const char *name, unsigned int level, MemoryStream *stream)
+{
+	size_t size;
+	unsigned char *output = FindInCache(call, context, data, data_size, name, level, 0, &size);
+
+	if (output == NULL)
+		return false;
+
+	MemoryStream_WriteBytes(stream, output, size);
+	ClownLZSS_Free(ClownLZSS_ContextGetAllocator(context), output);
+
+	return true;
+}
+
+// Adds the compressed data in 'stream' to the cache, unless the data is incomplete
+static void AddToCache(const CachedCall *call, ClownLZSS_Context *context, MemoryStream *stream)
+{
+	if (call->cache != NULL && !HasRunOutOfMemory(context) && !MemoryStream_HasFailed(stream))
+		Cache_Add(call->cache, &call->key, MemoryStream_GetBuffer(stream), MemoryStream_GetPosition(stream));
+}
+
+unsigned char* RegularWrapper(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function)
+{
+	ClownLZSS_Context local_context;
+	context = BeginCall(context, &local_context);
+
+	// The buffer is handed to the caller, who frees it with free, so it comes from malloc
+	MemoryStream output_stream;
+	MemoryStream_Init(&output_stream, true);
+
+	CachedCall cached_call;
+
+	if (!ReadFromCache(&cached_call, context, data, data_size, name, level, &output_stream))
+	{
+		function(data, data_size, level, context, &output_stream, user_data);
+		CountStream(context, &output_stream);
+		AddToCache(&cached_call, context, &output_stream);
+	}
+
+	const bool success = EndCall(context, &local_context) && !MemoryStream_HasFailed(&output_stream);
+
+	unsigned char *out_buffer = NULL;
+	size_t buffer_size;
+
+	if (success)
+		out_buffer = MemoryStream_ReleaseBuffer(&output_stream, &buffer_size);
 
 	if (compressed_size)
-		*compressed_size = MemoryStream_GetPosition(output_stream);
+		*compressed_size = success ? MemoryStream_GetPosition(&output_stream) : 0;
 
-	MemoryStream_Destroy(output_stream);
+	MemoryStream_Deinit(&output_stream);
 
 	return out_buffer;
 }
 
-unsigned char* ModuledCompressionWrapper(unsigned char *data, size_t data_size, size_t *out_compressed_size, void *user_data, void (*function)(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user_data), size_t module_size, size_t module_alignment)
+bool RegularBufferWrapper(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function)
 {
-	MemoryStream *output_stream = MemoryStream_Create(false);
+	ClownLZSS_Context local_context;
+	context = BeginCall(context, &local_context);
+
+	MemoryStream output_stream;
+	MemoryStream_InitWithBuffer(&output_stream, buffer, buffer_size);
+	MemoryStream_SetAllocator(&output_stream, ClownLZSS_ContextGetAllocator(context));
+
+	CachedCall cached_call;
+
+	if (!ReadFromCache(&cached_call, context, data, data_size, name, level, &output_stream))
+	{
+		function(data, data_size, level, context, &output_stream, user_data);
+		CountStream(context, &output_stream);
+		AddToCache(&cached_call, context, &output_stream);
+	}
+
+	const bool success = EndCall(context, &local_context) && !MemoryStream_HasOverflowed(&output_stream) && !MemoryStream_HasFailed(&output_stream);
+
+	if (compressed_size)
+		*compressed_size = MemoryStream_GetPosition(&output_stream);
+
+	MemoryStream_Deinit(&output_stream);
+
+	return success;
+}
+
+bool RegularSinkWrapper(unsigned char *data, size_t data_size, CompressionSink sink, void *sink_user_data, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function)
+{
+	ClownLZSS_Context local_context;
+	context = BeginCall(context, &local_context);
+
+	// Every format goes back to fill in earlier parts of its output (descriptors, headers),
+	// so nothing is final until the whole stream is, and it is handed over in one piece
+	MemoryStream output_stream;
+	ScratchStream_Init(&output_stream, context, CLOWNLZSS_CONTEXT_OUTPUT);
+
+	CachedCall cached_call;
+
+	if (!ReadFromCache(&cached_call, context, data, data_size, name, level, &output_stream))
+	{
+		function(data, data_size, level, context, &output_stream, user_data);
+		CountStream(context, &output_stream);
+		AddToCache(&cached_call, context, &output_stream);
+	}
+
+	const size_t size = MemoryStream_GetPosition(&output_stream);
+	bool success = !HasRunOutOfMemory(context) && !MemoryStream_HasFailed(&output_stream);
+
+	if (success)
+		success = sink(MemoryStream_GetBuffer(&output_stream), size, sink_user_data);
+
+	if (compressed_size)
+		*compressed_size = size;
+
+	ScratchStream_Deinit(&output_stream, context, CLOWNLZSS_CONTEXT_OUTPUT);
+
+	return EndCall(context, &local_context) && success;
+}
+
+typedef struct Module
+{
+	unsigned char *data;
+	size_t data_size;
+	unsigned int level;
+	void *user_data;
+	CompressionFunction function;
+	MemoryStream output_stream;
+	ClownLZSS_Context context;	// The modules are compressed on different threads, so they cannot share a context
+} Module;
+
+static void CompressModule(void *item)
+{
+	Module *module = (Module*)item;
+
+	ScratchStream_Init(&module->output_stream, &module->context, CLOWNLZSS_CONTEXT_OUTPUT);
+	CLOWNLZSS_PROFILE_BEGIN(&module->context, CLOWNLZSS_STAGE_MODULE);
+	module->function(module->data, module->data_size, module->level, &module->context, &module->output_stream, module->user_data);
+	CLOWNLZSS_PROFILE_END(&module->context, CLOWNLZSS_STAGE_MODULE);
+	CountStream(&module->context, &module->output_stream);
+}
+
+// Passes a compressed module to the sink, after the padding that aligns it to 'module_alignment'
+static bool SinkModule(const unsigned char *bytes, size_t size, size_t previous_size, size_t module_alignment, CompressionSink sink, void *sink_user_data, size_t *total_size)
+{
+	static const unsigned char padding[0x10] = {0};
+
+	bool success = true;
+
+	if (previous_size % module_alignment)
+	{
+		for (size_t padding_size = module_alignment - (previous_size % module_alignment); padding_size != 0 && success; )
+		{
+			const size_t chunk_size = CLOWNLZSS_MIN(padding_size, sizeof(padding));
+
+			success = sink(padding, chunk_size, sink_user_data);
+			padding_size -= chunk_size;
+			*total_size += chunk_size;
+		}
+	}
+
+	if (success)
+		success = sink(bytes, size, sink_user_data);
+
+	*total_size += size;
+
+	return success;
+}
+
+typedef struct TeeSink
+{
+	CompressionSink sink;
+	void *user_data;
+	MemoryStream copy;
+} TeeSink;
+
+static bool WriteToTee(const unsigned char *bytes, size_t size, void *user_data)
+{
+	TeeSink *tee = (TeeSink*)user_data;
+
+	MemoryStream_WriteBytes(&tee->copy, bytes, size);
+
+	return tee->sink(bytes, size, tee->user_data);
+}
+
+// Compresses the modules, then passes the header, each module, and the padding between them to the sink in order
+static bool CompressModules(unsigned char *data, size_t data_size, size_t *out_compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function, size_t module_size, size_t module_alignment, CompressionSink sink, void *sink_user_data)
+{
+	const size_t total_modules = (data_size + module_size - 1) / module_size;
+
+	ClownLZSS_Context local_context;
+	context = BeginCall(context, &local_context);
+
+	const size_t total_threads = ClownLZSS_ContextGetThreadCount(context);
+
+	CachedCall cached_call;
+	size_t cached_size;
+	unsigned char *cached_output = FindInCache(&cached_call, context, data, data_size, name, level, module_size, &cached_size);
+
+	if (cached_output != NULL)
+	{
+		const bool success = sink(cached_output, cached_size, sink_user_data);
+		ClownLZSS_Free(ClownLZSS_ContextGetAllocator(context), cached_output);
+
+		if (out_compressed_size)
+			*out_compressed_size = cached_size;
+
+		return EndCall(context, &local_context) && success;
+	}
+
+	// To be added to the cache, the output is copied on its way to the sink, as the sink may not keep it
+	TeeSink tee;
+
+	if (cached_call.cache != NULL)
+	{
+		tee.sink = sink;
+		tee.user_data = sink_user_data;
+		MemoryStream_Init(&tee.copy, true);
+		MemoryStream_SetAllocator(&tee.copy, ClownLZSS_ContextGetAllocator(context));
+
+		sink = WriteToTee;
+		sink_user_data = &tee;
+	}
 
 	const unsigned short header = (unsigned short)((data_size % module_size) | ((data_size / module_size) << 12));
+	const unsigned char header_bytes[2] = {header >> 8, header & 0xFF};
 
-	MemoryStream_WriteByte(output_stream, header >> 8);
-	MemoryStream_WriteByte(output_stream, header & 0xFF);
+	bool success = sink(header_bytes, sizeof(header_bytes), sink_user_data);
+	size_t total_size = sizeof(header_bytes);
 
-	for (size_t compressed_size = 0, i = 0; i < data_size; i += module_size)
+	if (context != NULL && (total_threads <= 1 || total_modules <= 1))
 	{
-		if (compressed_size % module_alignment)
-			for (unsigned int i = 0; i < module_alignment - (compressed_size % module_alignment); ++i)
-				MemoryStream_WriteByte(output_stream, 0);
+		// With nothing to run alongside, each module is compressed into the context's
+		// buffer and passed on straight away, so that nothing has to be allocated
+		for (size_t compressed_size = 0, i = 0; i < total_modules && success; ++i)
+		{
+			const size_t this_module_size = CLOWNLZSS_MIN(module_size, data_size - i * module_size);
+
+			MemoryStream output_stream;
+			ScratchStream_Init(&output_stream, context, CLOWNLZSS_CONTEXT_OUTPUT);
+
+			CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_MODULE);
+			function(data + i * module_size, this_module_size, level, context, &output_stream, user_data);
+			CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_MODULE);
+			CountStream(context, &output_stream);
+
+			success = !HasRunOutOfMemory(context) && !MemoryStream_HasFailed(&output_stream) && SinkModule(MemoryStream_GetBuffer(&output_stream), MemoryStream_GetPosition(&output_stream), compressed_size, module_alignment, sink, sink_user_data, &total_size);
+			compressed_size = MemoryStream_GetPosition(&output_stream);
 
-		const size_t start = MemoryStream_GetPosition(output_stream);
-		function(data + i, module_size < data_size - i ? module_size : data_size - i, output_stream, user_data);
-		compressed_size = MemoryStream_GetPosition(output_stream) - start;
+			ScratchStream_Deinit(&output_stream, context, CLOWNLZSS_CONTEXT_OUTPUT);
+		}
 	}
+	else
+	{
+		// The modules do not depend on each other, so they are compressed
+		// all at once, and then joined together in order afterwards
+		Module *modules = (Module*)ClownLZSS_Allocate(ClownLZSS_ContextGetAllocator(context), total_modules * sizeof(Module));
+
+		if (modules == NULL && total_modules != 0)
+		{
+			if (cached_call.cache != NULL)
+				MemoryStream_Deinit(&tee.copy);
+
+			EndCall(context, &local_context);
+			return false;
+		}
+
+		for (size_t i = 0; i < total_modules; ++i)
+		{
+			modules[i].data = data + i * module_size;
+			modules[i].data_size = CLOWNLZSS_MIN(module_size, data_size - i * module_size);
+			modules[i].level = level;
+			modules[i].user_data = user_data;
+			modules[i].function = function;
+			ClownLZSS_ContextInitWorker(&modules[i].context, context);
+		}
+
+		ClownLZSS_RunInParallel(CompressModule, modules, sizeof(Module), total_modules, total_threads);
+
+		// A module that ran out of memory is incomplete, so none of them are passed on
+		success = success && !HasRunOutOfMemory(context);
+
+		for (size_t i = 0; i < total_modules; ++i)
+			success = success && !MemoryStream_HasFailed(&modules[i].output_stream);
 
-	unsigned char *out_buffer = MemoryStream_GetBuffer(output_stream);
+		for (size_t compressed_size = 0, i = 0; i < total_modules; ++i)
+		{
+			const size_t this_compressed_size = MemoryStream_GetPosition(&modules[i].output_stream);
+
+			if (success)
+				success = SinkModule(MemoryStream_GetBuffer(&modules[i].output_stream), this_compressed_size, compressed_size, module_alignment, sink, sink_user_data, &total_size);
+			else
+				total_size += this_compressed_size;
+
+			compressed_size = this_compressed_size;
+			ScratchStream_Deinit(&modules[i].output_stream, &modules[i].context, CLOWNLZSS_CONTEXT_OUTPUT);
+			ClownLZSS_ContextDeinit(&modules[i].context);
+		}
+
+		ClownLZSS_Free(ClownLZSS_ContextGetAllocator(context), modules);
+	}
 
 	if (out_compressed_size)
-		*out_compressed_size = MemoryStream_GetPosition(output_stream);
+		*out_compressed_size = total_size;
+
+	if (cached_call.cache != NULL)
+	{
+		if (success)
+			AddToCache(&cached_call, context, &tee.copy);
+
+		MemoryStream_Deinit(&tee.copy);
+	}
+
+	return EndCall(context, &local_context) && success;
+}
+
+static bool WriteToStream(const unsigned char *bytes, size_t size, void *user_data)
+{
+	MemoryStream *stream = (MemoryStream*)user_data;
+
+	MemoryStream_WriteBytes(stream, bytes, size);
+
+	return !MemoryStream_HasFailed(stream);
+}
 
-	MemoryStream_Destroy(output_stream);
+unsigned char* ModuledCompressionWrapper(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function, size_t module_size, size_t module_alignment)
+{
+	MemoryStream output_stream;
+	MemoryStream_Init(&output_stream, false);
+
+	if (!CompressModules(data, data_size, compressed_size, level, context, name, user_data, function, module_size, module_alignment, WriteToStream, &output_stream))
+	{
+		free(MemoryStream_GetBuffer(&output_stream));
+		return NULL;
+	}
+
+	// The stream that the modules are joined in is outside of the call, so only the caller's context can count it
+	CountStream(context, &output_stream);
+
+	unsigned char *out_buffer = MemoryStream_GetBuffer(&output_stream);
+
+	MemoryStream_Deinit(&output_stream);
 
 	return out_buffer;
 }
+
+bool ModuledBufferWrapper(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function, size_t module_size, size_t module_alignment)
+{
+	MemoryStream output_stream;
+	MemoryStream_InitWithBuffer(&output_stream, buffer, buffer_size);
+
+	const bool success = CompressModules(data, data_size, compressed_size, level, context, name, user_data, function, module_size, module_alignment, WriteToStream, &output_stream) && !MemoryStream_HasOverflowed(&output_stream);
+
+	CountStream(context, &output_stream);
+	MemoryStream_Deinit(&output_stream);
+
+	return success;
+}
+
+bool ModuledSinkWrapper(unsigned char *data, size_t data_size, CompressionSink sink, void *sink_user_data, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function, size_t module_size, size_t module_alignment)
+{
+	return CompressModules(data, data_size, compressed_size, level, context, name, user_data, function, module_size, module_alignment, sink, sink_user_data);
+}
+
+void ScratchStream_Init(MemoryStream *stream, ClownLZSS_Context *context, ClownLZSS_ContextBuffer buffer)
+{
+	if (context == NULL)
+		MemoryStream_Init(stream, true);
+	else
+		MemoryStream_InitWithBuffer(stream, (unsigned char*)context->buffers[buffer].memory, context->buffers[buffer].size);
+
+	MemoryStream_SetAllocator(stream, ClownLZSS_ContextGetAllocator(context));
+}
+
+void ScratchStream_Deinit(MemoryStream *stream, ClownLZSS_Context *context, ClownLZSS_ContextBuffer buffer)
+{
+	// The buffer that the stream grew into is kept for next time
+	if (context != NULL && MemoryStream_HasOverflowed(stream))
+	{
+		size_t size;
+		unsigned char *memory = MemoryStream_ReleaseBuffer(stream, &size);
+
+		ClownLZSS_ContextReplace(context, buffer, memory, size);
+	}
+
+	MemoryStream_Deinit(stream);
+}
+
+size_t CompressBound(size_t header_size, size_t total_bits, size_t descriptor_size)
+{
+	// Both parsers only use a match when it costs fewer bits than the literals it replaces,
+	// so the bits can never add up to more than 'total_bits'. Splitting them into descriptors
+	// and match bytes can waste what is left of the last descriptor, as well as one more
+	// descriptor that is started just before the stream ends.
+	return header_size + (total_bits + 7) / 8 + descriptor_size * 2;
+}
+
+size_t ModuledCompressBound(size_t data_size, size_t module_size, size_t module_alignment, size_t module_bound, size_t last_module_bound)
+{
+	const size_t full_modules = data_size / module_size;
+	const size_t total_modules = (data_size + module_size - 1) / module_size;
+	size_t bound = 2 + full_modules * module_bound;
+
+	if (full_modules != total_modules)
+		bound += last_module_bound;
+
+	// Padding before every module but the first
+	if (total_modules != 0)
+		bound += (total_modules - 1) * (module_alignment - 1);
+
+	return bound;
+}
+
+static void ReserveDescriptor(BitWriter *writer)
+{
+	const size_t descriptor_size = writer->total_descriptor_bits / 8;
+
+	if (writer->capacity - writer->position < descriptor_size)
+		BitWriter_Reserve(writer, descriptor_size);
+
+	writer->descriptor_position = writer->position;
+	writer->position += descriptor_size;
+	writer->descriptor = 0;
+	writer->descriptor_bits = 0;
+}
+
+static void WriteDescriptor(BitWriter *writer)
+{
+	unsigned char *destination = &writer->buffer[writer->descriptor_position];
+
+	if (writer->total_descriptor_bits == 8)
+	{
+		destination[0] = writer->descriptor & 0xFF;
+	}
+	else if (writer->big_endian)
+	{
+		destination[0] = (writer->descriptor >> 8) & 0xFF;
+		destination[1] = writer->descriptor & 0xFF;
+	}
+	else
+	{
+		destination[0] = writer->descriptor & 0xFF;
+		destination[1] = (writer->descriptor >> 8) & 0xFF;
+	}
+}
+
+void BitWriter_Init(BitWriter *writer, MemoryStream *stream, unsigned int total_descriptor_bits, bool big_endian, bool first_bit_high, bool start_when_full)
+{
+	writer->stream = stream;
+	writer->position = MemoryStream_GetPosition(stream);
+	writer->capacity = MemoryStream_Reserve(stream, writer->position);
+	writer->buffer = MemoryStream_GetBuffer(stream);
+	writer->descriptor = 0;
+	writer->descriptor_bits = 0;
+	writer->total_descriptor_bits = total_descriptor_bits;
+	writer->big_endian = big_endian;
+	writer->first_bit_high = first_bit_high;
+	writer->start_when_full = start_when_full;
+
+	// The first descriptor always comes before anything else
+	if (total_descriptor_bits != 0)
+		ReserveDescriptor(writer);
+}
+
+void BitWriter_Finish(BitWriter *writer)
+{
+	if (writer->total_descriptor_bits != 0)
+		WriteDescriptor(writer);
+
+	if (!MemoryStream_HasFailed(writer->stream))
+		MemoryStream_SetPosition(writer->stream, (ptrdiff_t)writer->position, MEMORYSTREAM_START);
+}
+
+void BitWriter_Reserve(BitWriter *writer, size_t length)
+{
+	writer->capacity = MemoryStream_Reserve(writer->stream, writer->position + length);
+	writer->buffer = MemoryStream_GetBuffer(writer->stream);
+
+	// Once the stream has run out of memory, the output is lost anyway,
+	// so the rest of it is written over the scrap buffer, to be thrown away
+	if (MemoryStream_HasFailed(writer->stream))
+	{
+		writer->buffer = writer->scrap;
+		writer->capacity = sizeof(writer->scrap);
+		writer->position = 0;
+		writer->descriptor_position = 0;
+	}
+}
+
+void BitWriter_StartDescriptor(BitWriter *writer)
+{
+	WriteDescriptor(writer);
+	ReserveDescriptor(writer);
+}
+
+bool DecompressionBuffer_Reserve(DecompressionBuffer *output, size_t length)
+{
+	if (length > output->capacity - output->position)
+	{
+		size_t new_capacity = output->capacity == 0 ? 0x1000 : output->capacity;
+
+		while (new_capacity - output->position < length)
+			new_capacity *= 2;
+
+		unsigned char *new_buffer = (unsigned char*)realloc(output->buffer, new_capacity);
+
+		if (new_buffer == NULL)
+			return false;
+
+		output->buffer = new_buffer;
+		output->capacity = new_capacity;
+	}
+
+	return true;
+}
+
+unsigned char* RegularDecompressionWrapper(unsigned char *data, size_t data_size, size_t *decompressed_size, void *user_data, DecompressionFunction function)
+{
+	DecompressionInput input = {data, data_size, 0, false};
+	DecompressionBuffer output = {NULL, 0, 0, 0};
+
+	// Reserve some space, so that an empty output is not mistaken for a failure
+	if (!DecompressionBuffer_Reserve(&output, 1))
+		return NULL;
+
+	if (!function(&input, &output, (size_t)-1, user_data) || input.out_of_data)
+	{
+		free(output.buffer);
+		return NULL;
+	}
+
+	if (decompressed_size)
+		*decompressed_size = output.position;
+
+	return output.buffer;
+}
+
+unsigned char* ModuledDecompressionWrapper(unsigned char *data, size_t data_size, size_t *decompressed_size, void *user_data, DecompressionFunction function, size_t module_size, size_t module_alignment)
+{
+	if (data_size < 2)
+		return NULL;
+
+	// This is the reverse of the header that ModuledCompressionWrapper writes
+	const unsigned short header = (unsigned short)((data[0] << 8) | data[1]);
+	const size_t total_size = (header >> 12) * module_size + (header & 0xFFF);
+
+	DecompressionInput input = {data, data_size, 2, false};
+	DecompressionBuffer output = {NULL, 0, 0, 0};
+
+	if (!DecompressionBuffer_Reserve(&output, 1))
+		return NULL;
+
+	while (output.position < total_size)
+	{
+		const size_t this_module_size = CLOWNLZSS_MIN(module_size, total_size - output.position);
+		const size_t module_start = input.position;
+
+		output.stream_start = output.position;
+
+		if (!function(&input, &output, this_module_size, user_data) || input.out_of_data || output.position - output.stream_start != this_module_size)
+		{
+			free(output.buffer);
+			return NULL;
+		}
+
+		// Skip the padding before the next module
+		const size_t compressed_size = input.position - module_start;
+
+		if (output.position < total_size && compressed_size % module_alignment)
+			input.position += module_alignment - (compressed_size % module_alignment);
+	}
+
+	if (decompressed_size)
+		*decompressed_size = output.position;
+
+	return output.buffer;
+}
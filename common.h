@@ -20,9 +20,172 @@
 
 #pragma once
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
 #include <stddef.h>
+#include <string.h>
 
+#include "clownlzss.h"
 #include "memory_stream.h"
 
-unsigned char* RegularWrapper(unsigned char *data, size_t data_size, size_t *compressed_size, void *user_data, void (*function)(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user_data));
-unsigned char* ModuledCompressionWrapper(unsigned char *data, size_t data_size, size_t *compressed_size, void *user_data, void (*function)(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user_data), size_t module_size, size_t module_alignment);
+// 'level' is one of the CLOWNLZSS_*_LEVEL compression levels, and is passed straight to the engine, along with 'context', which may be NULL
+typedef void (*CompressionFunction)(unsigned char *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, MemoryStream *output_stream, void *user_data);
+
+// Receives the compressed data in order, a piece at a time. Returning false stops compression.
+typedef bool (*CompressionSink)(const unsigned char *bytes, size_t size, void *user_data);
+
+// In all of these, 'name' identifies the format, and any options that it is given in 'user_data', in the
+// keys of the context's cache. If the output is in the cache, it is read from there instead of compressing.
+
+unsigned char* RegularWrapper(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function);
+unsigned char* ModuledCompressionWrapper(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function, size_t module_size, size_t module_alignment);
+
+// These compress into the caller's buffer, and return false if it is too small, in which case
+// 'compressed_size' is still set to how large it needed to be
+bool RegularBufferWrapper(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function);
+bool ModuledBufferWrapper(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function, size_t module_size, size_t module_alignment);
+
+// These pass the compressed data to 'sink', and return false if it does
+bool RegularSinkWrapper(unsigned char *data, size_t data_size, CompressionSink sink, void *sink_user_data, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function);
+bool ModuledSinkWrapper(unsigned char *data, size_t data_size, CompressionSink sink, void *sink_user_data, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, const char *name, void *user_data, CompressionFunction function, size_t module_size, size_t module_alignment);
+
+// A stream that writes into one of the context's buffers, and gives the buffer back to the context
+// if it has to grow, so that later streams start out large enough. Without a context, it is a plain stream.
+// Either way, its memory comes from the context's allocator.
+void ScratchStream_Init(MemoryStream *stream, ClownLZSS_Context *context, ClownLZSS_ContextBuffer buffer);
+void ScratchStream_Deinit(MemoryStream *stream, ClownLZSS_Context *context, ClownLZSS_ContextBuffer buffer);
+
+// The most that a stream can compress to, given the size of its header, the cost in bits
+// of encoding all of its data as literals plus its terminator, and the size of a descriptor
+size_t CompressBound(size_t header_size, size_t total_bits, size_t descriptor_size);
+// The most that moduled data can compress to, given the bounds of a full module and of the last, partial module
+size_t ModuledCompressBound(size_t data_size, size_t module_size, size_t module_alignment, size_t module_bound, size_t last_module_bound);
+
+// Writes a compressed stream's descriptor bits and match bytes straight into the output.
+// Each descriptor is given its place in the output as soon as it is started, and is
+// filled in once all of its bits are known, so the match bytes that follow it never
+// have to be held back and copied after it.
+typedef struct BitWriter
+{
+	MemoryStream *stream;
+	unsigned char *buffer;	// The stream's buffer, which is written to directly
+	size_t position;
+	size_t capacity;	// How much of 'buffer' can be written to before it must grow
+	size_t descriptor_position;
+	unsigned int descriptor;
+	unsigned int descriptor_bits;	// How many bits of the current descriptor have been written
+	unsigned int total_descriptor_bits;	// 8 or 16, or 0 if the writer is only used for bytes
+	bool big_endian;	// The byte order of 16-bit descriptors
+	bool first_bit_high;	// Whether the first bit is the descriptor's highest, rather than its lowest
+	bool start_when_full;	// Whether the next descriptor goes straight after a full one, rather than before the next bit
+	unsigned char scrap[0x10];	// Written to instead of the stream once it has run out of memory
+} BitWriter;
+
+void BitWriter_Init(BitWriter *writer, MemoryStream *stream, unsigned int total_descriptor_bits, bool big_endian, bool first_bit_high, bool start_when_full);
+// Fills in the last descriptor, even if it has no bits, and moves the stream's position to the end of the output
+void BitWriter_Finish(BitWriter *writer);
+void BitWriter_Reserve(BitWriter *writer, size_t length);
+void BitWriter_StartDescriptor(BitWriter *writer);
+
+static inline void BitWriter_PutByte(BitWriter *writer, unsigned char byte)
+{
+	if (writer->position == writer->capacity)
+		BitWriter_Reserve(writer, 1);
+
+	writer->buffer[writer->position++] = byte;
+}
+
+static inline void BitWriter_PutBit(BitWriter *writer, bool bit)
+{
+	if (writer->descriptor_bits == writer->total_descriptor_bits)
+		BitWriter_StartDescriptor(writer);
+
+	if (bit)
+		writer->descriptor |= 1u << (writer->first_bit_high ? writer->total_descriptor_bits - 1 - writer->descriptor_bits : writer->descriptor_bits);
+
+	if (++writer->descriptor_bits == writer->total_descriptor_bits && writer->start_when_full)
+		BitWriter_StartDescriptor(writer);
+}
+
+// The compressed data that a decompressor reads from
+typedef struct DecompressionInput
+{
+	const unsigned char *data;
+	size_t size;
+	size_t position;
+	bool out_of_data;
+} DecompressionInput;
+
+// The decompressed data, which matches are copied out of
+typedef struct DecompressionBuffer
+{
+	unsigned char *buffer;
+	size_t position;
+	size_t capacity;
+	size_t stream_start;	// Where the output of the stream being decompressed begins
+} DecompressionBuffer;
+
+// 'decompressed_size' is how much the stream should decompress to, or (size_t)-1 if it is not known
+typedef bool (*DecompressionFunction)(DecompressionInput *input, DecompressionBuffer *output, size_t decompressed_size, void *user_data);
+
+bool DecompressionBuffer_Reserve(DecompressionBuffer *output, size_t length);
+
+static inline unsigned char DecompressionInput_ReadByte(DecompressionInput *input)
+{
+	if (input->position >= input->size)
+	{
+		input->out_of_data = true;
+		return 0;
+	}
+
+	return input->data[input->position++];
+}
+
+static inline bool DecompressionBuffer_WriteByte(DecompressionBuffer *output, unsigned char byte)
+{
+	if (output->position == output->capacity && !DecompressionBuffer_Reserve(output, 1))
+		return false;
+
+	output->buffer[output->position++] = byte;
+
+	return true;
+}
+
+static inline bool DecompressionBuffer_Fill(DecompressionBuffer *output, unsigned char byte, size_t length)
+{
+	if (!DecompressionBuffer_Reserve(output, length))
+		return false;
+
+	memset(&output->buffer[output->position], byte, length);
+	output->position += length;
+
+	return true;
+}
+
+// Copies 'length' bytes from 'distance' bytes behind the end of the output
+static inline bool DecompressionBuffer_CopyMatch(DecompressionBuffer *output, size_t distance, size_t length)
+{
+	if (distance == 0 || distance > output->position - output->stream_start || !DecompressionBuffer_Reserve(output, length))
+		return false;
+
+	unsigned char *destination = &output->buffer[output->position];
+
+	output->position += length;
+
+	// Copy in chunks no longer than the distance, so that the source and destination never
+	// overlap: this lets memcpy move whole words, while still repeating short patterns
+	while (length != 0)
+	{
+		const size_t chunk_length = length < distance ? length : distance;
+
+		memcpy(destination, destination - distance, chunk_length);
+		destination += chunk_length;
+		length -= chunk_length;
+	}
+
+	return true;
+}
+
+unsigned char* RegularDecompressionWrapper(unsigned char *data, size_t data_size, size_t *decompressed_size, void *user_data, DecompressionFunction function);
+unsigned char* ModuledDecompressionWrapper(unsigned char *data, size_t data_size, size_t *decompressed_size, void *user_data, DecompressionFunction function, size_t module_size, size_t module_alignment);
@@ -33,44 +33,17 @@
 
 typedef struct ComperInstance
 {
-	MemoryStream *output_stream;
-	MemoryStream *match_stream;
-
-	unsigned short descriptor;
-	unsigned int descriptor_bits_remaining;
+	BitWriter writer;
 } ComperInstance;
 
-static void FlushData(ComperInstance *instance)
-{
-	MemoryStream_WriteByte(instance->output_stream, instance->descriptor >> 8);
-	MemoryStream_WriteByte(instance->output_stream, instance->descriptor & 0xFF);
-
-	const size_t match_buffer_size = MemoryStream_GetPosition(instance->match_stream);
-	unsigned char *match_buffer = MemoryStream_GetBuffer(instance->match_stream);
-
-	MemoryStream_WriteBytes(instance->output_stream, match_buffer, match_buffer_size);
-}
-
 static void PutMatchByte(ComperInstance *instance, unsigned char byte)
 {
-	MemoryStream_WriteByte(instance->match_stream, byte);
+	BitWriter_PutByte(&instance->writer, byte);
 }
 
 static void PutDescriptorBit(ComperInstance *instance, bool bit)
 {
-	if (instance->descriptor_bits_remaining == 0)
-	{
-		FlushData(instance);
-
-		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
-		MemoryStream_Rewind(instance->match_stream);
-	}
-
-	--instance->descriptor_bits_remaining;
-
-	instance->descriptor <<= 1;
-
-	instance->descriptor |= bit;
+	BitWriter_PutBit(&instance->writer, bit);
 }
 
 static void DoLiteral(unsigned short value, void *user)
@@ -93,54 +66,148 @@ static void DoMatch(size_t distance, size_t length, size_t offset, void *user)
 	PutMatchByte(instance, (unsigned char)(length - 1));
 }
 
-static unsigned int GetMatchCost(size_t distance, size_t length, void *user)
-{
-	(void)distance;
-	(void)length;
-	(void)user;
+static const ClownLZSS_MatchEncoding match_encodings[] = {
+	{0x100, 2, 0x100, 1 + 16}	// Descriptor bit, offset/length bytes
+};
 
-	return 1 + 16;	// Descriptor bit, offset/length bytes
-}
+static const ClownLZSS_Format format = {2, 0x100, 0x100, 1 + 16, match_encodings, sizeof(match_encodings) / sizeof(match_encodings[0]), NULL};
 
-static void FindExtraMatches(unsigned short *data, size_t data_size, size_t offset, ClownLZSS_GraphEdge *node_meta_array, void *user)
+static void FindExtraMatches(unsigned short *data, size_t data_size, const unsigned int *run_lengths, size_t offset, ClownLZSS_Graph *graph, void *user)
 {
 	(void)data;
 	(void)data_size;
+	(void)run_lengths;
 	(void)offset;
-	(void)node_meta_array;
+	(void)graph;
 	(void)user;
 }
 
-static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned short, 0x100, 0x100, FindExtraMatches, 1 + 16, DoLiteral, GetMatchCost, DoMatch)
+static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned short, format, FindExtraMatches, DoLiteral, DoMatch)
 
-static void ComperCompressStream(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user)
+static void ComperCompressStream(unsigned char *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, MemoryStream *output_stream, void *user)
 {
 	(void)user;
 
 	ComperInstance instance;
-	instance.output_stream = output_stream;
-	instance.match_stream = MemoryStream_Create(true);
-	instance.descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+	BitWriter_Init(&instance.writer, output_stream, TOTAL_DESCRIPTOR_BITS, true, true, false);
 
-	CompressData((unsigned short*)data, data_size / sizeof(unsigned short), &instance);
+	CompressData((unsigned short*)data, data_size / sizeof(unsigned short), level, context, &instance);
 
 	// Terminator match
 	PutDescriptorBit(&instance, 1);
 	PutMatchByte(&instance, 0);
 	PutMatchByte(&instance, 0);
 
-	instance.descriptor <<= instance.descriptor_bits_remaining;
-	FlushData(&instance);
+	BitWriter_Finish(&instance.writer);
+}
+
+unsigned char* ClownLZSS_ComperCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularWrapper(data, data_size, compressed_size, level, context, "comper", NULL, ComperCompressStream);
+}
+
+unsigned char* ClownLZSS_ModuledComperCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledCompressionWrapper(data, data_size, compressed_size, level, context, "comper", NULL, ComperCompressStream, module_size, 1);
+}
+
+size_t ClownLZSS_ComperCompressBound(size_t data_size)
+{
+	// The terminator match is included
+	return CompressBound(0, data_size / sizeof(unsigned short) * format.literal_cost + 1 + 16, TOTAL_DESCRIPTOR_BITS / 8);
+}
+
+size_t ClownLZSS_ModuledComperCompressBound(size_t data_size, size_t module_size)
+{
+	return ModuledCompressBound(data_size, module_size, 1, ClownLZSS_ComperCompressBound(module_size), ClownLZSS_ComperCompressBound(data_size % module_size));
+}
+
+bool ClownLZSS_ComperCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "comper", NULL, ComperCompressStream);
+}
+
+bool ClownLZSS_ModuledComperCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "comper", NULL, ComperCompressStream, module_size, 1);
+}
+
+bool ClownLZSS_ComperCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "comper", NULL, ComperCompressStream);
+}
+
+bool ClownLZSS_ModuledComperCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "comper", NULL, ComperCompressStream, module_size, 1);
+}
+
+typedef struct ComperDecompressionInstance
+{
+	DecompressionInput *input;
+
+	unsigned short descriptor;
+	unsigned int descriptor_bits_remaining;
+} ComperDecompressionInstance;
+
+static bool GetDescriptorBit(ComperDecompressionInstance *instance)
+{
+	if (instance->descriptor_bits_remaining == 0)
+	{
+		instance->descriptor = DecompressionInput_ReadByte(instance->input) << 8;
+		instance->descriptor |= DecompressionInput_ReadByte(instance->input);
+		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+	}
+
+	--instance->descriptor_bits_remaining;
+
+	const bool bit = instance->descriptor & (1 << (TOTAL_DESCRIPTOR_BITS - 1));
+
+	instance->descriptor <<= 1;
+
+	return bit;
+}
+
+static bool ComperDecompressStream(DecompressionInput *input, DecompressionBuffer *output, size_t decompressed_size, void *user)
+{
+	(void)decompressed_size;
+	(void)user;
+
+	ComperDecompressionInstance instance;
+	instance.input = input;
+	instance.descriptor_bits_remaining = 0;
+
+	while (!input->out_of_data)
+	{
+		if (!GetDescriptorBit(&instance))
+		{
+			// Literal (a whole word, stored in the same byte order as the original file)
+			if (!DecompressionBuffer_WriteByte(output, DecompressionInput_ReadByte(input)) || !DecompressionBuffer_WriteByte(output, DecompressionInput_ReadByte(input)))
+				return false;
+		}
+		else
+		{
+			// Match (the distance and length are in words)
+			const size_t distance = 0x100 - DecompressionInput_ReadByte(input);
+			const unsigned int length_byte = DecompressionInput_ReadByte(input);
+
+			if (length_byte == 0)
+				break;	// Terminator match
+
+			if (!DecompressionBuffer_CopyMatch(output, distance * 2, (length_byte + 1) * 2))
+				return false;
+		}
+	}
 
-	MemoryStream_Destroy(instance.match_stream);
+	return true;
 }
 
-unsigned char* ClownLZSS_ComperCompress(unsigned char *data, size_t data_size, size_t *compressed_size)
+unsigned char* ClownLZSS_ComperDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size)
 {
-	return RegularWrapper(data, data_size, compressed_size, NULL, ComperCompressStream);
+	return RegularDecompressionWrapper(data, data_size, decompressed_size, NULL, ComperDecompressStream);
 }
 
-unsigned char* ClownLZSS_ModuledComperCompress(unsigned char *data, size_t data_size, size_t *compressed_size, size_t module_size)
+unsigned char* ClownLZSS_ModuledComperDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, size_t module_size)
 {
-	return ModuledCompressionWrapper(data, data_size, compressed_size, NULL, ComperCompressStream, module_size, 1);
+	return ModuledDecompressionWrapper(data, data_size, decompressed_size, NULL, ComperDecompressStream, module_size, 1);
 }
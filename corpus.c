@@ -0,0 +1,557 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+/* Generates data that looks like the insides of a Mega Drive game, for the benchmarks
+   to compress. The same seed is always used, so the data is the same every time. */
+
+#include "corpus.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clownlzss.h"
+
+typedef struct Random
+{
+	unsigned long long state;
+} Random;
+
+static unsigned long Random_Next(Random *random)
+{
+	/* xorshift64* */
+	random->state ^= random->state >> 12;
+	random->state ^= random->state << 25;
+	random->state ^= random->state >> 27;
+	return (unsigned long)((random->state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+/* A number from 0 to 'limit' - 1 */
+static size_t Random_Below(Random *random, size_t limit)
+{
+	return (size_t)(Random_Next(random) % limit);
+}
+
+/* True 'percent' percent of the time */
+static bool Random_Chance(Random *random, unsigned int percent)
+{
+	return Random_Below(random, 100) < percent;
+}
+
+typedef struct Writer
+{
+	unsigned char *buffer;
+	size_t position;
+	size_t size;
+} Writer;
+
+static bool Writer_IsFull(const Writer *writer)
+{
+	return writer->position == writer->size;
+}
+
+static void Writer_Byte(Writer *writer, unsigned int byte)
+{
+	if (writer->position != writer->size)
+		writer->buffer[writer->position++] = (unsigned char)byte;
+}
+
+static void Writer_Word(Writer *writer, unsigned int word)
+{
+	Writer_Byte(writer, (word >> 8) & 0xFF);
+	Writer_Byte(writer, word & 0xFF);
+}
+
+static void Writer_Long(Writer *writer, unsigned long value)
+{
+	Writer_Word(writer, (value >> 16) & 0xFFFF);
+	Writer_Word(writer, value & 0xFFFF);
+}
+
+/* Copies some of what has already been written, like the same macro or phrase appearing twice */
+static void Writer_Repeat(Writer *writer, Random *random, size_t minimum_length, size_t maximum_length, size_t maximum_distance)
+{
+	const size_t distance = 1 + Random_Below(random, CLOWNLZSS_MIN(writer->position, maximum_distance));
+	const size_t length = minimum_length + Random_Below(random, maximum_length - minimum_length + 1);
+
+	for (size_t i = 0; i < length; ++i)
+		Writer_Byte(writer, writer->buffer[writer->position - distance]);
+}
+
+/* 4bpp 8x8 tiles, each of which uses a few colours in horizontal spans, with some
+   blank tiles, and some that repeat or mirror an earlier one */
+static void GenerateTiles(Writer *writer, Random *random)
+{
+	while (!Writer_IsFull(writer))
+	{
+		const size_t tile_start = writer->position;
+		const size_t earlier_tiles = tile_start / 0x20;
+		unsigned char pixels[8][8];
+
+		if (Random_Chance(random, 10))
+		{
+			memset(pixels, 0, sizeof(pixels));
+		}
+		else if (earlier_tiles != 0 && Random_Chance(random, 30))
+		{
+			/* Use an earlier tile as it is, or mirrored */
+			const size_t source = tile_start - 0x20 * (1 + Random_Below(random, CLOWNLZSS_MIN(earlier_tiles, 0x40)));
+			const bool horizontal_flip = Random_Chance(random, 40);
+			const bool vertical_flip = Random_Chance(random, 20);
+
+			for (unsigned int y = 0; y < 8; ++y)
+			{
+				for (unsigned int x = 0; x < 8; ++x)
+				{
+					const unsigned int source_x = horizontal_flip ? 7 - x : x;
+					const unsigned int source_y = vertical_flip ? 7 - y : y;
+					const unsigned char byte = writer->buffer[source + source_y * 4 + source_x / 2];
+
+					pixels[y][x] = source_x % 2 ? byte & 0xF : byte >> 4;
+				}
+			}
+		}
+		else
+		{
+			unsigned char colours[4];
+
+			colours[0] = Random_Chance(random, 60) ? 0 : (unsigned char)Random_Below(random, 0x10);
+			for (unsigned int i = 1; i < 4; ++i)
+				colours[i] = (unsigned char)(1 + Random_Below(random, 0xF));
+
+			for (unsigned int y = 0; y < 8; ++y)
+			{
+				if (y != 0 && Random_Chance(random, 50))
+				{
+					memcpy(pixels[y], pixels[y - 1], sizeof(pixels[y]));
+				}
+				else
+				{
+					memset(pixels[y], colours[0], sizeof(pixels[y]));
+
+					for (unsigned int span = Random_Below(random, 3); span != 0; --span)
+					{
+						const unsigned int start = (unsigned int)Random_Below(random, 8);
+						const unsigned int end = start + 1 + (unsigned int)Random_Below(random, 8 - start);
+
+						memset(&pixels[y][start], colours[1 + Random_Below(random, 3)], end - start);
+					}
+				}
+			}
+		}
+
+		for (unsigned int y = 0; y < 8; ++y)
+			for (unsigned int x = 0; x < 8; x += 2)
+				Writer_Byte(writer, (pixels[y][x] << 4) | pixels[y][x + 1]);
+	}
+}
+
+/* Plane mappings: big-endian words of priority, palette line, flip flags, and a tile index,
+   in 64-cell rows where the tiles of an image are mostly laid out one after another, and
+   rows are often the same as the one above */
+static void GenerateMappings(Writer *writer, Random *random)
+{
+	unsigned int tile = (unsigned int)Random_Below(random, 0x400);
+	unsigned int attributes = 0;
+
+	while (!Writer_IsFull(writer))
+	{
+		const unsigned int run = 1 + (unsigned int)Random_Below(random, 16);
+
+		if (writer->position >= 0x80 && writer->position % 0x80 == 0 && Random_Chance(random, 30))
+		{
+			/* The same row as the one above */
+			for (unsigned int i = 0; i < 0x80; ++i)
+				Writer_Byte(writer, writer->buffer[writer->position - 0x80]);
+
+			continue;
+		}
+
+		if (Random_Chance(random, 10))
+			attributes = (unsigned int)(Random_Below(random, 2) << 15 | Random_Below(random, 4) << 13);
+
+		if (Random_Chance(random, 20))
+		{
+			/* Blank cells */
+			for (unsigned int i = 0; i < run; ++i)
+				Writer_Word(writer, 0);
+		}
+		else if (Random_Chance(random, 15))
+		{
+			/* The same tile again and again, like a floor or a sky */
+			const unsigned int flip = (unsigned int)Random_Below(random, 4) << 11;
+
+			for (unsigned int i = 0; i < run; ++i)
+				Writer_Word(writer, attributes | flip | tile);
+		}
+		else
+		{
+			if (Random_Chance(random, 10))
+				tile = (unsigned int)Random_Below(random, 0x7FF);
+
+			for (unsigned int i = 0; i < run; ++i)
+				Writer_Word(writer, attributes | (tile++ & 0x7FF));
+		}
+	}
+}
+
+/* SMPS music: notes and durations, coordination flags and their parameters, and phrases
+   that are played again, sometimes with a pointer to jump or loop back to them */
+static void GenerateMusic(Writer *writer, Random *random)
+{
+	unsigned int note = 0xA0;
+
+	while (!Writer_IsFull(writer))
+	{
+		if (writer->position > 0x20 && Random_Chance(random, 15))
+		{
+			Writer_Repeat(writer, random, 4, 48, 0x400);
+		}
+		else if (Random_Chance(random, 10))
+		{
+			static const unsigned char flags[] = {0xE0, 0xE1, 0xE6, 0xE8, 0xE9, 0xEF, 0xF0, 0xF6, 0xF7, 0xF8, 0xF9};
+			const unsigned char flag = flags[Random_Below(random, sizeof(flags))];
+
+			Writer_Byte(writer, flag);
+
+			switch (flag)
+			{
+				case 0xF0:	/* Modulation */
+					Writer_Byte(writer, 1 + Random_Below(random, 0x20));
+					Writer_Byte(writer, 1);
+					Writer_Byte(writer, Random_Below(random, 8));
+					Writer_Byte(writer, 4);
+					break;
+
+				case 0xF6:	/* Jump */
+				case 0xF8:	/* Call */
+					Writer_Word(writer, writer->position & ~1u);
+					break;
+
+				case 0xF7:	/* Loop */
+					Writer_Byte(writer, 0);
+					Writer_Byte(writer, 2 + Random_Below(random, 3));
+					Writer_Word(writer, writer->position & ~1u);
+					break;
+
+				case 0xF9:	/* Return */
+					break;
+
+				default:
+					Writer_Byte(writer, Random_Below(random, 0x10));
+					break;
+			}
+		}
+		else
+		{
+			/* Notes wander around a few semitones at a time, and only sometimes change duration */
+			const unsigned int next_note = note + (unsigned int)Random_Below(random, 9) - 4;
+
+			note = CLOWNLZSS_MIN(0xDF, CLOWNLZSS_MAX(0x81, next_note));
+
+			Writer_Byte(writer, Random_Chance(random, 10) ? 0x80 : note);
+
+			if (Random_Chance(random, 40))
+			{
+				static const unsigned char durations[] = {0x03, 0x06, 0x0C, 0x18, 0x30};
+
+				Writer_Byte(writer, durations[Random_Below(random, sizeof(durations))]);
+			}
+		}
+	}
+}
+
+/* Z80 code, for a sound driver, with little-endian addresses in the Z80's RAM and bank window */
+static void GenerateZ80Code(Writer *writer, Random *random)
+{
+	while (!Writer_IsFull(writer))
+	{
+		const unsigned int address = Random_Chance(random, 80) ? 0x1000 + (unsigned int)Random_Below(random, 0xC00) : 0x8000 + (unsigned int)Random_Below(random, 0x8000);
+
+		if (writer->position > 0x10 && Random_Chance(random, 20))
+		{
+			Writer_Repeat(writer, random, 3, 24, 0x800);
+			continue;
+		}
+
+		switch (Random_Below(random, 12))
+		{
+			case 0:	/* ld a,n */
+				Writer_Byte(writer, 0x3E);
+				Writer_Byte(writer, Random_Below(random, 0x100));
+				break;
+
+			case 1:	/* ld (nn),a */
+				Writer_Byte(writer, 0x32);
+				Writer_Byte(writer, address & 0xFF);
+				Writer_Byte(writer, address >> 8);
+				break;
+
+			case 2:	/* ld hl,nn */
+				Writer_Byte(writer, 0x21);
+				Writer_Byte(writer, address & 0xFF);
+				Writer_Byte(writer, address >> 8);
+				break;
+
+			case 3:	/* call nn */
+				Writer_Byte(writer, 0xCD);
+				Writer_Byte(writer, address & 0xFF);
+				Writer_Byte(writer, (address >> 8) & 0x1F);
+				break;
+
+			case 4:	/* ret */
+				Writer_Byte(writer, 0xC9);
+				break;
+
+			case 5:	/* jr e / djnz e */
+				Writer_Byte(writer, Random_Chance(random, 50) ? 0x18 : 0x10);
+				Writer_Byte(writer, 0x100 - 2 - Random_Below(random, 0x20));
+				break;
+
+			case 6:	/* push / pop */
+				Writer_Byte(writer, 0xC1 + (Random_Below(random, 4) << 4) + (Random_Chance(random, 50) ? 4 : 0));
+				break;
+
+			case 7:	/* ld r,r' */
+				Writer_Byte(writer, 0x40 + Random_Below(random, 0x30));
+				break;
+
+			case 8:	/* ld a,(ix+d) / ld (ix+d),a */
+				Writer_Byte(writer, 0xDD);
+				Writer_Byte(writer, Random_Chance(random, 50) ? 0x7E : 0x77);
+				Writer_Byte(writer, Random_Below(random, 0x30));
+				break;
+
+			case 9:	/* and / or / add / cp n */
+				Writer_Byte(writer, 0xC6 + (Random_Below(random, 8) << 3));
+				Writer_Byte(writer, Random_Below(random, 0x100));
+				break;
+
+			case 10:	/* jp cc,nn */
+				Writer_Byte(writer, 0xC2 + (Random_Below(random, 8) << 3));
+				Writer_Byte(writer, address & 0xFF);
+				Writer_Byte(writer, (address >> 8) & 0x1F);
+				break;
+
+			case 11:	/* inc / dec */
+				Writer_Byte(writer, 0x03 + (Random_Below(random, 4) << 4) + (Random_Chance(random, 50) ? 8 : 0));
+				break;
+		}
+	}
+}
+
+/* 68000 code, with big-endian opcodes, absolute addresses in work RAM at 0xFF0000, and
+   the same few idioms used over and over */
+static void GenerateM68kCode(Writer *writer, Random *random)
+{
+	while (!Writer_IsFull(writer))
+	{
+		const unsigned int data_register = (unsigned int)Random_Below(random, 8);
+		const unsigned int address_register = (unsigned int)Random_Below(random, 7);
+		const unsigned long ram_address = 0xFFFF0000ul | (unsigned long)(Random_Below(random, 0x800) * 2);
+		const unsigned long rom_address = (unsigned long)(Random_Below(random, 0x40000) * 2);
+
+		if (writer->position > 0x10 && Random_Chance(random, 25))
+		{
+			Writer_Repeat(writer, random, 4, 32, 0x1000);
+			continue;
+		}
+
+		switch (Random_Below(random, 14))
+		{
+			case 0:	/* move.w d0,d1 */
+				Writer_Word(writer, 0x3000 | data_register << 9 | (unsigned int)Random_Below(random, 8));
+				break;
+
+			case 1:	/* move.w (ram).w,dn */
+				Writer_Word(writer, 0x3038 | data_register << 9);
+				Writer_Word(writer, ram_address & 0xFFFF);
+				break;
+
+			case 2:	/* move.b dn,d(an) */
+				Writer_Word(writer, 0x1140 | address_register << 9 | data_register);
+				Writer_Word(writer, (unsigned int)Random_Below(random, 0x40));
+				break;
+
+			case 3:	/* lea (ram).l,an */
+				Writer_Word(writer, 0x41F9 | address_register << 9);
+				Writer_Long(writer, ram_address & 0xFFFFFF);
+				break;
+
+			case 4:	/* jsr (rom).l */
+				Writer_Word(writer, 0x4EB9);
+				Writer_Long(writer, rom_address);
+				break;
+
+			case 5:	/* bsr.w */
+				Writer_Word(writer, 0x6100);
+				Writer_Word(writer, (0x10000 - 2 * (unsigned int)Random_Below(random, 0x400)) & 0xFFFF);
+				break;
+
+			case 6:	/* rts */
+				Writer_Word(writer, 0x4E75);
+				break;
+
+			case 7:	/* moveq #n,dn */
+				Writer_Word(writer, 0x7000 | data_register << 9 | (unsigned int)Random_Below(random, 0x20));
+				break;
+
+			case 8:	/* addq.w #n,dn / subq.w #n,dn */
+				Writer_Word(writer, (Random_Chance(random, 50) ? 0x5040 : 0x5140) | (unsigned int)Random_Below(random, 8) << 9 | data_register);
+				break;
+
+			case 9:	/* beq.s / bne.s / bra.s */
+			{
+				static const unsigned int branches[] = {0x6700, 0x6600, 0x6000, 0x6B00, 0x6A00};
+
+				Writer_Word(writer, branches[Random_Below(random, sizeof(branches) / sizeof(branches[0]))] | (unsigned int)(2 + Random_Below(random, 0x20) * 2));
+				break;
+			}
+
+			case 10:	/* dbf dn,loop */
+				Writer_Word(writer, 0x51C8 | data_register);
+				Writer_Word(writer, (0x10000 - 2 * (unsigned int)Random_Below(random, 0x20)) & 0xFFFF);
+				break;
+
+			case 11:	/* tst.b d(an) */
+				Writer_Word(writer, 0x4A28 | address_register);
+				Writer_Word(writer, (unsigned int)Random_Below(random, 0x40));
+				break;
+
+			case 12:	/* move.l #imm,(ram).w */
+				Writer_Word(writer, 0x21FC);
+				Writer_Long(writer, Random_Chance(random, 50) ? rom_address : (unsigned long)Random_Below(random, 0x10000));
+				Writer_Word(writer, ram_address & 0xFFFF);
+				break;
+
+			case 13:	/* cmpi.b #n,d(an) */
+				Writer_Word(writer, 0x0C28 | address_register);
+				Writer_Word(writer, (unsigned int)Random_Below(random, 0x100));
+				Writer_Word(writer, (unsigned int)Random_Below(random, 0x40));
+				break;
+		}
+	}
+}
+
+static void GenerateZeroes(Writer *writer, Random *random)
+{
+	(void)random;
+
+	memset(writer->buffer + writer->position, 0, writer->size - writer->position);
+	writer->position = writer->size;
+}
+
+/* Stands in for data that is already compressed */
+static void GenerateRandom(Writer *writer, Random *random)
+{
+	while (!Writer_IsFull(writer))
+		Writer_Byte(writer, Random_Next(random) & 0xFF);
+}
+
+typedef void (*Generator)(Writer *writer, Random *random);
+
+typedef struct Content
+{
+	const char *name;
+	Generator generator;
+	unsigned int weight;	/* How much of a ROM is made of it */
+} Content;
+
+static const Content contents[] = {
+	{"tiles", GenerateTiles, 25},
+	{"mappings", GenerateMappings, 10},
+	{"smps", GenerateMusic, 10},
+	{"z80", GenerateZ80Code, 5},
+	{"m68k", GenerateM68kCode, 30},
+	{"zeroes", GenerateZeroes, 10},
+	{"random", GenerateRandom, 10},
+};
+
+/* A whole ROM's worth of the other kinds of content, in blocks of 1KiB to 16KiB */
+static void GenerateROM(Writer *writer, Random *random)
+{
+	unsigned int total_weight = 0;
+
+	for (size_t i = 0; i < sizeof(contents) / sizeof(contents[0]); ++i)
+		total_weight += contents[i].weight;
+
+	while (!Writer_IsFull(writer))
+	{
+		unsigned int choice = (unsigned int)Random_Below(random, total_weight);
+		size_t content = 0;
+
+		while (choice >= contents[content].weight)
+			choice -= contents[content++].weight;
+
+		/* Each block is generated on its own, as if it were a separate file in the ROM */
+		const size_t block_size = 0x400 * (1 + Random_Below(random, 16));
+
+		Writer block;
+		block.buffer = writer->buffer + writer->position;
+		block.position = 0;
+		block.size = CLOWNLZSS_MIN(writer->size - writer->position, block_size);
+
+		contents[content].generator(&block, random);
+		writer->position += block.size;
+	}
+}
+
+size_t Corpus_GetTotalContents(void)
+{
+	return sizeof(contents) / sizeof(contents[0]) + 1;
+}
+
+const char* Corpus_GetContentName(size_t index)
+{
+	return index == sizeof(contents) / sizeof(contents[0]) ? "rom" : contents[index].name;
+}
+
+unsigned char* Corpus_Generate(const char *content, size_t size)
+{
+	Generator generator = NULL;
+
+	if (!strcmp(content, "rom"))
+		generator = GenerateROM;
+
+	for (size_t i = 0; i < sizeof(contents) / sizeof(contents[0]); ++i)
+		if (!strcmp(content, contents[i].name))
+			generator = contents[i].generator;
+
+	if (generator == NULL)
+		return NULL;
+
+	unsigned char *buffer = (unsigned char*)malloc(size);
+
+	if (buffer != NULL)
+	{
+		Random random;
+		random.state = CORPUS_SEED;
+
+		Writer writer;
+		writer.buffer = buffer;
+		writer.position = 0;
+		writer.size = size;
+
+		generator(&writer, &random);
+	}
+
+	return buffer;
+}
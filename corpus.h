@@ -0,0 +1,35 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#define CORPUS_SEED 0x436C6F776E4C5A53ull
+
+/* The kinds of content that the corpus can be made of, the last of which is "rom",
+   which mixes all of the others together in blocks, like a whole game would */
+size_t Corpus_GetTotalContents(void);
+const char* Corpus_GetContentName(size_t index);
+
+/* Returns a buffer (which must be freed with free) of 'size' bytes of the named
+   content, or NULL if there is no such content or there is not enough memory.
+   A smaller buffer of the same content is the start of a larger one. */
+unsigned char* Corpus_Generate(const char *content, size_t size);
@@ -33,47 +33,20 @@
 
 typedef struct FaxmanInstance
 {
-	MemoryStream *output_stream;
-	MemoryStream *match_stream;
-
-	unsigned char descriptor;
-	unsigned int descriptor_bits_remaining;
+	BitWriter writer;
 	unsigned short descriptor_bits_total;
 } FaxmanInstance;
 
-static void FlushData(FaxmanInstance *instance)
-{
-	MemoryStream_WriteByte(instance->output_stream, instance->descriptor);
-
-	const size_t match_buffer_size = MemoryStream_GetPosition(instance->match_stream);
-	unsigned char *match_buffer = MemoryStream_GetBuffer(instance->match_stream);
-
-	MemoryStream_WriteBytes(instance->output_stream, match_buffer, match_buffer_size);
-}
-
 static void PutMatchByte(FaxmanInstance *instance, unsigned char byte)
 {
-	MemoryStream_WriteByte(instance->match_stream, byte);
+	BitWriter_PutByte(&instance->writer, byte);
 }
 
 static void PutDescriptorBit(FaxmanInstance *instance, bool bit)
 {
 	++instance->descriptor_bits_total;
 
-	if (instance->descriptor_bits_remaining == 0)
-	{
-		FlushData(instance);
-
-		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
-		MemoryStream_Rewind(instance->match_stream);
-	}
-
-	--instance->descriptor_bits_remaining;
-
-	instance->descriptor >>= 1;
-
-	if (bit)
-		instance->descriptor |= 1 << (TOTAL_DESCRIPTOR_BITS - 1);
+	BitWriter_PutBit(&instance->writer, bit);
 }
 
 static void DoLiteral(unsigned char value, void *user)
@@ -86,9 +59,11 @@ static void DoLiteral(unsigned char value, void *user)
 
 static void DoMatch(size_t distance, size_t length, size_t offset, void *user)
 {
+	(void)offset;
+
 	FaxmanInstance *instance = (FaxmanInstance*)user;
 
-	if (offset == (size_t)-1)
+	if (distance == 0)	// Zero-fill match
 		distance = 0x800;
 
 	if (length >= 2 && length <= 5 && distance <= 0x100)
@@ -108,70 +83,56 @@ static void DoMatch(size_t distance, size_t length, size_t offset, void *user)
 	}
 }
 
-static unsigned int GetMatchCost(size_t distance, size_t length, void *user)
-{
-	(void)user;
+static const ClownLZSS_MatchEncoding match_encodings[] = {
+	{0x100, 2, 5, 2 + 8 + 2},	// Descriptor bits, offset byte, length bits
+	{0x800, 3, 0x1F + 3, 2 + 16}	// Descriptor bits, offset/length bits
+};
 
-	if (length >= 2 && length <= 5 && distance <= 0x100)
-		return 2 + 8 + 2;
-	else if (length >= 3)
-		return 2 + 16;	// Descriptor bit, offset/length bits
-	else
-		return 0;
-}
+static const ClownLZSS_Format format = {2, 0x1F + 3, 0x800, 1 + 8, match_encodings, sizeof(match_encodings) / sizeof(match_encodings[0]), NULL};
 
-static void FindExtraMatches(unsigned char *data, size_t data_size, size_t offset, ClownLZSS_GraphEdge *node_meta_array, void *user)
+static void FindExtraMatches(unsigned char *data, size_t data_size, const unsigned int *run_lengths, size_t offset, ClownLZSS_Graph *graph, void *user)
 {
+	(void)data_size;
 	(void)user;
 
-	if (offset < 0x800)
+	// Zero-fill matches
+	if (offset < 0x800 && data[offset] == 0)
 	{
-		const size_t max_read_ahead = CLOWNLZSS_MIN(0x1F + 3, data_size - offset);
+		const size_t max_read_ahead = CLOWNLZSS_MIN(0x1F + 3, run_lengths[offset]);
 
 		for (size_t k = 0; k < max_read_ahead; ++k)
 		{
-			if (data[offset + k] == 0)
-			{
-				const unsigned int cost = (k + 1 >= 3) ? 2 + 16 : 0;
-
-				if (cost && node_meta_array[offset + k + 1].u.cost > node_meta_array[offset].u.cost + cost)
-				{
-					node_meta_array[offset + k + 1].u.cost = node_meta_array[offset].u.cost + cost;
-					node_meta_array[offset + k + 1].previous_node_index = offset;
-					node_meta_array[offset + k + 1].match_length = k + 1;
-					node_meta_array[offset + k + 1].match_offset = (size_t)-1;
-				}
-			}
-			else
-				break;
+			const unsigned int cost = (k + 1 >= 3) ? 2 + 16 : 0;
+
+			CLOWNLZSS_ADD_MATCH(graph, offset, k + 1, offset, cost);	// Points at itself
 		}
 	}
 }
 
-static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, 0x1F + 3, 0x800, FindExtraMatches, 1 + 8, DoLiteral, GetMatchCost, DoMatch)
+static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, format, FindExtraMatches, DoLiteral, DoMatch)
 
-static void FaxmanCompressStream(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user)
+static void FaxmanCompressStream(unsigned char *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, MemoryStream *output_stream, void *user)
 {
 	(void)user;
 
 	const size_t file_offset = MemoryStream_GetPosition(output_stream);
 
 	FaxmanInstance instance;
-	instance.output_stream = output_stream;
-	instance.match_stream = MemoryStream_Create(true);
-	instance.descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
 	instance.descriptor_bits_total = 0;
 
 	// Blank header
 	MemoryStream_WriteByte(output_stream, 0);
 	MemoryStream_WriteByte(output_stream, 0);
 
-	CompressData(data, data_size, &instance);
+	BitWriter_Init(&instance.writer, output_stream, TOTAL_DESCRIPTOR_BITS, false, false, false);
+
+	CompressData(data, data_size, level, context, &instance);
 
-	instance.descriptor >>= instance.descriptor_bits_remaining;
-	FlushData(&instance);
+	BitWriter_Finish(&instance.writer);
 
-	MemoryStream_Destroy(instance.match_stream);
+	// There is no header to fill in if the output ran out of memory
+	if (MemoryStream_HasFailed(output_stream))
+		return;
 
 	unsigned char *buffer = MemoryStream_GetBuffer(output_stream);
 
@@ -180,12 +141,141 @@ static void FaxmanCompressStream(unsigned char *data, size_t data_size, MemorySt
 	buffer[file_offset + 1] = instance.descriptor_bits_total >> 8;
 }
 
-unsigned char* ClownLZSS_FaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size)
+unsigned char* ClownLZSS_FaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularWrapper(data, data_size, compressed_size, level, context, "faxman", NULL, FaxmanCompressStream);
+}
+
+unsigned char* ClownLZSS_ModuledFaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledCompressionWrapper(data, data_size, compressed_size, level, context, "faxman", NULL, FaxmanCompressStream, module_size, 1);
+}
+
+size_t ClownLZSS_FaxmanCompressBound(size_t data_size)
+{
+	return CompressBound(2, data_size * format.literal_cost, TOTAL_DESCRIPTOR_BITS / 8);
+}
+
+size_t ClownLZSS_ModuledFaxmanCompressBound(size_t data_size, size_t module_size)
+{
+	return ModuledCompressBound(data_size, module_size, 1, ClownLZSS_FaxmanCompressBound(module_size), ClownLZSS_FaxmanCompressBound(data_size % module_size));
+}
+
+bool ClownLZSS_FaxmanCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "faxman", NULL, FaxmanCompressStream);
+}
+
+bool ClownLZSS_ModuledFaxmanCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "faxman", NULL, FaxmanCompressStream, module_size, 1);
+}
+
+bool ClownLZSS_FaxmanCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "faxman", NULL, FaxmanCompressStream);
+}
+
+bool ClownLZSS_ModuledFaxmanCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "faxman", NULL, FaxmanCompressStream, module_size, 1);
+}
+
+typedef struct FaxmanDecompressionInstance
+{
+	DecompressionInput *input;
+
+	unsigned char descriptor;
+	unsigned int descriptor_bits_remaining;
+	size_t descriptor_bits_read;
+} FaxmanDecompressionInstance;
+
+static bool GetDescriptorBit(FaxmanDecompressionInstance *instance)
+{
+	++instance->descriptor_bits_read;
+
+	if (instance->descriptor_bits_remaining == 0)
+	{
+		instance->descriptor = DecompressionInput_ReadByte(instance->input);
+		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+	}
+
+	--instance->descriptor_bits_remaining;
+
+	const bool bit = instance->descriptor & 1;
+
+	instance->descriptor >>= 1;
+
+	return bit;
+}
+
+static bool FaxmanDecompressStream(DecompressionInput *input, DecompressionBuffer *output, size_t decompressed_size, void *user)
+{
+	(void)decompressed_size;
+	(void)user;
+
+	FaxmanDecompressionInstance instance;
+	instance.input = input;
+	instance.descriptor_bits_remaining = 0;
+	instance.descriptor_bits_read = 0;
+
+	// The header is the number of descriptor bits
+	size_t descriptor_bits_total = DecompressionInput_ReadByte(input);
+	descriptor_bits_total |= DecompressionInput_ReadByte(input) << 8;
+
+	while (instance.descriptor_bits_read < descriptor_bits_total && !input->out_of_data)
+	{
+		if (GetDescriptorBit(&instance))
+		{
+			// Literal
+			if (!DecompressionBuffer_WriteByte(output, DecompressionInput_ReadByte(input)))
+				return false;
+		}
+		else
+		{
+			size_t distance;
+			size_t length;
+
+			if (!GetDescriptorBit(&instance))
+			{
+				// Short match
+				distance = 0x100 - DecompressionInput_ReadByte(input);
+				length = GetDescriptorBit(&instance) << 1;
+				length |= GetDescriptorBit(&instance);
+				length += 2;
+			}
+			else
+			{
+				// Full match
+				const unsigned int first_byte = DecompressionInput_ReadByte(input);
+				const unsigned int second_byte = DecompressionInput_ReadByte(input);
+
+				distance = (((second_byte & 0xE0) << 3) | first_byte) + 1;
+				length = (second_byte & 0x1F) + 3;
+			}
+
+			if (distance > output->position - output->stream_start)
+			{
+				// Matches that reach back past the start of the file are zero-fills
+				if (!DecompressionBuffer_Fill(output, 0, length))
+					return false;
+			}
+			else if (!DecompressionBuffer_CopyMatch(output, distance, length))
+			{
+				return false;
+			}
+		}
+	}
+
+	return instance.descriptor_bits_read == descriptor_bits_total;
+}
+
+unsigned char* ClownLZSS_FaxmanDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size)
 {
-	return RegularWrapper(data, data_size, compressed_size, NULL, FaxmanCompressStream);
+	return RegularDecompressionWrapper(data, data_size, decompressed_size, NULL, FaxmanDecompressStream);
 }
 
-unsigned char* ClownLZSS_ModuledFaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, size_t module_size)
+unsigned char* ClownLZSS_ModuledFaxmanDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, size_t module_size)
 {
-	return ModuledCompressionWrapper(data, data_size, compressed_size, NULL, FaxmanCompressStream, module_size, 1);
+	return ModuledDecompressionWrapper(data, data_size, decompressed_size, NULL, FaxmanDecompressStream, module_size, 1);
 }
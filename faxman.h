@@ -20,7 +20,20 @@
 
 #pragma once
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
 #include <stddef.h>
 
-unsigned char* ClownLZSS_FaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size);
-unsigned char* ClownLZSS_ModuledFaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, size_t module_size);
+#include "clownlzss.h"
+
+unsigned char* ClownLZSS_FaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context);
+unsigned char* ClownLZSS_ModuledFaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size);
+size_t ClownLZSS_FaxmanCompressBound(size_t data_size);
+size_t ClownLZSS_ModuledFaxmanCompressBound(size_t data_size, size_t module_size);
+bool ClownLZSS_FaxmanCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context);
+bool ClownLZSS_ModuledFaxmanCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size);
+bool ClownLZSS_FaxmanCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context);
+bool ClownLZSS_ModuledFaxmanCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size);
+unsigned char* ClownLZSS_FaxmanDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size);
+unsigned char* ClownLZSS_ModuledFaxmanDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, size_t module_size);
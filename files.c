@@ -0,0 +1,400 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "files.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Given to empty files, so that their data is never NULL
+static unsigned char empty_data[1];
+
+static bool IsStandardStream(const char *filename)
+{
+	return filename[0] == '-' && filename[1] == '\0';
+}
+
+// Reads a stream whose size is not known up front, such as a pipe, to its end
+static bool ReadStream(InputFile *file, FILE *stream)
+{
+	size_t capacity = 0x10000;
+
+	file->data = (unsigned char*)malloc(capacity);
+	file->size = 0;
+
+	if (file->data == NULL)
+		return false;
+
+	for (;;)
+	{
+		if (file->size == capacity)
+		{
+			unsigned char *new_data = capacity > (size_t)-1 / 2 ? NULL : (unsigned char*)realloc(file->data, capacity * 2);
+
+			if (new_data == NULL)
+			{
+				free(file->data);
+				return false;
+			}
+
+			file->data = new_data;
+			capacity *= 2;
+		}
+
+		const size_t bytes_read = fread(&file->data[file->size], 1, capacity - file->size, stream);
+
+		file->size += bytes_read;
+
+		if (bytes_read == 0)
+			break;
+	}
+
+	if (ferror(stream))
+	{
+		free(file->data);
+		return false;
+	}
+
+	return true;
+}
+
+#ifndef _WIN32
+// Maps the rest of a regular file. Returns false if it is not one, so that it is read instead.
+static bool MapDescriptor(InputFile *file, int descriptor)
+{
+	struct stat status;
+
+	if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode) || (unsigned long long)status.st_size > (size_t)-1 || lseek(descriptor, 0, SEEK_CUR) != 0)
+		return false;
+
+	file->size = (size_t)status.st_size;
+
+	if (file->size == 0)
+	{
+		file->data = empty_data;
+		return true;
+	}
+
+	// A private mapping can be written to without the file ever seeing it
+	void *data = mmap(NULL, file->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	file->data = (unsigned char*)data;
+	file->mapped = true;
+
+	return true;
+}
+#endif
+
+bool InputFile_Open(InputFile *file, const char *filename)
+{
+	file->data = NULL;
+	file->size = 0;
+	file->mapped = false;
+
+#ifdef _WIN32
+	if (IsStandardStream(filename))
+	{
+		_setmode(_fileno(stdin), _O_BINARY);
+		return ReadStream(file, stdin);
+	}
+
+	HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (handle != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER size;
+
+		if (GetFileSizeEx(handle, &size) && (unsigned long long)size.QuadPart <= (size_t)-1)
+		{
+			file->size = (size_t)size.QuadPart;
+
+			if (file->size == 0)
+			{
+				file->data = empty_data;
+			}
+			else
+			{
+				HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+				if (mapping != NULL)
+				{
+					// A copy-on-write view can be written to without the file ever seeing it
+					file->data = (unsigned char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+					file->mapped = file->data != NULL;
+					CloseHandle(mapping);
+				}
+			}
+		}
+
+		CloseHandle(handle);
+
+		if (file->data != NULL)
+			return true;
+	}
+
+	FILE *stream = fopen(filename, "rb");
+#else
+	if (IsStandardStream(filename))
+		return MapDescriptor(file, STDIN_FILENO) || ReadStream(file, stdin);
+
+	const int descriptor = open(filename, O_RDONLY);
+
+	if (descriptor == -1)
+		return false;
+
+	// The mapping stays valid once the file is closed
+	const bool mapped = MapDescriptor(file, descriptor);
+
+	FILE *stream = mapped ? NULL : fdopen(descriptor, "rb");
+
+	if (stream == NULL)
+	{
+		close(descriptor);
+		return mapped;
+	}
+#endif
+
+	if (stream == NULL)
+		return false;
+
+	const bool success = ReadStream(file, stream);
+
+	fclose(stream);
+
+	return success;
+}
+
+void InputFile_Close(InputFile *file)
+{
+	if (file->mapped)
+	{
+	#ifdef _WIN32
+		UnmapViewOfFile(file->data);
+	#else
+		munmap(file->data, file->size);
+	#endif
+	}
+	else if (file->data != empty_data)
+	{
+		free(file->data);
+	}
+}
+
+unsigned char* InputFile_GetData(InputFile *file)
+{
+	return file->data;
+}
+
+size_t InputFile_GetSize(InputFile *file)
+{
+	return file->size;
+}
+
+size_t InputFile_GetSizeOnDisk(const char *filename)
+{
+	if (IsStandardStream(filename))
+		return 0;
+
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+	if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes) || (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+		return 0;
+
+	const unsigned long long size = ((unsigned long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+#else
+	struct stat status;
+
+	if (stat(filename, &status) != 0 || !S_ISREG(status.st_mode))
+		return 0;
+
+	const unsigned long long size = (unsigned long long)status.st_size;
+#endif
+
+	return size > (size_t)-1 ? (size_t)-1 : (size_t)size;
+}
+
+#ifndef _WIN32
+// Creates the temporary file that replaces the output file once it is complete, and maps it
+static bool MapTemporaryFile(OutputFile *file)
+{
+	struct stat status;
+	const bool exists = lstat(file->filename, &status) == 0;
+
+	// Devices, pipes, and symbolic links are written to as they are, instead of being replaced
+	if ((exists && !S_ISREG(status.st_mode)) || (!exists && errno != ENOENT) || file->capacity == 0)
+		return false;
+
+	const size_t filename_length = strlen(file->filename);
+
+	file->temporary_filename = (char*)malloc(filename_length + 64);
+
+	if (file->temporary_filename == NULL)
+		return false;
+
+	// The process ID and the address of the file make the name unique to this output
+	sprintf(file->temporary_filename, "%s.%lx.%lx.tmp", file->filename, (unsigned long)getpid(), (unsigned long)(uintptr_t)file);
+
+	file->descriptor = open(file->temporary_filename, O_RDWR | O_CREAT | O_EXCL, 0666);
+
+	if (file->descriptor != -1)
+	{
+		// The file replaces the old one, so it takes on its permissions too.
+		// Its blocks are reserved up front: writing to a hole in a shared mapping when the disk is
+		// full raises SIGBUS, which cannot be recovered from, so the output is buffered instead.
+		if ((!exists || fchmod(file->descriptor, status.st_mode & 07777) == 0) && posix_fallocate(file->descriptor, 0, (off_t)file->capacity) == 0)
+		{
+			void *data = mmap(NULL, file->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, file->descriptor, 0);
+
+			if (data != MAP_FAILED)
+			{
+				file->data = (unsigned char*)data;
+				file->mapped = true;
+				return true;
+			}
+		}
+
+		close(file->descriptor);
+		unlink(file->temporary_filename);
+		file->descriptor = -1;
+	}
+
+	free(file->temporary_filename);
+	file->temporary_filename = NULL;
+
+	return false;
+}
+#endif
+
+bool OutputFile_Open(OutputFile *file, const char *filename, size_t capacity)
+{
+	file->filename = filename;
+	file->data = NULL;
+	file->capacity = capacity;
+	file->mapped = false;
+	file->descriptor = -1;
+	file->temporary_filename = NULL;
+
+#ifndef _WIN32
+	if (!IsStandardStream(filename) && MapTemporaryFile(file))
+		return true;
+#endif
+
+	file->data = (unsigned char*)malloc(capacity == 0 ? 1 : capacity);
+
+	return file->data != NULL;
+}
+
+unsigned char* OutputFile_GetData(OutputFile *file)
+{
+	return file->data;
+}
+
+bool OutputFile_Commit(OutputFile *file, size_t size)
+{
+	bool success = false;
+
+#ifndef _WIN32
+	if (file->mapped)
+	{
+		munmap(file->data, file->capacity);
+
+		success = ftruncate(file->descriptor, (off_t)size) == 0;
+		success = close(file->descriptor) == 0 && success;
+		success = success && rename(file->temporary_filename, file->filename) == 0;
+
+		if (!success)
+			unlink(file->temporary_filename);
+
+		free(file->temporary_filename);
+
+		return success;
+	}
+#endif
+
+	FILE *stream;
+
+	if (IsStandardStream(file->filename))
+	{
+	#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+	#endif
+		stream = stdout;
+	}
+	else
+	{
+		stream = fopen(file->filename, "wb");
+	}
+
+	if (stream != NULL)
+	{
+		success = fwrite(file->data, 1, size, stream) == size;
+
+		if (stream == stdout)
+			success = fflush(stream) == 0 && success;
+		else
+			success = fclose(stream) == 0 && success;
+	}
+
+	free(file->data);
+
+	return success;
+}
+
+void OutputFile_Abandon(OutputFile *file)
+{
+#ifndef _WIN32
+	if (file->mapped)
+	{
+		munmap(file->data, file->capacity);
+		close(file->descriptor);
+		unlink(file->temporary_filename);
+		free(file->temporary_filename);
+		return;
+	}
+#endif
+
+	free(file->data);
+}
@@ -0,0 +1,68 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+
+// In both of these, the filename "-" stands for the standard input or output
+
+// The whole of a file, mapped into memory where possible, so that it is never copied. Anything
+// that cannot be mapped, such as a pipe, is read into a buffer instead. The data can be written
+// to, but the changes never reach the file.
+// This is only public so that files can live on the stack: use the functions below instead of the fields
+typedef struct InputFile
+{
+	unsigned char *data;
+	size_t size;
+	bool mapped;
+} InputFile;
+
+bool InputFile_Open(InputFile *file, const char *filename);
+void InputFile_Close(InputFile *file);
+unsigned char* InputFile_GetData(InputFile *file);
+size_t InputFile_GetSize(InputFile *file);
+// The size of a regular file, without reading it. Anything else, such as a pipe, is 0, as its size is not known until it has been read.
+size_t InputFile_GetSizeOnDisk(const char *filename);
+
+// A file that is written to directly through memory: it is made 'capacity' bytes long, and cut
+// down to the size that was used once it is committed. A regular file is written as a temporary
+// file alongside it, which replaces it when it is committed, so that nothing is written if the
+// output is abandoned. Anything else, such as the standard output, is written from a buffer, and
+// so is a regular file whose space cannot be set aside up front, such as when the disk is full.
+typedef struct OutputFile
+{
+	const char *filename;
+	unsigned char *data;
+	size_t capacity;
+	bool mapped;
+	int descriptor;
+	char *temporary_filename;
+} OutputFile;
+
+bool OutputFile_Open(OutputFile *file, const char *filename, size_t capacity);
+unsigned char* OutputFile_GetData(OutputFile *file);
+// Writes the first 'size' bytes to the file, and closes it
+bool OutputFile_Commit(OutputFile *file, size_t size);
+// Closes the file without writing anything to it
+void OutputFile_Abandon(OutputFile *file);
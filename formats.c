@@ -0,0 +1,132 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+/* Every format behind the same interface, for the benchmarks */
+
+#include "formats.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "chameleon.h"
+#include "clownlzss.h"
+#include "comper.h"
+#include "faxman.h"
+#include "kosinski.h"
+#include "kosinskiplus.h"
+#include "rage.h"
+#include "rocket.h"
+#include "saxman.h"
+
+#define FORMAT_FUNCTIONS(NAME)\
+static size_t NAME##Bound(size_t data_size, bool moduled)\
+{\
+	return moduled ? ClownLZSS_Moduled##NAME##CompressBound(data_size, FORMAT_MODULE_SIZE) : ClownLZSS_##NAME##CompressBound(data_size);\
+}\
+\
+static bool NAME##Compress(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, bool moduled, unsigned int level, ClownLZSS_Context *context)\
+{\
+	if (moduled)\
+		return ClownLZSS_Moduled##NAME##CompressToBuffer(data, data_size, buffer, buffer_size, compressed_size, level, context, FORMAT_MODULE_SIZE);\
+	else\
+		return ClownLZSS_##NAME##CompressToBuffer(data, data_size, buffer, buffer_size, compressed_size, level, context);\
+}\
+\
+static unsigned char* NAME##Decompress(unsigned char *data, size_t data_size, size_t *decompressed_size, bool moduled)\
+{\
+	return moduled ? ClownLZSS_Moduled##NAME##Decompress(data, data_size, decompressed_size, FORMAT_MODULE_SIZE) : ClownLZSS_##NAME##Decompress(data, data_size, decompressed_size);\
+}
+
+FORMAT_FUNCTIONS(Chameleon)
+FORMAT_FUNCTIONS(Comper)
+FORMAT_FUNCTIONS(Faxman)
+FORMAT_FUNCTIONS(Kosinski)
+FORMAT_FUNCTIONS(KosinskiPlus)
+FORMAT_FUNCTIONS(Rage)
+FORMAT_FUNCTIONS(Rocket)
+
+/* Saxman takes an extra parameter, for whether it has a header */
+static size_t SaxmanBound(size_t data_size, bool moduled)
+{
+	return moduled ? ClownLZSS_ModuledSaxmanCompressBound(data_size, true, FORMAT_MODULE_SIZE) : ClownLZSS_SaxmanCompressBound(data_size, true);
+}
+
+static bool SaxmanCompress(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, bool moduled, unsigned int level, ClownLZSS_Context *context)
+{
+	if (moduled)
+		return ClownLZSS_ModuledSaxmanCompressToBuffer(data, data_size, buffer, buffer_size, compressed_size, true, level, context, FORMAT_MODULE_SIZE);
+	else
+		return ClownLZSS_SaxmanCompressToBuffer(data, data_size, buffer, buffer_size, compressed_size, true, level, context);
+}
+
+static unsigned char* SaxmanDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, bool moduled)
+{
+	return moduled ? ClownLZSS_ModuledSaxmanDecompress(data, data_size, decompressed_size, true, FORMAT_MODULE_SIZE) : ClownLZSS_SaxmanDecompress(data, data_size, decompressed_size, true);
+}
+
+static size_t SaxmanNoHeaderBound(size_t data_size, bool moduled)
+{
+	return moduled ? ClownLZSS_ModuledSaxmanCompressBound(data_size, false, FORMAT_MODULE_SIZE) : ClownLZSS_SaxmanCompressBound(data_size, false);
+}
+
+static bool SaxmanNoHeaderCompress(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, bool moduled, unsigned int level, ClownLZSS_Context *context)
+{
+	if (moduled)
+		return ClownLZSS_ModuledSaxmanCompressToBuffer(data, data_size, buffer, buffer_size, compressed_size, false, level, context, FORMAT_MODULE_SIZE);
+	else
+		return ClownLZSS_SaxmanCompressToBuffer(data, data_size, buffer, buffer_size, compressed_size, false, level, context);
+}
+
+static unsigned char* SaxmanNoHeaderDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, bool moduled)
+{
+	return moduled ? ClownLZSS_ModuledSaxmanDecompress(data, data_size, decompressed_size, false, FORMAT_MODULE_SIZE) : ClownLZSS_SaxmanDecompress(data, data_size, decompressed_size, false);
+}
+
+static const Format formats[] = {
+	{"chameleon", ChameleonBound, ChameleonCompress, ChameleonDecompress, true},
+	{"comper", ComperBound, ComperCompress, ComperDecompress, false},
+	{"kosinski", KosinskiBound, KosinskiCompress, KosinskiDecompress, false},
+	{"kosinskiplus", KosinskiPlusBound, KosinskiPlusCompress, KosinskiPlusDecompress, false},
+	{"rage", RageBound, RageCompress, RageDecompress, true},
+	{"rocket", RocketBound, RocketCompress, RocketDecompress, true},
+	{"saxman", SaxmanBound, SaxmanCompress, SaxmanDecompress, true},
+	{"saxman_no_header", SaxmanNoHeaderBound, SaxmanNoHeaderCompress, SaxmanNoHeaderDecompress, false},
+	{"faxman", FaxmanBound, FaxmanCompress, FaxmanDecompress, true},
+};
+
+size_t Format_GetTotal(void)
+{
+	return sizeof(formats) / sizeof(formats[0]);
+}
+
+const Format* Format_Get(size_t index)
+{
+	return &formats[index];
+}
+
+const Format* Format_Find(const char *name)
+{
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i)
+		if (!strcmp(name, formats[i].name))
+			return &formats[i];
+
+	return NULL;
+}
@@ -0,0 +1,41 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "clownlzss.h"
+
+#define FORMAT_MODULE_SIZE 0x1000
+
+typedef struct Format
+{
+	const char *name;
+	size_t (*bound)(size_t data_size, bool moduled);
+	bool (*compress)(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, bool moduled, unsigned int level, ClownLZSS_Context *context);
+	unsigned char* (*decompress)(unsigned char *data, size_t data_size, size_t *decompressed_size, bool moduled);
+	bool small_header;	/* The header has 16-bit fields, so it cannot describe more than 64KiB */
+} Format;
+
+size_t Format_GetTotal(void);
+const Format* Format_Get(size_t index);
+const Format* Format_Find(const char *name);	/* NULL if there is no format by that name */
@@ -33,45 +33,17 @@
 
 typedef struct KosinskiInstance
 {
-	MemoryStream *output_stream;
-	MemoryStream *match_stream;
-
-	unsigned short descriptor;
-	unsigned int descriptor_bits_remaining;
+	BitWriter writer;
 } KosinskiInstance;
 
-static void FlushData(KosinskiInstance *instance)
-{
-	MemoryStream_WriteByte(instance->output_stream, instance->descriptor & 0xFF);
-	MemoryStream_WriteByte(instance->output_stream, instance->descriptor >> 8);
-
-	const size_t match_buffer_size = MemoryStream_GetPosition(instance->match_stream);
-	unsigned char *match_buffer = MemoryStream_GetBuffer(instance->match_stream);
-
-	MemoryStream_WriteBytes(instance->output_stream, match_buffer, match_buffer_size);
-}
-
 static void PutMatchByte(KosinskiInstance *instance, unsigned char byte)
 {
-	MemoryStream_WriteByte(instance->match_stream, byte);
+	BitWriter_PutByte(&instance->writer, byte);
 }
 
 static void PutDescriptorBit(KosinskiInstance *instance, bool bit)
 {
-	--instance->descriptor_bits_remaining;
-
-	instance->descriptor >>= 1;
-
-	if (bit)
-		instance->descriptor |= 1 << (TOTAL_DESCRIPTOR_BITS - 1);
-
-	if (instance->descriptor_bits_remaining == 0)
-	{
-		FlushData(instance);
-
-		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
-		MemoryStream_Rewind(instance->match_stream);
-	}
+	BitWriter_PutBit(&instance->writer, bit);
 }
 
 static void DoLiteral(unsigned char value, void *user)
@@ -113,41 +85,34 @@ static void DoMatch(size_t distance, size_t length, size_t offset, void *user)
 	}
 }
 
-static unsigned int GetMatchCost(size_t distance, size_t length, void *user)
-{
-	(void)user;
+static const ClownLZSS_MatchEncoding match_encodings[] = {
+	{256, 2, 5, 2 + 2 + 8},		// Descriptor bits, length bits, offset byte
+	{0x2000, 3, 9, 2 + 16},		// Descriptor bits, offset/length bytes
+	{0x2000, 10, 0x100, 2 + 16 + 8}	// Descriptor bits, offset bytes, length byte
+};
 
-	if (length >= 2 && length <= 5 && distance <= 256)
-		return 2 + 2 + 8;	// Descriptor bits, length bits, offset byte
-	else if (length >= 3 && length <= 9)
-		return 2 + 16;		// Descriptor bits, offset/length bytes
-	else if (length >= 3)
-		return 2 + 16 + 8;	// Descriptor bits, offset bytes, length byte
-	else
-		return 0; 		// In the event a match cannot be compressed
-}
+static const ClownLZSS_Format format = {2, 0x100, 0x2000, 1 + 8, match_encodings, sizeof(match_encodings) / sizeof(match_encodings[0]), NULL};
 
-static void FindExtraMatches(unsigned char *data, size_t data_size, size_t offset, ClownLZSS_GraphEdge *node_meta_array, void *user)
+static void FindExtraMatches(unsigned char *data, size_t data_size, const unsigned int *run_lengths, size_t offset, ClownLZSS_Graph *graph, void *user)
 {
 	(void)data;
 	(void)data_size;
+	(void)run_lengths;
 	(void)offset;
-	(void)node_meta_array;
+	(void)graph;
 	(void)user;
 }
 
-static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, 0x100, 0x2000, FindExtraMatches, 1 + 8, DoLiteral, GetMatchCost, DoMatch)
+static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, format, FindExtraMatches, DoLiteral, DoMatch)
 
-static void KosinskiCompressStream(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user)
+static void KosinskiCompressStream(unsigned char *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, MemoryStream *output_stream, void *user)
 {
 	(void)user;
 
 	KosinskiInstance instance;
-	instance.output_stream = output_stream;
-	instance.match_stream = MemoryStream_Create(true);
-	instance.descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+	BitWriter_Init(&instance.writer, output_stream, TOTAL_DESCRIPTOR_BITS, false, false, true);
 
-	CompressData(data, data_size, &instance);
+	CompressData(data, data_size, level, context, &instance);
 
 	// Terminator match
 	PutDescriptorBit(&instance, 0);
@@ -156,18 +121,148 @@ static void KosinskiCompressStream(unsigned char *data, size_t data_size, Memory
 	PutMatchByte(&instance, 0xF0);
 	PutMatchByte(&instance, 0x00);
 
-	instance.descriptor >>= instance.descriptor_bits_remaining;
-	FlushData(&instance);
+	BitWriter_Finish(&instance.writer);
+}
+
+unsigned char* ClownLZSS_KosinskiCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularWrapper(data, data_size, compressed_size, level, context, "kosinski", NULL, KosinskiCompressStream);
+}
+
+unsigned char* ClownLZSS_ModuledKosinskiCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledCompressionWrapper(data, data_size, compressed_size, level, context, "kosinski", NULL, KosinskiCompressStream, module_size, 0x10);
+}
+
+size_t ClownLZSS_KosinskiCompressBound(size_t data_size)
+{
+	// The terminator match is included
+	return CompressBound(0, data_size * format.literal_cost + 2 + 24, TOTAL_DESCRIPTOR_BITS / 8);
+}
+
+size_t ClownLZSS_ModuledKosinskiCompressBound(size_t data_size, size_t module_size)
+{
+	return ModuledCompressBound(data_size, module_size, 0x10, ClownLZSS_KosinskiCompressBound(module_size), ClownLZSS_KosinskiCompressBound(data_size % module_size));
+}
+
+bool ClownLZSS_KosinskiCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "kosinski", NULL, KosinskiCompressStream);
+}
+
+bool ClownLZSS_ModuledKosinskiCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "kosinski", NULL, KosinskiCompressStream, module_size, 0x10);
+}
+
+bool ClownLZSS_KosinskiCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "kosinski", NULL, KosinskiCompressStream);
+}
+
+bool ClownLZSS_ModuledKosinskiCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "kosinski", NULL, KosinskiCompressStream, module_size, 0x10);
+}
+
+typedef struct KosinskiDecompressionInstance
+{
+	DecompressionInput *input;
+
+	unsigned short descriptor;
+	unsigned int descriptor_bits_remaining;
+} KosinskiDecompressionInstance;
+
+static void ReadDescriptor(KosinskiDecompressionInstance *instance)
+{
+	instance->descriptor = DecompressionInput_ReadByte(instance->input);
+	instance->descriptor |= DecompressionInput_ReadByte(instance->input) << 8;
+	instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+}
+
+static bool GetDescriptorBit(KosinskiDecompressionInstance *instance)
+{
+	const bool bit = instance->descriptor & 1;
+
+	instance->descriptor >>= 1;
+
+	// The next descriptor is read as soon as this one runs out, just like PutDescriptorBit writes it
+	if (--instance->descriptor_bits_remaining == 0)
+		ReadDescriptor(instance);
+
+	return bit;
+}
+
+static bool KosinskiDecompressStream(DecompressionInput *input, DecompressionBuffer *output, size_t decompressed_size, void *user)
+{
+	(void)decompressed_size;
+	(void)user;
+
+	KosinskiDecompressionInstance instance;
+	instance.input = input;
+
+	ReadDescriptor(&instance);
+
+	while (!input->out_of_data)
+	{
+		if (GetDescriptorBit(&instance))
+		{
+			// Literal
+			if (!DecompressionBuffer_WriteByte(output, DecompressionInput_ReadByte(input)))
+				return false;
+		}
+		else
+		{
+			size_t distance;
+			size_t length;
+
+			if (!GetDescriptorBit(&instance))
+			{
+				// Short match
+				length = GetDescriptorBit(&instance) << 1;
+				length |= GetDescriptorBit(&instance);
+				length += 2;
+				distance = 0x100 - DecompressionInput_ReadByte(input);
+			}
+			else
+			{
+				// Full match
+				const unsigned int low_byte = DecompressionInput_ReadByte(input);
+				const unsigned int high_byte = DecompressionInput_ReadByte(input);
+
+				distance = 0x2000 - (((high_byte & 0xF8) << 5) | low_byte);
+
+				if (high_byte & 7)
+				{
+					length = (high_byte & 7) + 2;
+				}
+				else
+				{
+					const unsigned int length_byte = DecompressionInput_ReadByte(input);
+
+					if (length_byte == 0)
+						break;	// Terminator match
+					else if (length_byte == 1)
+						continue;	// Dummy match
+
+					length = length_byte + 1;
+				}
+			}
+
+			if (!DecompressionBuffer_CopyMatch(output, distance, length))
+				return false;
+		}
+	}
 
-	MemoryStream_Destroy(instance.match_stream);
+	return true;
 }
 
-unsigned char* ClownLZSS_KosinskiCompress(unsigned char *data, size_t data_size, size_t *compressed_size)
+unsigned char* ClownLZSS_KosinskiDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size)
 {
-	return RegularWrapper(data, data_size, compressed_size, NULL, KosinskiCompressStream);
+	return RegularDecompressionWrapper(data, data_size, decompressed_size, NULL, KosinskiDecompressStream);
 }
 
-unsigned char* ClownLZSS_ModuledKosinskiCompress(unsigned char *data, size_t data_size, size_t *compressed_size, size_t module_size)
+unsigned char* ClownLZSS_ModuledKosinskiDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, size_t module_size)
 {
-	return ModuledCompressionWrapper(data, data_size, compressed_size, NULL, KosinskiCompressStream, module_size, 0x10);
+	return ModuledDecompressionWrapper(data, data_size, decompressed_size, NULL, KosinskiDecompressStream, module_size, 0x10);
 }
@@ -20,7 +20,20 @@
 
 #pragma once
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
 #include <stddef.h>
 
-unsigned char* ClownLZSS_KosinskiCompress(unsigned char *data, size_t data_size, size_t *compressed_size);
-unsigned char* ClownLZSS_ModuledKosinskiCompress(unsigned char *data, size_t data_size, size_t *compressed_size, size_t module_size);
+#include "clownlzss.h"
+
+unsigned char* ClownLZSS_KosinskiCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context);
+unsigned char* ClownLZSS_ModuledKosinskiCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size);
+size_t ClownLZSS_KosinskiCompressBound(size_t data_size);
+size_t ClownLZSS_ModuledKosinskiCompressBound(size_t data_size, size_t module_size);
+bool ClownLZSS_KosinskiCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context);
+bool ClownLZSS_ModuledKosinskiCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size);
+bool ClownLZSS_KosinskiCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context);
+bool ClownLZSS_ModuledKosinskiCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size);
+unsigned char* ClownLZSS_KosinskiDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size);
+unsigned char* ClownLZSS_ModuledKosinskiDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, size_t module_size);
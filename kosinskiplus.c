@@ -33,43 +33,17 @@
 
 typedef struct KosinskiPlusInstance
 {
-	MemoryStream *output_stream;
-	MemoryStream *match_stream;
-
-	unsigned char descriptor;
-	unsigned int descriptor_bits_remaining;
+	BitWriter writer;
 } KosinskiPlusInstance;
 
-static void FlushData(KosinskiPlusInstance *instance)
-{
-	MemoryStream_WriteByte(instance->output_stream, instance->descriptor);
-
-	const size_t match_buffer_size = MemoryStream_GetPosition(instance->match_stream);
-	unsigned char *match_buffer = MemoryStream_GetBuffer(instance->match_stream);
-
-	MemoryStream_WriteBytes(instance->output_stream, match_buffer, match_buffer_size);
-}
-
 static void PutMatchByte(KosinskiPlusInstance *instance, unsigned char byte)
 {
-	MemoryStream_WriteByte(instance->match_stream, byte);
+	BitWriter_PutByte(&instance->writer, byte);
 }
 
 static void PutDescriptorBit(KosinskiPlusInstance *instance, bool bit)
 {
-	if (instance->descriptor_bits_remaining == 0)
-	{
-		FlushData(instance);
-
-		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
-		MemoryStream_Rewind(instance->match_stream);
-	}
-
-	--instance->descriptor_bits_remaining;
-
-	instance->descriptor <<= 1;
-
-	instance->descriptor |= bit;
+	BitWriter_PutBit(&instance->writer, bit);
 }
 
 static void DoLiteral(unsigned char value, void *user)
@@ -111,41 +85,34 @@ static void DoMatch(size_t distance, size_t length, size_t offset, void *user)
 	}
 }
 
-static unsigned int GetMatchCost(size_t distance, size_t length, void *user)
-{
-	(void)user;
+static const ClownLZSS_MatchEncoding match_encodings[] = {
+	{256, 2, 5, 2 + 8 + 2},		// Descriptor bits, offset byte, length bits
+	{0x2000, 3, 9, 2 + 16},		// Descriptor bits, offset/length bytes
+	{0x2000, 10, 0x100 + 8, 2 + 16 + 8}	// Descriptor bits, offset bytes, length byte
+};
 
-	if (length >= 2 && length <= 5 && distance <= 256)
-		return 2 + 8 + 2;	// Descriptor bits, offset byte, length bits
-	else if (length >= 3 && length <= 9)
-		return 2 + 16;		// Descriptor bits, offset/length bytes
-	else if (length >= 10)
-		return 2 + 16 + 8;	// Descriptor bits, offset bytes, length byte
-	else
-		return 0; 		// In the event a match cannot be compressed
-}
+static const ClownLZSS_Format format = {2, 0x100 + 8, 0x2000, 1 + 8, match_encodings, sizeof(match_encodings) / sizeof(match_encodings[0]), NULL};
 
-static void FindExtraMatches(unsigned char *data, size_t data_size, size_t offset, ClownLZSS_GraphEdge *node_meta_array, void *user)
+static void FindExtraMatches(unsigned char *data, size_t data_size, const unsigned int *run_lengths, size_t offset, ClownLZSS_Graph *graph, void *user)
 {
 	(void)data;
 	(void)data_size;
+	(void)run_lengths;
 	(void)offset;
-	(void)node_meta_array;
+	(void)graph;
 	(void)user;
 }
 
-static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, 0x100 + 8, 0x2000, FindExtraMatches, 1 + 8, DoLiteral, GetMatchCost, DoMatch)
+static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, format, FindExtraMatches, DoLiteral, DoMatch)
 
-static void KosinskiPlusCompressStream(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user)
+static void KosinskiPlusCompressStream(unsigned char *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, MemoryStream *output_stream, void *user)
 {
 	(void)user;
 
 	KosinskiPlusInstance instance;
-	instance.output_stream = output_stream;
-	instance.match_stream = MemoryStream_Create(true);
-	instance.descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+	BitWriter_Init(&instance.writer, output_stream, TOTAL_DESCRIPTOR_BITS, false, true, false);
 
-	CompressData(data, data_size, &instance);
+	CompressData(data, data_size, level, context, &instance);
 
 	// Terminator match
 	PutDescriptorBit(&instance, 0);
@@ -154,18 +121,142 @@ static void KosinskiPlusCompressStream(unsigned char *data, size_t data_size, Me
 	PutMatchByte(&instance, 0x00);
 	PutMatchByte(&instance, 0x00);
 
-	instance.descriptor <<= instance.descriptor_bits_remaining;
-	FlushData(&instance);
+	BitWriter_Finish(&instance.writer);
+}
+
+unsigned char* ClownLZSS_KosinskiPlusCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularWrapper(data, data_size, compressed_size, level, context, "kosinskiplus", NULL, KosinskiPlusCompressStream);
+}
+
+unsigned char* ClownLZSS_ModuledKosinskiPlusCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledCompressionWrapper(data, data_size, compressed_size, level, context, "kosinskiplus", NULL, KosinskiPlusCompressStream, module_size, 1);
+}
+
+size_t ClownLZSS_KosinskiPlusCompressBound(size_t data_size)
+{
+	// The terminator match is included
+	return CompressBound(0, data_size * format.literal_cost + 2 + 24, TOTAL_DESCRIPTOR_BITS / 8);
+}
+
+size_t ClownLZSS_ModuledKosinskiPlusCompressBound(size_t data_size, size_t module_size)
+{
+	return ModuledCompressBound(data_size, module_size, 1, ClownLZSS_KosinskiPlusCompressBound(module_size), ClownLZSS_KosinskiPlusCompressBound(data_size % module_size));
+}
+
+bool ClownLZSS_KosinskiPlusCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "kosinskiplus", NULL, KosinskiPlusCompressStream);
+}
+
+bool ClownLZSS_ModuledKosinskiPlusCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "kosinskiplus", NULL, KosinskiPlusCompressStream, module_size, 1);
+}
+
+bool ClownLZSS_KosinskiPlusCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "kosinskiplus", NULL, KosinskiPlusCompressStream);
+}
+
+bool ClownLZSS_ModuledKosinskiPlusCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "kosinskiplus", NULL, KosinskiPlusCompressStream, module_size, 1);
+}
+
+typedef struct KosinskiPlusDecompressionInstance
+{
+	DecompressionInput *input;
+
+	unsigned char descriptor;
+	unsigned int descriptor_bits_remaining;
+} KosinskiPlusDecompressionInstance;
+
+static bool GetDescriptorBit(KosinskiPlusDecompressionInstance *instance)
+{
+	if (instance->descriptor_bits_remaining == 0)
+	{
+		instance->descriptor = DecompressionInput_ReadByte(instance->input);
+		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+	}
+
+	--instance->descriptor_bits_remaining;
+
+	const bool bit = instance->descriptor & (1 << (TOTAL_DESCRIPTOR_BITS - 1));
+
+	instance->descriptor <<= 1;
+
+	return bit;
+}
+
+static bool KosinskiPlusDecompressStream(DecompressionInput *input, DecompressionBuffer *output, size_t decompressed_size, void *user)
+{
+	(void)decompressed_size;
+	(void)user;
+
+	KosinskiPlusDecompressionInstance instance;
+	instance.input = input;
+	instance.descriptor_bits_remaining = 0;
+
+	while (!input->out_of_data)
+	{
+		if (GetDescriptorBit(&instance))
+		{
+			// Literal
+			if (!DecompressionBuffer_WriteByte(output, DecompressionInput_ReadByte(input)))
+				return false;
+		}
+		else
+		{
+			size_t distance;
+			size_t length;
+
+			if (!GetDescriptorBit(&instance))
+			{
+				// Short match
+				distance = 0x100 - DecompressionInput_ReadByte(input);
+				length = GetDescriptorBit(&instance) << 1;
+				length |= GetDescriptorBit(&instance);
+				length += 2;
+			}
+			else
+			{
+				// Full match
+				const unsigned int high_byte = DecompressionInput_ReadByte(input);
+				const unsigned int low_byte = DecompressionInput_ReadByte(input);
+
+				distance = 0x2000 - (((high_byte & 0xF8) << 5) | low_byte);
+
+				if (high_byte & 7)
+				{
+					length = 10 - (high_byte & 7);
+				}
+				else
+				{
+					const unsigned int length_byte = DecompressionInput_ReadByte(input);
+
+					if (length_byte == 0)
+						break;	// Terminator match
+
+					length = length_byte + 9;
+				}
+			}
+
+			if (!DecompressionBuffer_CopyMatch(output, distance, length))
+				return false;
+		}
+	}
 
-	MemoryStream_Destroy(instance.match_stream);
+	return true;
 }
 
-unsigned char* ClownLZSS_KosinskiPlusCompress(unsigned char *data, size_t data_size, size_t *compressed_size)
+unsigned char* ClownLZSS_KosinskiPlusDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size)
 {
-	return RegularWrapper(data, data_size, compressed_size, NULL, KosinskiPlusCompressStream);
+	return RegularDecompressionWrapper(data, data_size, decompressed_size, NULL, KosinskiPlusDecompressStream);
 }
 
-unsigned char* ClownLZSS_ModuledKosinskiPlusCompress(unsigned char *data, size_t data_size, size_t *compressed_size, size_t module_size)
+unsigned char* ClownLZSS_ModuledKosinskiPlusDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, size_t module_size)
 {
-	return ModuledCompressionWrapper(data, data_size, compressed_size, NULL, KosinskiPlusCompressStream, module_size, 1);
+	return ModuledDecompressionWrapper(data, data_size, decompressed_size, NULL, KosinskiPlusDecompressStream, module_size, 1);
 }
@@ -27,13 +27,18 @@
 #include <string.h>
 
 #include "chameleon.h"
+#include "clownlzss.h"
 #include "comper.h"
 #include "faxman.h"
+#include "files.h"
 #include "kosinski.h"
 #include "kosinskiplus.h"
 #include "rage.h"
 #include "rocket.h"
 #include "saxman.h"
+#include "threads.h"
+#include "timer.h"
+#include "trace.h"
 
 typedef enum Format
 {
@@ -54,26 +59,80 @@ typedef struct Mode
 	Format format;
 	const char *normal_default_filename;
 	const char *moduled_default_filename;
+	const char *name;
 } Mode;
 
 static const Mode modes[] = {
-	{"-ch", FORMAT_CHAMELEON, "out.cham", "out.chamm"},
-	{"-c", FORMAT_COMPER, "out.comp", "out.compm"},
-	{"-k", FORMAT_KOSINSKI, "out.kos", "out.kosm"},
-	{"-kp", FORMAT_KOSINSKIPLUS, "out.kosp", "out.kospm"},
-	{"-ra", FORMAT_RAGE, "out.rage", "out.ragem"},
-	{"-r", FORMAT_ROCKET, "out.rock", "out.rockm"},
-	{"-s", FORMAT_SAXMAN, "out.sax", "out.saxm"},
-	{"-sn", FORMAT_SAXMAN_NO_HEADER, "out.sax", "out.saxm"},
-	{"-f", FORMAT_FAXMAN, "out.fax", "out.faxm"},
+	{"-ch", FORMAT_CHAMELEON, "out.cham", "out.chamm", "chameleon"},
+	{"-c", FORMAT_COMPER, "out.comp", "out.compm", "comper"},
+	{"-k", FORMAT_KOSINSKI, "out.kos", "out.kosm", "kosinski"},
+	{"-kp", FORMAT_KOSINSKIPLUS, "out.kosp", "out.kospm", "kosinskiplus"},
+	{"-ra", FORMAT_RAGE, "out.rage", "out.ragem", "rage"},
+	{"-r", FORMAT_ROCKET, "out.rock", "out.rockm", "rocket"},
+	{"-s", FORMAT_SAXMAN, "out.sax", "out.saxm", "saxman"},
+	{"-sn", FORMAT_SAXMAN_NO_HEADER, "out.sax", "out.saxm", "saxman_no_header"},
+	{"-f", FORMAT_FAXMAN, "out.fax", "out.faxm", "faxman"},
 };
 
-static void PrintUsage(void)
+/* One file to compress, as given by '-i' or a line of the manifest */
+typedef struct Job
 {
-	printf(
+	const char *in_filename;
+	const char *out_filename;
+	const Mode *mode;
+	bool moduled;
+	size_t module_size;
+	unsigned int level;
+	bool verify;
+	size_t in_size;
+	size_t out_size;
+	const char *error;	/* NULL if the job succeeded */
+	bool keep_statistics;
+	ClownLZSS_Statistics statistics;	/* Only counted if the tool is built with CLOWNLZSS_STATISTICS */
+	unsigned long long nanoseconds;	/* How long compressing took */
+	ClownLZSS_Cache *cache;	/* NULL if the job is not cached */
+	bool cached;	/* Whether the output came from the cache */
+} Job;
+
+/* Indexed by ClownLZSS_Stage */
+static const char* const stage_names[CLOWNLZSS_TOTAL_STAGES] = {
+	"run_lengths",
+	"suffix_array",
+	"match_finding",
+	"graph",
+	"path_reversal",
+	"emission",
+	"fast_parse",
+	"module"
+};
+
+static void BeginTraceStage(ClownLZSS_Stage stage, void *user)
+{
+	(void)user;
+
+	Trace_Begin(stage_names[stage]);
+}
+
+static void EndTraceStage(ClownLZSS_Stage stage, void *user)
+{
+	(void)stage;
+	(void)user;
+
+	Trace_End();
+}
+
+/* Only reports the library's stages if it was built with CLOWNLZSS_PROFILE */
+static const ClownLZSS_Profiler trace_profiler = {BeginTraceStage, EndTraceStage, NULL};
+
+static void PrintUsage(FILE *stream)
+{
+	fprintf(stream,
 	"Clownacy's compression tool thingy\n"
 	"\n"
-	"Usage: tool [options] [in-filename] [out-filename]"
+	"Usage: tool [options] [in-filename] [out-filename]\n"
+	"       ('-' reads the standard input, or writes the standard output)"
+	"\n"
+	"   or: tool [options] -i in:out:format[:module_size] [-i ...] [--manifest MANIFEST]"
 	"\n"
 	"Options:\n"
 	"\n"
@@ -91,9 +150,792 @@ static void PrintUsage(void)
 	" Misc:\n"
 	"  -m[=MODULE_SIZE]  Compresses into modules\n"
 	"                    MODULE_SIZE controls the module size (defaults to 0x1000)\n"
+	"  -l=LEVEL          Sets the compression level, from 1 (fastest) to 5\n"
+	"                    (smallest, and the default)\n"
+	"  -t=THREADS        Sets how many threads to compress with, including when\n"
+	"                    compressing modules (defaults to one per processor)\n"
+	"  -p                Also splits large files into segments that are parsed\n"
+	"                    on separate threads (the output is the same)\n"
+	"  --verify          Decompresses the output in memory and checks that it\n"
+	"                    matches the input\n"
+	"  --cache-dir DIR   Keeps the compressed data in DIR, and reuses it instead of\n"
+	"                    compressing the same file the same way again\n"
+	"  --cache-size=MIB  How large DIR may grow before the entries that were used\n"
+	"                    least recently are deleted (defaults to 1024)\n"
+	"\n"
+	" Batch:\n"
+	"  -i JOB             Compresses a file: JOB is in:out:format[:module_size],\n"
+	"                     where format is one of the format options without the\n"
+	"                     '-', and giving a module size compresses into modules\n"
+	"  --manifest FILE    Compresses every file listed in FILE, one JOB per line\n"
+	"                     (blank lines and lines starting with '#' are skipped)\n"
+	"                     Jobs are run at the same time, largest first\n"
+	"\n"
+	" Statistics (when built with CLOWNLZSS_STATISTICS):\n"
+	"  --stats            Prints what compressing each file took, and what it\n"
+	"                     produced, to the standard error\n"
+	"  --stats-json       The same, as JSON\n"
+	"\n"
+	" Tracing:\n"
+	"  --trace FILE       Writes a timeline of reading, compressing and writing each\n"
+	"                     file, and the stages and modules inside them, in Chrome's\n"
+	"                     trace-event format, to be viewed in chrome://tracing or\n"
+	"                     Perfetto\n"
 	);
 }
 
+static const Mode* FindMode(const char *command)
+{
+	for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i)
+		if (!strcmp(command, modes[i].command))
+			return &modes[i];
+
+	return NULL;
+}
+
+/* How large the output file is made before compressing into it */
+static size_t GetCompressBound(const Mode *mode, bool moduled, size_t module_size, size_t file_size)
+{
+	size_t bound = 0;
+
+	switch (mode->format)
+	{
+		case FORMAT_CHAMELEON:
+			if (moduled)
+				bound = ClownLZSS_ModuledChameleonCompressBound(file_size, module_size);
+			else
+				bound = ClownLZSS_ChameleonCompressBound(file_size);
+			break;
+
+		case FORMAT_COMPER:
+			if (moduled)
+				bound = ClownLZSS_ModuledComperCompressBound(file_size, module_size);
+			else
+				bound = ClownLZSS_ComperCompressBound(file_size);
+			break;
+
+		case FORMAT_KOSINSKI:
+			if (moduled)
+				bound = ClownLZSS_ModuledKosinskiCompressBound(file_size, module_size);
+			else
+				bound = ClownLZSS_KosinskiCompressBound(file_size);
+			break;
+
+		case FORMAT_KOSINSKIPLUS:
+			if (moduled)
+				bound = ClownLZSS_ModuledKosinskiPlusCompressBound(file_size, module_size);
+			else
+				bound = ClownLZSS_KosinskiPlusCompressBound(file_size);
+			break;
+
+		case FORMAT_RAGE:
+			if (moduled)
+				bound = ClownLZSS_ModuledRageCompressBound(file_size, module_size);
+			else
+				bound = ClownLZSS_RageCompressBound(file_size);
+			break;
+
+		case FORMAT_ROCKET:
+			if (moduled)
+				bound = ClownLZSS_ModuledRocketCompressBound(file_size, module_size);
+			else
+				bound = ClownLZSS_RocketCompressBound(file_size);
+			break;
+
+		case FORMAT_SAXMAN:
+			if (moduled)
+				bound = ClownLZSS_ModuledSaxmanCompressBound(file_size, true, module_size);
+			else
+				bound = ClownLZSS_SaxmanCompressBound(file_size, true);
+			break;
+
+		case FORMAT_SAXMAN_NO_HEADER:
+			if (moduled)
+				bound = ClownLZSS_ModuledSaxmanCompressBound(file_size, false, module_size);
+			else
+				bound = ClownLZSS_SaxmanCompressBound(file_size, false);
+			break;
+
+		case FORMAT_FAXMAN:
+			if (moduled)
+				bound = ClownLZSS_ModuledFaxmanCompressBound(file_size, module_size);
+			else
+				bound = ClownLZSS_FaxmanCompressBound(file_size);
+			break;
+	}
+
+	return bound;
+}
+
+/* Compresses straight into the output file, which is at least as large as GetCompressBound says */
+static bool Compress(const Mode *mode, bool moduled, size_t module_size, unsigned int level, ClownLZSS_Context *context, unsigned char *file_buffer, size_t file_size, unsigned char *compressed_buffer, size_t buffer_size, size_t *compressed_size)
+{
+	bool success = false;
+
+	switch (mode->format)
+	{
+		case FORMAT_CHAMELEON:
+			if (moduled)
+				success = ClownLZSS_ModuledChameleonCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context, module_size);
+			else
+				success = ClownLZSS_ChameleonCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context);
+			break;
+
+		case FORMAT_COMPER:
+			if (moduled)
+				success = ClownLZSS_ModuledComperCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context, module_size);
+			else
+				success = ClownLZSS_ComperCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context);
+			break;
+
+		case FORMAT_KOSINSKI:
+			if (moduled)
+				success = ClownLZSS_ModuledKosinskiCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context, module_size);
+			else
+				success = ClownLZSS_KosinskiCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context);
+			break;
+
+		case FORMAT_KOSINSKIPLUS:
+			if (moduled)
+				success = ClownLZSS_ModuledKosinskiPlusCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context, module_size);
+			else
+				success = ClownLZSS_KosinskiPlusCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context);
+			break;
+
+		case FORMAT_RAGE:
+			if (moduled)
+				success = ClownLZSS_ModuledRageCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context, module_size);
+			else
+				success = ClownLZSS_RageCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context);
+			break;
+
+		case FORMAT_ROCKET:
+			if (moduled)
+				success = ClownLZSS_ModuledRocketCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context, module_size);
+			else
+				success = ClownLZSS_RocketCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context);
+			break;
+
+		case FORMAT_SAXMAN:
+			if (moduled)
+				success = ClownLZSS_ModuledSaxmanCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, true, level, context, module_size);
+			else
+				success = ClownLZSS_SaxmanCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, true, level, context);
+			break;
+
+		case FORMAT_SAXMAN_NO_HEADER:
+			if (moduled)
+				success = ClownLZSS_ModuledSaxmanCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, false, level, context, module_size);
+			else
+				success = ClownLZSS_SaxmanCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, false, level, context);
+			break;
+
+		case FORMAT_FAXMAN:
+			if (moduled)
+				success = ClownLZSS_ModuledFaxmanCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context, module_size);
+			else
+				success = ClownLZSS_FaxmanCompressToBuffer(file_buffer, file_size, compressed_buffer, buffer_size, compressed_size, level, context);
+			break;
+	}
+
+	return success;
+}
+
+static unsigned char* Decompress(const Mode *mode, bool moduled, size_t module_size, unsigned char *compressed_buffer, size_t compressed_size, size_t *decompressed_size)
+{
+	unsigned char *decompressed_buffer = NULL;
+
+	switch (mode->format)
+	{
+		case FORMAT_CHAMELEON:
+			if (moduled)
+				decompressed_buffer = ClownLZSS_ModuledChameleonDecompress(compressed_buffer, compressed_size, decompressed_size, module_size);
+			else
+				decompressed_buffer = ClownLZSS_ChameleonDecompress(compressed_buffer, compressed_size, decompressed_size);
+			break;
+
+		case FORMAT_COMPER:
+			if (moduled)
+				decompressed_buffer = ClownLZSS_ModuledComperDecompress(compressed_buffer, compressed_size, decompressed_size, module_size);
+			else
+				decompressed_buffer = ClownLZSS_ComperDecompress(compressed_buffer, compressed_size, decompressed_size);
+			break;
+
+		case FORMAT_KOSINSKI:
+			if (moduled)
+				decompressed_buffer = ClownLZSS_ModuledKosinskiDecompress(compressed_buffer, compressed_size, decompressed_size, module_size);
+			else
+				decompressed_buffer = ClownLZSS_KosinskiDecompress(compressed_buffer, compressed_size, decompressed_size);
+			break;
+
+		case FORMAT_KOSINSKIPLUS:
+			if (moduled)
+				decompressed_buffer = ClownLZSS_ModuledKosinskiPlusDecompress(compressed_buffer, compressed_size, decompressed_size, module_size);
+			else
+				decompressed_buffer = ClownLZSS_KosinskiPlusDecompress(compressed_buffer, compressed_size, decompressed_size);
+			break;
+
+		case FORMAT_RAGE:
+			if (moduled)
+				decompressed_buffer = ClownLZSS_ModuledRageDecompress(compressed_buffer, compressed_size, decompressed_size, module_size);
+			else
+				decompressed_buffer = ClownLZSS_RageDecompress(compressed_buffer, compressed_size, decompressed_size);
+			break;
+
+		case FORMAT_ROCKET:
+			if (moduled)
+				decompressed_buffer = ClownLZSS_ModuledRocketDecompress(compressed_buffer, compressed_size, decompressed_size, module_size);
+			else
+				decompressed_buffer = ClownLZSS_RocketDecompress(compressed_buffer, compressed_size, decompressed_size);
+			break;
+
+		case FORMAT_SAXMAN:
+			if (moduled)
+				decompressed_buffer = ClownLZSS_ModuledSaxmanDecompress(compressed_buffer, compressed_size, decompressed_size, true, module_size);
+			else
+				decompressed_buffer = ClownLZSS_SaxmanDecompress(compressed_buffer, compressed_size, decompressed_size, true);
+			break;
+
+		case FORMAT_SAXMAN_NO_HEADER:
+			if (moduled)
+				decompressed_buffer = ClownLZSS_ModuledSaxmanDecompress(compressed_buffer, compressed_size, decompressed_size, false, module_size);
+			else
+				decompressed_buffer = ClownLZSS_SaxmanDecompress(compressed_buffer, compressed_size, decompressed_size, false);
+			break;
+
+		case FORMAT_FAXMAN:
+			if (moduled)
+				decompressed_buffer = ClownLZSS_ModuledFaxmanDecompress(compressed_buffer, compressed_size, decompressed_size, module_size);
+			else
+				decompressed_buffer = ClownLZSS_FaxmanDecompress(compressed_buffer, compressed_size, decompressed_size);
+			break;
+	}
+
+	return decompressed_buffer;
+}
+
+/* Checks that the compressed data decompresses back into the original data */
+static bool Verify(const Mode *mode, bool moduled, size_t module_size, unsigned char *file_buffer, size_t file_size, unsigned char *compressed_buffer, size_t compressed_size)
+{
+	size_t decompressed_size;
+	unsigned char *decompressed_buffer = Decompress(mode, moduled, module_size, compressed_buffer, compressed_size, &decompressed_size);
+
+	const bool success = decompressed_buffer != NULL && decompressed_size == file_size && !memcmp(decompressed_buffer, file_buffer, file_size);
+
+	free(decompressed_buffer);
+
+	return success;
+}
+
+/* 'context' may be NULL, unless the job keeps statistics or is cached */
+static void RunJob(Job *job, ClownLZSS_Context *context)
+{
+	/* The whole job is traced under the name of its input file */
+	Trace_SetJob(job->mode->name, 0);
+	Trace_Begin(job->in_filename);
+	Trace_Begin("read");
+
+	job->error = "could not read input file";
+
+	InputFile in_file;
+	const bool opened = InputFile_Open(&in_file, job->in_filename);
+
+	Trace_SetJob(job->mode->name, opened ? InputFile_GetSize(&in_file) : 0);
+	Trace_End();
+
+	if (opened)
+	{
+		unsigned char *file_buffer = InputFile_GetData(&in_file);
+		const size_t file_size = InputFile_GetSize(&in_file);
+
+		job->in_size = file_size;
+		job->error = "could not create output file";
+
+		/* The output is compressed straight into the output file, instead of being copied there afterwards */
+		const size_t bound = GetCompressBound(job->mode, job->moduled, job->module_size, file_size);
+		OutputFile out_file;
+
+		if (OutputFile_Open(&out_file, job->out_filename, bound))
+		{
+			unsigned char *compressed_buffer = OutputFile_GetData(&out_file);
+			size_t compressed_size;
+			bool committed = false;
+
+			job->error = "could not compress";
+
+			if (job->keep_statistics)
+				ClownLZSS_ContextSetStatistics(context, &job->statistics);
+
+			if (job->cache != NULL)
+				ClownLZSS_ContextSetCache(context, job->cache);
+
+			Trace_Begin("compress");
+			const unsigned long long start_time = Timer_GetNanoseconds();
+			const bool compressed = Compress(job->mode, job->moduled, job->module_size, job->level, context, file_buffer, file_size, compressed_buffer, bound, &compressed_size);
+			job->nanoseconds = Timer_GetNanoseconds() - start_time;
+			Trace_End();
+
+			if (job->keep_statistics)
+				ClownLZSS_ContextSetStatistics(context, NULL);
+
+			if (job->cache != NULL)
+			{
+				job->cached = ClownLZSS_ContextWasCached(context);
+				ClownLZSS_ContextSetCache(context, NULL);
+			}
+
+			if (compressed)
+			{
+				/* Nothing is written if the output is broken */
+				if (job->verify && !Verify(job->mode, job->moduled, job->module_size, file_buffer, file_size, compressed_buffer, compressed_size))
+				{
+					job->error = "the compressed data does not decompress back into the input";
+				}
+				else
+				{
+					committed = true;
+					job->error = "could not write output file";
+
+					Trace_Begin("write");
+					const bool written = OutputFile_Commit(&out_file, compressed_size);
+					Trace_End();
+
+					if (written)
+					{
+						job->out_size = compressed_size;
+						job->error = NULL;
+					}
+				}
+			}
+
+			if (!committed)
+				OutputFile_Abandon(&out_file);
+		}
+
+		InputFile_Close(&in_file);
+	}
+
+	Trace_End();
+}
+
+/* Splits 'spec' (in:out:format[:module_size]) in place */
+static bool ParseJob(char *spec, Job *job)
+{
+	char *fields[4] = {spec, NULL, NULL, NULL};
+	size_t total_fields = 1;
+
+	for (char *character = spec; *character != '\0'; ++character)
+	{
+		if (*character == ':')
+		{
+			if (total_fields == sizeof(fields) / sizeof(fields[0]))
+				return false;
+
+			*character = '\0';
+			fields[total_fields++] = character + 1;
+		}
+	}
+
+	if (total_fields < 3 || fields[0][0] == '\0' || fields[1][0] == '\0')
+		return false;
+
+	/* The format can be given with or without its leading '-' */
+	char command[8] = "-";
+
+	if (strlen(fields[2]) >= sizeof(command) - 1)
+		return false;
+
+	strcpy(fields[2][0] == '-' ? command : command + 1, fields[2]);
+
+	job->in_filename = fields[0];
+	job->out_filename = fields[1];
+	job->mode = FindMode(command);
+	job->moduled = total_fields == 4;
+	job->module_size = 0x1000;
+	job->level = CLOWNLZSS_DEFAULT_LEVEL;
+	job->verify = false;
+	job->in_size = 0;
+	job->out_size = 0;
+	job->error = NULL;
+	job->keep_statistics = false;
+	job->nanoseconds = 0;
+	ClownLZSS_StatisticsClear(&job->statistics);
+	job->cache = NULL;
+	job->cached = false;
+
+	if (job->moduled)
+	{
+		char *end;
+		job->module_size = strtoul(fields[3], &end, 0);
+
+		if (*end != '\0' || job->module_size == 0)
+			return false;
+	}
+
+	return job->mode != NULL;
+}
+
+static bool AddJob(Job **jobs, size_t *total_jobs, char *spec)
+{
+	Job *new_jobs = (Job*)realloc(*jobs, (*total_jobs + 1) * sizeof(Job));
+
+	if (new_jobs == NULL)
+		return false;
+
+	*jobs = new_jobs;
+
+	const size_t spec_length = strlen(spec);
+
+	if (!ParseJob(spec, &new_jobs[*total_jobs]))
+	{
+		for (size_t i = 0; i < spec_length; ++i)
+			if (spec[i] == '\0')
+				spec[i] = ':';
+
+		fprintf(stderr, "Invalid job '%s'\n", spec);
+		return false;
+	}
+
+	++*total_jobs;
+
+	return true;
+}
+
+/* The manifest is kept in memory for as long as its jobs are, as they point into it */
+static char* AddManifestJobs(Job **jobs, size_t *total_jobs, const char *filename)
+{
+	InputFile file;
+
+	/* Like the inputs, the manifest can be a pipe, or the standard input */
+	if (!InputFile_Open(&file, filename))
+	{
+		fprintf(stderr, "Could not open manifest '%s'\n", filename);
+		return NULL;
+	}
+
+	/* It is copied so that it can be terminated, and so that its lines can outlive the mapping */
+	const size_t file_size = InputFile_GetSize(&file);
+	char *manifest = file_size == (size_t)-1 ? NULL : (char*)malloc(file_size + 1);
+
+	if (manifest)
+	{
+		memcpy(manifest, InputFile_GetData(&file), file_size);
+		manifest[file_size] = '\0';
+
+		for (char *line = manifest; line != NULL;)
+		{
+			char *next_line = strchr(line, '\n');
+
+			if (next_line != NULL)
+				*next_line++ = '\0';
+
+			const size_t length = strlen(line);
+
+			if (length != 0 && line[length - 1] == '\r')
+				line[length - 1] = '\0';
+
+			if (line[0] != '\0' && line[0] != '#' && !AddJob(jobs, total_jobs, line))
+			{
+				free(manifest);
+				manifest = NULL;
+				break;
+			}
+
+			line = next_line;
+		}
+	}
+	else
+	{
+		fprintf(stderr, "Could not read manifest '%s'\n", filename);
+	}
+
+	InputFile_Close(&file);
+
+	return manifest;
+}
+
+static int CompareJobSizes(const void *a, const void *b)
+{
+	const Job *job_a = *(const Job* const*)a;
+	const Job *job_b = *(const Job* const*)b;
+
+	return job_a->in_size < job_b->in_size ? 1 : job_a->in_size > job_b->in_size ? -1 : 0;
+}
+
+/* Each worker keeps its own context, so that once it has compressed a few files
+   it stops allocating memory for the ones after them */
+typedef struct Worker
+{
+	Job **scheduled_jobs;
+	size_t total_jobs;
+	size_t *next_job;
+	Mutex *mutex;
+	ClownLZSS_Context context;
+} Worker;
+
+static void RunWorker(void *item)
+{
+	Worker *worker = (Worker*)item;
+
+	for (;;)
+	{
+		Mutex_Lock(worker->mutex);
+		const size_t job_index = (*worker->next_job)++;
+		Mutex_Unlock(worker->mutex);
+
+		if (job_index >= worker->total_jobs)
+			break;
+
+		RunJob(worker->scheduled_jobs[job_index], &worker->context);
+	}
+}
+
+/* Compression takes more than linear time, so the largest files are started
+   first, leaving the small ones to fill in the gaps at the end. Each file is
+   compressed on a single thread, with the files spread across the threads
+   instead of each one being split between them. */
+static bool RunJobs(Job *jobs, size_t total_jobs)
+{
+	Job **scheduled_jobs = (Job**)malloc(total_jobs * sizeof(Job*));
+
+	if (scheduled_jobs == NULL)
+		return false;
+
+	/* Inputs whose size cannot be known until they are read, such as pipes, go last */
+	for (size_t i = 0; i < total_jobs; ++i)
+	{
+		jobs[i].in_size = InputFile_GetSizeOnDisk(jobs[i].in_filename);
+		scheduled_jobs[i] = &jobs[i];
+	}
+
+	qsort(scheduled_jobs, total_jobs, sizeof(Job*), CompareJobSizes);
+
+	const size_t total_threads = ClownLZSS_GetThreadCount();
+	const size_t total_workers = CLOWNLZSS_MAX(1, CLOWNLZSS_MIN(total_threads, total_jobs));
+
+	Worker *workers = (Worker*)malloc(total_workers * sizeof(Worker));
+	Mutex *mutex = Mutex_Create();
+
+	if (workers == NULL || mutex == NULL)
+	{
+		if (mutex != NULL)
+			Mutex_Destroy(mutex);
+
+		free(workers);
+		free(scheduled_jobs);
+		return false;
+	}
+
+	size_t next_job = 0;
+	size_t total_contexts = 0;
+
+	for (size_t i = 0; i < total_workers; ++i)
+	{
+		workers[i].scheduled_jobs = scheduled_jobs;
+		workers[i].total_jobs = total_jobs;
+		workers[i].next_job = &next_job;
+		workers[i].mutex = mutex;
+
+		if (!ClownLZSS_ContextInit(&workers[i].context))
+		{
+			ClownLZSS_ContextDeinit(&workers[i].context);
+			break;
+		}
+
+		/* The jobs are already spread across the threads */
+		ClownLZSS_ContextSetThreadCount(&workers[i].context, 1);
+		++total_contexts;
+	}
+
+	if (total_contexts != total_workers)
+	{
+		for (size_t i = 0; i < total_contexts; ++i)
+			ClownLZSS_ContextDeinit(&workers[i].context);
+
+		Mutex_Destroy(mutex);
+		free(workers);
+		free(scheduled_jobs);
+		return false;
+	}
+
+	ClownLZSS_RunInParallel(RunWorker, workers, sizeof(Worker), total_workers, total_workers);
+
+	for (size_t i = 0; i < total_workers; ++i)
+		ClownLZSS_ContextDeinit(&workers[i].context);
+
+	Mutex_Destroy(mutex);
+	free(workers);
+	free(scheduled_jobs);
+
+	size_t total_succeeded = 0;
+	size_t total_in_size = 0;
+	size_t total_out_size = 0;
+
+	for (size_t i = 0; i < total_jobs; ++i)
+	{
+		const Job *job = &jobs[i];
+
+		if (job->error != NULL)
+		{
+			fprintf(stderr, "%s -> %s: Error: %s\n", job->in_filename, job->out_filename, job->error);
+		}
+		else
+		{
+			fprintf(stderr, "%s -> %s: %lu -> %lu bytes%s\n", job->in_filename, job->out_filename, (unsigned long)job->in_size, (unsigned long)job->out_size, job->cached ? " (cached)" : "");
+			++total_succeeded;
+			total_in_size += job->in_size;
+			total_out_size += job->out_size;
+		}
+	}
+
+	fprintf(stderr, "%lu of %lu files compressed: %lu -> %lu bytes\n", (unsigned long)total_succeeded, (unsigned long)total_jobs, (unsigned long)total_in_size, (unsigned long)total_out_size);
+
+	return total_succeeded == total_jobs;
+}
+
+static double Divide(unsigned long long dividend, unsigned long long divisor)
+{
+	return divisor == 0 ? 0.0 : (double)dividend / divisor;
+}
+
+/* Only the buckets with something in them are printed */
+static void PrintHistogram(const char *title, const unsigned long long *buckets, const char *zero_label)
+{
+	fprintf(stderr, "  %s:\n", title);
+
+	for (size_t i = 0; i < CLOWNLZSS_STATISTICS_BUCKETS; ++i)
+	{
+		if (buckets[i] == 0)
+			continue;
+
+		/* Bucket N holds the values that are N bits wide */
+		char label[48];
+
+		if (i == 0)
+			sprintf(label, "%s", zero_label);
+		else if (i == 1)
+			sprintf(label, "1");
+		else
+			sprintf(label, "%llu-%llu", 1ULL << (i - 1), (1ULL << i) - 1);
+
+		fprintf(stderr, "    %-24s %llu\n", label, buckets[i]);
+	}
+}
+
+static void PrintStatistics(const Job *job)
+{
+	const ClownLZSS_Statistics *statistics = &job->statistics;
+
+	fprintf(stderr, "%s (%s, level %u", job->in_filename, job->mode->name, job->level);
+
+	if (job->moduled)
+		fprintf(stderr, ", modules of 0x%lX bytes", (unsigned long)job->module_size);
+
+	fprintf(stderr, "):\n");
+
+	if (job->error != NULL)
+		fprintf(stderr, "  Error:           %s\n", job->error);
+
+	fprintf(stderr, "  Size:            %lu -> %lu bytes\n", (unsigned long)job->in_size, (unsigned long)job->out_size);
+	fprintf(stderr, "  Time:            %.3f ms\n", job->nanoseconds / 1000000.0);
+
+	for (size_t i = 0; i < CLOWNLZSS_TOTAL_STAGES; ++i)
+		if (statistics->stage_nanoseconds[i] != 0)
+			fprintf(stderr, "    %-15s %.3f ms\n", stage_names[i], statistics->stage_nanoseconds[i] / 1000000.0);
+
+	fprintf(stderr, "  Nodes:           %llu\n", statistics->nodes);
+	fprintf(stderr, "  Candidates:      %llu (%.1f per node)\n", statistics->candidates, Divide(statistics->candidates, statistics->nodes));
+	fprintf(stderr, "  Comparisons:     %llu (%.1f per candidate)\n", statistics->comparisons, Divide(statistics->comparisons, statistics->candidates));
+	fprintf(stderr, "  Edges relaxed:   %llu\n", statistics->edges_relaxed);
+	fprintf(stderr, "  Edges improved:  %llu (%.1f%%)\n", statistics->edges_improved, Divide(statistics->edges_improved * 100, statistics->edges_relaxed));
+	fprintf(stderr, "  Literals:        %llu, making %.1f bytes\n", statistics->literals, statistics->literal_bits / 8.0);
+	fprintf(stderr, "  Matches:         %llu, making %.1f bytes\n", statistics->matches, statistics->match_bits / 8.0);
+	fprintf(stderr, "  Output buffer:   %llu reallocations, %llu bytes copied\n", statistics->output_reallocations, statistics->output_bytes_copied);
+
+	PrintHistogram("Match lengths", statistics->match_lengths, "0");
+	PrintHistogram("Match distances", statistics->match_distances, "none (no earlier data)");
+}
+
+static void PrintJSONString(const char *string)
+{
+	fputc('"', stderr);
+
+	for (const unsigned char *character = (const unsigned char*)string; *character != '\0'; ++character)
+	{
+		if (*character == '"' || *character == '\\')
+			fprintf(stderr, "\\%c", *character);
+		else if (*character < 0x20)
+			fprintf(stderr, "\\u%04X", *character);
+		else
+			fputc(*character, stderr);
+	}
+
+	fputc('"', stderr);
+}
+
+static void PrintJSONBuckets(const char *name, const unsigned long long *buckets)
+{
+	fprintf(stderr, "      \"%s\": [", name);
+
+	for (size_t i = 0; i < CLOWNLZSS_STATISTICS_BUCKETS; ++i)
+		fprintf(stderr, i == 0 ? "%llu" : ", %llu", buckets[i]);
+
+	fprintf(stderr, "],\n");
+}
+
+/* One document for every job, so that it can be read in one go */
+static void PrintStatisticsJSON(const Job *jobs, size_t total_jobs)
+{
+	fprintf(stderr, "{\n  \"jobs\": [\n");
+
+	for (size_t i = 0; i < total_jobs; ++i)
+	{
+		const Job *job = &jobs[i];
+		const ClownLZSS_Statistics *statistics = &job->statistics;
+
+		fprintf(stderr, "    {\n      \"input\": ");
+		PrintJSONString(job->in_filename);
+		fprintf(stderr, ",\n      \"output\": ");
+		PrintJSONString(job->out_filename);
+		fprintf(stderr, ",\n      \"format\": \"%s\",\n", job->mode->name);
+		fprintf(stderr, "      \"level\": %u,\n", job->level);
+		fprintf(stderr, "      \"module_size\": %lu,\n", job->moduled ? (unsigned long)job->module_size : 0UL);
+		fprintf(stderr, "      \"error\": ");
+
+		if (job->error != NULL)
+			PrintJSONString(job->error);
+		else
+			fprintf(stderr, "null");
+
+		fprintf(stderr, ",\n");
+		fprintf(stderr, "      \"input_bytes\": %lu,\n", (unsigned long)job->in_size);
+		fprintf(stderr, "      \"output_bytes\": %lu,\n", (unsigned long)job->out_size);
+		fprintf(stderr, "      \"nanoseconds\": %llu,\n", job->nanoseconds);
+		fprintf(stderr, "      \"stage_nanoseconds\": {");
+
+		for (size_t j = 0; j < CLOWNLZSS_TOTAL_STAGES; ++j)
+			fprintf(stderr, "%s\"%s\": %llu", j == 0 ? "" : ", ", stage_names[j], statistics->stage_nanoseconds[j]);
+
+		fprintf(stderr, "},\n");
+		fprintf(stderr, "      \"nodes\": %llu,\n", statistics->nodes);
+		fprintf(stderr, "      \"candidates\": %llu,\n", statistics->candidates);
+		fprintf(stderr, "      \"comparisons\": %llu,\n", statistics->comparisons);
+		fprintf(stderr, "      \"edges_relaxed\": %llu,\n", statistics->edges_relaxed);
+		fprintf(stderr, "      \"edges_improved\": %llu,\n", statistics->edges_improved);
+		fprintf(stderr, "      \"literals\": %llu,\n", statistics->literals);
+		fprintf(stderr, "      \"matches\": %llu,\n", statistics->matches);
+		fprintf(stderr, "      \"literal_bits\": %llu,\n", statistics->literal_bits);
+		fprintf(stderr, "      \"match_bits\": %llu,\n", statistics->match_bits);
+		PrintJSONBuckets("match_length_bits", statistics->match_lengths);
+		PrintJSONBuckets("match_distance_bits", statistics->match_distances);
+		fprintf(stderr, "      \"output_reallocations\": %llu,\n", statistics->output_reallocations);
+		fprintf(stderr, "      \"output_bytes_copied\": %llu\n", statistics->output_bytes_copied);
+		fprintf(stderr, "    }%s\n", i + 1 == total_jobs ? "" : ",");
+	}
+
+	fprintf(stderr, "  ]\n}\n");
+}
+
 int main(int argc, char *argv[])
 {
 	--argc;
@@ -105,13 +947,93 @@ int main(int argc, char *argv[])
 	bool moduled = false;
 	size_t module_size = 0x1000;
 
+	Job *jobs = NULL;
+	size_t total_jobs = 0;
+	char *manifests[0x10];
+	size_t total_manifests = 0;
+	unsigned int level = CLOWNLZSS_DEFAULT_LEVEL;
+	bool verify = false;
+	bool print_statistics = false;
+	bool print_statistics_json = false;
+	const char *trace_filename = NULL;
+	bool tracing = false;
+	const char *cache_directory = NULL;
+	unsigned long long cache_size = 1024ULL * 1024 * 1024;
+	ClownLZSS_Cache cache;
+	bool caching = false;
+	int exit_code = 0;
+
 	for (int i = 0; i < argc; ++i)
 	{
-		if (argv[i][0] == '-')
+		/* A lone '-' is the standard input or output, rather than an option */
+		if (argv[i][0] == '-' && argv[i][1] != '\0')
 		{
 			if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
 			{
-				PrintUsage();
+				PrintUsage(stdout);
+			}
+			else if (!strcmp(argv[i], "-i") || !strcmp(argv[i], "--manifest"))
+			{
+				if (i + 1 == argc)
+				{
+					fprintf(stderr, "Missing parameter to %s\n", argv[i]);
+					exit_code = -1;
+					break;
+				}
+
+				if (!strcmp(argv[i], "-i"))
+				{
+					if (!AddJob(&jobs, &total_jobs, argv[++i]))
+					{
+						exit_code = -1;
+						break;
+					}
+				}
+				else
+				{
+					if (total_manifests == sizeof(manifests) / sizeof(manifests[0]) || (manifests[total_manifests] = AddManifestJobs(&jobs, &total_jobs, argv[++i])) == NULL)
+					{
+						exit_code = -1;
+						break;
+					}
+
+					++total_manifests;
+				}
+			}
+			else if (!strcmp(argv[i], "--trace"))
+			{
+				if (i + 1 == argc)
+				{
+					fprintf(stderr, "Missing parameter to %s\n", argv[i]);
+					exit_code = -1;
+					break;
+				}
+
+				trace_filename = argv[++i];
+			}
+			else if (!strcmp(argv[i], "--cache-dir"))
+			{
+				if (i + 1 == argc)
+				{
+					fprintf(stderr, "Missing parameter to %s\n", argv[i]);
+					exit_code = -1;
+					break;
+				}
+
+				cache_directory = argv[++i];
+			}
+			else if (!strncmp(argv[i], "--cache-size=", 13))
+			{
+				char *end;
+				unsigned long result = strtoul(argv[i] + 13, &end, 0);
+
+				if (*end != '\0' || result == 0)
+				{
+					fprintf(stderr, "Invalid parameter to --cache-size\n");
+					return -1;
+				}
+
+				cache_size = result * 1024ULL * 1024;
 			}
 			else if (!strncmp(argv[i], "-m", 2))
 			{
@@ -124,9 +1046,9 @@ int main(int argc, char *argv[])
 					char *end;
 					unsigned long result = strtoul(argument + 1, &end, 0);
 
-					if (*end != '\0')
+					if (*end != '\0' || result == 0)
 					{
-						printf("Invalid parameter to -m\n");
+						fprintf(stderr, "Invalid parameter to -m\n");
 						return -1;
 					}
 					else
@@ -134,20 +1056,62 @@ int main(int argc, char *argv[])
 						module_size = result;
 
 						if (module_size > 0x1000)
-							printf("Warning: the moduled format header does not fully support sizes greater than\n 0x1000 - header will likely be invalid!");
+							fprintf(stderr, "Warning: the moduled format header does not fully support sizes greater than\n 0x1000 - header will likely be invalid!\n");
 					}
 				}
 			}
-			else
+			else if (!strncmp(argv[i], "-l=", 3))
 			{
-				for (size_t j = 0; j < sizeof(modes) / sizeof(modes[0]); ++j)
+				char *end;
+				unsigned long result = strtoul(argv[i] + 3, &end, 0);
+
+				if (*end != '\0' || result < CLOWNLZSS_MINIMUM_LEVEL || result > CLOWNLZSS_MAXIMUM_LEVEL)
 				{
-					if (!strcmp(argv[i], modes[j].command))
-					{
-						mode = &modes[j];
-						break;
-					}
+					fprintf(stderr, "Invalid parameter to -l\n");
+					return -1;
 				}
+
+				level = result;
+			}
+			else if (!strcmp(argv[i], "--verify"))
+			{
+				verify = true;
+			}
+			else if (!strcmp(argv[i], "--stats") || !strcmp(argv[i], "--stats-json"))
+			{
+#if CLOWNLZSS_STATISTICS
+				if (!strcmp(argv[i], "--stats"))
+					print_statistics = true;
+				else
+					print_statistics_json = true;
+#else
+				fprintf(stderr, "%s needs the tool to be built with CLOWNLZSS_STATISTICS\n", argv[i]);
+				return -1;
+#endif
+			}
+			else if (!strcmp(argv[i], "-p"))
+			{
+				ClownLZSS_SetParallelParse(true);
+			}
+			else if (!strncmp(argv[i], "-t=", 3))
+			{
+				char *end;
+				unsigned long result = strtoul(argv[i] + 3, &end, 0);
+
+				if (*end != '\0' || result == 0)
+				{
+					fprintf(stderr, "Invalid parameter to -t\n");
+					return -1;
+				}
+
+				ClownLZSS_SetThreadCount(result);
+			}
+			else
+			{
+				const Mode *new_mode = FindMode(argv[i]);
+
+				if (new_mode != NULL)
+					mode = new_mode;
 			}
 		}
 		else
@@ -159,113 +1123,133 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (!in_filename)
+	if (exit_code == 0 && trace_filename != NULL)
 	{
-		printf("Error: Input file not specified\n\n");
-		PrintUsage();
+		tracing = Trace_Start();
+
+		if (tracing)
+		{
+			ClownLZSS_SetProfiler(&trace_profiler);
+		}
+		else
+		{
+			fprintf(stderr, "Could not start tracing\n");
+			exit_code = -1;
+		}
 	}
-	else if (!mode)
+
+	if (exit_code == 0 && cache_directory != NULL)
 	{
-		printf("Error: Format not specified\n\n");
-		PrintUsage();
+		caching = ClownLZSS_CacheInit(&cache, cache_directory, cache_size);
+
+		if (!caching)
+		{
+			fprintf(stderr, "Could not use cache directory '%s'\n", cache_directory);
+			exit_code = -1;
+		}
 	}
-	else
+
+	if (exit_code != 0)
 	{
-		if (!out_filename)
-			out_filename = moduled ? mode->moduled_default_filename : mode->normal_default_filename;
+		// Don't run any of the jobs if one of them is wrong
+	}
+	else if (total_jobs != 0)
+	{
+		for (size_t i = 0; i < total_jobs; ++i)
+		{
+			jobs[i].level = level;
+			jobs[i].verify = verify;
+			jobs[i].keep_statistics = print_statistics || print_statistics_json;
+			jobs[i].cache = caching ? &cache : NULL;
+		}
 
-		FILE *in_file = fopen(in_filename, "rb");
+		if (!RunJobs(jobs, total_jobs))
+			exit_code = -1;
 
-		if (in_file)
-		{
-			fseek(in_file, 0, SEEK_END);
-			const size_t file_size = ftell(in_file);
-			rewind(in_file);
+		if (print_statistics)
+			for (size_t i = 0; i < total_jobs; ++i)
+				PrintStatistics(&jobs[i]);
 
-			unsigned char *file_buffer = (unsigned char*)malloc(file_size);
-			fread(file_buffer, 1, file_size, in_file);
-			fclose(in_file);
+		if (print_statistics_json)
+			PrintStatisticsJSON(jobs, total_jobs);
+	}
+	else if (!in_filename)
+	{
+		fprintf(stderr, "Error: Input file not specified\n\n");
+		PrintUsage(stderr);
+	}
+	else if (!mode)
+	{
+		fprintf(stderr, "Error: Format not specified\n\n");
+		PrintUsage(stderr);
+	}
+	else
+	{
+		Job job;
+		job.in_filename = in_filename;
+		job.out_filename = out_filename ? out_filename : moduled ? mode->moduled_default_filename : mode->normal_default_filename;
+		job.mode = mode;
+		job.moduled = moduled;
+		job.module_size = module_size;
+		job.level = level;
+		job.verify = verify;
+		job.in_size = 0;
+		job.out_size = 0;
+		job.keep_statistics = print_statistics || print_statistics_json;
+		job.nanoseconds = 0;
+		ClownLZSS_StatisticsClear(&job.statistics);
+		job.cache = caching ? &cache : NULL;
+		job.cached = false;
 
-			size_t compressed_size;
-			unsigned char *compressed_buffer = NULL;
+		if (!job.keep_statistics && job.cache == NULL)
+		{
+			RunJob(&job, NULL);
+		}
+		else
+		{
+			/* The statistics are counted into a context, and the cache is used through one */
+			ClownLZSS_Context context;
 
-			switch (mode->format)
-			{
-				case FORMAT_CHAMELEON:
-					if (moduled)
-						compressed_buffer = ClownLZSS_ModuledChameleonCompress(file_buffer, file_size, &compressed_size, module_size);
-					else
-						compressed_buffer = ClownLZSS_ChameleonCompress(file_buffer, file_size, &compressed_size);
-					break;
+			if (ClownLZSS_ContextInit(&context))
+				RunJob(&job, &context);
+			else
+				job.error = "could not allocate memory";
 
-				case FORMAT_COMPER:
-					if (moduled)
-						compressed_buffer = ClownLZSS_ModuledComperCompress(file_buffer, file_size, &compressed_size, module_size);
-					else
-						compressed_buffer = ClownLZSS_ComperCompress(file_buffer, file_size, &compressed_size);
-					break;
+			ClownLZSS_ContextDeinit(&context);
+		}
 
-				case FORMAT_KOSINSKI:
-					if (moduled)
-						compressed_buffer = ClownLZSS_ModuledKosinskiCompress(file_buffer, file_size, &compressed_size, module_size);
-					else
-						compressed_buffer = ClownLZSS_KosinskiCompress(file_buffer, file_size, &compressed_size);
-					break;
+		if (job.error != NULL)
+		{
+			fprintf(stderr, "Error: %s\n", job.error);
+			exit_code = -1;
+		}
 
-				case FORMAT_KOSINSKIPLUS:
-					if (moduled)
-						compressed_buffer = ClownLZSS_ModuledKosinskiPlusCompress(file_buffer, file_size, &compressed_size, module_size);
-					else
-						compressed_buffer = ClownLZSS_KosinskiPlusCompress(file_buffer, file_size, &compressed_size);
-					break;
+		if (print_statistics)
+			PrintStatistics(&job);
 
-				case FORMAT_RAGE:
-					if (moduled)
-						compressed_buffer = ClownLZSS_ModuledRageCompress(file_buffer, file_size, &compressed_size, module_size);
-					else
-						compressed_buffer = ClownLZSS_RageCompress(file_buffer, file_size, &compressed_size);
-					break;
+		if (print_statistics_json)
+			PrintStatisticsJSON(&job, 1);
+	}
 
-				case FORMAT_ROCKET:
-					if (moduled)
-						compressed_buffer = ClownLZSS_ModuledRocketCompress(file_buffer, file_size, &compressed_size, module_size);
-					else
-						compressed_buffer = ClownLZSS_RocketCompress(file_buffer, file_size, &compressed_size);
-					break;
+	/* This is done before the manifests are freed, as the trace's spans are named after the jobs' files */
+	if (tracing)
+	{
+		ClownLZSS_SetProfiler(NULL);
 
-				case FORMAT_SAXMAN:
-					if (moduled)
-						compressed_buffer = ClownLZSS_ModuledSaxmanCompress(file_buffer, file_size, &compressed_size, true, module_size);
-					else
-						compressed_buffer = ClownLZSS_SaxmanCompress(file_buffer, file_size, &compressed_size, true);
-					break;
+		if (!Trace_Write(trace_filename))
+		{
+			fprintf(stderr, "Could not write trace '%s'\n", trace_filename);
+			exit_code = -1;
+		}
+	}
 
-				case FORMAT_SAXMAN_NO_HEADER:
-					if (moduled)
-						compressed_buffer = ClownLZSS_ModuledSaxmanCompress(file_buffer, file_size, &compressed_size, false, module_size);
-					else
-						compressed_buffer = ClownLZSS_SaxmanCompress(file_buffer, file_size, &compressed_size, false);
-					break;
+	if (caching)
+		ClownLZSS_CacheDeinit(&cache);
 
-				case FORMAT_FAXMAN:
-					if (moduled)
-						compressed_buffer = ClownLZSS_ModuledFaxmanCompress(file_buffer, file_size, &compressed_size, module_size);
-					else
-						compressed_buffer = ClownLZSS_FaxmanCompress(file_buffer, file_size, &compressed_size);
-					break;
-			}
+	for (size_t i = 0; i < total_manifests; ++i)
+		free(manifests[i]);
 
-			if (compressed_buffer)
-			{
-				FILE *out_file = fopen(out_filename, "wb");
+	free(jobs);
 
-				if (out_file)
-				{
-					fwrite(compressed_buffer, compressed_size, 1, out_file);
-					free(compressed_buffer);
-					fclose(out_file);
-				}
-			}
-		}
-	}
+	return exit_code;
 }
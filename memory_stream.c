@@ -24,69 +24,165 @@
 #include <stdbool.h>
 #endif
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-struct MemoryStream
-{
-	unsigned char *buffer;
-	size_t position;
-	size_t end;
-	size_t size;
-	bool free_buffer_when_destroyed;
-};
-
-static void ResizeIfNeeded(MemoryStream *memory_stream, size_t minimum_needed_size)
+static bool Grow(MemoryStream *memory_stream, size_t minimum_needed_size)
 {
 	if (minimum_needed_size > memory_stream->size)
 	{
+		if (memory_stream->failed)
+			return false;
+
 		size_t new_size = 1;
-		while (new_size < minimum_needed_size)
+		while (new_size < minimum_needed_size && new_size != 0)
 			new_size <<= 1;
 
-		memory_stream->buffer = (unsigned char*)realloc(memory_stream->buffer, new_size);
+		unsigned char *new_buffer = NULL;
+
+		if (new_size != 0)
+		{
+			if (memory_stream->external_buffer)
+			{
+				new_buffer = (unsigned char*)ClownLZSS_Allocate(memory_stream->allocator, new_size);
+
+				if (new_buffer != NULL)
+				{
+					if (memory_stream->size != 0)
+						memcpy(new_buffer, memory_stream->buffer, memory_stream->size);
+
+					memory_stream->bytes_copied += memory_stream->size;
+
+					memory_stream->external_buffer = false;
+					memory_stream->overflowed = true;
+				}
+			}
+			else
+			{
+				// The old address is kept as an integer, as the pointer is invalid once the buffer has moved
+				const uintptr_t old_address = (uintptr_t)memory_stream->buffer;
+
+				new_buffer = (unsigned char*)ClownLZSS_Reallocate(memory_stream->allocator, memory_stream->buffer, new_size);
+
+				if (new_buffer != NULL && old_address != 0 && (uintptr_t)new_buffer != old_address)
+					memory_stream->bytes_copied += memory_stream->size;
+			}
+		}
+
+		// The buffer is left as it was, so that what has been written so far can still be freed
+		if (new_buffer == NULL)
+		{
+			memory_stream->failed = true;
+			return false;
+		}
+
+		++memory_stream->total_reallocations;
+		memory_stream->buffer = new_buffer;
 		memset(memory_stream->buffer + memory_stream->size, 0, new_size - memory_stream->size);
 		memory_stream->size = new_size;
 	}
 
+	return true;
+}
+
+static bool ResizeIfNeeded(MemoryStream *memory_stream, size_t minimum_needed_size)
+{
+	if (!Grow(memory_stream, minimum_needed_size))
+		return false;
+
 	if (minimum_needed_size > memory_stream->end)
 		memory_stream->end = minimum_needed_size;
+
+	return true;
 }
 
 MemoryStream* MemoryStream_Create(bool free_buffer_when_destroyed)
 {
 	MemoryStream *memory_stream = (MemoryStream*)malloc(sizeof(MemoryStream));
+	MemoryStream_Init(memory_stream, free_buffer_when_destroyed);
+	return memory_stream;
+}
+
+MemoryStream* MemoryStream_CreateWithBuffer(unsigned char *buffer, size_t size)
+{
+	MemoryStream *memory_stream = (MemoryStream*)malloc(sizeof(MemoryStream));
+	MemoryStream_InitWithBuffer(memory_stream, buffer, size);
+	return memory_stream;
+}
+
+void MemoryStream_Destroy(MemoryStream *memory_stream)
+{
+	MemoryStream_Deinit(memory_stream);
+	free(memory_stream);
+}
+
+void MemoryStream_Init(MemoryStream *memory_stream, bool free_buffer_when_destroyed)
+{
 	memory_stream->buffer = NULL;
 	memory_stream->position = 0;
 	memory_stream->end = 0;
 	memory_stream->size = 0;
 	memory_stream->free_buffer_when_destroyed = free_buffer_when_destroyed;
-	return memory_stream;
+	memory_stream->external_buffer = false;
+	memory_stream->overflowed = false;
+	memory_stream->failed = false;
+	memory_stream->allocator = NULL;
+	memory_stream->total_reallocations = 0;
+	memory_stream->bytes_copied = 0;
 }
 
-void MemoryStream_Destroy(MemoryStream *memory_stream)
+void MemoryStream_InitWithBuffer(MemoryStream *memory_stream, unsigned char *buffer, size_t size)
 {
-	if (memory_stream->free_buffer_when_destroyed)
-		free(memory_stream->buffer);
+	memory_stream->buffer = buffer;
+	memory_stream->position = 0;
+	memory_stream->end = 0;
+	memory_stream->size = size;
+	memory_stream->free_buffer_when_destroyed = true;	// Only ever applies to the buffer that replaces the caller's
+	memory_stream->external_buffer = true;
+	memory_stream->overflowed = false;
+	memory_stream->failed = false;
+	memory_stream->allocator = NULL;
+	memory_stream->total_reallocations = 0;
+	memory_stream->bytes_copied = 0;
+}
 
-	free(memory_stream);
+void MemoryStream_Deinit(MemoryStream *memory_stream)
+{
+	if (memory_stream->free_buffer_when_destroyed && !memory_stream->external_buffer)
+		ClownLZSS_Free(memory_stream->allocator, memory_stream->buffer);
 }
 
-void MemoryStream_WriteByte(MemoryStream *memory_stream, unsigned char byte)
+void MemoryStream_SetAllocator(MemoryStream *memory_stream, const ClownLZSS_Allocator *allocator)
 {
-	ResizeIfNeeded(memory_stream, memory_stream->position + 1);
+	memory_stream->allocator = allocator;
+}
 
-	memory_stream->buffer[memory_stream->position++] = byte;
+void MemoryStream_WriteByte(MemoryStream *memory_stream, unsigned char byte)
+{
+	if (ResizeIfNeeded(memory_stream, memory_stream->position + 1))
+		memory_stream->buffer[memory_stream->position++] = byte;
 }
 
-void MemoryStream_WriteBytes(MemoryStream *memory_stream, unsigned char *bytes, size_t length)
+void MemoryStream_WriteBytes(MemoryStream *memory_stream, const unsigned char *bytes, size_t length)
 {
-	ResizeIfNeeded(memory_stream, memory_stream->position + length);
+	if (length > (size_t)-1 - memory_stream->position || !ResizeIfNeeded(memory_stream, memory_stream->position + length))
+	{
+		memory_stream->failed = true;
+		return;
+	}
 
 	memcpy(&memory_stream->buffer[memory_stream->position], bytes, length);
 	memory_stream->position += length;
 }
 
+size_t MemoryStream_Reserve(MemoryStream *memory_stream, size_t size)
+{
+	Grow(memory_stream, size);
+
+	return memory_stream->size;
+}
+
 unsigned char* MemoryStream_GetBuffer(MemoryStream *memory_stream)
 {
 	return memory_stream->buffer;
@@ -111,6 +207,44 @@ void MemoryStream_SetPosition(MemoryStream *memory_stream, ptrdiff_t offset, enu
 			memory_stream->position = (size_t)(memory_stream->end + offset);
 			break;
 	}
+
+	// Bytes that were written through MemoryStream_Reserve become part of the stream once the position passes them
+	if (memory_stream->position > memory_stream->end && memory_stream->position <= memory_stream->size)
+		memory_stream->end = memory_stream->position;
+}
+
+bool MemoryStream_HasOverflowed(MemoryStream *memory_stream)
+{
+	return memory_stream->overflowed;
+}
+
+bool MemoryStream_HasFailed(MemoryStream *memory_stream)
+{
+	return memory_stream->failed;
+}
+
+size_t MemoryStream_GetTotalReallocations(MemoryStream *memory_stream)
+{
+	return memory_stream->total_reallocations;
+}
+
+size_t MemoryStream_GetBytesCopied(MemoryStream *memory_stream)
+{
+	return memory_stream->bytes_copied;
+}
+
+unsigned char* MemoryStream_ReleaseBuffer(MemoryStream *memory_stream, size_t *size)
+{
+	if (memory_stream->external_buffer)
+	{
+		*size = 0;
+		return NULL;
+	}
+
+	*size = memory_stream->size;
+	memory_stream->free_buffer_when_destroyed = false;
+
+	return memory_stream->buffer;
 }
 
 void MemoryStream_Rewind(MemoryStream *memory_stream)
@@ -25,7 +25,23 @@
 #endif
 #include <stddef.h>
 
-typedef struct MemoryStream MemoryStream;
+#include "clownlzss.h"
+
+// This is only public so that streams can live on the stack: use the functions below instead of the fields
+typedef struct MemoryStream
+{
+	unsigned char *buffer;
+	size_t position;
+	size_t end;
+	size_t size;
+	bool free_buffer_when_destroyed;
+	bool external_buffer;	// Whether 'buffer' belongs to the caller, and so cannot be reallocated or freed
+	bool overflowed;	// Whether the caller's buffer was too small, and had to be swapped for one of our own
+	bool failed;	// Whether the buffer could not grow, after which nothing more is written
+	const ClownLZSS_Allocator *allocator;
+	size_t total_reallocations;
+	size_t bytes_copied;
+} MemoryStream;
 
 enum MemoryStream_Origin
 {
@@ -35,10 +51,31 @@ enum MemoryStream_Origin
 };
 
 MemoryStream* MemoryStream_Create(bool free_buffer_when_destroyed);
+// Writes into the caller's buffer instead of allocating one. If more than 'size' bytes are needed, the stream carries on
+// in a buffer of its own (which it frees when destroyed), so that the full size can still be found, and MemoryStream_HasOverflowed returns true.
+MemoryStream* MemoryStream_CreateWithBuffer(unsigned char *buffer, size_t size);
 void MemoryStream_Destroy(MemoryStream *memory_stream);
+// The same as the above, but for a stream that the caller has already made room for
+void MemoryStream_Init(MemoryStream *memory_stream, bool free_buffer_when_destroyed);
+void MemoryStream_InitWithBuffer(MemoryStream *memory_stream, unsigned char *buffer, size_t size);
+void MemoryStream_Deinit(MemoryStream *memory_stream);
+// Makes the stream's buffer come from 'allocator' instead of malloc. This must be done before anything is written.
+void MemoryStream_SetAllocator(MemoryStream *memory_stream, const ClownLZSS_Allocator *allocator);
 void MemoryStream_WriteByte(MemoryStream *memory_stream, unsigned char byte);
-void MemoryStream_WriteBytes(MemoryStream *memory_stream, unsigned char *bytes, size_t byte_count);
+void MemoryStream_WriteBytes(MemoryStream *memory_stream, const unsigned char *bytes, size_t byte_count);
+// Makes the buffer at least 'size' bytes long, without moving the position, so that it can be
+// written to directly through MemoryStream_GetBuffer. Returns how long the buffer now is, which is less than 'size' if it could not grow.
+size_t MemoryStream_Reserve(MemoryStream *memory_stream, size_t size);
 unsigned char* MemoryStream_GetBuffer(MemoryStream *memory_stream);
 size_t MemoryStream_GetPosition(MemoryStream *memory_stream);
 void MemoryStream_SetPosition(MemoryStream *memory_stream, ptrdiff_t offset, enum MemoryStream_Origin origin);
+bool MemoryStream_HasOverflowed(MemoryStream *memory_stream);
+// Whether the stream ran out of memory, in which case its contents are incomplete
+bool MemoryStream_HasFailed(MemoryStream *memory_stream);
+// How often the buffer had to grow, and how many bytes were moved when it did
+size_t MemoryStream_GetTotalReallocations(MemoryStream *memory_stream);
+size_t MemoryStream_GetBytesCopied(MemoryStream *memory_stream);
+// Hands the buffer that the stream allocated for itself over to the caller, who must free it with the stream's allocator, and sets 'size' to how long it is.
+// Returns NULL if the stream is still writing into the caller's buffer.
+unsigned char* MemoryStream_ReleaseBuffer(MemoryStream *memory_stream, size_t *size);
 void MemoryStream_Rewind(MemoryStream *memory_stream);
@@ -0,0 +1,716 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+/* Times each stage of compression on its own, for one format at a time, so that it
+   is clear where the time goes before anything is tuned. On Linux, the hardware's
+   performance counters are read as well, through perf_event_open. Everything runs
+   on one thread, because the counters only count the thread that opens them. */
+
+#ifdef __linux__
+#define _GNU_SOURCE	/* For syscall */
+#elif !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "clownlzss.h"
+#include "corpus.h"
+#include "files.h"
+#include "formats.h"
+#include "timer.h"
+
+#if !CLOWNLZSS_PROFILE
+#error "The microbenchmark must be built with CLOWNLZSS_PROFILE defined as 1"
+#endif
+
+#define MAXIMUM_DEPTH 0x10	/* How deeply stages can nest */
+
+/***********
+* Counters *
+***********/
+
+typedef enum Metric
+{
+	METRIC_NANOSECONDS,
+	METRIC_CYCLES,
+	METRIC_INSTRUCTIONS,
+	METRIC_CACHE_MISSES,
+	METRIC_BRANCH_MISSES,
+	TOTAL_METRICS
+} Metric;
+
+static const char* const metric_names[TOTAL_METRICS] = {"nanoseconds", "cycles", "instructions", "cache_misses", "branch_misses"};
+
+typedef struct Sample
+{
+	unsigned long long values[TOTAL_METRICS];
+} Sample;
+
+/* The hardware counters, which are opened as a group so that they are always counted together */
+typedef struct Counters
+{
+	bool available[TOTAL_METRICS];
+#ifdef __linux__
+	int descriptors[TOTAL_METRICS];
+	size_t total_descriptors;
+#endif
+} Counters;
+
+static void Counters_Open(Counters *counters)
+{
+	counters->available[METRIC_NANOSECONDS] = true;
+
+	for (unsigned int i = 1; i < TOTAL_METRICS; ++i)
+		counters->available[i] = false;
+
+#ifdef __linux__
+	static const unsigned long long configs[TOTAL_METRICS] = {0, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+	counters->total_descriptors = 0;
+
+	for (unsigned int i = 1; i < TOTAL_METRICS; ++i)
+	{
+		struct perf_event_attr attributes;
+		memset(&attributes, 0, sizeof(attributes));
+		attributes.type = PERF_TYPE_HARDWARE;
+		attributes.size = sizeof(attributes);
+		attributes.config = configs[i];
+		attributes.disabled = counters->total_descriptors == 0;
+		attributes.exclude_kernel = 1;	/* Counting only this process's own code is allowed by the default security settings */
+		attributes.exclude_hv = 1;
+		attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		/* Without the cycle counter to lead the group, there is no group to join */
+		const int leader = counters->total_descriptors == 0 ? -1 : counters->descriptors[0];
+		const int descriptor = (int)syscall(__NR_perf_event_open, &attributes, 0, -1, leader, 0);
+
+		if (descriptor == -1)
+		{
+			if (i == METRIC_CYCLES)
+				break;
+		}
+		else
+		{
+			counters->descriptors[counters->total_descriptors++] = descriptor;
+			counters->available[i] = true;
+		}
+	}
+
+	if (counters->total_descriptors != 0)
+		ioctl(counters->descriptors[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+static void Counters_Close(Counters *counters)
+{
+#ifdef __linux__
+	for (size_t i = 0; i < counters->total_descriptors; ++i)
+		close(counters->descriptors[i]);
+#else
+	(void)counters;
+#endif
+}
+
+static bool Counters_HasHardware(const Counters *counters)
+{
+	return counters->available[METRIC_CYCLES];
+}
+
+static void Counters_Read(const Counters *counters, Sample *sample)
+{
+	memset(sample, 0, sizeof(*sample));
+
+#ifdef __linux__
+	if (counters->total_descriptors != 0)
+	{
+		/* The number of counters, how long they were enabled and actually running, and then their values */
+		unsigned long long buffer[3 + TOTAL_METRICS];
+
+		if (read(counters->descriptors[0], buffer, sizeof(buffer)) >= (ssize_t)((3 + counters->total_descriptors) * sizeof(unsigned long long)))
+		{
+			/* If the counters had to share the hardware with others, they only counted some of the time */
+			const double scale = buffer[2] != 0 && buffer[2] < buffer[1] ? (double)buffer[1] / (double)buffer[2] : 1.0;
+			size_t value = 3;
+
+			for (unsigned int i = 1; i < TOTAL_METRICS; ++i)
+				if (counters->available[i])
+					sample->values[i] = (unsigned long long)((double)buffer[value++] * scale);
+		}
+	}
+#else
+	(void)counters;
+#endif
+
+	sample->values[METRIC_NANOSECONDS] = Timer_GetNanoseconds();
+}
+
+/***********
+* Profiler *
+***********/
+
+/* The 'other' stage is whatever is not in any of the library's stages: setting up, and the
+   format's own work, such as writing its header. 'total' is the whole call. */
+#define STAGE_OTHER CLOWNLZSS_TOTAL_STAGES
+#define STAGE_TOTAL (CLOWNLZSS_TOTAL_STAGES + 1)
+#define TOTAL_STAGES (CLOWNLZSS_TOTAL_STAGES + 2)
+
+static const char* const stage_names[TOTAL_STAGES] = {"run_lengths", "suffix_array", "match_finding", "graph", "path_reversal", "emission", "fast_parse", "module", "other", "total"};
+
+typedef struct Frame
+{
+	ClownLZSS_Stage stage;
+	Sample start;
+	Sample nested;	/* Counted by the stages inside this one */
+} Frame;
+
+/* Each stage is given only what was counted in it, and not in the stages inside of it */
+typedef struct Profile
+{
+	const Counters *counters;
+	Frame stack[MAXIMUM_DEPTH];
+	size_t depth;
+	bool overflowed;
+	Sample stages[TOTAL_STAGES];
+	unsigned long calls[TOTAL_STAGES];
+} Profile;
+
+static void Profile_Reset(Profile *profile)
+{
+	profile->depth = 0;
+	profile->overflowed = false;
+	memset(profile->stages, 0, sizeof(profile->stages));
+	memset(profile->calls, 0, sizeof(profile->calls));
+}
+
+static void Profile_Begin(ClownLZSS_Stage stage, void *user)
+{
+	Profile *profile = (Profile*)user;
+
+	if (profile->depth == MAXIMUM_DEPTH)
+	{
+		profile->overflowed = true;
+		return;
+	}
+
+	Frame *frame = &profile->stack[profile->depth++];
+
+	frame->stage = stage;
+	memset(&frame->nested, 0, sizeof(frame->nested));
+	Counters_Read(profile->counters, &frame->start);
+}
+
+static void Profile_End(ClownLZSS_Stage stage, void *user)
+{
+	Profile *profile = (Profile*)user;
+	Sample end;
+
+	Counters_Read(profile->counters, &end);
+
+	if (profile->depth == 0 || profile->stack[profile->depth - 1].stage != stage)
+	{
+		profile->overflowed = true;
+		return;
+	}
+
+	const Frame *frame = &profile->stack[--profile->depth];
+
+	for (unsigned int i = 0; i < TOTAL_METRICS; ++i)
+	{
+		const unsigned long long inclusive = end.values[i] - frame->start.values[i];
+
+		profile->stages[stage].values[i] += inclusive - frame->nested.values[i];
+
+		if (profile->depth != 0)
+			profile->stack[profile->depth - 1].nested.values[i] += inclusive;
+	}
+
+	++profile->calls[stage];
+}
+
+/* The whole call is measured around the compressor, and whatever the stages did not count goes to 'other' */
+static void Profile_Finish(Profile *profile, const Sample *start, const Sample *end)
+{
+	for (unsigned int i = 0; i < TOTAL_METRICS; ++i)
+	{
+		unsigned long long staged = 0;
+
+		for (unsigned int stage = 0; stage < CLOWNLZSS_TOTAL_STAGES; ++stage)
+			staged += profile->stages[stage].values[i];
+
+		profile->stages[STAGE_TOTAL].values[i] = end->values[i] - start->values[i];
+		profile->stages[STAGE_OTHER].values[i] = profile->stages[STAGE_TOTAL].values[i] > staged ? profile->stages[STAGE_TOTAL].values[i] - staged : 0;
+	}
+
+	profile->calls[STAGE_OTHER] = profile->calls[STAGE_TOTAL] = 1;
+}
+
+/*************
+* Statistics *
+*************/
+
+typedef struct Summary
+{
+	double minimum;
+	double median;
+	double mean;
+	double standard_deviation;
+	double maximum;
+} Summary;
+
+static int CompareDoubles(const void *a, const void *b)
+{
+	const double x = *(const double*)a;
+	const double y = *(const double*)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Sorts the values in the process */
+static Summary Summarise(double *values, size_t total_values)
+{
+	Summary summary;
+	double sum = 0.0;
+	double squares = 0.0;
+
+	qsort(values, total_values, sizeof(double), CompareDoubles);
+
+	for (size_t i = 0; i < total_values; ++i)
+		sum += values[i];
+
+	summary.mean = sum / (double)total_values;
+
+	for (size_t i = 0; i < total_values; ++i)
+		squares += (values[i] - summary.mean) * (values[i] - summary.mean);
+
+	summary.minimum = values[0];
+	summary.maximum = values[total_values - 1];
+	summary.median = total_values % 2 ? values[total_values / 2] : (values[total_values / 2 - 1] + values[total_values / 2]) / 2.0;
+	summary.standard_deviation = total_values > 1 ? sqrt(squares / (double)(total_values - 1)) : 0.0;
+
+	return summary;
+}
+
+/************
+* Benchmark *
+************/
+
+typedef struct Options
+{
+	unsigned int level;
+	bool moduled;
+	unsigned int warm_up_runs;
+	unsigned int runs;
+	bool json;
+} Options;
+
+typedef struct Results
+{
+	Summary summaries[TOTAL_STAGES][TOTAL_METRICS];
+	unsigned long calls[TOTAL_STAGES];	/* In each run */
+	size_t compressed_size;
+} Results;
+
+static bool Benchmark(const Format *format, unsigned char *data, size_t data_size, const Options *options, const Counters *counters, ClownLZSS_Context *context, Results *results)
+{
+	bool success = false;
+
+	const size_t bound = format->bound(data_size, options->moduled);
+	unsigned char *compressed_buffer = (unsigned char*)malloc(bound);
+	double *values = (double*)malloc(options->runs * TOTAL_STAGES * TOTAL_METRICS * sizeof(double));
+
+	if (compressed_buffer != NULL && values != NULL)
+	{
+		Profile profile;
+		profile.counters = counters;
+
+		ClownLZSS_Profiler profiler;
+		profiler.begin = Profile_Begin;
+		profiler.end = Profile_End;
+		profiler.user = &profile;
+
+		ClownLZSS_ContextSetProfiler(context, &profiler);
+
+		success = true;
+
+		/* The warm-up runs fill the caches, and grow the context's buffers to their full size */
+		for (unsigned int run = 0; success && run < options->warm_up_runs + options->runs; ++run)
+		{
+			Sample start, end;
+
+			Profile_Reset(&profile);
+
+			Counters_Read(counters, &start);
+			success = format->compress(data, data_size, compressed_buffer, bound, &results->compressed_size, options->moduled, options->level, context);
+			Counters_Read(counters, &end);
+
+			Profile_Finish(&profile, &start, &end);
+
+			if (profile.overflowed || profile.depth != 0)
+			{
+				fprintf(stderr, "The stages did not nest properly\n");
+				success = false;
+			}
+
+			if (run >= options->warm_up_runs)
+			{
+				const size_t index = run - options->warm_up_runs;
+
+				for (unsigned int stage = 0; stage < TOTAL_STAGES; ++stage)
+					for (unsigned int metric = 0; metric < TOTAL_METRICS; ++metric)
+						values[(stage * TOTAL_METRICS + metric) * options->runs + index] = (double)profile.stages[stage].values[metric];
+
+				memcpy(results->calls, profile.calls, sizeof(results->calls));
+			}
+		}
+
+		ClownLZSS_ContextSetProfiler(context, NULL);
+
+		if (success)
+			for (unsigned int stage = 0; stage < TOTAL_STAGES; ++stage)
+				for (unsigned int metric = 0; metric < TOTAL_METRICS; ++metric)
+					results->summaries[stage][metric] = Summarise(&values[(stage * TOTAL_METRICS + metric) * options->runs], options->runs);
+	}
+
+	free(values);
+	free(compressed_buffer);
+
+	return success;
+}
+
+static void PrintTable(const Format *format, size_t data_size, const Results *results, const Counters *counters)
+{
+	const double total = results->summaries[STAGE_TOTAL][METRIC_NANOSECONDS].median;
+
+	printf("\n%s: %lu -> %lu bytes, %.3fms\n", format->name, (unsigned long)data_size, (unsigned long)results->compressed_size, total / 1e6);
+	printf("  %-14s %8s %11s %9s %6s", "stage", "calls", "median ms", "stddev", "share");
+
+	if (Counters_HasHardware(counters))
+		printf(" %14s %14s %6s %12s %13s", "cycles", "instructions", "IPC", "cache misses", "branch misses");
+
+	printf("\n");
+
+	for (unsigned int stage = 0; stage < TOTAL_STAGES; ++stage)
+	{
+		const Summary *summaries = results->summaries[stage];
+
+		/* Stages that this format and level never entered are left out */
+		if (results->calls[stage] == 0)
+			continue;
+
+		printf("  %-14s %8lu %11.3f %9.3f %5.1f%%", stage_names[stage], results->calls[stage], summaries[METRIC_NANOSECONDS].median / 1e6, summaries[METRIC_NANOSECONDS].standard_deviation / 1e6, total == 0.0 ? 0.0 : summaries[METRIC_NANOSECONDS].median * 100.0 / total);
+
+		if (Counters_HasHardware(counters))
+		{
+			printf(" %14.0f", summaries[METRIC_CYCLES].median);
+
+			if (counters->available[METRIC_INSTRUCTIONS])
+				printf(" %14.0f %6.2f", summaries[METRIC_INSTRUCTIONS].median, summaries[METRIC_CYCLES].median == 0.0 ? 0.0 : summaries[METRIC_INSTRUCTIONS].median / summaries[METRIC_CYCLES].median);
+			else
+				printf(" %14s %6s", "-", "-");
+
+			if (counters->available[METRIC_CACHE_MISSES])
+				printf(" %12.0f", summaries[METRIC_CACHE_MISSES].median);
+			else
+				printf(" %12s", "-");
+
+			if (counters->available[METRIC_BRANCH_MISSES])
+				printf(" %13.0f", summaries[METRIC_BRANCH_MISSES].median);
+			else
+				printf(" %13s", "-");
+		}
+
+		printf("\n");
+	}
+}
+
+static void PrintJSON(const Format *format, size_t data_size, const Results *results, const Counters *counters, bool first)
+{
+	printf("%s    {\"format\": \"%s\", \"size\": %lu, \"compressed_size\": %lu, \"stages\": {", first ? "" : ",\n", format->name, (unsigned long)data_size, (unsigned long)results->compressed_size);
+
+	bool first_stage = true;
+
+	for (unsigned int stage = 0; stage < TOTAL_STAGES; ++stage)
+	{
+		if (results->calls[stage] == 0)
+			continue;
+
+		printf("%s\n      \"%s\": {\"calls\": %lu", first_stage ? "" : ",", stage_names[stage], results->calls[stage]);
+		first_stage = false;
+
+		for (unsigned int metric = 0; metric < TOTAL_METRICS; ++metric)
+		{
+			const Summary *summary = &results->summaries[stage][metric];
+
+			if (counters->available[metric])
+				printf(", \"%s\": {\"min\": %.0f, \"median\": %.1f, \"mean\": %.1f, \"stddev\": %.1f, \"max\": %.0f}", metric_names[metric], summary->minimum, summary->median, summary->mean, summary->standard_deviation, summary->maximum);
+			else
+				printf(", \"%s\": null", metric_names[metric]);
+		}
+
+		printf("}");
+	}
+
+	printf("\n    }}");
+}
+
+static void PrintUsage(void)
+{
+	fprintf(stderr,
+	"Times each stage of compression separately, reading the hardware's performance\n"
+	"counters where possible (Linux only)\n"
+	"\n"
+	"Usage: microbench [options]\n"
+	"\n"
+	"Options:\n"
+	"  -f=FORMAT         Only benchmarks this format (chameleon, comper, kosinski,\n"
+	"                    kosinskiplus, rage, rocket, saxman, saxman_no_header, or\n"
+	"                    faxman): may be given more than once (defaults to all)\n"
+	"  -l=LEVEL          Sets the compression level, from 1 (fastest) to 5\n"
+	"                    (smallest, and the default)\n"
+	"  -m                Compresses into modules of 0x1000 bytes\n"
+	"  --content=NAME    Compresses generated content: tiles, mappings, smps, z80,\n"
+	"                    m68k, zeroes, random, or rom (the default, a mix of them all)\n"
+	"  --size=SIZE       Sets the size of the generated content (defaults to 256K)\n"
+	"  --input=FILE      Compresses a file instead of generated content\n"
+	"  --warmup=COUNT    Sets how many runs are made before measuring (defaults to 2)\n"
+	"  --runs=COUNT      Sets how many runs are measured (defaults to 10)\n"
+	"  --json            Prints the results as JSON instead of as tables\n"
+	);
+}
+
+static bool ParseCount(const char *string, unsigned int *count)
+{
+	char *end;
+	const unsigned long result = strtoul(string, &end, 0);
+
+	*count = (unsigned int)result;
+
+	return end != string && *end == '\0' && result <= 0xFFFF;
+}
+
+int main(int argc, char *argv[])
+{
+	Options options;
+	options.level = CLOWNLZSS_DEFAULT_LEVEL;
+	options.moduled = false;
+	options.warm_up_runs = 2;
+	options.runs = 10;
+	options.json = false;
+
+	const Format *selected_formats[0x10];
+	size_t total_selected_formats = 0;
+	const char *content = "rom";
+	size_t size = 256 << 10;
+	const char *input_filename = NULL;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		char *end;
+
+		if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+		{
+			PrintUsage();
+			return 0;
+		}
+		else if (!strncmp(argv[i], "-f=", 3))
+		{
+			const Format *format = Format_Find(argv[i] + 3);
+
+			if (format == NULL || total_selected_formats == sizeof(selected_formats) / sizeof(selected_formats[0]))
+			{
+				fprintf(stderr, "Invalid parameter to -f\n");
+				return -1;
+			}
+
+			selected_formats[total_selected_formats++] = format;
+		}
+		else if (!strncmp(argv[i], "-l=", 3))
+		{
+			const unsigned long result = strtoul(argv[i] + 3, &end, 0);
+
+			if (*end != '\0' || result < CLOWNLZSS_MINIMUM_LEVEL || result > CLOWNLZSS_MAXIMUM_LEVEL)
+			{
+				fprintf(stderr, "Invalid parameter to -l\n");
+				return -1;
+			}
+
+			options.level = result;
+		}
+		else if (!strcmp(argv[i], "-m"))
+		{
+			options.moduled = true;
+		}
+		else if (!strncmp(argv[i], "--content=", 10))
+		{
+			content = argv[i] + 10;
+		}
+		else if (!strncmp(argv[i], "--size=", 7))
+		{
+			unsigned long result = strtoul(argv[i] + 7, &end, 0);
+
+			if (*end == 'K' || *end == 'k')
+			{
+				result <<= 10;
+				++end;
+			}
+			else if (*end == 'M' || *end == 'm')
+			{
+				result <<= 20;
+				++end;
+			}
+
+			if (*end != '\0' || result == 0)
+			{
+				fprintf(stderr, "Invalid parameter to --size\n");
+				return -1;
+			}
+
+			size = result;
+		}
+		else if (!strncmp(argv[i], "--input=", 8))
+		{
+			input_filename = argv[i] + 8;
+		}
+		else if (!strncmp(argv[i], "--warmup=", 9))
+		{
+			if (!ParseCount(argv[i] + 9, &options.warm_up_runs))
+			{
+				fprintf(stderr, "Invalid parameter to --warmup\n");
+				return -1;
+			}
+		}
+		else if (!strncmp(argv[i], "--runs=", 7))
+		{
+			if (!ParseCount(argv[i] + 7, &options.runs) || options.runs == 0)
+			{
+				fprintf(stderr, "Invalid parameter to --runs\n");
+				return -1;
+			}
+		}
+		else if (!strcmp(argv[i], "--json"))
+		{
+			options.json = true;
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+			PrintUsage();
+			return -1;
+		}
+	}
+
+	if (total_selected_formats == 0)
+		for (size_t i = 0; i < Format_GetTotal() && i < sizeof(selected_formats) / sizeof(selected_formats[0]); ++i)
+			selected_formats[total_selected_formats++] = Format_Get(i);
+
+	InputFile input_file;
+	unsigned char *data = NULL;
+
+	if (input_filename != NULL)
+	{
+		if (!InputFile_Open(&input_file, input_filename))
+		{
+			fprintf(stderr, "Could not open '%s'\n", input_filename);
+			return -1;
+		}
+
+		data = InputFile_GetData(&input_file);
+		size = InputFile_GetSize(&input_file);
+		content = input_filename;
+	}
+	else
+	{
+		data = Corpus_Generate(content, size);
+
+		if (data == NULL)
+		{
+			fprintf(stderr, "Could not generate '%s' content\n", content);
+			return -1;
+		}
+	}
+
+	if (options.moduled && size > 0xFFFF)
+		fprintf(stderr, "Warning: the moduled header cannot describe more than 0xFFFF bytes, so the output will not be valid\n");
+
+	/* The worker threads would not be counted */
+	ClownLZSS_SetThreadCount(1);
+
+	Counters counters;
+	Counters_Open(&counters);
+
+	ClownLZSS_Context context;
+	const bool context_ready = ClownLZSS_ContextInit(&context);
+	bool success = context_ready;
+
+	if (!context_ready)
+		fprintf(stderr, "Could not create a compression context\n");
+
+	if (options.json)
+		printf("{\n  \"content\": \"%s\", \"level\": %u, \"moduled\": %s, \"warm_up_runs\": %u, \"runs\": %u, \"hardware_counters\": %s,\n  \"results\": [\n", content, options.level, options.moduled ? "true" : "false", options.warm_up_runs, options.runs, Counters_HasHardware(&counters) ? "true" : "false");
+	else
+		printf("%s, %lu bytes, level %u%s: median of %u runs after %u warm-up runs%s\n", content, (unsigned long)size, options.level, options.moduled ? ", moduled" : "", options.runs, options.warm_up_runs, Counters_HasHardware(&counters) ? "" : "\n(the hardware counters are not available, so only the time is measured)");
+
+	for (size_t i = 0; success && i < total_selected_formats; ++i)
+	{
+		Results results;
+
+		if (!Benchmark(selected_formats[i], data, size, &options, &counters, &context, &results))
+		{
+			fprintf(stderr, "Could not compress with %s\n", selected_formats[i]->name);
+			success = false;
+		}
+		else if (options.json)
+		{
+			PrintJSON(selected_formats[i], size, &results, &counters, i == 0);
+		}
+		else
+		{
+			PrintTable(selected_formats[i], size, &results, &counters);
+		}
+	}
+
+	if (options.json)
+		printf("\n  ]\n}\n");
+
+	if (context_ready)
+		ClownLZSS_ContextDeinit(&context);
+
+	Counters_Close(&counters);
+
+	if (input_filename != NULL)
+		InputFile_Close(&input_file);
+	else
+		free(data);
+
+	return success ? 0 : -1;
+}
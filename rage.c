@@ -27,6 +27,7 @@
 #include <stdbool.h>
 #endif
 #include <stddef.h>
+#include <string.h>
 
 #include "clownlzss.h"
 #include "common.h"
@@ -36,44 +37,65 @@
 
 typedef struct RageInstance
 {
-	MemoryStream *output_stream;
+	BitWriter writer;	// Rage has no descriptors, so this only writes bytes
 	unsigned char *data;
+	size_t position;
+	size_t total_literals;	// The literals output by the fast parser, which are waiting to be put in an uncompressed run
 } RageInstance;
 
 static void PutMatchByte(RageInstance *instance, unsigned char byte)
 {
-	MemoryStream_WriteByte(instance->output_stream, byte);
+	BitWriter_PutByte(&instance->writer, byte);
 }
 
+static void PutUncompressedRun(RageInstance *instance, size_t offset, size_t length)
+{
+	if (length > 0x1F)
+	{
+		PutMatchByte(instance, 0x20 | ((length >> 8) & 0x1F));
+		PutMatchByte(instance, length & 0xFF);
+	}
+	else
+	{
+		PutMatchByte(instance, length);
+	}
+
+	for (size_t i = 0; i < length; ++i)
+		PutMatchByte(instance, instance->data[offset + i]);
+}
+
+static void FlushLiterals(RageInstance *instance)
+{
+	if (instance->total_literals != 0)
+		PutUncompressedRun(instance, instance->position - instance->total_literals, instance->total_literals);
+
+	instance->total_literals = 0;
+}
+
+// Rage has no literals, so the fast parser's are grouped into uncompressed runs
 static void DoLiteral(unsigned char value, void *user)
 {
 	(void)value;
-	(void)user;
 
-	// This should never be ran
+	RageInstance *instance = (RageInstance*)user;
+
+	++instance->position;
+
+	if (++instance->total_literals == 0x1FFF)
+		FlushLiterals(instance);
 }
 
 static void DoMatch(size_t distance, size_t length, size_t offset, void *user)
 {
-	(void)distance;
-
 	RageInstance *instance = (RageInstance*)user;
 
+	FlushLiterals(instance);
+	instance->position += length;
+
 	if (distance == 0)
 	{
 		// Uncompressed run
-		if (length > 0x1F)
-		{
-			PutMatchByte(instance, 0x20 | ((length >> 8) & 0x1F));
-			PutMatchByte(instance, length & 0xFF);
-		}
-		else
-		{
-			PutMatchByte(instance, length);
-		}
-
-		for (size_t i = 0; i < length; ++i)
-			PutMatchByte(instance, instance->data[offset + i]);
+		PutUncompressedRun(instance, offset, length);
 	}
 	else if ((offset & 0xFFFFFF00) == 0xFFFFFF00)
 	{
@@ -128,64 +150,540 @@ static unsigned int GetMatchCost(size_t distance, size_t length, void *user)
 		return 0;
 }
 
-static void FindExtraMatches(unsigned char *data, size_t data_size, size_t offset, ClownLZSS_GraphEdge *node_meta_array, void *user)
+// The cost of a dictionary-match grows with its length without end, so it cannot be listed as encodings
+// The literal cost is only used by the fast parser, whose literals become uncompressed runs
+static const ClownLZSS_Format format = {4, 0xFFFFFFFF/*dictionary-matches can be infinite*/, 0x1FFF, 8, NULL, 0, GetMatchCost};
+
+CLOWNLZSS_MAKE_MATCH_FINDER(Dictionary, unsigned char, format)
+
+// RLE-matches, for the fast parser. It only wants the longest length of each
+// cost, so only those are added, instead of every length of the run.
+static void FindRLEMatches(unsigned char *data, size_t data_size, const unsigned int *run_lengths, size_t offset, ClownLZSS_Graph *graph, void *user)
 {
-	size_t max_read_ahead;
+	(void)data_size;
+	(void)user;
+
+	const size_t max_read_ahead = CLOWNLZSS_MIN(0xFFF + 4, run_lengths[offset]);
 
+	if (max_read_ahead >= 4)
+	{
+		CLOWNLZSS_ADD_MATCH(graph, offset, CLOWNLZSS_MIN(0xF + 4, max_read_ahead), 0xFFFFFF00 | data[offset], 2 * 8);
+
+		if (max_read_ahead > 0xF + 4)
+			CLOWNLZSS_ADD_MATCH(graph, offset, max_read_ahead, 0xFFFFFF00 | data[offset], 3 * 8);
+	}
+}
+
+// Found by trying the fast levels on a mix of data: shorter runs are worth leaving in the dictionary-match
+#define LONG_RUN_LENGTH 64
+
+// A dictionary-match costs another byte for every 0x1F bytes that it goes on
+// for, but an RLE-match costs at most 3 bytes however long it is, so a
+// dictionary-match should end where a long run starts, and leave the run to an
+// RLE-match. The greedy parse only compares whole matches, so it would not
+// see this, and the more places it searches, the longer the matches it finds
+// and the worse this gets.
+static size_t LimitMatchLength(const unsigned char *data, const unsigned int *run_lengths, size_t offset, size_t length, void *user)
+{
+	(void)data;
 	(void)user;
 
-	// Look for RLE-matches
-	max_read_ahead = CLOWNLZSS_MIN(0xFFF + 4, data_size - offset);
+	// Runs are skipped whole, so only the first one can have started before the match
+	for (size_t i = offset; i < offset + length; i += run_lengths[i])
+		if (run_lengths[i] >= LONG_RUN_LENGTH)
+			return i - offset;
+
+	return length;
+}
+
+CLOWNLZSS_MAKE_FAST_PARSER(Rage, unsigned char, format, FindRLEMatches, LimitMatchLength, DoLiteral, DoMatch)
+
+// Rage's uncompressed runs and RLE-matches can be thousands of bytes long, and
+// its dictionary-matches have no limit at all, so adding every length of every
+// one of them to the graph, like the other formats do, takes quadratic time.
+// Instead, this builds the same graph one node at a time, by finding the
+// cheapest edge that ends at each node. Ties are broken in the same way as the
+// generic parser would: the edge that starts first wins, and an RLE-match wins
+// over an uncompressed run, which wins over a dictionary-match.
+// Literals are never used: an uncompressed run of one byte is always cheaper.
+
+#define RLE_SHORT_MAX_LENGTH (0xF + 4)
+#define RLE_MAX_LENGTH (0xFFF + 4)
+#define RAW_SHORT_MAX_LENGTH 0x1F
+#define RAW_MAX_LENGTH 0x1FFF
+#define DICTIONARY_SHORT_MAX_LENGTH (7 + 0x1F)	// Dictionary-matches up to this long are added to the graph directly
+#define DICTIONARY_BLOCK_LENGTH 0x1F	// Each continuation byte after the first 7 bytes of a dictionary-match adds this many
+
+// The edges of one kind, whose cost only depends on where they start and how
+// long they are, and which can start anywhere in a range that only ever moves
+// forwards. The starts are kept in order, with every start that can never be
+// the cheapest again removed, so the cheapest is always the first one.
+typedef struct SlidingMinimum
+{
+	unsigned int *starts;
+	size_t mask;
+	size_t head;
+	size_t tail;
+	unsigned int cost_per_byte;
+} SlidingMinimum;
+
+static void SlidingMinimumPush(SlidingMinimum *window, const unsigned int *costs, size_t start)
+{
+	// Earlier starts win ties, so they are only removed if they are strictly more expensive
+	while (window->tail != window->head)
+	{
+		const size_t last_start = window->starts[(window->tail - 1) & window->mask];
+
+		if (costs[last_start] + (start - last_start) * window->cost_per_byte <= costs[start])
+			break;
+
+		--window->tail;
+	}
+
+	window->starts[window->tail++ & window->mask] = (unsigned int)start;
+}
+
+// Returns (size_t)-1 if there are no starts from 'earliest_start' onwards
+static size_t SlidingMinimumGet(SlidingMinimum *window, size_t earliest_start)
+{
+	while (window->head != window->tail && window->starts[window->head & window->mask] < earliest_start)
+		++window->head;
+
+	return window->head != window->tail ? window->starts[window->head & window->mask] : (size_t)-1;
+}
+
+typedef struct Edge
+{
+	unsigned int cost;
+	size_t start;
+	unsigned int kind;	// 0 for RLE-matches, 1 for uncompressed runs, 2 for dictionary-matches
+	size_t offset;
+} Edge;
+
+static void ConsiderEdge(Edge *best, unsigned int cost, size_t start, unsigned int kind, size_t offset, ClownLZSS_Statistics *statistics)
+{
+	(void)statistics;
+
+	CLOWNLZSS_COUNT(++statistics->edges_relaxed;)
+
+	if (cost < best->cost || (cost == best->cost && (start < best->start || (start == best->start && kind < best->kind))))
+	{
+		CLOWNLZSS_COUNT(++statistics->edges_improved;)
+		best->cost = cost;
+		best->start = start;
+		best->kind = kind;
+		best->offset = offset;
+	}
+}
+
+// The dictionary-matches that are too long to add to the graph directly.
+// Beyond its first 7 bytes, a dictionary-match costs 8 bits for every 0x1F
+// bytes, so for the starts that are a multiple of 0x1F bytes apart, which one
+// is cheapest is the same for every node. The starts are split into that many
+// heaps, ordered by their cost, and a start is removed once the node is past
+// the end of its longest match.
+typedef struct DictionaryHeaps
+{
+	unsigned int *starts;
+	size_t capacity;
+	size_t sizes[DICTIONARY_BLOCK_LENGTH];
+} DictionaryHeaps;
+
+typedef struct RageParser
+{
+	const unsigned int *costs;
+	const size_t *match_ends;
+	const ClownLZSS_Match *matches;
+	size_t data_size;
+} RageParser;
+
+static bool DictionaryStartIsCheaper(const RageParser *parser, size_t a, size_t b)
+{
+	const size_t cost_a = parser->costs[a] + (parser->data_size / DICTIONARY_BLOCK_LENGTH - a / DICTIONARY_BLOCK_LENGTH) * 8;
+	const size_t cost_b = parser->costs[b] + (parser->data_size / DICTIONARY_BLOCK_LENGTH - b / DICTIONARY_BLOCK_LENGTH) * 8;
+
+	return cost_a < cost_b || (cost_a == cost_b && a < b);
+}
+
+static void DictionaryHeapsPush(DictionaryHeaps *heaps, const RageParser *parser, size_t start)
+{
+	const size_t heap_index = start % DICTIONARY_BLOCK_LENGTH;
+	unsigned int *heap = &heaps->starts[heap_index * heaps->capacity];
+	size_t child = heaps->sizes[heap_index]++;
+
+	while (child != 0)
+	{
+		const size_t parent = (child - 1) / 2;
+
+		if (!DictionaryStartIsCheaper(parser, start, heap[parent]))
+			break;
+
+		heap[child] = heap[parent];
+		child = parent;
+	}
+
+	heap[child] = (unsigned int)start;
+}
+
+static void DictionaryHeapsPop(DictionaryHeaps *heaps, const RageParser *parser, size_t heap_index)
+{
+	unsigned int *heap = &heaps->starts[heap_index * heaps->capacity];
+	const size_t size = --heaps->sizes[heap_index];
+	const unsigned int last = heap[size];
+	size_t parent = 0;
+
+	for (;;)
+	{
+		size_t child = parent * 2 + 1;
+
+		if (child >= size)
+			break;
+
+		if (child + 1 < size && DictionaryStartIsCheaper(parser, heap[child + 1], heap[child]))
+			++child;
+
+		if (!DictionaryStartIsCheaper(parser, heap[child], last))
+			break;
+
+		heap[parent] = heap[child];
+		parent = child;
+	}
+
+	heap[parent] = last;
+}
+
+// Returns the nearest match that is at least 'length' bytes long
+static size_t FindDictionaryOffset(const RageParser *parser, size_t start, size_t length)
+{
+	const ClownLZSS_Match *match = &parser->matches[start == 0 ? 0 : parser->match_ends[start - 1]];
+
+	while (match->length < length)
+		++match;
+
+	return match->position;
+}
+
+static bool AddMatches(ClownLZSS_Match **matches, size_t *total_matches, size_t *matches_capacity, const ClownLZSS_Match *new_matches, size_t total_new_matches, ClownLZSS_Context *context)
+{
+	// The buffer is NULL until the first match is added, and memcpy must not be given NULL, even to copy nothing
+	if (total_new_matches == 0)
+		return true;
+
+	if (*total_matches + total_new_matches > *matches_capacity)
+	{
+		size_t new_capacity = CLOWNLZSS_MAX(*matches_capacity, 0x100);
+
+		while (new_capacity < *total_matches + total_new_matches)
+			new_capacity *= 2;
+
+		ClownLZSS_Match *new_buffer = (ClownLZSS_Match*)ClownLZSS_ContextReallocate(context, CLOWNLZSS_CONTEXT_FORMAT_4, *matches, new_capacity * sizeof(ClownLZSS_Match));
+
+		if (new_buffer == NULL)
+			return false;
+
+		*matches = new_buffer;
+		*matches_capacity = new_capacity;
+	}
+
+	memcpy(&(*matches)[*total_matches], new_matches, total_new_matches * sizeof(ClownLZSS_Match));
+	*total_matches += total_new_matches;
+
+	return true;
+}
+
+static bool BuildGraph(unsigned char *data, size_t data_size, const unsigned int *run_lengths, const ClownLZSS_SuffixArray *suffix_array, unsigned int *costs, unsigned int *lengths, unsigned int *offsets, ClownLZSS_Context *context)
+{
+	const size_t total_threads = ClownLZSS_ContextGetThreadCount(context);
+
+	unsigned int *window_buffer = (unsigned int*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_FORMAT_0, (0x20 + 0x2000 + 0x20 + 0x1000) * sizeof(unsigned int));
+	SlidingMinimum raw_short = {window_buffer, 0x1F, 0, 0, 8};
+	SlidingMinimum raw_long = {window_buffer + 0x20, 0x1FFF, 0, 0, 8};
+	SlidingMinimum rle_short = {window_buffer + 0x20 + 0x2000, 0x1F, 0, 0, 0};
+	SlidingMinimum rle_long = {window_buffer + 0x20 + 0x2000 + 0x20, 0xFFF, 0, 0, 0};
+
+	DictionaryHeaps heaps;
+	heaps.capacity = data_size / DICTIONARY_BLOCK_LENGTH + 1;
+	heaps.starts = (unsigned int*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_FORMAT_1, heaps.capacity * DICTIONARY_BLOCK_LENGTH * sizeof(unsigned int));
+
+	for (size_t i = 0; i < DICTIONARY_BLOCK_LENGTH; ++i)
+		heaps.sizes[i] = 0;
+
+	size_t *match_ends = (size_t*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_FORMAT_2, data_size * sizeof(size_t));
+	unsigned int *longest_matches = (unsigned int*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_FORMAT_3, data_size * sizeof(unsigned int));
+	ClownLZSS_Match *matches = NULL;
+	size_t total_matches = 0;
+	size_t matches_capacity = 0;
+
+	ClownLZSS_Statistics statistics;
+	CLOWNLZSS_COUNT(ClownLZSS_StatisticsClear(&statistics);)
+
+	RageParser parser;
+	parser.costs = costs;
+	parser.match_ends = match_ends;
+	parser.data_size = data_size;
+
+	// The match finder can only share the context if it runs on this thread
+	ClownLZSS_Context shared_context;
+	ClownLZSS_Context *finder_context = ClownLZSS_MatchPipelineIsSerial(0, data_size, CLOWNLZSS_MATCH_BLOCK_SIZE, total_threads) ? context : ClownLZSS_ContextInitShared(&shared_context, context);
+	ClownLZSS_MatchFinderState state;
+	const bool state_ready = ClownLZSS_MatchFinderStateInit(&state, data, data_size, run_lengths, suffix_array, total_threads, format.maximum_match_distance, finder_context);
+
+	ClownLZSS_MatchPipeline *pipeline = NULL;
+
+	if (state_ready && window_buffer != NULL && heaps.starts != NULL && match_ends != NULL && longest_matches != NULL)
+		pipeline = ClownLZSS_MatchPipelineCreate(0, data_size, CLOWNLZSS_MATCH_BLOCK_SIZE, total_threads, Dictionary_FindMatches, &state, finder_context);
+
+	bool success = pipeline != NULL;
 
-	for (size_t k = 0; k < max_read_ahead; ++k)
+	costs[0] = 0;
+
+	for (size_t i = 1; i <= data_size; ++i)
+	{
+		costs[i] = UINT_MAX;
+		lengths[i] = 0;
+	}
+
+	size_t run_start = 0;
+
+	for (size_t block_start = 0; success && block_start < data_size; block_start += CLOWNLZSS_MATCH_BLOCK_SIZE)
 	{
-		if (data[offset + k] == data[offset])
+		CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_MATCH_FINDING);
+		const ClownLZSS_MatchBlock *block = ClownLZSS_MatchPipelineGetBlock(pipeline);
+		CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_MATCH_FINDING);
+
+		if (block->out_of_memory || !AddMatches(&matches, &total_matches, &matches_capacity, block->matches, block->total_matches, context))
+			success = false;
+
+		CLOWNLZSS_COUNT(
+			statistics.nodes += block->end_position - block->first_position;
+			statistics.candidates += block->candidates;
+			statistics.comparisons += block->comparisons;
+		)
+
+		CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_GRAPH);
+
+		parser.matches = matches;
+
+		for (size_t i = block->first_position; success && i < block->end_position; ++i)
 		{
-			unsigned int cost;
+			// The cheapest path to node 'i' is final, so the edges that start there can be added
+			match_ends[i] = total_matches - block->total_matches + block->match_ends[i - block->first_position];
+
+			// Each length only needs the nearest match that reaches it, which is the first one
+			size_t longest_match = 0;
+
+			for (const ClownLZSS_Match *match = &matches[i == 0 ? 0 : match_ends[i - 1]]; match != &matches[match_ends[i]]; ++match)
+			{
+				const size_t longest_length = CLOWNLZSS_MIN(match->length, DICTIONARY_SHORT_MAX_LENGTH);
+
+				for (size_t k = CLOWNLZSS_MAX(longest_match + 1, format.minimum_match_length); k <= longest_length; ++k)
+				{
+					const unsigned int cost = costs[i] + GetMatchCost(0, k, NULL);
+
+					CLOWNLZSS_COUNT(++statistics.edges_relaxed;)
+
+					if (costs[i + k] > cost)
+					{
+						CLOWNLZSS_COUNT(++statistics.edges_improved;)
+						costs[i + k] = cost;
+						lengths[i + k] = (unsigned int)k;
+						offsets[i + k] = match->position;
+					}
+				}
+
+				longest_match = CLOWNLZSS_MAX(longest_match, match->length);
+			}
+
+			longest_matches[i] = (unsigned int)longest_match;
+
+			if (i == 0 || data[i] != data[i - 1])
+				run_start = i;
+
+			// Now every edge that ends at the next node is known, so the cheapest can be found
+			const size_t node = i + 1;
+			Edge best;
+
+			best.cost = costs[node];
+			best.start = node - lengths[node];
+			best.kind = 2;
+			best.offset = offsets[node];
+
+			if (node >= 4)
+				SlidingMinimumPush(&rle_short, costs, node - 4);
+
+			if (node >= RLE_SHORT_MAX_LENGTH + 1)
+				SlidingMinimumPush(&rle_long, costs, node - (RLE_SHORT_MAX_LENGTH + 1));
+
+			SlidingMinimumPush(&raw_short, costs, node - 1);
+
+			if (node >= RAW_SHORT_MAX_LENGTH + 1)
+				SlidingMinimumPush(&raw_long, costs, node - (RAW_SHORT_MAX_LENGTH + 1));
+
+			size_t start = SlidingMinimumGet(&rle_short, CLOWNLZSS_MAX(run_start, node - CLOWNLZSS_MIN(node, RLE_SHORT_MAX_LENGTH)));
+
+			if (start != (size_t)-1)
+				ConsiderEdge(&best, costs[start] + 2 * 8, start, 0, 0xFFFFFF00 | data[start], &statistics);	// Horrible hack, like the rest of this compressor
+
+			start = SlidingMinimumGet(&rle_long, CLOWNLZSS_MAX(run_start, node - CLOWNLZSS_MIN(node, RLE_MAX_LENGTH)));
+
+			if (start != (size_t)-1)
+				ConsiderEdge(&best, costs[start] + 3 * 8, start, 0, 0xFFFFFF00 | data[start], &statistics);
+
+			start = SlidingMinimumGet(&raw_short, node - CLOWNLZSS_MIN(node, RAW_SHORT_MAX_LENGTH));
 
-			if (k + 1 < 4)
-				cost = 0;
-			else
-				cost = ((k + 1 - 4 > 0xF ? 2 : 1) + 1) * 8;
+			if (start != (size_t)-1)
+				ConsiderEdge(&best, costs[start] + (unsigned int)(node - start + 1) * 8, start, 1, start, &statistics);	// Points at itself
 
-			if (cost && node_meta_array[offset + k + 1].u.cost > node_meta_array[offset].u.cost + cost)
+			start = SlidingMinimumGet(&raw_long, node - CLOWNLZSS_MIN(node, RAW_MAX_LENGTH));
+
+			if (start != (size_t)-1)
+				ConsiderEdge(&best, costs[start] + (unsigned int)(node - start + 2) * 8, start, 1, start, &statistics);
+
+			if (node >= DICTIONARY_SHORT_MAX_LENGTH + 1 && longest_matches[node - (DICTIONARY_SHORT_MAX_LENGTH + 1)] > DICTIONARY_SHORT_MAX_LENGTH)
+				DictionaryHeapsPush(&heaps, &parser, node - (DICTIONARY_SHORT_MAX_LENGTH + 1));
+
+			for (size_t j = 0; j < DICTIONARY_BLOCK_LENGTH; ++j)
 			{
-				node_meta_array[offset + k + 1].u.cost = node_meta_array[offset].u.cost + cost;
-				node_meta_array[offset + k + 1].previous_node_index = offset;
-				node_meta_array[offset + k + 1].match_length = k + 1;
-				node_meta_array[offset + k + 1].match_offset = 0xFFFFFF00 | data[offset];	// Horrible hack, like the rest of this compressor
+				const unsigned int *heap = &heaps.starts[j * heaps.capacity];
+
+				while (heaps.sizes[j] != 0 && heap[0] + longest_matches[heap[0]] < node)
+					DictionaryHeapsPop(&heaps, &parser, j);
+
+				if (heaps.sizes[j] != 0)
+					ConsiderEdge(&best, costs[heap[0]] + GetMatchCost(0, node - heap[0], NULL), heap[0], 2, FindDictionaryOffset(&parser, heap[0], node - heap[0]), &statistics);
 			}
+
+			costs[node] = best.cost;
+			lengths[node] = (unsigned int)(node - best.start);
+			offsets[node] = (unsigned int)best.offset;
 		}
-		else
-			break;
+
+		CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_GRAPH);
+
+		ClownLZSS_MatchPipelineReleaseBlock(pipeline);
 	}
 
-	// Add uncompressed runs
-	max_read_ahead = CLOWNLZSS_MIN(0x1FFF, data_size - offset);
+	if (pipeline != NULL)
+		ClownLZSS_MatchPipelineDestroy(pipeline);
+
+	if (state_ready)
+		ClownLZSS_MatchFinderStateDeinit(&state);
+
+	ClownLZSS_ContextFree(context, matches);
+	ClownLZSS_ContextFree(context, longest_matches);
+	ClownLZSS_ContextFree(context, match_ends);
+	ClownLZSS_ContextFree(context, heaps.starts);
+	ClownLZSS_ContextFree(context, window_buffer);
 
-	for (size_t k = 0; k < max_read_ahead; ++k)
+	CLOWNLZSS_COUNT(ClownLZSS_ContextAddStatistics(context, &statistics);)
+
+	return success;
+}
+
+#if CLOWNLZSS_STATISTICS
+// Counts the edge of the path that ends at 'node'. Uncompressed runs are counted as literals.
+static void CountEdge(ClownLZSS_Statistics *statistics, size_t node, size_t length, size_t offset, unsigned int cost)
+{
+	const size_t start = node - length;
+
+	if ((offset & 0xFFFFFF00) == 0xFFFFFF00)
+		ClownLZSS_StatisticsAddMatch(statistics, 0, length, cost);	// RLE-matches copy no earlier data
+	else if (offset == start)
+		ClownLZSS_StatisticsAddLiterals(statistics, length, cost);
+	else
+		ClownLZSS_StatisticsAddMatch(statistics, start - offset, length, cost);
+}
+#endif
+
+static void CompressData(unsigned char *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, RageInstance *instance)
+{
+	if (data_size == 0)
+		return;
+
+	const ClownLZSS_Level *fast_level = ClownLZSS_GetLevel(level);
+
+	if (fast_level != NULL)
 	{
-		const unsigned int cost = (k + 1 + (k + 1 > 0x1F ? 2 : 1)) * 8;
+		CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_RUN_LENGTHS);
+		unsigned int *run_lengths = ClownLZSS_RunLengthsCreate(data, 1, data_size, context);
+		CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_RUN_LENGTHS);
 
-		if (cost && node_meta_array[offset + k + 1].u.cost > node_meta_array[offset].u.cost + cost)
+		if (run_lengths != NULL)
+			Rage_ParseFast(data, data_size, instance, run_lengths, fast_level, context);
+
+		FlushLiterals(instance);
+		ClownLZSS_ContextFree(context, run_lengths);
+		return;
+	}
+
+	// Rage data is full of long repeats, and its dictionary-matches can be any
+	// length, which is where the hash chains slow down the most, so the suffix
+	// array is used no matter how small the input is
+	CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_SUFFIX_ARRAY);
+	ClownLZSS_SuffixArray suffix_array;
+	const bool use_suffix_array = !CLOWNLZSS_BRUTE_FORCE && ClownLZSS_SuffixArrayInit(&suffix_array, data, 1, data_size, context);
+	CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_SUFFIX_ARRAY);
+
+	CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_RUN_LENGTHS);
+	unsigned int *run_lengths = ClownLZSS_RunLengthsCreate(data, 1, data_size, context);
+	CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_RUN_LENGTHS);
+	unsigned int *costs = (unsigned int*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_GRAPH_COSTS, (data_size + 1) * sizeof(unsigned int));
+	unsigned int *lengths = (unsigned int*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_GRAPH_LENGTHS, (data_size + 1) * sizeof(unsigned int));
+	unsigned int *offsets = (unsigned int*)ClownLZSS_ContextAllocate(context, CLOWNLZSS_CONTEXT_GRAPH_OFFSETS, (data_size + 1) * sizeof(unsigned int));
+
+	if (run_lengths != NULL && costs != NULL && lengths != NULL && offsets != NULL && BuildGraph(data, data_size, run_lengths, use_suffix_array ? &suffix_array : NULL, costs, lengths, offsets, context))
+	{
+		// Follow the cheapest path backwards, replacing the cost of each node
+		// on it with the distance to the next node, so it can be followed forwards
+		CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_PATH_REVERSAL);
+		CLOWNLZSS_COUNT(
+			ClownLZSS_Statistics statistics;
+			ClownLZSS_StatisticsClear(&statistics);
+			unsigned int cost = costs[data_size];	// What it costs to reach the node, before it is replaced
+		)
+
+		for (size_t node = data_size; node != 0; node -= lengths[node])
 		{
-			node_meta_array[offset + k + 1].u.cost = node_meta_array[offset].u.cost + cost;
-			node_meta_array[offset + k + 1].previous_node_index = offset;
-			node_meta_array[offset + k + 1].match_length = k + 1;
-			node_meta_array[offset + k + 1].match_offset = offset;	// Points at itself
+			CLOWNLZSS_COUNT(
+				const unsigned int previous_cost = costs[node - lengths[node]];
+				CountEdge(&statistics, node, lengths[node], offsets[node], cost - previous_cost);
+				cost = previous_cost;
+			)
+
+			costs[node - lengths[node]] = lengths[node];
 		}
+
+		CLOWNLZSS_COUNT(ClownLZSS_ContextAddStatistics(context, &statistics);)
+		CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_PATH_REVERSAL);
+		CLOWNLZSS_PROFILE_BEGIN(context, CLOWNLZSS_STAGE_EMISSION);
+
+		for (size_t node = 0; node != data_size; node += costs[node])
+		{
+			const size_t next_node = node + costs[node];
+
+			DoMatch(node - offsets[next_node], lengths[next_node], offsets[next_node], instance);
+		}
+
+		CLOWNLZSS_PROFILE_END(context, CLOWNLZSS_STAGE_EMISSION);
 	}
-}
 
-static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, 0xFFFFFFFF/*dictionary-matches can be infinite*/, 0x1FFF, FindExtraMatches, 0xFFFFFFF/*dummy*/, DoLiteral, GetMatchCost, DoMatch)
+	ClownLZSS_ContextFree(context, offsets);
+	ClownLZSS_ContextFree(context, lengths);
+	ClownLZSS_ContextFree(context, costs);
+	ClownLZSS_ContextFree(context, run_lengths);
+
+	if (use_suffix_array)
+		ClownLZSS_SuffixArrayDeinit(&suffix_array);
+}
 
-static void RageCompressStream(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user)
+static void RageCompressStream(unsigned char *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, MemoryStream *output_stream, void *user)
 {
 	(void)user;
 
 	RageInstance instance;
-	instance.output_stream = output_stream;
 	instance.data = data;
+	instance.position = 0;
+	instance.total_literals = 0;
 
 	const size_t file_offset = MemoryStream_GetPosition(output_stream);
 
@@ -193,7 +691,15 @@ static void RageCompressStream(unsigned char *data, size_t data_size, MemoryStre
 	MemoryStream_WriteByte(output_stream, 0);
 	MemoryStream_WriteByte(output_stream, 0);
 
-	CompressData(data, data_size, &instance);
+	BitWriter_Init(&instance.writer, output_stream, 0, false, false, false);
+
+	CompressData(data, data_size, level, context, &instance);
+
+	BitWriter_Finish(&instance.writer);
+
+	// There is no header to fill in if the output ran out of memory
+	if (MemoryStream_HasFailed(output_stream))
+		return;
 
 	unsigned char *buffer = MemoryStream_GetBuffer(output_stream);
 	const size_t compressed_size = MemoryStream_GetPosition(output_stream) - file_offset;
@@ -203,12 +709,121 @@ static void RageCompressStream(unsigned char *data, size_t data_size, MemoryStre
 	buffer[file_offset + 1] = (compressed_size >> 8) & 0xFF;
 }
 
-unsigned char* ClownLZSS_RageCompress(unsigned char *data, size_t data_size, size_t *compressed_size)
+unsigned char* ClownLZSS_RageCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularWrapper(data, data_size, compressed_size, level, context, "rage", NULL, RageCompressStream);
+}
+
+unsigned char* ClownLZSS_ModuledRageCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledCompressionWrapper(data, data_size, compressed_size, level, context, "rage", NULL, RageCompressStream, module_size, 1);
+}
+
+size_t ClownLZSS_RageCompressBound(size_t data_size)
+{
+	// Rage has no descriptors: the worst case is the literals in uncompressed runs, each
+	// with a header of up to two bytes. A match is always at least two bytes shorter than
+	// the data that it replaces, which pays for the header of the run before it, so only
+	// the last run and the runs that are split for being too long cost anything extra.
+	return 2 + data_size + 2 * (data_size / 0x1FFF + 1);
+}
+
+size_t ClownLZSS_ModuledRageCompressBound(size_t data_size, size_t module_size)
+{
+	return ModuledCompressBound(data_size, module_size, 1, ClownLZSS_RageCompressBound(module_size), ClownLZSS_RageCompressBound(data_size % module_size));
+}
+
+bool ClownLZSS_RageCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "rage", NULL, RageCompressStream);
+}
+
+bool ClownLZSS_ModuledRageCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "rage", NULL, RageCompressStream, module_size, 1);
+}
+
+bool ClownLZSS_RageCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "rage", NULL, RageCompressStream);
+}
+
+bool ClownLZSS_ModuledRageCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "rage", NULL, RageCompressStream, module_size, 1);
+}
+
+static bool RageDecompressStream(DecompressionInput *input, DecompressionBuffer *output, size_t decompressed_size, void *user)
+{
+	(void)decompressed_size;
+	(void)user;
+
+	// The compressed size includes the header
+	size_t end = DecompressionInput_ReadByte(input);
+	end |= DecompressionInput_ReadByte(input) << 8;
+	end += input->position - 2;
+
+	if (end > input->size)
+		return false;
+
+	size_t distance = 0;
+
+	while (input->position < end)
+	{
+		const unsigned int first_byte = DecompressionInput_ReadByte(input);
+
+		if (first_byte & 0x80)
+		{
+			// Dictionary-match
+			distance = (first_byte & 0x1F) << 8;
+			distance |= DecompressionInput_ReadByte(input);
+
+			if (!DecompressionBuffer_CopyMatch(output, distance, ((first_byte >> 5) & 3) + 4))
+				return false;
+		}
+		else if ((first_byte & 0x60) == 0x60)
+		{
+			// Continuation of the previous dictionary-match
+			if (!DecompressionBuffer_CopyMatch(output, distance, first_byte & 0x1F))
+				return false;
+		}
+		else if (first_byte & 0x40)
+		{
+			// RLE-match
+			size_t length = first_byte & 0xF;
+
+			if (first_byte & 0x10)
+				length = (length << 8) | DecompressionInput_ReadByte(input);
+
+			if (!DecompressionBuffer_Fill(output, DecompressionInput_ReadByte(input), length + 4))
+				return false;
+		}
+		else
+		{
+			// Uncompressed run
+			size_t length = first_byte & 0x1F;
+
+			if (first_byte & 0x20)
+				length = (length << 8) | DecompressionInput_ReadByte(input);
+
+			if (length > end - CLOWNLZSS_MIN(input->position, end) || !DecompressionBuffer_Reserve(output, length))
+				return false;
+
+			memcpy(&output->buffer[output->position], &input->data[input->position], length);
+			output->position += length;
+			input->position += length;
+		}
+	}
+
+	return input->position == end;
+}
+
+unsigned char* ClownLZSS_RageDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size)
 {
-	return RegularWrapper(data, data_size, compressed_size, NULL, RageCompressStream);
+	return RegularDecompressionWrapper(data, data_size, decompressed_size, NULL, RageDecompressStream);
 }
 
-unsigned char* ClownLZSS_ModuledRageCompress(unsigned char *data, size_t data_size, size_t *compressed_size, size_t module_size)
+unsigned char* ClownLZSS_ModuledRageDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, size_t module_size)
 {
-	return ModuledCompressionWrapper(data, data_size, compressed_size, NULL, RageCompressStream, module_size, 1);
+	return ModuledDecompressionWrapper(data, data_size, decompressed_size, NULL, RageDecompressStream, module_size, 1);
 }
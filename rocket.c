@@ -33,44 +33,17 @@
 
 typedef struct RocketInstance
 {
-	MemoryStream *output_stream;
-	MemoryStream *match_stream;
-
-	unsigned char descriptor;
-	unsigned int descriptor_bits_remaining;
+	BitWriter writer;
 } RocketInstance;
 
-static void FlushData(RocketInstance *instance)
-{
-	MemoryStream_WriteByte(instance->output_stream, instance->descriptor);
-
-	const size_t match_buffer_size = MemoryStream_GetPosition(instance->match_stream);
-	unsigned char *match_buffer = MemoryStream_GetBuffer(instance->match_stream);
-
-	MemoryStream_WriteBytes(instance->output_stream, match_buffer, match_buffer_size);
-}
-
 static void PutMatchByte(RocketInstance *instance, unsigned char byte)
 {
-	MemoryStream_WriteByte(instance->match_stream, byte);
+	BitWriter_PutByte(&instance->writer, byte);
 }
 
 static void PutDescriptorBit(RocketInstance *instance, bool bit)
 {
-	if (instance->descriptor_bits_remaining == 0)
-	{
-		FlushData(instance);
-
-		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
-		MemoryStream_Rewind(instance->match_stream);
-	}
-
-	--instance->descriptor_bits_remaining;
-
-	instance->descriptor >>= 1;
-
-	if (bit)
-		instance->descriptor |= 1 << (TOTAL_DESCRIPTOR_BITS - 1);
+	BitWriter_PutBit(&instance->writer, bit);
 }
 
 static void DoLiteral(unsigned char value, void *user)
@@ -94,34 +67,29 @@ static void DoMatch(size_t distance, size_t length, size_t offset, void *user)
 	PutMatchByte(instance, offset_adjusted & 0xFF);
 }
 
-static unsigned int GetMatchCost(size_t distance, size_t length, void *user)
-{
-	(void)distance;
-	(void)length;
-	(void)user;
+static const ClownLZSS_MatchEncoding match_encodings[] = {
+	{0x400, 2, 0x40, 1 + 16}	// Descriptor bit, offset/length bytes
+};
 
-	return 1 + 16;	// Descriptor bit, offset/length bytes
-}
+static const ClownLZSS_Format format = {2, 0x40, 0x400, 1 + 8, match_encodings, sizeof(match_encodings) / sizeof(match_encodings[0]), NULL};
 
-static void FindExtraMatches(unsigned char *data, size_t data_size, size_t offset, ClownLZSS_GraphEdge *node_meta_array, void *user)
+static void FindExtraMatches(unsigned char *data, size_t data_size, const unsigned int *run_lengths, size_t offset, ClownLZSS_Graph *graph, void *user)
 {
 	(void)data;
 	(void)data_size;
+	(void)run_lengths;
 	(void)offset;
-	(void)node_meta_array;
+	(void)graph;
 	(void)user;
 }
 
-static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, 0x40, 0x400, FindExtraMatches, 1 + 8, DoLiteral, GetMatchCost, DoMatch)
+static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, format, FindExtraMatches, DoLiteral, DoMatch)
 
-static void RocketCompressStream(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user)
+static void RocketCompressStream(unsigned char *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, MemoryStream *output_stream, void *user)
 {
 	(void)user;
 
 	RocketInstance instance;
-	instance.output_stream = output_stream;
-	instance.match_stream = MemoryStream_Create(true);
-	instance.descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
 
 	const size_t file_offset = MemoryStream_GetPosition(output_stream);
 
@@ -131,12 +99,15 @@ static void RocketCompressStream(unsigned char *data, size_t data_size, MemorySt
 	MemoryStream_WriteByte(output_stream, 0);
 	MemoryStream_WriteByte(output_stream, 0);
 
-	CompressData(data, data_size, &instance);
+	BitWriter_Init(&instance.writer, output_stream, TOTAL_DESCRIPTOR_BITS, false, false, false);
+
+	CompressData(data, data_size, level, context, &instance);
 
-	instance.descriptor >>= instance.descriptor_bits_remaining;
-	FlushData(&instance);
+	BitWriter_Finish(&instance.writer);
 
-	MemoryStream_Destroy(instance.match_stream);
+	// There is no header to fill in if the output ran out of memory
+	if (MemoryStream_HasFailed(output_stream))
+		return;
 
 	unsigned char *buffer = MemoryStream_GetBuffer(output_stream);
 	const size_t compressed_size = MemoryStream_GetPosition(output_stream) - file_offset - 2;
@@ -146,12 +117,143 @@ static void RocketCompressStream(unsigned char *data, size_t data_size, MemorySt
 	buffer[file_offset + 3] = compressed_size & 0xFF;
 }
 
-unsigned char* ClownLZSS_RocketCompress(unsigned char *data, size_t data_size, size_t *compressed_size)
+unsigned char* ClownLZSS_RocketCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularWrapper(data, data_size, compressed_size, level, context, "rocket", NULL, RocketCompressStream);
+}
+
+unsigned char* ClownLZSS_ModuledRocketCompress(unsigned char *data, size_t data_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledCompressionWrapper(data, data_size, compressed_size, level, context, "rocket", NULL, RocketCompressStream, module_size, 1);
+}
+
+size_t ClownLZSS_RocketCompressBound(size_t data_size)
+{
+	return CompressBound(4, data_size * format.literal_cost, TOTAL_DESCRIPTOR_BITS / 8);
+}
+
+size_t ClownLZSS_ModuledRocketCompressBound(size_t data_size, size_t module_size)
+{
+	return ModuledCompressBound(data_size, module_size, 1, ClownLZSS_RocketCompressBound(module_size), ClownLZSS_RocketCompressBound(data_size % module_size));
+}
+
+bool ClownLZSS_RocketCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "rocket", NULL, RocketCompressStream);
+}
+
+bool ClownLZSS_ModuledRocketCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, "rocket", NULL, RocketCompressStream, module_size, 1);
+}
+
+bool ClownLZSS_RocketCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "rocket", NULL, RocketCompressStream);
+}
+
+bool ClownLZSS_ModuledRocketCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, "rocket", NULL, RocketCompressStream, module_size, 1);
+}
+
+typedef struct RocketDecompressionInstance
+{
+	DecompressionInput *input;
+
+	unsigned char descriptor;
+	unsigned int descriptor_bits_remaining;
+} RocketDecompressionInstance;
+
+static bool GetDescriptorBit(RocketDecompressionInstance *instance)
+{
+	if (instance->descriptor_bits_remaining == 0)
+	{
+		instance->descriptor = DecompressionInput_ReadByte(instance->input);
+		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+	}
+
+	--instance->descriptor_bits_remaining;
+
+	const bool bit = instance->descriptor & 1;
+
+	instance->descriptor >>= 1;
+
+	return bit;
+}
+
+static bool RocketDecompressStream(DecompressionInput *input, DecompressionBuffer *output, size_t decompressed_size, void *user)
+{
+	(void)decompressed_size;
+	(void)user;
+
+	RocketDecompressionInstance instance;
+	instance.input = input;
+	instance.descriptor_bits_remaining = 0;
+
+	size_t uncompressed_size = DecompressionInput_ReadByte(input) << 8;
+	uncompressed_size |= DecompressionInput_ReadByte(input);
+
+	// The compressed size includes itself
+	size_t end = DecompressionInput_ReadByte(input) << 8;
+	end |= DecompressionInput_ReadByte(input);
+	end += input->position - 2;
+
+	if (end > input->size)
+		return false;
+
+	while (output->position - output->stream_start < uncompressed_size && !input->out_of_data)
+	{
+		if (GetDescriptorBit(&instance))
+		{
+			// Literal
+			if (!DecompressionBuffer_WriteByte(output, DecompressionInput_ReadByte(input)))
+				return false;
+		}
+		else
+		{
+			// Match
+			const unsigned int first_byte = DecompressionInput_ReadByte(input);
+			const unsigned int second_byte = DecompressionInput_ReadByte(input);
+
+			// The offset is an address in a 0x400-byte ring buffer, which starts out filled with spaces
+			const size_t position = output->position - output->stream_start;
+			const size_t offset = ((((first_byte & 3) << 8) | second_byte) + 0x40) & 0x3FF;
+			size_t length = (first_byte >> 2) + 1;
+			size_t distance = (position - offset) & 0x3FF;
+
+			if (distance == 0)
+				distance = 0x400;
+
+			if (distance > position)
+			{
+				const size_t fill_length = CLOWNLZSS_MIN(length, distance - position);
+
+				if (!DecompressionBuffer_Fill(output, ' ', fill_length))
+					return false;
+
+				length -= fill_length;
+			}
+
+			if (length != 0 && !DecompressionBuffer_CopyMatch(output, distance, length))
+				return false;
+		}
+	}
+
+	if (input->position > end)
+		return false;
+
+	input->position = end;
+
+	return output->position - output->stream_start == uncompressed_size;
+}
+
+unsigned char* ClownLZSS_RocketDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size)
 {
-	return RegularWrapper(data, data_size, compressed_size, NULL, RocketCompressStream);
+	return RegularDecompressionWrapper(data, data_size, decompressed_size, NULL, RocketDecompressStream);
 }
 
-unsigned char* ClownLZSS_ModuledRocketCompress(unsigned char *data, size_t data_size, size_t *compressed_size, size_t module_size)
+unsigned char* ClownLZSS_ModuledRocketDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, size_t module_size)
 {
-	return ModuledCompressionWrapper(data, data_size, compressed_size, NULL, RocketCompressStream, module_size, 1);
+	return ModuledDecompressionWrapper(data, data_size, decompressed_size, NULL, RocketDecompressStream, module_size, 1);
 }
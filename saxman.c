@@ -33,44 +33,17 @@
 
 typedef struct SaxmanInstance
 {
-	MemoryStream *output_stream;
-	MemoryStream *match_stream;
-
-	unsigned char descriptor;
-	unsigned int descriptor_bits_remaining;
+	BitWriter writer;
 } SaxmanInstance;
 
-static void FlushData(SaxmanInstance *instance)
-{
-	MemoryStream_WriteByte(instance->output_stream, instance->descriptor);
-
-	const size_t match_buffer_size = MemoryStream_GetPosition(instance->match_stream);
-	unsigned char *match_buffer = MemoryStream_GetBuffer(instance->match_stream);
-
-	MemoryStream_WriteBytes(instance->output_stream, match_buffer, match_buffer_size);
-}
-
 static void PutMatchByte(SaxmanInstance *instance, unsigned char byte)
 {
-	MemoryStream_WriteByte(instance->match_stream, byte);
+	BitWriter_PutByte(&instance->writer, byte);
 }
 
 static void PutDescriptorBit(SaxmanInstance *instance, bool bit)
 {
-	if (instance->descriptor_bits_remaining == 0)
-	{
-		FlushData(instance);
-
-		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
-		MemoryStream_Rewind(instance->match_stream);
-	}
-
-	--instance->descriptor_bits_remaining;
-
-	instance->descriptor >>= 1;
-
-	if (bit)
-		instance->descriptor |= 1 << (TOTAL_DESCRIPTOR_BITS - 1);
+	BitWriter_PutBit(&instance->writer, bit);
 }
 
 static void DoLiteral(unsigned char value, void *user)
@@ -92,56 +65,38 @@ static void DoMatch(size_t distance, size_t length, size_t offset, void *user)
 	PutMatchByte(instance, (unsigned char)((((offset - 0x12) & 0xF00) >> 4) | (length - 3)));
 }
 
-static unsigned int GetMatchCost(size_t distance, size_t length, void *user)
-{
-	(void)distance;
-	(void)length;
-	(void)user;
+static const ClownLZSS_MatchEncoding match_encodings[] = {
+	{0x1000, 3, 0x12, 1 + 16}	// Descriptor bit, offset/length bits
+};
 
-	if (length >= 3)
-		return 1 + 16;	// Descriptor bit, offset/length bits
-	else
-		return 0;
-}
+static const ClownLZSS_Format format = {3, 0x12, 0x1000, 1 + 8, match_encodings, sizeof(match_encodings) / sizeof(match_encodings[0]), NULL};
 
-static void FindExtraMatches(unsigned char *data, size_t data_size, size_t offset, ClownLZSS_GraphEdge *node_meta_array, void *user)
+static void FindExtraMatches(unsigned char *data, size_t data_size, const unsigned int *run_lengths, size_t offset, ClownLZSS_Graph *graph, void *user)
 {
+	(void)data_size;
 	(void)user;
 
-	if (offset < 0x1000)
+	// Zero-fill matches
+	if (offset < 0x1000 && data[offset] == 0)
 	{
-		const size_t max_read_ahead = CLOWNLZSS_MIN(0x12, data_size - offset);
+		const size_t max_read_ahead = CLOWNLZSS_MIN(0x12, run_lengths[offset]);
 
 		for (size_t k = 0; k < max_read_ahead; ++k)
 		{
-			if (data[offset + k] == 0)
-			{
-				const unsigned int cost = GetMatchCost(0, k + 1, user);
-
-				if (cost && node_meta_array[offset + k + 1].u.cost > node_meta_array[offset].u.cost + cost)
-				{
-					node_meta_array[offset + k + 1].u.cost = node_meta_array[offset].u.cost + cost;
-					node_meta_array[offset + k + 1].previous_node_index = offset;
-					node_meta_array[offset + k + 1].match_length = k + 1;
-					node_meta_array[offset + k + 1].match_offset = 0xFFF;
-				}
-			}
-			else
-				break;
+			const unsigned int cost = ClownLZSS_GetMatchCost(&format, 0, k + 1, user);
+
+			CLOWNLZSS_ADD_MATCH(graph, offset, k + 1, 0xFFF, cost);
 		}
 	}
 }
 
-static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, 0x12, 0x1000, FindExtraMatches, 1 + 8, DoLiteral, GetMatchCost, DoMatch)
+static CLOWNLZSS_MAKE_COMPRESSION_FUNCTION(CompressData, unsigned char, format, FindExtraMatches, DoLiteral, DoMatch)
 
-static void SaxmanCompressStream(unsigned char *data, size_t data_size, MemoryStream *output_stream, void *user)
+static void SaxmanCompressStream(unsigned char *data, size_t data_size, unsigned int level, ClownLZSS_Context *context, MemoryStream *output_stream, void *user)
 {
 	const bool header = *(bool*)user;
 
 	SaxmanInstance instance;
-	instance.output_stream = output_stream;
-	instance.match_stream = MemoryStream_Create(true);
-	instance.descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
 
 	const size_t file_offset = MemoryStream_GetPosition(output_stream);
 
@@ -152,12 +107,15 @@ static void SaxmanCompressStream(unsigned char *data, size_t data_size, MemorySt
 		MemoryStream_WriteByte(output_stream, 0);
 	}
 
-	CompressData(data, data_size, &instance);
+	BitWriter_Init(&instance.writer, output_stream, TOTAL_DESCRIPTOR_BITS, false, false, false);
 
-	instance.descriptor >>= instance.descriptor_bits_remaining;
-	FlushData(&instance);
+	CompressData(data, data_size, level, context, &instance);
 
-	MemoryStream_Destroy(instance.match_stream);
+	BitWriter_Finish(&instance.writer);
+
+	// There is no header to fill in if the output ran out of memory
+	if (MemoryStream_HasFailed(output_stream))
+		return;
 
 	if (header)
 	{
@@ -170,12 +128,149 @@ static void SaxmanCompressStream(unsigned char *data, size_t data_size, MemorySt
 	}
 }
 
-unsigned char* ClownLZSS_SaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, bool header)
+unsigned char* ClownLZSS_SaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularWrapper(data, data_size, compressed_size, level, context, header ? "saxman" : "saxman_no_header", &header, SaxmanCompressStream);
+}
+
+unsigned char* ClownLZSS_ModuledSaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledCompressionWrapper(data, data_size, compressed_size, level, context, header ? "saxman" : "saxman_no_header", &header, SaxmanCompressStream, module_size, 1);
+}
+
+size_t ClownLZSS_SaxmanCompressBound(size_t data_size, bool header)
+{
+	return CompressBound(header ? 2 : 0, data_size * format.literal_cost, TOTAL_DESCRIPTOR_BITS / 8);
+}
+
+size_t ClownLZSS_ModuledSaxmanCompressBound(size_t data_size, bool header, size_t module_size)
+{
+	return ModuledCompressBound(data_size, module_size, 1, ClownLZSS_SaxmanCompressBound(module_size, header), ClownLZSS_SaxmanCompressBound(data_size % module_size, header));
+}
+
+bool ClownLZSS_SaxmanCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, header ? "saxman" : "saxman_no_header", &header, SaxmanCompressStream);
+}
+
+bool ClownLZSS_ModuledSaxmanCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledBufferWrapper(data, data_size, buffer, buffer_size, compressed_size, level, context, header ? "saxman" : "saxman_no_header", &header, SaxmanCompressStream, module_size, 1);
+}
+
+bool ClownLZSS_SaxmanCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context)
+{
+	return RegularSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, header ? "saxman" : "saxman_no_header", &header, SaxmanCompressStream);
+}
+
+bool ClownLZSS_ModuledSaxmanCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context, size_t module_size)
+{
+	return ModuledSinkWrapper(data, data_size, sink, sink_user, compressed_size, level, context, header ? "saxman" : "saxman_no_header", &header, SaxmanCompressStream, module_size, 1);
+}
+
+typedef struct SaxmanDecompressionInstance
+{
+	DecompressionInput *input;
+
+	unsigned char descriptor;
+	unsigned int descriptor_bits_remaining;
+} SaxmanDecompressionInstance;
+
+static bool GetDescriptorBit(SaxmanDecompressionInstance *instance)
+{
+	if (instance->descriptor_bits_remaining == 0)
+	{
+		instance->descriptor = DecompressionInput_ReadByte(instance->input);
+		instance->descriptor_bits_remaining = TOTAL_DESCRIPTOR_BITS;
+	}
+
+	--instance->descriptor_bits_remaining;
+
+	const bool bit = instance->descriptor & 1;
+
+	instance->descriptor >>= 1;
+
+	return bit;
+}
+
+static bool SaxmanDecompressStream(DecompressionInput *input, DecompressionBuffer *output, size_t decompressed_size, void *user)
+{
+	const bool header = *(bool*)user;
+
+	SaxmanDecompressionInstance instance;
+	instance.input = input;
+	instance.descriptor_bits_remaining = 0;
+
+	// Without a header, the data ends either where the output should or where the input does
+	size_t end = input->size;
+
+	if (header)
+	{
+		end = DecompressionInput_ReadByte(input);
+		end |= DecompressionInput_ReadByte(input) << 8;
+		end += input->position;
+
+		if (end > input->size)
+			return false;
+	}
+
+	while (input->position < end && output->position - output->stream_start < decompressed_size && !input->out_of_data)
+	{
+		const bool bit = GetDescriptorBit(&instance);
+
+		// The rest of the final descriptor is padding
+		if (input->position == end)
+			break;
+
+		if (bit)
+		{
+			// Literal
+			if (!DecompressionBuffer_WriteByte(output, DecompressionInput_ReadByte(input)))
+				return false;
+		}
+		else
+		{
+			// Match
+			const unsigned int first_byte = DecompressionInput_ReadByte(input);
+			const unsigned int second_byte = DecompressionInput_ReadByte(input);
+
+			// The offset is an address in a 0x1000-byte ring buffer
+			const size_t position = output->position - output->stream_start;
+			const size_t offset = ((((second_byte & 0xF0) << 4) | first_byte) + 0x12) & 0xFFF;
+			const size_t length = (second_byte & 0xF) + 3;
+			size_t distance = (position - offset) & 0xFFF;
+
+			if (distance == 0)
+				distance = 0x1000;
+
+			if (distance > position)
+			{
+				// Matches that reach back past the start of the file are zero-fills
+				if (!DecompressionBuffer_Fill(output, 0, length))
+					return false;
+			}
+			else if (!DecompressionBuffer_CopyMatch(output, distance, length))
+			{
+				return false;
+			}
+		}
+	}
+
+	if (input->position > end)
+		return false;
+
+	if (header)
+		input->position = end;
+
+	return true;
+}
+
+unsigned char* ClownLZSS_SaxmanDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, bool header)
 {
-	return RegularWrapper(data, data_size, compressed_size, &header, SaxmanCompressStream);
+	return RegularDecompressionWrapper(data, data_size, decompressed_size, &header, SaxmanDecompressStream);
 }
 
-unsigned char* ClownLZSS_ModuledSaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, bool header, size_t module_size)
+unsigned char* ClownLZSS_ModuledSaxmanDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, bool header, size_t module_size)
 {
-	return ModuledCompressionWrapper(data, data_size, compressed_size, &header, SaxmanCompressStream, module_size, 1);
+	return ModuledDecompressionWrapper(data, data_size, decompressed_size, &header, SaxmanDecompressStream, module_size, 1);
 }
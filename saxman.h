@@ -25,5 +25,15 @@
 #endif
 #include <stddef.h>
 
-unsigned char* ClownLZSS_SaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, bool header);
-unsigned char* ClownLZSS_ModuledSaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, bool header, size_t module_size);
+#include "clownlzss.h"
+
+unsigned char* ClownLZSS_SaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context);
+unsigned char* ClownLZSS_ModuledSaxmanCompress(unsigned char *data, size_t data_size, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context, size_t module_size);
+size_t ClownLZSS_SaxmanCompressBound(size_t data_size, bool header);
+size_t ClownLZSS_ModuledSaxmanCompressBound(size_t data_size, bool header, size_t module_size);
+bool ClownLZSS_SaxmanCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context);
+bool ClownLZSS_ModuledSaxmanCompressToBuffer(unsigned char *data, size_t data_size, unsigned char *buffer, size_t buffer_size, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context, size_t module_size);
+bool ClownLZSS_SaxmanCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context);
+bool ClownLZSS_ModuledSaxmanCompressToSink(unsigned char *data, size_t data_size, bool (*sink)(const unsigned char *bytes, size_t size, void *user), void *sink_user, size_t *compressed_size, bool header, unsigned int level, ClownLZSS_Context *context, size_t module_size);
+unsigned char* ClownLZSS_SaxmanDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, bool header);
+unsigned char* ClownLZSS_ModuledSaxmanDecompress(unsigned char *data, size_t data_size, size_t *decompressed_size, bool header, size_t module_size);
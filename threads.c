@@ -0,0 +1,293 @@
+/*
+	(C) 2018-2019 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "threads.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <process.h>
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+struct Thread
+{
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	void (*function)(void *user_data);
+	void *user_data;
+};
+
+struct Mutex
+{
+#ifdef _WIN32
+	CRITICAL_SECTION handle;
+#else
+	pthread_mutex_t handle;
+#endif
+};
+
+struct ConditionVariable
+{
+#ifdef _WIN32
+	CONDITION_VARIABLE handle;
+#else
+	pthread_cond_t handle;
+#endif
+};
+
+struct ThreadLocal
+{
+#ifdef _WIN32
+	DWORD index;
+#else
+	pthread_key_t key;
+#endif
+};
+
+#ifdef _WIN32
+static unsigned int __stdcall ThreadEntry(void *argument)
+#else
+static void* ThreadEntry(void *argument)
+#endif
+{
+	Thread *thread = (Thread*)argument;
+
+	thread->function(thread->user_data);
+
+	return 0;
+}
+
+Thread* Thread_Create(void (*function)(void *user_data), void *user_data)
+{
+	Thread *thread = (Thread*)malloc(sizeof(Thread));
+
+	if (thread != NULL)
+	{
+		thread->function = function;
+		thread->user_data = user_data;
+
+	#ifdef _WIN32
+		thread->handle = (HANDLE)_beginthreadex(NULL, 0, ThreadEntry, thread, 0, NULL);
+
+		if (thread->handle == 0)
+	#else
+		if (pthread_create(&thread->handle, NULL, ThreadEntry, thread) != 0)
+	#endif
+		{
+			free(thread);
+			thread = NULL;
+		}
+	}
+
+	return thread;
+}
+
+/* Waits for the thread to finish, and then frees it */
+void Thread_Join(Thread *thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+
+	free(thread);
+}
+
+size_t Thread_GetProcessorCount(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO system_info;
+	GetSystemInfo(&system_info);
+	const long total_processors = (long)system_info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	const long total_processors = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	const long total_processors = 1;
+#endif
+
+	return total_processors < 1 ? 1 : (size_t)total_processors;
+}
+
+Mutex* Mutex_Create(void)
+{
+	Mutex *mutex = (Mutex*)malloc(sizeof(Mutex));
+
+	if (mutex != NULL)
+	{
+	#ifdef _WIN32
+		InitializeCriticalSection(&mutex->handle);
+	#else
+		if (pthread_mutex_init(&mutex->handle, NULL) != 0)
+		{
+			free(mutex);
+			mutex = NULL;
+		}
+	#endif
+	}
+
+	return mutex;
+}
+
+void Mutex_Destroy(Mutex *mutex)
+{
+#ifdef _WIN32
+	DeleteCriticalSection(&mutex->handle);
+#else
+	pthread_mutex_destroy(&mutex->handle);
+#endif
+
+	free(mutex);
+}
+
+void Mutex_Lock(Mutex *mutex)
+{
+#ifdef _WIN32
+	EnterCriticalSection(&mutex->handle);
+#else
+	pthread_mutex_lock(&mutex->handle);
+#endif
+}
+
+void Mutex_Unlock(Mutex *mutex)
+{
+#ifdef _WIN32
+	LeaveCriticalSection(&mutex->handle);
+#else
+	pthread_mutex_unlock(&mutex->handle);
+#endif
+}
+
+ConditionVariable* ConditionVariable_Create(void)
+{
+	ConditionVariable *condition_variable = (ConditionVariable*)malloc(sizeof(ConditionVariable));
+
+	if (condition_variable != NULL)
+	{
+	#ifdef _WIN32
+		InitializeConditionVariable(&condition_variable->handle);
+	#else
+		if (pthread_cond_init(&condition_variable->handle, NULL) != 0)
+		{
+			free(condition_variable);
+			condition_variable = NULL;
+		}
+	#endif
+	}
+
+	return condition_variable;
+}
+
+void ConditionVariable_Destroy(ConditionVariable *condition_variable)
+{
+#ifndef _WIN32
+	pthread_cond_destroy(&condition_variable->handle);
+#endif
+
+	free(condition_variable);
+}
+
+/* 'mutex' must be locked, and is locked again by the time this returns */
+void ConditionVariable_Wait(ConditionVariable *condition_variable, Mutex *mutex)
+{
+#ifdef _WIN32
+	SleepConditionVariableCS(&condition_variable->handle, &mutex->handle, INFINITE);
+#else
+	pthread_cond_wait(&condition_variable->handle, &mutex->handle);
+#endif
+}
+
+void ConditionVariable_Broadcast(ConditionVariable *condition_variable)
+{
+#ifdef _WIN32
+	WakeAllConditionVariable(&condition_variable->handle);
+#else
+	pthread_cond_broadcast(&condition_variable->handle);
+#endif
+}
+
+/* A value that each thread has its own copy of, starting as NULL */
+ThreadLocal* ThreadLocal_Create(void)
+{
+	ThreadLocal *local = (ThreadLocal*)malloc(sizeof(ThreadLocal));
+
+	if (local != NULL)
+	{
+	#ifdef _WIN32
+		local->index = TlsAlloc();
+
+		if (local->index == TLS_OUT_OF_INDEXES)
+	#else
+		if (pthread_key_create(&local->key, NULL) != 0)
+	#endif
+		{
+			free(local);
+			local = NULL;
+		}
+	}
+
+	return local;
+}
+
+void ThreadLocal_Destroy(ThreadLocal *local)
+{
+#ifdef _WIN32
+	TlsFree(local->index);
+#else
+	pthread_key_delete(local->key);
+#endif
+
+	free(local);
+}
+
+void* ThreadLocal_Get(ThreadLocal *local)
+{
+#ifdef _WIN32
+	return TlsGetValue(local->index);
+#else
+	return pthread_getspecific(local->key);
+#endif
+}
+
+/* Returns false if the value could not be set */
+bool ThreadLocal_Set(ThreadLocal *local, void *value)
+{
+#ifdef _WIN32
+	return TlsSetValue(local->index, value) != 0;
+#else
+	return pthread_setspecific(local->key, value) == 0;
+#endif
+}
@@ -0,0 +1,50 @@
+/*
+	(C) 2018-2019 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+
+typedef struct Thread Thread;
+typedef struct Mutex Mutex;
+typedef struct ConditionVariable ConditionVariable;
+typedef struct ThreadLocal ThreadLocal;
+
+Thread* Thread_Create(void (*function)(void *user_data), void *user_data);
+void Thread_Join(Thread *thread);
+size_t Thread_GetProcessorCount(void);
+
+Mutex* Mutex_Create(void);
+void Mutex_Destroy(Mutex *mutex);
+void Mutex_Lock(Mutex *mutex);
+void Mutex_Unlock(Mutex *mutex);
+
+ConditionVariable* ConditionVariable_Create(void);
+void ConditionVariable_Destroy(ConditionVariable *condition_variable);
+void ConditionVariable_Wait(ConditionVariable *condition_variable, Mutex *mutex);
+void ConditionVariable_Broadcast(ConditionVariable *condition_variable);
+
+ThreadLocal* ThreadLocal_Create(void);
+void ThreadLocal_Destroy(ThreadLocal *local);
+void* ThreadLocal_Get(ThreadLocal *local);
+bool ThreadLocal_Set(ThreadLocal *local, void *value);
@@ -0,0 +1,314 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "trace.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "threads.h"
+#include "timer.h"
+
+#define TRACE_CHUNK_SIZE 0x400
+#define TRACE_MAXIMUM_DEPTH 0x10
+
+typedef struct TraceEvent
+{
+	const char *name;
+	const char *format;
+	size_t input_size;
+	unsigned long long start;
+	unsigned long long end;
+} TraceEvent;
+
+typedef struct TraceChunk
+{
+	struct TraceChunk *next;
+	size_t total_events;
+	TraceEvent events[TRACE_CHUNK_SIZE];
+} TraceChunk;
+
+/* Only ever touched by its own thread, until the trace is written. Its events
+   are kept in chunks, so that recording one never has to move the others. */
+typedef struct TraceThread
+{
+	struct TraceThread *next;
+	unsigned long id;
+	const char *format;
+	size_t input_size;
+	TraceChunk *first_chunk;
+	TraceChunk *last_chunk;
+	size_t depth;
+	const char *names[TRACE_MAXIMUM_DEPTH];
+	unsigned long long starts[TRACE_MAXIMUM_DEPTH];
+	unsigned long dropped_events;	/* Ones that were too deep, or had no memory */
+} TraceThread;
+
+static bool tracing;
+static unsigned long long start_time;
+static ThreadLocal *current_thread;	/* Each thread's TraceThread */
+
+/* These are only used when a thread records its first span, or a job starts */
+static Mutex *mutex;
+static TraceThread *threads;
+static unsigned long total_threads;
+static const char *last_format;
+static size_t last_input_size;
+
+bool Trace_Start(void)
+{
+	mutex = Mutex_Create();
+	current_thread = ThreadLocal_Create();
+
+	if (mutex == NULL || current_thread == NULL)
+	{
+		if (mutex != NULL)
+			Mutex_Destroy(mutex);
+
+		if (current_thread != NULL)
+			ThreadLocal_Destroy(current_thread);
+
+		return false;
+	}
+
+	start_time = Timer_GetNanoseconds();
+	tracing = true;
+
+	return true;
+}
+
+static TraceThread* GetThread(void)
+{
+	TraceThread *thread = (TraceThread*)ThreadLocal_Get(current_thread);
+
+	if (thread == NULL)
+	{
+		thread = (TraceThread*)malloc(sizeof(TraceThread));
+
+		if (thread == NULL)
+			return NULL;
+
+		thread->first_chunk = thread->last_chunk = NULL;
+		thread->depth = 0;
+		thread->dropped_events = 0;
+
+		if (!ThreadLocal_Set(current_thread, thread))
+		{
+			free(thread);
+			return NULL;
+		}
+
+		Mutex_Lock(mutex);
+		thread->next = threads;
+		threads = thread;
+		thread->id = ++total_threads;
+		thread->format = last_format;
+		thread->input_size = last_input_size;
+		Mutex_Unlock(mutex);
+	}
+
+	return thread;
+}
+
+void Trace_SetJob(const char *format, size_t input_size)
+{
+	if (!tracing)
+		return;
+
+	TraceThread *thread = GetThread();
+
+	if (thread != NULL)
+	{
+		thread->format = format;
+		thread->input_size = input_size;
+	}
+
+	Mutex_Lock(mutex);
+	last_format = format;
+	last_input_size = input_size;
+	Mutex_Unlock(mutex);
+}
+
+void Trace_Begin(const char *name)
+{
+	if (!tracing)
+		return;
+
+	TraceThread *thread = GetThread();
+
+	if (thread == NULL)
+		return;
+
+	/* A span that is too deep is still counted, so that its end is not mistaken for its parent's */
+	if (thread->depth < TRACE_MAXIMUM_DEPTH)
+	{
+		thread->names[thread->depth] = name;
+		thread->starts[thread->depth] = Timer_GetNanoseconds();
+	}
+
+	++thread->depth;
+}
+
+void Trace_End(void)
+{
+	if (!tracing)
+		return;
+
+	const unsigned long long end = Timer_GetNanoseconds();
+
+	TraceThread *thread = GetThread();
+
+	if (thread == NULL || thread->depth == 0)
+		return;
+
+	--thread->depth;
+
+	if (thread->depth >= TRACE_MAXIMUM_DEPTH)
+	{
+		++thread->dropped_events;
+		return;
+	}
+
+	TraceChunk *chunk = thread->last_chunk;
+
+	if (chunk == NULL || chunk->total_events == TRACE_CHUNK_SIZE)
+	{
+		chunk = (TraceChunk*)malloc(sizeof(TraceChunk));
+
+		if (chunk == NULL)
+		{
+			++thread->dropped_events;
+			return;
+		}
+
+		chunk->next = NULL;
+		chunk->total_events = 0;
+
+		if (thread->last_chunk == NULL)
+			thread->first_chunk = chunk;
+		else
+			thread->last_chunk->next = chunk;
+
+		thread->last_chunk = chunk;
+	}
+
+	TraceEvent *event = &chunk->events[chunk->total_events++];
+	event->name = thread->names[thread->depth];
+	event->format = thread->format;
+	event->input_size = thread->input_size;
+	event->start = thread->starts[thread->depth];
+	event->end = end;
+}
+
+static void WriteString(FILE *file, const char *string)
+{
+	fputc('"', file);
+
+	for (const unsigned char *character = (const unsigned char*)string; *character != '\0'; ++character)
+	{
+		if (*character == '"' || *character == '\\')
+			fprintf(file, "\\%c", *character);
+		else if (*character < 0x20)
+			fprintf(file, "\\u%04X", *character);
+		else
+			fputc(*character, file);
+	}
+
+	fputc('"', file);
+}
+
+/* Chrome's timestamps are in microseconds */
+static void WriteMicroseconds(FILE *file, unsigned long long nanoseconds)
+{
+	fprintf(file, "%llu.%03u", nanoseconds / 1000, (unsigned int)(nanoseconds % 1000));
+}
+
+bool Trace_Write(const char *filename)
+{
+	if (!tracing)
+		return false;
+
+	tracing = false;
+
+	FILE *file = fopen(filename, "w");
+
+	if (file != NULL)
+		fprintf(file, "{\"traceEvents\": [\n");
+
+	bool first_event = true;
+	unsigned long dropped_events = 0;
+
+	for (TraceThread *thread = threads; thread != NULL;)
+	{
+		if (file != NULL)
+		{
+			fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %lu, \"args\": {\"name\": \"Thread %lu\"}}", first_event ? "" : ",\n", thread->id, thread->id);
+			first_event = false;
+		}
+
+		for (TraceChunk *chunk = thread->first_chunk; chunk != NULL;)
+		{
+			for (size_t i = 0; i < chunk->total_events && file != NULL; ++i)
+			{
+				const TraceEvent *event = &chunk->events[i];
+
+				fprintf(file, ",\n{\"name\": ");
+				WriteString(file, event->name);
+				fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %lu, \"ts\": ", thread->id);
+				WriteMicroseconds(file, event->start - start_time);
+				fprintf(file, ", \"dur\": ");
+				WriteMicroseconds(file, event->end - event->start);
+				fprintf(file, ", \"args\": {\"format\": ");
+
+				if (event->format != NULL)
+					WriteString(file, event->format);
+				else
+					fprintf(file, "null");
+
+				fprintf(file, ", \"input_size\": %lu, \"thread\": %lu}}", (unsigned long)event->input_size, thread->id);
+			}
+
+			TraceChunk *next_chunk = chunk->next;
+			free(chunk);
+			chunk = next_chunk;
+		}
+
+		dropped_events += thread->dropped_events;
+
+		TraceThread *next_thread = thread->next;
+		free(thread);
+		thread = next_thread;
+	}
+
+	threads = NULL;
+	total_threads = 0;
+	ThreadLocal_Destroy(current_thread);
+	Mutex_Destroy(mutex);
+
+	if (file == NULL)
+		return false;
+
+	fprintf(file, "\n], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": %lu}}\n", dropped_events);
+
+	const bool success = !ferror(file);
+
+	return fclose(file) == 0 && success;
+}
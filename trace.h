@@ -0,0 +1,42 @@
+/*
+	(C) 2018-2020 Clownacy
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgment in the product documentation would be
+	   appreciated but is not required.
+	2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+
+/* Records spans of time, to be written out in Chrome's trace-event format and
+   viewed in chrome://tracing or Perfetto. Each thread appends to its own
+   buffer, without locking, so spans can be recorded from any thread. Until
+   Trace_Start is called, the other functions do nothing. */
+bool Trace_Start(void);
+/* Must not be called until every thread that recorded a span has finished with it */
+bool Trace_Write(const char *filename);
+
+/* The format and input size that this thread's spans are tagged with. Threads
+   that have not recorded anything yet take the tags that were set last. */
+void Trace_SetJob(const char *format, size_t input_size);
+
+/* Spans nest, and 'name' must last until the trace is written */
+void Trace_Begin(const char *name);
+void Trace_End(void);